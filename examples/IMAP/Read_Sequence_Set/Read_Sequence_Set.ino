@@ -245,6 +245,10 @@ void setup()
     , to allow case sensitive parse, uncomment below line*/
     // imap_data.enable.header_case_sensitive = true;
 
+    /* To cache the message headers in storage (keyed by the mailbox UIDVALIDITY and message UID)
+    , the headers of the cached messages will be read from storage instead of fetching from server, uncomment below line*/
+    // imap_data.enable.header_cache = true;
+
     /** Set the maximum size of message stored in
      * IMAPSession object in byte
      */
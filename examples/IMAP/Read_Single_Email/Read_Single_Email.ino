@@ -242,6 +242,11 @@ void setup()
      */
     imap_data.limit.attachment_size = 1024 * 1024 * 5;
 
+    /** Set to download the attachments in partial ranges which can be resumed
+     * from the last completed range when the connection was lost.
+     */
+    // imap_data.enable.resumable_download = true;
+
     // If ID extension was supported by IMAP server, assign the client identification
     // name, version, vendor, os, os_version, support_url, address, command, arguments, environment
     // Server ID can be optained from imap.serverID() after calling imap.connect and imap.id.
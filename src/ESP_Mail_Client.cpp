@@ -178,8 +178,8 @@ void ESP_Mail_Client::appendTagSpace(MB_String &buf, PGM_P tag)
   appendSpace(buf);
 }
 
-template <class T>
-void ESP_Mail_Client::appendList(MB_String &buf, _vectorImpl<T> &list)
+template <class V>
+void ESP_Mail_Client::appendList(MB_String &buf, V &list)
 {
   for (size_t i = 0; i < list.size(); i++)
   {
@@ -580,7 +580,7 @@ bool ESP_Mail_Client::mAppendMessage(IMAPSession *imap, SMTP_Message *msg, bool
 
   sendContent(nullptr, msg, false, rfc822MSG);
 
-  MB_String cmd;
+  IMAP_Cmd cmd;
 
   if (!imap->_feature_capability[esp_mail_imap_read_capability_multiappend])
   {
@@ -588,24 +588,18 @@ bool ESP_Mail_Client::mAppendMessage(IMAPSession *imap, SMTP_Message *msg, bool
     imap->_prev_imap_cmd = esp_mail_imap_cmd_sasl_login;
   }
 
+  // The MULTIAPPEND continuation line starts with the space
   if (imap->_prev_imap_cmd != esp_mail_imap_cmd_append)
-    joinStringSpace(cmd, true, 2, imap_commands[esp_mail_imap_command_append].text, imap->_currentFolder.c_str());
-
-  appendSpace(cmd);
+    cmd.join({esp_mail_imap_tag_str, imap_commands[esp_mail_imap_command_append].text, imap->_currentFolder.c_str()});
 
   if (_flags.length() > 0)
-  {
-    appendString(cmd, _flags.c_str(), false, false, esp_mail_string_mark_type_round_bracket);
-    appendSpace(cmd);
-  }
+    cmd.append({esp_mail_str_2 /* " " */, esp_mail_str_38 /* "(" */, _flags.c_str(), esp_mail_str_39 /* ")" */});
 
   if (_dt.length() > 0)
-  {
-    appendString(cmd, _dt.c_str(), false, false, esp_mail_string_mark_type_double_quote);
-    appendSpace(cmd);
-  }
+    cmd.append({esp_mail_str_2 /* " " */, esp_mail_str_11 /* "\"" */, _dt.c_str(), esp_mail_str_11 /* "\"" */});
 
-  appendString(cmd, MB_String((int)dataLen).c_str(), false, false, esp_mail_string_mark_type_curly_bracket);
+  char num[11];
+  cmd.append({esp_mail_str_2 /* " " */, esp_mail_str_36 /* "{" */, IMAP_Cmd::num(num, dataLen), esp_mail_str_37 /* "}" */});
 
   if (imapSend(imap, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
   {
@@ -694,36 +688,7 @@ void ESP_Mail_Client::splitToken(const char *str, _vectorImpl<MB_String> &tk, co
 
 int ESP_Mail_Client::strpos(const char *haystack, const char *needle, int offset, bool caseSensitive)
 {
-  if (!haystack || !needle)
-    return -1;
-
-  int hlen = strlen(haystack);
-  int nlen = strlen(needle);
-
-  if (hlen == 0 || nlen == 0)
-    return -1;
-
-  int hidx = offset, nidx = 0;
-  while ((*(haystack + hidx) != '\0') && (*(needle + nidx) != '\0') && hidx < hlen)
-  {
-
-    bool nm = caseSensitive ? *(needle + nidx) != *(haystack + hidx) : tolower(*(needle + nidx)) != tolower(*(haystack + hidx));
-
-    if (nm)
-    {
-      hidx++;
-      nidx = 0;
-    }
-    else
-    {
-      nidx++;
-      hidx++;
-      if (nidx == nlen)
-        return hidx - nidx;
-    }
-  }
-
-  return -1;
+  return PGM_Compare::findRAM(haystack, needle, offset < 0 ? 0 : offset, caseSensitive);
 }
 
 char *ESP_Mail_Client::subStr(const char *buf, PGM_P beginToken, PGM_P endToken, int beginPos, int endPos, bool caseSensitive)
@@ -734,10 +699,13 @@ char *ESP_Mail_Client::subStr(const char *buf, PGM_P beginToken, PGM_P endToken,
     int p1 = strposP(buf, beginToken, beginPos, caseSensitive);
     if (p1 != -1)
     {
-      while (buf[p1 + strlen_P(beginToken)] == ' ' || buf[p1 + strlen_P(beginToken)] == '\r' || buf[p1 + strlen_P(beginToken)] == '\n')
+      int blen = strlen_P(beginToken);
+      int slen = strlen(buf);
+
+      while (buf[p1 + blen] == ' ' || buf[p1 + blen] == '\r' || buf[p1 + blen] == '\n')
       {
         p1++;
-        if (strlen(buf) <= p1 + strlen_P(beginToken))
+        if (slen <= p1 + blen)
         {
           p1--;
           break;
@@ -746,15 +714,15 @@ char *ESP_Mail_Client::subStr(const char *buf, PGM_P beginToken, PGM_P endToken,
 
       int p2 = -1;
       if (endPos == 0)
-        p2 = strposP(buf, endToken, p1 + strlen_P(beginToken), caseSensitive);
+        p2 = strposP(buf, endToken, p1 + blen, caseSensitive);
 
       if (p2 == -1)
-        p2 = strlen(buf);
+        p2 = slen;
 
-      int len = p2 - p1 - strlen_P(beginToken);
+      int len = p2 - p1 - blen;
       int ofs = endToken ? strlen_P(endToken) : 1;
       tmp = allocMem<char *>(len + ofs);
-      memcpy(tmp, &buf[p1 + strlen_P(beginToken)], len);
+      memcpy(tmp, &buf[p1 + blen], len);
     }
   }
   else
@@ -836,9 +804,10 @@ void ESP_Mail_Client::appendLowerCaseString(MB_String &buf, PGM_P value, bool cl
 {
   if (clear)
     buf.clear();
-  char *tmp = strP2Lower(value);
-  buf += tmp;
-  freeMem(&tmp);
+  size_t len = buf.length();
+  buf += value;
+  for (size_t i = len; i < buf.length(); i++)
+    buf[i] = PGM_Compare::fold(buf[i]);
 }
 
 void ESP_Mail_Client::appendHeaderProp(MB_String &buf, PGM_P prop, const char *value, bool &firstProp, bool lowerCase, bool isString, bool newLine)
@@ -1639,6 +1608,9 @@ String ESP_Mail_Client::errorReason(bool isSMTP, int errorCode, const char *msg)
   case IMAP_STATUS_FIRMWARE_UPDATE_END_FAILED:
     ret = esp_mail_error_imap_str_8; /* "firmware update finalize failed" */
     break;
+  case IMAP_STATUS_FIRMWARE_UPDATE_DIGEST_MISMATCH:
+    ret = esp_mail_error_imap_str_22; /* "firmware digest mismatch" */
+    break;
   case IMAP_STATUS_CHANGEDSINC_MODSEQ_TEST_FAILED:
     ret = esp_mail_error_imap_str_14; /* "no message changed since (assigned) modsec" */
     break;
@@ -1698,6 +1670,8 @@ void ESP_Mail_Client::closeTCPSession(T sessionPtr)
 
   sessionPtr->_authenticated = false;
   sessionPtr->_loginStatus = false;
+
+  sessionPtr->releaseBuffers();
 }
 
 template <class T>
@@ -1712,75 +1686,143 @@ size_t ESP_Mail_Client::getReservedLen(size_t len)
 }
 
 template <typename T>
-T ESP_Mail_Client::allocMem(size_t size, bool clear)
+T ESP_Mail_Client::allocMem(size_t size, bool clear, esp_mail_mem_purpose purpose)
 {
-  return reinterpret_cast<T>(mbfs->newP(size, clear));
+#if defined(ESP_MAIL_STATIC_MEMORY)
+  // The temporary buffers of mail operation are allocated from arena when possible
+  (void)purpose;
+  void *p = _arena.alloc(mbfs->getReservedLen(size), clear);
+  if (!p)
+  {
+    size = mbfs->getReservedLen(size);
+    p = ESP_Mail_Static_Pool::alloc(size);
+    if (p && clear)
+      memset(p, 0, size);
+  }
+#else
+  // The temporary buffers of mail operation are allocated from arena (internal RAM) when possible
+  // unless they are placed in PSRAM
+  bool psram = placeInPSRAM(size, purpose);
+  void *p = psram ? nullptr : _arena.alloc(mbfs->getReservedLen(size), clear);
+#if defined(MB_HEAP_PROFILE_SITE)
+  // The heap allocation is attributed to the caller of allocMem
+  if (!p)
+    p = mbfs->newP(size, clear, psram, MB_HEAP_PROFILE_SITE);
+#else
+  if (!p)
+    p = mbfs->newP(size, clear, psram);
+#endif
+#endif
+
+  return reinterpret_cast<T>(p);
 }
 
-void ESP_Mail_Client::freeMem(void *ptr)
+template <typename T>
+T ESP_Mail_Client::reuseMem(Session_Buffer &buf, size_t size, bool clear, esp_mail_mem_purpose purpose)
 {
-  mbfs->delP(ptr);
+  return reinterpret_cast<T>(buf.get(size, clear, placeInPSRAM(size, purpose)));
 }
 
-bool ESP_Mail_Client::strcmpP(const char *buf, int ofs, PGM_P beginToken, bool caseSensitive)
+bool ESP_Mail_Client::placeInPSRAM(size_t size, esp_mail_mem_purpose purpose)
 {
-  if (ofs < 0)
+#if defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
+  if (ESP.getPsramSize() == 0)
+    return false;
+#else
+  // No PSRAM, all buffers are placed in internal RAM (and may be served from arena).
+  return false;
+#endif
+
+  return _placement.placeInPSRAM(size, purpose);
+}
+
+void ESP_Mail_Client::freeMem(void *ptr)
+{
+  void **p = (void **)ptr;
+  if (*p && _arena.owns(*p))
   {
-    int p = strposP(buf, beginToken, 0, caseSensitive);
-    if (p == -1)
-      return false;
-    ofs = p;
+    _arena.dealloc(*p);
+    *p = nullptr;
+    return;
   }
 
-  char *tmp2 = allocMem<char *>(strlen_P(beginToken) + 1);
-  memcpy(tmp2, &buf[ofs], strlen_P(beginToken));
-  tmp2[strlen_P(beginToken)] = 0;
-  MB_String s = beginToken;
-  bool ret = (strcasecmp(s.c_str(), tmp2) == 0);
-  // release memory
-  freeMem(&tmp2);
-  return ret;
+#if defined(ESP_MAIL_STATIC_MEMORY)
+  ESP_Mail_Static_Pool::dealloc(*p);
+  *p = nullptr;
+#else
+  mbfs->delP(ptr);
+#endif
 }
 
-int ESP_Mail_Client::strposP(const char *buf, PGM_P beginToken, int ofs, bool caseSensitive)
+Mem_Arena_Stats ESP_Mail_Client::getArenaStats()
 {
-  MB_String s = beginToken;
-  return strpos(buf, s.c_str(), ofs, caseSensitive);
+  return _arena.stats();
 }
 
-char *ESP_Mail_Client::strP(PGM_P pgm)
+void ESP_Mail_Client::setMemoryPlacement(const Mem_Placement_Policy &policy)
 {
-  size_t len = strlen_P(pgm) + 1;
-  char *buf = allocMem<char *>(len);
-  strcpy_P(buf, pgm);
-  buf[len - 1] = 0;
-  return buf;
+  _placement = policy;
+
+  // The string buffers are placed by their size
+  MB_String::setPSRAMMinSize(_placement.stringPSRAMMinSize());
 }
 
-char *ESP_Mail_Client::strP2Lower(PGM_P pgm)
+Mem_Placement_Policy ESP_Mail_Client::getMemoryPlacement()
 {
-  size_t len = strlen_P(pgm) + 1;
-  char *buf = allocMem<char *>(len);
-  strcpy_P(buf, pgm);
+  return _placement;
+}
 
-  for (char *p = buf; *p; p++)
-  {
-    *p = tolower(*p);
-  }
+#if defined(ESP_MAIL_STATIC_MEMORY)
+Static_Pool_Stats ESP_Mail_Client::getStaticPoolStats()
+{
+  return ESP_Mail_Static_Pool::stats();
+}
+#endif
+
+#if defined(ESP_MAIL_HEAP_PROFILER)
+Heap_Profile_Stats ESP_Mail_Client::getHeapProfileStats()
+{
+  return ESP_Mail_Heap_Profiler::stats();
+}
+
+size_t ESP_Mail_Client::getHeapProfileSiteCount()
+{
+  return ESP_Mail_Heap_Profiler::siteCount();
+}
 
-  buf[len - 1] = 0;
-  return buf;
+Heap_Profile_Site ESP_Mail_Client::getHeapProfileSite(size_t index)
+{
+  return ESP_Mail_Heap_Profiler::site(index);
 }
 
-void ESP_Mail_Client::strReplaceP(MB_String &buf, PGM_P name, PGM_P value)
+void ESP_Mail_Client::resetHeapProfile()
 {
-  char *n = strP(name);
-  char *v = strP(value);
+  ESP_Mail_Heap_Profiler::reset();
+}
 
-  buf.replaceAll(n, v);
+void ESP_Mail_Client::printHeapProfile(Print &out)
+{
+  ESP_Mail_Heap_Profiler::printJSON(out);
+}
+#endif
 
-  freeMem(&n);
-  freeMem(&v);
+bool ESP_Mail_Client::strcmpP(const char *buf, int ofs, PGM_P beginToken, bool caseSensitive)
+{
+  if (ofs < 0)
+  {
+    int p = strposP(buf, beginToken, 0, caseSensitive);
+    if (p == -1)
+      return false;
+    ofs = p;
+  }
+
+  // The token at offset is always compared case insensitive
+  return PGM_Compare::startsWith(buf + ofs, beginToken, false);
+}
+
+int ESP_Mail_Client::strposP(const char *buf, PGM_P beginToken, int ofs, bool caseSensitive)
+{
+  return PGM_Compare::find(buf, beginToken, ofs < 0 ? 0 : ofs, caseSensitive);
 }
 
 bool ESP_Mail_Client::isOAuthError(char *buf, int bufLen, int &chunkIdx, int ofs)
@@ -1810,6 +1852,23 @@ MB_String ESP_Mail_Client::getXOAUTH2String(const MB_String &email, const MB_Str
   return encodeBase64Str((const unsigned char *)raw.c_str(), raw.length());
 }
 
+int ESP_Mail_Client::base64Value(char c)
+{
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '+')
+    return 62;
+  if (c == '/')
+    return 63;
+  if (c == '=')
+    return 0;
+  return -1;
+}
+
 unsigned char *ESP_Mail_Client::decodeBase64(const unsigned char *src, size_t len, size_t *out_len)
 {
   unsigned char *out, *pos, block[4], tmp;
@@ -1839,7 +1898,7 @@ unsigned char *ESP_Mail_Client::decodeBase64(const unsigned char *src, size_t le
 
   olen = (count + extra_pad) / 4 * 3;
 
-  pos = out = allocMem<unsigned char *>(olen);
+  pos = out = allocMem<unsigned char *>(olen, true, esp_mail_mem_purpose_decoded_body);
 
   if (out == NULL)
     goto exit;
@@ -1877,7 +1936,7 @@ unsigned char *ESP_Mail_Client::decodeBase64(const unsigned char *src, size_t le
         else
         {
           // release memory
-          free(out);
+          freeMem(&out);
           goto exit;
         }
         break;
@@ -66,16 +66,28 @@
 
 #define ESP_MAIL_MIN_MEM 70000
 
+#if !defined(ESP_MAIL_ARENA_SIZE)
+#define ESP_MAIL_ARENA_SIZE 16384
+#endif
+
 #elif defined(ESP8266)
 
 #define SD_CS_PIN 15
 #define ESP_MAIL_MIN_MEM 8000
 
+#if !defined(ESP_MAIL_ARENA_SIZE)
+#define ESP_MAIL_ARENA_SIZE 4096
+#endif
+
 #elif defined(MB_ARDUINO_PICO)
 
 #define ESP_MAIL_MIN_MEM 70000
 #define SD_CS_PIN PIN_SPI1_SS
 
+#if !defined(ESP_MAIL_ARENA_SIZE)
+#define ESP_MAIL_ARENA_SIZE 16384
+#endif
+
 #endif
 
 #else
@@ -85,6 +97,10 @@
 #define ESP_MAIL_MIN_MEM 3000
 #define UPLOAD_CHUNKS_NUM 5
 
+#if !defined(ESP_MAIL_ARENA_SIZE)
+#define ESP_MAIL_ARENA_SIZE 0
+#endif
+
 #ifdef __arm__
 // should use uinstd.h to define sbrk but Due causes a conflict
 extern "C" char *sbrk(int incr);
@@ -94,6 +110,12 @@ extern char *__brkval;
 
 #endif
 
+#if defined(ESP_MAIL_STATIC_MEMORY)
+static_assert(ESP_MAIL_ARENA_SIZE == 0 || ESP_MAIL_ARENA_SIZE >= 1024, "ESP_MAIL_ARENA_SIZE should be 0 (no arena) or at least 1024 bytes in static memory build");
+// The library memory (pool and arena) in static memory build
+#define ESP_MAIL_STATIC_MEMORY_SIZE (ESP_MAIL_STATIC_POOL_SIZE + ESP_MAIL_ARENA_SIZE)
+#endif
+
 #include "./client/ESP_Mail_TCPClient.h"
 
 using namespace mb_string;
@@ -121,7 +143,7 @@ public:
   void clear() { _list.clear(); }
 
 private:
-  _vectorImpl<int> _list;
+  _internalVectorImpl<int> _list;
 };
 
 /* The class that provides the info of selected or opened mailbox folder */
@@ -226,8 +248,8 @@ private:
   bool _floderChangedState = false;
   bool _nomodsec = false;
   IMAP_Polling_Status _polling_status;
-  _vectorImpl<MB_String> _flags;
-  _vectorImpl<MB_String> _permanent_flags;
+  _internalVectorImpl<MB_String> _flags;
+  _internalVectorImpl<MB_String> _permanent_flags;
 };
 
 /* The class that provides the list of FolderInfo e.g. name, attributes and
@@ -249,6 +271,12 @@ public:
       fd.name = _folders[index].name.c_str();
       fd.attributes = _folders[index].attributes.c_str();
       fd.delimiter = _folders[index].delimiter.c_str();
+      fd.hasStatus = _folders[index].hasStatus;
+      fd.messages = _folders[index].messages;
+      fd.unseen = _folders[index].unseen;
+      fd.uidNext = _folders[index].uidNext;
+      fd.highestModSeq = strtoull(_folders[index].highestModSeq.c_str(), NULL, 10);
+      fd.statusError = _folders[index].statusError.c_str();
     }
     return fd;
   }
@@ -270,10 +298,12 @@ private:
       _folders[i].name.clear();
       _folders[i].attributes.clear();
       _folders[i].delimiter.clear();
+      _folders[i].highestModSeq.clear();
+      _folders[i].statusError.clear();
     }
     _folders.clear();
   }
-  _vectorImpl<esp_mail_folder_info_t> _folders;
+  _internalVectorImpl<esp_mail_folder_info_t> _folders;
 };
 
 /* The class that provides the list of IMAP_Quota_Root_Info e.g. resource name, used and limit */
@@ -296,7 +326,7 @@ public:
   }
 
 private:
-  _vectorImpl<IMAP_Quota_Root_Info> _quota_roots;
+  _internalVectorImpl<IMAP_Quota_Root_Info> _quota_roots;
 
   void add(IMAP_Quota_Root_Info v)
   {
@@ -328,7 +358,7 @@ public:
   }
 
 private:
-  _vectorImpl<IMAP_Namespace_Info> _ns_list;
+  _internalVectorImpl<IMAP_Namespace_Info> _ns_list;
 
   void add(IMAP_Namespace_Info v)
   {
@@ -360,7 +390,7 @@ public:
   }
 
 private:
-  _vectorImpl<IMAP_Rights_Info> _rights_list;
+  _internalVectorImpl<IMAP_Rights_Info> _rights_list;
 
   void add(IMAP_Rights_Info v)
   {
@@ -398,6 +428,70 @@ typedef void (*imapStatusCallback)(IMAP_Status);
 typedef void (*imapResponseCallback)(IMAP_Response);
 typedef void (*MIMEDataStreamCallback)(MIME_Data_Stream_Info);
 typedef void (*imapCharacterDecodingCallback)(IMAP_Decoding_Info *);
+typedef void (*imapMessageCallback)(const IMAP_MSG_Item &);
+
+/* The handle of message attachment that is fetched on demand */
+class IMAP_Attachment_Handle
+{
+  friend class IMAP_Message_Handle;
+
+public:
+  IMAP_Attachment_Handle(){};
+  ~IMAP_Attachment_Handle(){};
+
+  /** Fetch the attachment and save to file.
+   *
+   * @param path The folder in storage to save the attachment, the file will be saved as
+   * path/UID/filename in the storage type of IMAP_Data config.
+   * @return The boolean value which indicates the success of operation.
+   */
+  template <typename T = const char *>
+  bool saveTo(T path) { return mSaveTo(toStringPtr(path)); }
+
+private:
+  IMAPSession *_session = nullptr;
+  uint32_t _uid = 0;
+  int _index = -1;
+
+  bool mSaveTo(MB_StringPtr path);
+};
+
+/* The lightweight handle of message from header only listing that fetches its contents on demand */
+class IMAP_Message_Handle
+{
+  friend class IMAPSession;
+
+public:
+  IMAP_Message_Handle(){};
+  ~IMAP_Message_Handle(){};
+
+  /** Get the message UID.
+   */
+  uint32_t uid() { return _uid; }
+
+  /** Fetch the plain text content of message.
+   *
+   * @return The plain text content or empty string when no content or fetching failed.
+   */
+  String text();
+
+  /** Fetch the html content of message.
+   *
+   * @return The html content or empty string when no content or fetching failed.
+   */
+  String html();
+
+  /** Get the handle of attachment.
+   *
+   * @param index The index of attachment in the IMAP_MSG_Item attachments list.
+   * @return The IMAP_Attachment_Handle object.
+   */
+  IMAP_Attachment_Handle attachment(int index);
+
+private:
+  IMAPSession *_session = nullptr;
+  uint32_t _uid = 0;
+};
 
 #else
 
@@ -735,13 +829,14 @@ public:
 
 private:
   friend class ESP_Mail_Client;
-  _vectorImpl<struct esp_mail_address_info_t> _rcp;
-  _vectorImpl<struct esp_mail_address_info_t> _cc;
-  _vectorImpl<struct esp_mail_address_info_t> _bcc;
-  _vectorImpl<MB_String> _hdr;
-  _vectorImpl<SMTP_Attachment> _att;
-  _vectorImpl<SMTP_Attachment> _parallel;
-  _vectorImpl<SMTP_Message> _rfc822;
+  // The small lists keep their first elements inline
+  Small_Vector<struct esp_mail_address_info_t, 2> _rcp;
+  Small_Vector<struct esp_mail_address_info_t, 2> _cc;
+  Small_Vector<struct esp_mail_address_info_t, 2> _bcc;
+  _internalVectorImpl<MB_String> _hdr;
+  Small_Vector<SMTP_Attachment, 2> _att;
+  _internalVectorImpl<SMTP_Attachment> _parallel;
+  _internalVectorImpl<SMTP_Message> _rfc822;
 };
 
 class SMTP_Status
@@ -777,6 +872,10 @@ public:
   ESP_Mail_Client()
   {
     mbfs = new MB_FS();
+#if defined(ESP_MAIL_STATIC_MEMORY) && ESP_MAIL_ARENA_SIZE > 0
+    _arena.setBuffer(_arenaBuf, sizeof(_arenaBuf));
+#endif
+    setMemoryPlacement(_placement);
   };
 
   ~ESP_Mail_Client()
@@ -1040,6 +1139,75 @@ public:
    */
   int getFreeHeap();
 
+  /** Get the statistics of arena memory that used for the temporary buffers of current or last
+   * sendMail or readMail operation.
+   *
+   * @return The Mem_Arena_Stats data that provides these properties
+   * capacity, used, peak, allocations, fallbacks (the buffers allocated from heap) and live (the buffers not freed).
+   */
+  Mem_Arena_Stats getArenaStats();
+
+  /** Set the placement policy of library buffers on the device with PSRAM.
+   *
+   * @param policy The Mem_Placement_Policy data that provides these properties
+   * psram_threshold, general, response_buffer, attachment_staging, decoded_body and header_record.
+   * The buffers of esp_mail_mem_tier_internal tier are allocated from internal RAM, the buffers of
+   * esp_mail_mem_tier_psram tier are allocated from PSRAM and the buffers of esp_mail_mem_tier_auto tier
+   * are allocated from PSRAM when their size is not smaller than psram_threshold.
+   * The policy takes no effect when PSRAM is not available or ESP_MAIL_USE_PSRAM is not defined.
+   */
+  void setMemoryPlacement(const Mem_Placement_Policy &policy);
+
+  /** Get the placement policy of library buffers.
+   *
+   * @return The Mem_Placement_Policy data.
+   */
+  Mem_Placement_Policy getMemoryPlacement();
+
+#if defined(ESP_MAIL_STATIC_MEMORY)
+  /** Get the statistics of static pool memory that used for the containers, strings and
+   * temporary buffers in static memory build.
+   *
+   * @return The Static_Pool_Stats data that provides these properties
+   * capacity, used, peak and overflows (the allocations that did not fit the pool and allocated from heap).
+   */
+  Static_Pool_Stats getStaticPoolStats();
+#endif
+
+#if defined(ESP_MAIL_HEAP_PROFILER)
+  /** Get the statistics of heap profiler in the heap profiler build.
+   *
+   * @return The Heap_Profile_Stats data that provides these properties
+   * allocations, frees, live, live_bytes, peak_bytes, total_bytes, untracked (the allocations that did not fit
+   * the profiler tables), sites, free_heap, largest_free_block and fragmentation (in percent).
+   */
+  Heap_Profile_Stats getHeapProfileStats();
+
+  /** Get the number of allocation call sites in the heap profiler build.
+   *
+   * @return The number of call sites.
+   */
+  size_t getHeapProfileSiteCount();
+
+  /** Get the allocation call site in the heap profiler build.
+   *
+   * @param index The index of call site.
+   * @return The Heap_Profile_Site data that provides these properties
+   * tag, addr (the caller address), allocations, frees, live, live_bytes, peak_bytes and total_bytes.
+   */
+  Heap_Profile_Site getHeapProfileSite(size_t index);
+
+  /** Reset the counters of heap profiler, the live allocations are kept.
+   */
+  void resetHeapProfile();
+
+  /** Print the heap profiler statistics and call sites in JSON.
+   *
+   * @param out The Print object e.g. Serial.
+   */
+  void printHeapProfile(Print &out);
+#endif
+
   /** Get base64 encode string.
    *
    * @return String of base64 encoded string.
@@ -1054,12 +1222,21 @@ public:
   // Get encoding type from character set string
   esp_mail_char_decoding_scheme getEncodingFromCharset(const char *enc);
 
+  // Get the transcoder table of single-byte character set, nullptr for ISO-8859-1
+  const uint16_t *getCharsetTable(esp_mail_char_decoding_scheme scheme, bool &supported);
+
+  // The RFC2047 decoder charset callback to get the transcoder table of encoded word character set
+  static bool charsetTableCallback(void *param, const char *charset, const uint16_t *&table);
+
   // Decode Latin1 to UTF-8
   int decodeLatin1_UTF8(unsigned char *out, int *outlen, const unsigned char *in, int *inlen);
 
   // Decode TIS620 to UTF-8
   void decodeTIS620_UTF8(char *out, const char *in, size_t len);
 
+  // Decode the single-byte character set data to UTF-8, returns nullptr for UTF-8 or unsupported character set
+  char *decodeCharset(esp_mail_char_decoding_scheme scheme, const char *in, size_t len, size_t &olen);
+
   // handle rfc2047 Q (quoted printable) and B (base64) decodings
   RFC2047_Decoder RFC2047Decoder;
 
@@ -1068,8 +1245,15 @@ public:
 private:
   friend class SMTPSession;
   friend class IMAPSession;
+  friend struct esp_mail_imap_response_data;
 
   MB_FS *mbfs = nullptr;
+  Mem_Arena _arena;
+  Mem_Placement_Policy _placement;
+#if defined(ESP_MAIL_STATIC_MEMORY) && ESP_MAIL_ARENA_SIZE > 0
+  // The static memory block of arena
+  alignas(4) uint8_t _arenaBuf[ESP_MAIL_ARENA_SIZE];
+#endif
   bool timeStatus = false;
   time_t ts = 0;
   bool networkAutoReconnect = true;
@@ -1105,9 +1289,6 @@ private:
   template <class T>
   void sendCB(T sessionPtr, PGM_P info = "", bool prependCRLF = false, bool success = false);
 
-  // PGM string replacement
-  void strReplaceP(MB_String &buf, PGM_P key, PGM_P value);
-
   // Check for OAuth log in error response
   bool isOAuthError(char *buf, int bufLen, int &chunkIdx, int ofs);
 
@@ -1177,6 +1358,9 @@ private:
   // Decode base64 encoded string
   unsigned char *decodeBase64(const unsigned char *src, size_t len, size_t *out_len);
 
+  // Get the value of base64 character, 0 for padding or -1 for non-base64 character
+  int base64Value(char c);
+
   // Decode base64 encoded string
   MB_String encodeBase64Str(const unsigned char *src, size_t len);
 
@@ -1197,7 +1381,14 @@ private:
 
   // Memory allocation
   template <typename T>
-  T allocMem(size_t size, bool clear = true);
+  T allocMem(size_t size, bool clear = true, esp_mail_mem_purpose purpose = esp_mail_mem_purpose_general);
+
+  // Get the reusable session buffer of at least size bytes
+  template <typename T>
+  T reuseMem(Session_Buffer &buf, size_t size, bool clear = true, esp_mail_mem_purpose purpose = esp_mail_mem_purpose_response_buffer);
+
+  // Check whether the buffer of purpose should be allocated from PSRAM
+  bool placeInPSRAM(size_t size, esp_mail_mem_purpose purpose);
 
   // Memory deallocation
   void freeMem(void *ptr);
@@ -1208,12 +1399,6 @@ private:
   // Find PGM string
   int strposP(const char *buf, PGM_P beginToken, int ofs, bool caseSensitive = true);
 
-  // Memory allocation for PGM string
-  char *strP(PGM_P pgm);
-
-  // Memory allocation for PGM lower case string
-  char *strP2Lower(PGM_P pgm);
-
   // Set or sync device system time with NTP server
   // Do not modify or remove
   void setTime(const char *TZ_Var, const char *TZ_file, bool wait, bool debugProgress);
@@ -1258,9 +1443,9 @@ private:
   // Append quote string to buffer
   void appendString(MB_String &buf, PGM_P value, bool comma, bool newLine, esp_mail_string_mark_type type = esp_mail_string_mark_type_none);
 
-  // Append list to buffer
-  template <class T>
-  void appendList(MB_String &buf, _vectorImpl<T> &list);
+  // Append list (_vectorImpl or _internalVectorImpl) to buffer
+  template <class V>
+  void appendList(MB_String &buf, V &list);
 
   // Append space to buffer
   void appendSpace(MB_String &buf);
@@ -1405,6 +1590,12 @@ private:
   // Send file content
   bool sendFile(SMTPSession *smtp, SMTP_Message *msg, SMTP_Attachment *att);
 
+  // Start the attachment digest when attachment_digest option is enabled, return the digest or nullptr
+  SHA256_Digest *beginAttachmentDigest(SMTPSession *smtp, SMTP_Message *msg);
+
+  // Add the digest of sent attachment to the sending result of message
+  void addAttachmentDigest(SMTPSession *smtp, SMTP_Message *msg, SMTP_Attachment *att);
+
   // Send imap or smtp storage error callback
   void altSendStorageErrorCB(SMTPSession *smtp, int err);
 
@@ -1538,13 +1729,13 @@ private:
   int encodeUnicode_UTF8(char *out, uint32_t utf);
 
   // Append headers fetch command
-  void appendHeadersFetchCommand(IMAPSession *imap, MB_String &cmd, int index, bool debug);
+  void appendHeadersFetchCommand(IMAPSession *imap, IMAP_Cmd &cmd, int index, bool debug, bool binary = false);
 
   // Append rfc822 headers fetch command
-  void appendRFC822HeadersFetchCommand(MB_String &cmd);
+  void appendRFC822HeadersFetchCommand(IMAP_Cmd &cmd);
 
   // Get multipart MIME fetch command
-  bool getMultipartFechCmd(IMAPSession *imap, int msgIdx, MB_String &partText);
+  bool getMultipartFechCmd(IMAPSession *imap, int msgIdx, IMAP_Cmd &cmd);
 
   // Fetch multipart MIME body header
   bool fetchMultipartBodyHeader(IMAPSession *imap, int msgIdx);
@@ -1555,6 +1746,9 @@ private:
   // Handle IMAP server authentication
   bool imapAuth(IMAPSession *imap, bool &ssl);
 
+  // Start IMAP stream compression (COMPRESS=DEFLATE)
+  bool imapCompress(IMAPSession *imap);
+
   // Send IMAP command
   bool sendFetchCommand(IMAPSession *imap, int msgIndex, esp_mail_imap_command cmdCase);
 
@@ -1576,11 +1770,8 @@ private:
   // Parse search response
   int parseSearchResponse(IMAPSession *imap, esp_mail_imap_response_data &res, PGM_P tag, const char *key);
 
-  // Parse header state
-  bool parseHeaderField(IMAPSession *imap, const char *buf, PGM_P beginToken, bool caseSensitive, struct esp_mail_message_header_t &header, int &headerState, int state);
-
-  // Parse header response
-  void parseHeaderResponse(IMAPSession *imap, esp_mail_imap_response_data &res, bool caseSensitive = true);
+  // Parse the header line of header fields fetch response
+  void parseHeaderResponse(IMAPSession *imap, esp_mail_imap_response_data &res, char *buf, bool caseSensitive = true);
 
   // Set the header based on state parsed
   void collectHeaderField(IMAPSession *imap, char *buf, struct esp_mail_message_header_t &header, int state);
@@ -1591,8 +1782,11 @@ private:
   // Check attachment for firmware file
   void checkFirmwareFile(IMAPSession *imap, const char *filename, struct esp_mail_message_part_info_t &part, bool defaultSize = false);
 
-  // Parse part header response
-  void parsePartHeaderResponse(IMAPSession *imap, esp_mail_imap_response_data &res, bool caseSensitive = true);
+  // Parse the header line of part MIME header fetch response
+  void parsePartHeaderResponse(IMAPSession *imap, esp_mail_imap_response_data &res, char *buf, bool caseSensitive = true);
+
+  // Complete the part info when all lines of part MIME header were parsed
+  void completePartHeader(IMAPSession *imap, esp_mail_imap_response_data &res);
 
   // Count char in string
   int countChar(const char *buf, char find);
@@ -1617,7 +1811,7 @@ private:
 
 #if !defined(MB_USE_STD_VECTOR)
   // Decending sort
-  void numDecSort(_vectorImpl<struct esp_mail_imap_msg_num_t> &arr);
+  void numDecSort(esp_mail_imap_msg_num_list_t &arr);
 #endif
 
   // Handle IMAP response
@@ -1641,24 +1835,75 @@ private:
   // Get IMAP response status e.g. OK, NO and Bad status enum value
   esp_mail_imap_response_status imapResponseStatus(IMAPSession *imap, char *response, PGM_P tag);
 
-  // Add header item to string buffer
-  void addHeaderItem(MB_String &str, esp_mail_message_header_t *header, bool json);
+  // Write header item to header writer
+  void addHeaderItem(Header_Writer &w, esp_mail_message_header_t *header, bool json);
 
   // Get RFC822 header string pointer by index
   int getRFC822HeaderPtr(int index, esp_mail_imap_rfc822_msg_header_item_t *header);
 
-  // Add RFC822 headers to string buffer
-  void addRFC822Headers(MB_String &s, esp_mail_imap_rfc822_msg_header_item_t *header, bool json);
+  // Write RFC822 headers to header writer
+  void addRFC822Headers(Header_Writer &w, esp_mail_imap_rfc822_msg_header_item_t *header, bool json);
+
+  // Write RFC822 header item to header writer
+  void addRFC822HeaderItem(Header_Writer &w, esp_mail_imap_rfc822_msg_header_item_t *header, int index, bool json);
 
-  // Add RFC822 header item to string buffer
-  void addRFC822HeaderItem(MB_String &s, esp_mail_imap_rfc822_msg_header_item_t *header, int index, bool json);
+  // Write header by name and value to header writer
+  void addHeader(Header_Writer &w, const char *name, const char *s_value, int num_value, bool trim, bool isJson);
 
-  // Add header string by name and value to string buffer
-  void addHeader(MB_String &s, const char *name, const char *s_value, int num_value, bool trim, bool isJson);
+  // The header writer callback that writes the data to opened file
+  static void headerWriterCallback(void *param, const char *data, size_t len);
 
-  // Save header string buffer to file
+  // Stream the headers of fetched messages to file
   void saveHeader(IMAPSession *imap, bool json);
 
+  // Get the header cache file path of selected mailbox without file extension
+  void getHeaderCachePath(IMAPSession *imap, MB_String &path);
+
+  // Check the header cache index of selected mailbox, invalidate the cache when UIDVALIDITY changed
+  bool headerCacheReady(IMAPSession *imap);
+
+  // Find the header cache index entry of UID
+  bool findHeaderCache(IMAPSession *imap, uint32_t uid, struct header_cache_index_t &item);
+
+  // Fetch the message numbers and flags of all cached UIDs to read with one FETCH command
+  void fetchHeaderCacheFlags(IMAPSession *imap);
+
+  // Get the fetched message number and flags index of cached UID or -1 if the UID is not cached
+  int getHeaderCacheFlags(IMAPSession *imap, uint32_t uid);
+
+  // Parse the message number and flags of cached UID from untagged FETCH response
+  void parseHeaderCacheFlags(IMAPSession *imap, char *buf);
+
+  // Read the cached header of header cache index entry and add it to the headers list
+  bool readHeaderCache(IMAPSession *imap, const struct header_cache_index_t &item);
+
+  // Write the header to header cache
+  void writeHeaderCache(IMAPSession *imap, esp_mail_message_header_t *header);
+
+  // Write 32-bit value to opened cache file
+  void writeCacheValue(esp_mail_file_storage_type type, uint32_t value);
+
+  // Write length prefixed string to opened cache file
+  void writeCacheString(esp_mail_file_storage_type type, const MB_String &str);
+
+  // Read 32-bit value from opened cache file
+  bool readCacheValue(esp_mail_file_storage_type type, uint32_t &value);
+
+  // Read length prefixed string from opened cache file
+  bool readCacheString(esp_mail_file_storage_type type, MB_String &str);
+
+  // Download the attachment in partial ranges with resumable progress
+  bool fetchAttachmentRanges(IMAPSession *imap, int msgIdx, bool closeSession);
+
+  // Read the range fetch progress file, return false if not matched the current part
+  bool readRangeProgress(IMAPSession *imap, const MB_String &path, uint32_t &offset, uint32_t &size);
+
+  // Write the range fetch progress file
+  void writeRangeProgress(IMAPSession *imap, const MB_String &path, uint32_t offset, uint32_t size);
+
+  // Decode the complete base64 quanta of range literal in place and keep the rest for the next read
+  int decodeRangeBase64(IMAPSession *imap, esp_mail_imap_response_data &res, int len);
+
   // Send MIME stream to callback
   void sendStreamCB(IMAPSession *imap, void *buf, size_t len, int chunkIndex, bool hrdBrk);
 
@@ -1674,11 +1919,35 @@ private:
   // Get List
   char *getList(char *buf, bool &isList);
 
-  // Parse mailbox folder open response
-  void parseFoldersResponse(IMAPSession *imap, char *buf, bool list);
+  // The tokenizer callback of tokenized response
+  static void imapTokenCallback(void *param, const imap_token_t &token);
+
+  // Check the token value with the trimmed PGM token
+  bool isTokenValue(const char *value, PGM_P token);
+
+  // Parse the mailbox list (LIST and LSUB), status (STATUS) and tagged response tokens
+  void parseFolderToken(IMAPSession *imap, esp_mail_imap_response_data &res, const imap_token_t &token);
+
+  // Parse the header fields (message header and part MIME header) fetch response tokens
+  void parseFetchToken(IMAPSession *imap, esp_mail_imap_response_data &res, const imap_token_t &token);
+
+  // Parse the completed line of header fields literal
+  void parseFetchLine(IMAPSession *imap, esp_mail_imap_response_data &res, bool header);
 
-  // Prepare alias (short name) file list for unsupported long file name filesystem
-  void prepareFileList(IMAPSession *imap, MB_String &filePath);
+  // Add the file to download manifest, the file will be renamed (short name) for unsupported long file name filesystem
+  void prepareFileList(IMAPSession *imap, MB_String &filePath, bool partFile = true);
+
+  // Add the number of bytes written to the last file of download manifest
+  void addDownloadFileSize(IMAPSession *imap, size_t size);
+
+  // Start the digest of current attachment part when attachment_digest option is enabled
+  void beginAttachmentDigest(IMAPSession *imap);
+
+  // Hash the decoded data of current attachment part
+  void updateAttachmentDigest(IMAPSession *imap, const void *data, size_t len);
+
+  // Store the digest of downloaded attachment part to the part and its download manifest file
+  void finishAttachmentDigest(IMAPSession *imap);
 
   // Parse capability response
   bool parseCapabilityResponse(IMAPSession *imap, const char *buf, int &chunkIdx);
@@ -1722,6 +1991,14 @@ public:
    */
   void setTCPTimeout(unsigned long timeoutSec);
 
+  /** Set the server response buffer size.
+   *
+   * @param size The buffer size in bytes, the size that is less than ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE is ignored.
+   *
+   * The response buffer is allocated once and reused for all server responses until the session is closed or destroyed. The buffer that grows for the longer response line is freed when that response is handled.
+   */
+  void setResponseBufferSize(size_t size);
+
   /** Assign custom Client from Arduino Clients.
    *
    * @param client The pointer to Arduino Client derived class e.g. WiFiClient, EthernetClient or GSMClient.
@@ -1775,6 +2052,19 @@ public:
    */
   void setSSLBufferSize(int rx = -1, int tx = -1);
 
+  /** Enable the IMAP stream compression (RFC 4978) when server supports COMPRESS=DEFLATE.
+   *
+   * @param enable The boolean option to enable the compression.
+   * @param inflateWindowBits The receive history buffer size in bits (8 to 15), 15 for 32 kB.
+   * @param deflateWindowBits The transmit window size in bits (8 to 12), 10 for 1 kB.
+   *
+   * @note The compression will start after authentication.
+   * The receive history buffer should not be smaller than the compression window used by server
+   * (usually 32 kB), otherwise the decompression error will occur when server refers to the data
+   * that are out of the history buffer.
+   */
+  void setCompression(bool enable, uint8_t inflateWindowBits = 15, uint8_t deflateWindowBits = 10);
+
   /** Begin the IMAP server connection.
    *
    * @param session_config The pointer to Session_Config structured data that keeps
@@ -1869,9 +2159,14 @@ public:
    * @param folders The FoldersCollection class that contains the collection of
    * the
    * FolderInfo structured data.
+   * @param withStatus The option to get the status (number of messages, unseen messages, next UID
+   * and highest modsequence) of each folder.
    * @return The boolean value which indicates the success of operation.
+   *
+   * @note The status will be listed in single command when server supports LIST-STATUS extension (RFC 5819),
+   * otherwise the STATUS commands will be sent (pipelined) for all selectable folders.
    */
-  bool getFolders(FoldersCollection &folders);
+  bool getFolders(FoldersCollection &folders, bool withStatus = false);
 
   /** Select or open the mailbox folder to search or fetch the message inside.
    *
@@ -2199,6 +2494,16 @@ public:
    */
   void mimeDataStreamCallback(MIMEDataStreamCallback mimeDataStreamCallback);
 
+  /** Assign the callback function that returns each message as soon as it was read.
+   *
+   * @param callback The function that accepts the IMAP_MSG_Item as parameter.
+   *
+   * @note The message data are released after the callback returns, the data should be copied
+   * if they are required later. The data() function returns no message in this mode
+   * and the memory usage does not depend on the number of messages to read.
+   */
+  void messageCallback(imapMessageCallback callback);
+
   /** Determine if no message body contained in the search result and only the
    * message header is available.
    */
@@ -2213,6 +2518,16 @@ public:
    */
   IMAP_MSG_List data();
 
+  /** Get the handle of message that fetches its contents on demand.
+   *
+   * @param uid The message UID e.g. from the IMAP_MSG_Item of header only listing.
+   * @return The IMAP_Message_Handle object.
+   *
+   * @note The contents are fetched from the current opened mailbox using the IMAP_Data config
+   * that assigned in connect function. Only the requested content is fetched.
+   */
+  IMAP_Message_Handle messageHandle(uint32_t uid);
+
   /** Get the details of the selected or opned mailbox folder
    *
    * @return The SelectedFolderInfo class which contains the info about flags,
@@ -2253,6 +2568,29 @@ public:
    */
   String fileList();
 
+  /** Get the number of files in the download manifest of the last message reading.
+   *
+   * @return The number of downloaded files.
+   */
+  size_t downloadFileCount();
+
+  /** Get the downloaded file entry from the download manifest.
+   *
+   * @param index The index of file entry.
+   * @return The IMAP_Download_File object that contains the file path, original path, message UID,
+   * part number, size and SHA-256 digest.
+   */
+  IMAP_Download_File downloadFile(size_t index);
+
+  /** Save the download manifest to JSON index file.
+   *
+   * @param path The index file path.
+   * @return The boolean value which indicates the success of operation.
+   * @note The file will be saved to the storage type that set in IMAP_Data's storage config.
+   */
+  template <typename T = const char *>
+  bool saveDownloadManifest(T path) { return mSaveDownloadManifest(toStringPtr(path)); }
+
   /** Set the current timestamp.
    *
    * @param ts The current timestamp.
@@ -2282,6 +2620,8 @@ public:
 
   friend class ESP_Mail_Client;
   friend class foldderList;
+  friend class IMAP_Message_Handle;
+  friend class IMAP_Attachment_Handle;
 
 private:
   bool _sessionSSL = false;
@@ -2292,11 +2632,17 @@ private:
   unsigned long _last_server_connect_ms = 0;
   unsigned long _last_network_error_ms = 0;
   unsigned long tcpTimeout = TCP_CLIENT_DEFAULT_TCP_TIMEOUT_SEC;
+  size_t _respBufSize = ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE;
+  // The reusable server response and base64 line buffers
+  Session_Buffer _respBuf;
+  Session_Buffer _lastBuf;
+  // The reusable decoded data buffer of base64 range fetch
+  Session_Buffer _rangeBuf;
   struct esp_mail_imap_response_status_t _responseStatus;
   int _cMsgIdx = 0;
   int _cPartIdx = 0;
   int _totalRead = 0;
-  _vectorImpl<struct esp_mail_message_header_t> _headers;
+  _internalVectorImpl<struct esp_mail_message_header_t> _headers;
 
   esp_mail_imap_command _imap_cmd = esp_mail_imap_command::esp_mail_imap_cmd_sasl_login;
   esp_mail_imap_command _prev_imap_cmd = esp_mail_imap_command::esp_mail_imap_cmd_sasl_login;
@@ -2304,7 +2650,7 @@ private:
   esp_mail_imap_command _prev_imap_custom_cmd = esp_mail_imap_cmd_custom;
   bool _idle = false;
   MB_String _cmd;
-  _vectorImpl<struct esp_mail_imap_multipart_level_t> _multipart_levels;
+  Small_Vector<struct esp_mail_imap_multipart_level_t, 4> _multipart_levels;
   int _rfc822_part_count = 0;
   bool _unseen = false;
   bool _readOnlyMode = true;
@@ -2328,7 +2674,14 @@ private:
   MB_String _acl_tmp;
   MB_String _ns_tmp;
   MB_String _server_id_tmp;
-  MB_String _sdFileList;
+  _internalVectorImpl<IMAP_Download_File> _downloadFiles;
+  size_t _downloadFileStart = 0;
+  SHA256_Digest _digest;
+  MB_String _hcFolder;
+  uint32_t _hcUIDValidity = 0;
+  Header_Cache _hc;
+  // The fetched message numbers and flags of the cached UIDs
+  _internalVectorImpl<struct esp_mail_imap_header_cache_flags_t> _hcFlags;
 
   struct esp_mail_imap_data_config_t *_imap_data = nullptr;
 
@@ -2341,17 +2694,36 @@ private:
   bool _secure = false;
   bool _authenticated = false;
   bool _isFirmwareUpdated = false;
+#if defined(ESP_MAIL_OTA_UPDATE_ENABLED)
+  OTA_Sink _otaSink;
+#endif
   imapStatusCallback _statusCallback = NULL;
   imapResponseCallback _customCmdResCallback = NULL;
   MIMEDataStreamCallback _mimeDataStreamCallback = NULL;
   imapCharacterDecodingCallback _charDecCallback = NULL;
-
-  _vectorImpl<struct esp_mail_imap_msg_num_t> _imap_msg_num;
+  imapMessageCallback _messageCallback = NULL;
+  int _onDemandAttachment = -1;
+  bool _onDemand = false;
+  // The header and part structure of the last message fetched on demand, and its mailbox
+  struct esp_mail_message_header_t _onDemandHeader;
+  MB_String _onDemandFolder;
+  size_t _onDemandUIDValidity = 0;
+
+  esp_mail_imap_msg_num_list_t _imap_msg_num;
   esp_mail_session_type _sessionType = esp_mail_session_type_imap;
 
   FoldersCollection _folders;
   SelectedFolderInfo _mbif;
   int _uid_tmp = 0;
+  int _msg_num_tmp = 0;
+  int _pipelined_cmd_count = 0;
+  // The folder indexes of pipelined STATUS commands in sending order
+  size_t _pipelined_folders[ESP_MAIL_IMAP_MAX_PIPELINED_COMMANDS];
+  int _pipelined_folder_count = 0;
+  int _rangeChunkSize = ESP_MAIL_IMAP_RANGE_FETCH_INIT_CHUNK_SIZE;
+  bool _compress = false;
+  uint8_t _inflateWindowBits = 15;
+  uint8_t _deflateWindowBits = 10;
   int _lastProgress = -1;
 
   ESP_Mail_TCPClient client;
@@ -2372,6 +2744,12 @@ private:
   // Check for valid saving file path or prepend /
   void checkPath();
 
+  // Fetch the content of message on demand
+  bool fetchOnDemand(uint32_t uid, esp_mail_imap_on_demand_type type, int index, MB_StringPtr path, MB_String &out);
+
+  // Get message item with headers, contents and attachments by index
+  void getMessageItem(uint16_t messageIndex, struct esp_mail_imap_msg_item_t &msg);
+
   // Get message item by index
   void getMessages(uint16_t messageIndex, struct esp_mail_imap_msg_item_t &msg);
 
@@ -2385,7 +2763,10 @@ private:
   bool openMailbox(MB_StringPtr folder, esp_mail_imap_auth_mode mode, bool waitResponse, bool unselect);
 
   // Get folders list
-  bool getMailboxes(FoldersCollection &folders);
+  bool getMailboxes(FoldersCollection &folders, bool withStatus);
+
+  // Get folders status by pipelined STATUS commands
+  bool getMailboxesStatus();
 
   // Get subscribes mailboxes
   bool mGetSubscribesMailboxes(MB_StringPtr reference, MB_StringPtr mailbox, FoldersCollection &folders);
@@ -2399,11 +2780,14 @@ private:
   // Get UID
   int mGetUID(int msgNum);
 
+  // Get flags by message number or UID
+  const char *mGetFlags(int num, bool uid);
+
   // Fetch by sequence set
   bool mFetchSequenceSet();
 
-  // Return string from TAG prepended command
-  MB_String prependTag(PGM_P cmd, PGM_P tag = NULL);
+  // Return TAG prepended command
+  IMAP_Cmd prependTag(PGM_P cmd, PGM_P tag = NULL);
 
   // Check capabilities
   bool checkCapabilities();
@@ -2429,6 +2813,18 @@ private:
   // Create folder
   bool mCreateFolder(MB_StringPtr folderName);
 
+  // Save the download manifest to file
+  bool mSaveDownloadManifest(MB_StringPtr path);
+
+  // Check for the renamed file in download manifest from index
+  bool hasRenamedFile(size_t from);
+
+  // Write the download manifest entries from index, the renamed file list for renamedOnly
+  void writeDownloadFiles(Header_Writer &w, size_t from, bool renamedOnly);
+
+  // The header writer callback that appends the data to string
+  static void stringWriterCallback(void *param, const char *data, size_t len);
+
   // Rename folder
   bool mRenameFolder(MB_StringPtr currentFolderName, MB_StringPtr newFolderName);
 
@@ -2458,6 +2854,7 @@ private:
 
   // add UNCHANGEDSINCE STORE modifier and CHANGEDSINCE FETCH modifier to command
   void addModifier(MB_String &cmd, esp_mail_imap_command_types type, int32_t modsequence);
+  void addModifier(IMAP_Cmd &cmd, esp_mail_imap_command_types type, int32_t modsequence);
 
   // Delete message
   bool deleteMsg(MessageList *toDelete, const char *sequenceSet, bool UID, bool expunge, int32_t modsequence = -1);
@@ -2516,6 +2913,9 @@ private:
   // Handle connection
   bool handleConnection(Session_Config *session_config, IMAP_Data *imap_data, bool &ssl);
 
+  // Free the reusable response, base64 line and range decoding buffers
+  void releaseBuffers();
+
   // Start TCP connection
   bool connect(bool &ssl);
 
@@ -2530,7 +2930,7 @@ private:
 class SendingResult
 {
 private:
-  _vectorImpl<SMTP_Result> _result;
+  _internalVectorImpl<SMTP_Result> _result;
 
   void add(SMTP_Result *r)
   {
@@ -2551,6 +2951,7 @@ public:
       _result[i].subject.clear();
       _result[i].timestamp = 0;
       _result[i].completed = false;
+      _result[i].attachments.clear();
     }
     _result.clear();
   }
@@ -2578,6 +2979,14 @@ public:
    */
   void setTCPTimeout(unsigned long timeoutSec);
 
+  /** Set the server response buffer size.
+   *
+   * @param size The buffer size in bytes, the size that is less than ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE is ignored.
+   *
+   * The response buffer is allocated once and reused for all server responses until the session is closed or destroyed. The buffer that grows for the longer response line is freed when that response is handled.
+   */
+  void setResponseBufferSize(size_t size);
+
   /** Assign custom Client from Arduino Clients.
    *
    * @param client The pointer to Arduino Client derived class e.g. WiFiClient, EthernetClient or GSMClient.
@@ -2817,6 +3226,10 @@ private:
   int _chunkCount = 0;
   uint32_t ts = 0;
   unsigned long tcpTimeout = TCP_CLIENT_DEFAULT_TCP_TIMEOUT_SEC;
+  size_t _respBufSize = ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE;
+  // The reusable server response and upload chunk buffers
+  Session_Buffer _respBuf;
+  Session_Buffer _stageBuf;
 
   esp_mail_smtp_command _smtp_cmd = esp_mail_smtp_command::esp_mail_smtp_cmd_greeting;
 
@@ -2845,6 +3258,8 @@ private:
   SMTP_Status _cbData;
   struct esp_mail_smtp_msg_type_t _msgType;
   int _lastProgress = -1;
+  SHA256_Digest _digest;
+  _vectorImpl<SMTP_Attach_Digest> _attachDigests;
   BearSSL_Session _bsslSession;
 
   ESP_Mail_TCPClient client;
@@ -2858,6 +3273,9 @@ private:
   // Handle TCP connection
   bool handleConnection(Session_Config *session_config, bool &ssl);
 
+  // Free the reusable response and upload chunk buffers
+  void releaseBuffers();
+
   // Send custom command
   int mSendCustomCommand(MB_StringPtr cmd, smtpResponseCallback callback, int commandID = -1);
 
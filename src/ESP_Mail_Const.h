@@ -11,6 +11,18 @@
 #include "ESP_Mail_Error.h"
 #include "extras/MB_FS.h"
 #include "extras/RFC2047.h"
+#include "extras/IMAP_Tokenizer.h"
+#include "extras/Charset_Transcoder.h"
+#include "extras/Header_Writer.h"
+#include "extras/SHA256_Digest.h"
+#include "extras/PGM_Compare.h"
+#include "extras/Mem_Arena.h"
+#include "extras/Small_Vector.h"
+#include "extras/Interned_String.h"
+#include "extras/Cmd_Builder.h"
+#include "extras/Session_Buffer.h"
+#include "extras/Mem_Placement.h"
+#include "extras/Header_Cache.h"
 #include <time.h>
 #include <ctype.h>
 
@@ -26,6 +38,16 @@
 #define _vectorImpl std::vector
 #define MB_VECTOR std::vector
 
+#if defined(ESP_MAIL_STATIC_MEMORY)
+// The session containers are allocated from the static pool, the containers of
+// the data that returned to user (e.g. IMAP_MSG_List) are still std::vector
+template <typename T>
+using esp_mail_static_vector = std::vector<T, Static_Pool_Allocator<T>>;
+#define _internalVectorImpl esp_mail_static_vector
+#else
+#define _internalVectorImpl std::vector
+#endif
+
 #if !defined(FPSTR)
 #define FPSTR
 #endif
@@ -45,6 +67,7 @@
 #include <Updater.h>
 #endif
 #define ESP_MAIL_OTA_UPDATE_ENABLED
+#include "extras/OTA_Sink.h"
 #endif
 
 #if !defined(SILENT_MODE) && (defined(ENABLE_SMTP) || defined(ENABLE_IMAP))
@@ -63,8 +86,17 @@
 #define ESP_MAIL_PROGRESS_REPORT_STEP 5
 #define ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED 0
 #define ESP_MAIL_CLIENT_STREAM_CHUNK_SIZE 256
+#if !defined(ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE) || ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE < 1024
+#undef ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE
 #define ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE 1024 // should be 1 k or more to prevent buffer overflow
+#endif
 #define ESP_MAIL_CLIENT_VALID_TS 1577836800
+#define ESP_MAIL_IMAP_MAX_PIPELINED_COMMANDS 10
+#define ESP_MAIL_RANGE_FETCH_MAGIC 0x31465245 // "ERF1"
+#define ESP_MAIL_IMAP_RANGE_FETCH_MIN_CHUNK_SIZE 2048
+#define ESP_MAIL_IMAP_RANGE_FETCH_MAX_CHUNK_SIZE 65536
+#define ESP_MAIL_IMAP_RANGE_FETCH_INIT_CHUNK_SIZE 8192
+#define ESP_MAIL_IMAP_RANGE_FETCH_TARGET_MS 2000
 
 #endif
 
@@ -368,6 +400,14 @@ enum esp_mail_imap_command_types
     esp_mail_imap_command_unchangedsince,
     esp_mail_imap_command_changedsince,
     esp_mail_imap_command_modsec,
+    esp_mail_imap_command_status,
+    esp_mail_imap_command_return,
+    esp_mail_imap_command_messages,
+    esp_mail_imap_command_uidnext,
+    esp_mail_imap_command_highestmodseq,
+    esp_mail_imap_command_compress,
+    esp_mail_imap_command_deflate,
+    esp_mail_imap_command_binary,
     esp_mail_imap_command_maxType
 };
 
@@ -405,6 +445,10 @@ enum esp_mail_imap_read_capability_types
     esp_mail_imap_read_capability_children,
     // rfc7162 (rfc4551 obsoleted)
     esp_mail_imap_read_capability_condstore,
+    // rfc5819
+    esp_mail_imap_read_capability_list_status,
+    // rfc4978
+    esp_mail_imap_read_capability_compress_deflate,
     esp_mail_imap_read_capability_auto_caps,
     esp_mail_imap_read_capability_maxType
 };
@@ -445,6 +489,17 @@ enum esp_mail_char_decoding_types
     esp_mail_char_decoding_iso_8859_11,
     esp_mail_char_decoding_tis_620,
     esp_mail_char_decoding_windows_874,
+    esp_mail_char_decoding_iso_8859_2,
+    esp_mail_char_decoding_iso_8859_5,
+    esp_mail_char_decoding_iso_8859_7,
+    esp_mail_char_decoding_iso_8859_9,
+    esp_mail_char_decoding_iso_8859_15,
+    esp_mail_char_decoding_windows_1250,
+    esp_mail_char_decoding_windows_1251,
+    esp_mail_char_decoding_windows_1252,
+    esp_mail_char_decoding_windows_1253,
+    esp_mail_char_decoding_windows_1254,
+    esp_mail_char_decoding_koi8_r,
     esp_mail_char_decoding_maxType
 };
 
@@ -844,6 +899,7 @@ struct esp_mail_attachment_info_t
     const char *description = "";
     esp_mail_attach_type type = esp_mail_att_type_none;
     size_t size;
+    const char *sha256 = "";
 };
 
 #if defined(ENABLE_SMTP)
@@ -982,7 +1038,15 @@ const struct esp_mail_imap_command_t imap_commands[esp_mail_imap_command_maxType
     "NOOP",
     "UNCHANGEDSINCE",
     "CHANGEDSINCE",
-    "MODSEC"};
+    "MODSEC",
+    "STATUS",
+    "RETURN",
+    "MESSAGES",
+    "UIDNEXT",
+    "HIGHESTMODSEQ",
+    "COMPRESS",
+    "DEFLATE",
+    "BINARY"};
 
 struct esp_mail_imap_commands_tokens
 {
@@ -1053,7 +1117,7 @@ const struct esp_mail_imap_response_t imap_responses[esp_mail_imap_response_maxT
 
 struct esp_mail_char_decoding_t
 {
-    char text[12];
+    char text[13];
 };
 
 /** Supported charactor encodings.
@@ -1065,7 +1129,18 @@ const struct esp_mail_char_decoding_t char_decodings[esp_mail_char_decoding_maxT
     "iso-8859-1",
     "iso-8859-11",
     "tis-620",
-    "windows-874"};
+    "windows-874",
+    "iso-8859-2",
+    "iso-8859-5",
+    "iso-8859-7",
+    "iso-8859-9",
+    "iso-8859-15",
+    "windows-1250",
+    "windows-1251",
+    "windows-1252",
+    "windows-1253",
+    "windows-1254",
+    "koi8-r"};
 
 struct esp_mail_multipart_t
 {
@@ -1146,6 +1221,85 @@ const struct esp_mail_message_header_field_t message_headers[esp_mail_message_he
     "delsp",
     "Modification-Date"};
 
+#define ESP_MAIL_HEADER_HASH_SIZE 64
+#define ESP_MAIL_HEADER_HASH_RFC822(x) ((x) + 1)
+#define ESP_MAIL_HEADER_HASH_MESSAGE(x) (0x80 | (x))
+
+/** The header field name perfect hash table.
+ *  The bucket is (2 * len + name[0] + 2 * name[len - 1] + 3 * name[len / 2]) % 64
+ *  of the lower case field name, and the value is the rfc822_headers index + 1
+ *  or 0x80 | message_headers index (0 is empty bucket).
+ *  Regenerate it when the rfc822_headers or the content fields of message_headers were changed.
+ */
+const uint8_t header_field_hash[ESP_MAIL_HEADER_HASH_SIZE] PROGMEM = {
+    /*  0 */ 0, 0, 0, 0,
+    /*  4 */ 0, 0, 0, 0,
+    /*  8 */ ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_comments), ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_content_id), 0, ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_reply_to),
+    /* 12 */ 0, ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_accept_language), 0, ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_sender),
+    /* 16 */ 0, ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_content_language), ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_date), 0,
+    /* 20 */ ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_content_description), ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_from), ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_cc), ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_bcc),
+    /* 24 */ 0, 0, 0, ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_references),
+    /* 28 */ 0, 0, 0, 0,
+    /* 32 */ ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_content_disposition), ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_content_type), ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_return_path), ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_to),
+    /* 36 */ 0, 0, 0, ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_subject),
+    /* 40 */ 0, 0, 0, 0,
+    /* 44 */ 0, ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_in_reply_to), ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_keywords), 0,
+    /* 48 */ 0, 0, 0, 0,
+    /* 52 */ 0, 0, 0, 0,
+    /* 56 */ 0, ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_flags), 0, 0,
+    /* 60 */ ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_content_transfer_encoding), 0, ESP_MAIL_HEADER_HASH_RFC822(esp_mail_rfc822_header_field_msg_id), 0};
+
+// Get the header field hash table value of header line and its value position
+static int __attribute__((used))
+esp_mail_get_header_field_hash(const char *buf, int &valuePos, bool caseSensitive)
+{
+    valuePos = 0;
+
+    // folded line is the continuation of the previous field
+    if (buf[0] == ' ' || buf[0] == '\t')
+        return 0;
+
+    int len = 0;
+    while (buf[len] && buf[len] != ':')
+    {
+        if (buf[len] == ' ')
+            return 0;
+        len++;
+    }
+
+    if (buf[len] != ':' || len == 0)
+        return 0;
+
+    const unsigned char *p = (const unsigned char *)buf;
+    int field = pgm_read_byte(&header_field_hash[(2 * len + tolower(p[0]) + 2 * tolower(p[len - 1]) + 3 * tolower(p[len / 2])) % ESP_MAIL_HEADER_HASH_SIZE]);
+    if (field == 0)
+        return 0;
+
+    // confirm the bucket with the only candidate name
+    PGM_P name = field & 0x80 ? message_headers[field & 0x7f].text : rfc822_headers[field - 1].text;
+    if ((int)strlen_P(name) != len || strncasecmp_P(buf, name, len) != 0)
+        return 0;
+
+    // The case sensitive match uses the field name spelling of the previous field by field compare,
+    // the rfc822 and Content-Type names as defined and the other content field names in lower case.
+    if (caseSensitive)
+    {
+        bool lowercase = (field & 0x80) && field != ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_content_type);
+        for (int i = 0; i < len; i++)
+        {
+            char c = pgm_read_byte(name + i);
+            if (buf[i] != (lowercase ? tolower(c) : c))
+                return 0;
+        }
+    }
+
+    valuePos = len + 1;
+    while (buf[valuePos] == ' ' || buf[valuePos] == '\t')
+        valuePos++;
+
+    return field;
+}
+
 struct esp_mail_auth_capability_t
 {
     char text[20];
@@ -1267,7 +1421,7 @@ static esp_mail_imap_auth_tokens imap_auth_cap_pre_tokens(true);
 
 struct esp_mail_imap_read_capability_t
 {
-    char text[15];
+    char text[17];
 };
 
 /** The server capability keywords per standard.
@@ -1292,7 +1446,9 @@ const struct esp_mail_imap_read_capability_t imap_read_capabilities[esp_mail_ima
     "ID",
     "UNSELECT",
     "CHILDREN",
-    "CONDSTORE"
+    "CONDSTORE",
+    "LIST-STATUS",
+    "COMPRESS=DEFLATE",
     "" /* Auto cap */};
 
 struct esp_mail_imap_read_tokens
@@ -1489,6 +1645,9 @@ struct esp_mail_smtp_enable_option_t
 {
     /* Enable chunk data sending for large message */
     bool chunking = false;
+
+    /* Compute the SHA-256 digest of attachment data while sending */
+    bool attachment_digest = false;
 };
 
 /* The SMTP blob data attachment data [Session_Config] */
@@ -1565,6 +1724,16 @@ struct esp_mail_attachment_t
     struct esp_mail_attach_internal_t _int;
 };
 
+/* The SHA-256 digest of the sent attachment [SMTP_Result] */
+struct esp_mail_smtp_attach_digest_t
+{
+    /* The attachment file name */
+    MB_String filename;
+
+    /* The lowercase hex string of SHA-256 digest of attachment data */
+    MB_String sha256;
+};
+
 /* The struct used as SMTP_Result */
 struct esp_mail_smtp_send_status_t
 {
@@ -1579,6 +1748,9 @@ struct esp_mail_smtp_send_status_t
 
     /* The timestamp of the message */
     uint32_t timestamp = 0;
+
+    /* The digests of the sent attachments when attachment_digest option is enabled */
+    _vectorImpl<struct esp_mail_smtp_attach_digest_t> attachments;
 };
 
 /* Used internally for SMTPSession */
@@ -1597,6 +1769,7 @@ struct esp_mail_smtp_send_base64_data_info_t
     bool flashMem = false;
     size_t size = 0;
     size_t dataIndex = 0;
+    SHA256_Digest *digest = nullptr;
 };
 
 /* SMTP commands types enum */
@@ -1664,7 +1837,18 @@ enum esp_mail_char_decoding_scheme
     esp_mail_char_decoding_scheme_iso8859_1,
     esp_mail_char_decoding_scheme_iso8859_11,
     esp_mail_char_decoding_scheme_tis_620,
-    esp_mail_char_decoding_scheme_windows_874
+    esp_mail_char_decoding_scheme_windows_874,
+    esp_mail_char_decoding_scheme_iso8859_2,
+    esp_mail_char_decoding_scheme_iso8859_5,
+    esp_mail_char_decoding_scheme_iso8859_7,
+    esp_mail_char_decoding_scheme_iso8859_9,
+    esp_mail_char_decoding_scheme_iso8859_15,
+    esp_mail_char_decoding_scheme_windows_1250,
+    esp_mail_char_decoding_scheme_windows_1251,
+    esp_mail_char_decoding_scheme_windows_1252,
+    esp_mail_char_decoding_scheme_windows_1253,
+    esp_mail_char_decoding_scheme_windows_1254,
+    esp_mail_char_decoding_scheme_koi8_r
 };
 
 enum esp_mail_imap_rights_type_t
@@ -1723,6 +1907,26 @@ enum esp_mail_imap_response_status
     esp_mail_imap_resp_bad
 };
 
+/* The content types of on-demand fetching */
+enum esp_mail_imap_on_demand_type
+{
+    esp_mail_imap_on_demand_text,
+    esp_mail_imap_on_demand_html,
+    esp_mail_imap_on_demand_attachment
+};
+
+/* The response line types of tokenized response */
+enum esp_mail_imap_token_line_type
+{
+    esp_mail_imap_token_line_none,
+    esp_mail_imap_token_line_untagged,
+    esp_mail_imap_token_line_tagged,
+    esp_mail_imap_token_line_list,
+    esp_mail_imap_token_line_status,
+    esp_mail_imap_token_line_fetch,
+    esp_mail_imap_token_line_other
+};
+
 enum esp_mail_imap_polling_status_type
 {
     imap_polling_status_type_undefined,
@@ -1782,6 +1986,7 @@ enum esp_mail_imap_command
     esp_mail_imap_cmd_done,
     esp_mail_imap_cmd_get_uid,
     esp_mail_imap_cmd_get_flags,
+    esp_mail_imap_cmd_get_cached_flags,
     esp_mail_imap_cmd_append,
     esp_mail_imap_cmd_append_last,
     esp_mail_imap_cmd_enable,
@@ -1789,6 +1994,7 @@ enum esp_mail_imap_command
     esp_mail_imap_cmd_unselect,
     esp_mail_imap_cmd_noop,
     esp_mail_imap_cmd_copy,
+    esp_mail_imap_cmd_compress,
     esp_mail_imap_cmd_custom
 };
 
@@ -1859,6 +2065,9 @@ struct esp_mail_imap_msg_num_t
     uint32_t value = 0;
 };
 
+// The message numbers to fetch, the first 8 numbers are kept inline
+typedef Small_Vector<struct esp_mail_imap_msg_num_t, 8> esp_mail_imap_msg_num_list_t;
+
 __attribute__((used)) struct
 {
     bool operator()(struct esp_mail_imap_msg_num_t a, struct esp_mail_imap_msg_num_t b) const { return a.value > b.value; }
@@ -1869,6 +2078,14 @@ struct esp_mail_imap_rfc822_msg_header_item_t
     MB_String header_items[esp_mail_rfc822_header_field_maxType];
 };
 
+/* Internal use */
+struct esp_mail_imap_header_cache_flags_t
+{
+    struct header_cache_index_t item;
+    int msg_no = 0;
+    MB_String flags;
+};
+
 /* IMAP quota root info */
 typedef struct esp_mail_imap_quota_root_info_t
 {
@@ -2195,17 +2412,18 @@ struct esp_mail_message_part_info_t
     MB_String text;
     MB_String filename;
     MB_String CID;
-    MB_String type;
-    MB_String save_path;
     MB_String name;
-    MB_String content_disposition;
+    // The low-cardinality values are interned (shared by the parts that have the same value).
+    // The part takes 324 bytes on 32-bit targets, 192 of them are the twelve per-part MB_String values (part number,
+    // file name, name, description, dates and errors) which hold the short values inline.
+    Interned_String content_disposition;
     MB_String content_description;
-    MB_String content_type;
+    Interned_String content_type;
     MB_String descr;
-    MB_String content_transfer_encoding;
+    Interned_String content_transfer_encoding;
     MB_String creation_date;
     MB_String modification_date;
-    MB_String charset;
+    Interned_String charset;
     MB_String download_error;
     esp_mail_attach_type attach_type = esp_mail_att_type_none;
     esp_mail_message_type msg_type = esp_mail_msg_type_none;
@@ -2218,11 +2436,35 @@ struct esp_mail_message_part_info_t
     esp_mail_imap_message_sub_type message_sub_type = esp_mail_imap_message_sub_type_none;
     bool rfc822_part = false;
     int rfc822_msg_Idx = 0;
-    struct esp_mail_imap_rfc822_msg_header_item_t rfc822_header;
+    // The rfc822 message header, it is kept only by the rfc822 message part
+    _internalVectorImpl<struct esp_mail_imap_rfc822_msg_header_item_t> rfc822_header;
     bool error = false;
     bool plain_flowed = false;
     bool plain_delsp = false;
+    // fetched with BINARY (rfc3516), the server sends the decoded octets.
+    bool binary_fetch = false;
+    // fetched in partial ranges (resumable download).
+    bool range_fetch = false;
+    // the offset and estimated total size of the ranges (octets of fetched content).
+    int range_offset = 0;
+    int range_size = 0;
+    // the literal length of the current range and its undecoded (base64) tail length.
+    int range_length = 0;
+    int range_tail = 0;
+    // the decoded bytes to discard that were already written before resume.
+    int range_skip = 0;
+    // the SHA-256 digest of the decoded content is being computed and its hex string.
+    bool digest = false;
+    MB_String sha256;
     esp_mail_msg_xencoding xencoding = esp_mail_msg_xencoding_none;
+
+    // Get the rfc822 message header, the header is created when create is true
+    struct esp_mail_imap_rfc822_msg_header_item_t *rfc822Header(bool create)
+    {
+        if (rfc822_header.size() == 0 && create)
+            rfc822_header.push_back(esp_mail_imap_rfc822_msg_header_item_t());
+        return rfc822_header.size() > 0 ? &rfc822_header[0] : nullptr;
+    }
 };
 
 struct esp_mail_message_header_t
@@ -2251,7 +2493,8 @@ struct esp_mail_message_header_t
     MB_String flags;
     MB_String error_msg;
     bool error = false;
-    _vectorImpl<struct esp_mail_message_part_info_t> part_headers;
+    // The first 2 parts (e.g. plain and html text) are kept inline
+    Small_Vector<struct esp_mail_message_part_info_t, 2> part_headers;
     int attachment_count = 0;
     int sd_alias_file_count = 0;
     int total_download_size = 0;
@@ -2267,6 +2510,12 @@ struct esp_mail_folder_info_t
     MB_String name;
     MB_String attributes;
     MB_String delimiter;
+    bool hasStatus = false;
+    size_t messages = 0;
+    size_t unseen = 0;
+    size_t uidNext = 0;
+    MB_String highestModSeq;
+    MB_String statusError;
 };
 
 struct esp_mail_folder_info_item_t
@@ -2279,6 +2528,24 @@ struct esp_mail_folder_info_item_t
 
     /* The delimeter of folder */
     const char *delimiter = "";
+
+    /* The status (messages, unseen, uidNext and highestModSeq) of folder was available */
+    bool hasStatus = false;
+
+    /* The number of messages in folder */
+    size_t messages = 0;
+
+    /* The number of messages which do not have the \Seen flag set */
+    size_t unseen = 0;
+
+    /* The next unique identifier value of folder */
+    size_t uidNext = 0;
+
+    /* The highest mod-sequence value of all messages in folder (CONDSTORE) */
+    uint64_t highestModSeq = 0;
+
+    /* The server response when the STATUS command of folder failed, empty when no error */
+    const char *statusError = "";
 };
 
 struct esp_mail_imap_download_config_t
@@ -2321,6 +2588,24 @@ struct esp_mail_imap_enable_config_t
 
     /* To allow case sesitive in header parsing */
     bool header_case_sensitive = false;
+
+    /** To cache the fetched message headers in storage.
+     * The cache is keyed by the mailbox UIDVALIDITY and message UID,
+     * the headers of UID fetching will be read from cache instead of server.
+     */
+    bool header_cache = false;
+
+    /** To download the attachments in partial ranges with the resumable progress.
+     * The progress is kept in file (file path with ".rng" extension) and the next download
+     * of the same attachment will continue from the last completed range.
+     * The range size is adjusted by the download speed.
+     */
+    bool resumable_download = false;
+
+    /** To compute the SHA-256 digest of the attachment data while downloading.
+     * The digest is available in the attachment item (IMAP_Attach_Item) and download manifest.
+     */
+    bool attachment_digest = false;
 };
 
 struct esp_mail_imap_limit_config_t
@@ -2411,6 +2696,9 @@ struct esp_mail_imap_firmware_config_t
 
     /* Save firmware file */
     bool save_to_file = false;
+
+    /* The hex string of expected SHA-256 digest of firmware file, the update will not be finalized if the digest does not match. */
+    MB_String sha256;
 };
 
 struct esp_mail_imap_data_config_t
@@ -2439,6 +2727,23 @@ struct esp_mail_imap_data_config_t
     IMAP_Identification identification;
 };
 
+/* The downloaded file entry of the download manifest */
+struct esp_mail_imap_download_file_t
+{
+    /* The path of stored file */
+    MB_String path;
+    /* The original file path, differs from path when the file was renamed for the short file name filesystem */
+    MB_String original;
+    /* The UID of message */
+    uint32_t uid = 0;
+    /* The part number of message part, empty for the message header file */
+    MB_String part;
+    /* The number of bytes written to file */
+    size_t size = 0;
+    /* The hex string of SHA-256 digest of file content, empty if not computed */
+    MB_String sha256;
+};
+
 /* Mail and MIME Header Fields */
 struct esp_mail_imap_msg_item_t
 {
@@ -2601,8 +2906,6 @@ public:
     long dataTime = millis();
     int chunkBufSize = 512;
     int chunkIdx = 0;
-    bool isUntaggedResponse = false;
-    bool untaggedRespCompleted = false;
     bool completedResponse = false;
     bool endSearch = false;
     struct esp_mail_message_header_t header;
@@ -2616,22 +2919,24 @@ public:
     int searchCount = 0;
     char *lastBuf = nullptr;
     char *buf = nullptr;
+    // The incomplete base64 quantum of range fetching and its position in literal
+    char b64Carry[4];
+    int b64CarryLen = 0;
+    int b64CarryPos = 0;
+    // The incremental tokenizer and parsing states of tokenized response e.g. LIST, LSUB, STATUS and header fields FETCH
+    IMAP_Tokenizer tokenizer;
+    void *session = nullptr;
+    esp_mail_imap_token_line_type tokenLine = esp_mail_imap_token_line_none;
+    esp_mail_imap_response_status tokenResp = esp_mail_imap_resp_unknown;
+    esp_mail_imap_response_status tokenLineResp = esp_mail_imap_resp_unknown;
+    MB_String tokenValue;
+    MB_String tokenKey;
+    MB_String tokenText;
+    struct esp_mail_folder_info_t folder;
 
     esp_mail_imap_response_data(int bufLen) { chunkBufSize = bufLen; };
     ~esp_mail_imap_response_data() { clear(); }
-    void clear()
-    {
-        if (response)
-            free(response);
-        if (lastBuf)
-            free(lastBuf);
-        if (buf)
-            free(buf);
-
-        response = nullptr;
-        lastBuf = nullptr;
-        buf = nullptr;
-    }
+    void clear();
 };
 
 #endif
@@ -2878,12 +3183,31 @@ typedef struct esp_mail_transfer_encoding_t Content_Transfer_Encoding;
 typedef struct esp_mail_session_config_t ESP_Mail_Session; // obsoleted
 typedef struct esp_mail_session_config_t Session_Config;
 
+#if defined(ESP_MAIL_STATIC_MEMORY)
+typedef struct static_pool_stats_t Static_Pool_Stats;
+#endif
+
+#if defined(ESP_MAIL_HEAP_PROFILER)
+/* The heap profiler statistics and call site */
+typedef struct heap_profiler_stats_t Heap_Profile_Stats;
+typedef struct heap_profiler_site_t Heap_Profile_Site;
+#endif
+
 #endif
 
+/* The statistics of arena memory for the temporary buffers of mail operation */
+typedef struct mem_arena_stats_t Mem_Arena_Stats;
+
+/* The placement policy of library buffers in internal RAM and PSRAM */
+typedef struct esp_mail_mem_placement_policy_t Mem_Placement_Policy;
+
 #if defined(ENABLE_SMTP)
 /* The result from sending the Email */
 typedef struct esp_mail_smtp_send_status_t SMTP_Result;
 
+/* The SHA-256 digest of the sent attachment */
+typedef struct esp_mail_smtp_attach_digest_t SMTP_Attach_Digest;
+
 /* The attachment details for sending the Email */
 typedef struct esp_mail_attachment_t SMTP_Attachment;
 #endif
@@ -2915,6 +3239,9 @@ typedef struct esp_mail_imap_msg_item_t IMAP_MSG_Item;
  */
 typedef struct esp_mail_imap_msg_list_t IMAP_MSG_List;
 
+/* The downloaded file entry of the download manifest */
+typedef struct esp_mail_imap_download_file_t IMAP_Download_File;
+
 #endif
 
 struct esp_mail_wifi_credential_t
@@ -3095,6 +3422,8 @@ static const char esp_mail_dbg_str_80[] PROGMEM = "get Flags";
 static const char esp_mail_dbg_str_81[] PROGMEM = "delete folder";
 static const char esp_mail_dbg_str_82[] PROGMEM = "send IMAP command, ID";
 static const char esp_mail_dbg_str_83[] PROGMEM = "send IMAP command, NOOP";
+static const char esp_mail_dbg_str_84[] PROGMEM = "send IMAP command, STATUS";
+static const char esp_mail_dbg_str_85[] PROGMEM = "send IMAP command, COMPRESS";
 #endif
 
 /////////////////////////
@@ -3318,6 +3647,7 @@ static const char esp_mail_error_imap_str_18[] PROGMEM = "server disconnected or
 static const char esp_mail_error_imap_str_19[] PROGMEM = "authenticate failed";
 static const char esp_mail_error_imap_str_20[] PROGMEM = "flags or keywords store failed";
 static const char esp_mail_error_imap_str_21[] PROGMEM = "server is not support OAuth2 login";
+static const char esp_mail_error_imap_str_22[] PROGMEM = "firmware digest mismatch";
 #endif
 #endif
 
@@ -3403,7 +3733,6 @@ static const char esp_mail_str_78[] PROGMEM = "{\"";
 static const char esp_mail_str_79[] PROGMEM = "\":\"";
 static const char esp_mail_str_80[] PROGMEM = "{\"Renamed\":\"";
 static const char esp_mail_str_81[] PROGMEM = "\",\"Original\":\"";
-static const char esp_mail_str_82[] PROGMEM = "\"}]";
 static const char esp_mail_str_83[] PROGMEM = "_";
 static const char esp_mail_str_84[] PROGMEM = "message";
 static const char esp_mail_str_85[] PROGMEM = "rfc822";
@@ -3421,6 +3750,16 @@ static const char esp_mail_str_96[] PROGMEM = "Date/Time: %s";
 static const char esp_mail_str_97[] PROGMEM = "Recipient: %s";
 static const char esp_mail_str_98[] PROGMEM = "success";
 static const char esp_mail_str_99[] PROGMEM = "failed";
+static const char esp_mail_str_100[] PROGMEM = "/hcache/";
+static const char esp_mail_str_103[] PROGMEM = "\\Noselect";
+static const char esp_mail_str_104[] PROGMEM = "\\NonExistent";
+static const char esp_mail_str_105[] PROGMEM = ".rng";
+static const char esp_mail_str_106[] PROGMEM = "{\"Path\":\"";
+static const char esp_mail_str_107[] PROGMEM = "\",\"UID\":";
+static const char esp_mail_str_108[] PROGMEM = ",\"Part\":\"";
+static const char esp_mail_str_109[] PROGMEM = "\",\"Size\":";
+static const char esp_mail_str_110[] PROGMEM = ",\"SHA256\":\"";
+static const char esp_mail_str_111[] PROGMEM = "\"}";
 
 #if defined(ENABLE_SMTP)
 static const char boundary_table[] PROGMEM = "=_abcdefghijklmnopqrstuvwxyz0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
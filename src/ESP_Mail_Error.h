@@ -53,6 +53,7 @@
 #define IMAP_STATUS_FIRMWARE_UPDATE_END_FAILED -216
 #define IMAP_STATUS_CHANGEDSINC_MODSEQ_TEST_FAILED -217
 #define IMAP_STATUS_MODSEQ_WAS_NOT_SUPPORTED -218
+#define IMAP_STATUS_FIRMWARE_UPDATE_DIGEST_MISMATCH -219
 #endif
 
 /**
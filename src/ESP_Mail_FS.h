@@ -44,6 +44,12 @@
  */
 #define ESP_MAIL_USE_PSRAM
 
+/**📍 For enabling IMAP stream compression (COMPRESS=DEFLATE) support
+ * ⛔ Use following build flag to disable.
+ * -D DISABLE_IMAP_COMPRESS
+ */
+#define ENABLE_IMAP_COMPRESS
+
 /**📌 For enabling flash filesystem support
  *
  * 📍 For SPIFFS
@@ -164,6 +170,38 @@
  *
  * 🏷️ For debug port assignment if SILENT_MODE option was not set
  * #define ESP_MAIL_DEBUG_PORT Serial
+ *
+ * 🏷️ For the arena memory size in bytes for the temporary buffers of sendMail and readMail (0 to disable)
+ * #define ESP_MAIL_ARENA_SIZE 8192
+ *
+ * 🏷️ For the default buffer size in bytes that the buffer is allocated from PSRAM (see MailClient.setMemoryPlacement)
+ * #define ESP_MAIL_PSRAM_THRESHOLD 2048
+ *
+ * 🏷️ For the static memory build, the containers, strings and temporary buffers of library are allocated from
+ * the static memory (pool and arena) which its size is known at compile time instead of heap.
+ * - ESP_MAIL_STATIC_POOL_SIZE is the pool size in bytes.
+ * - ESP_MAIL_STATIC_MAX_MESSAGES is the maximum number of messages that are kept in IMAPSession.
+ * - ESP_MAIL_STATIC_MAX_PARTS is the maximum number of parts of each message.
+ *
+ * #define ESP_MAIL_STATIC_MEMORY
+ * #define ESP_MAIL_STATIC_POOL_SIZE 32768
+ * #define ESP_MAIL_STATIC_MAX_MESSAGES 10
+ * #define ESP_MAIL_STATIC_MAX_PARTS 16
+ *
+ * ⛔ Use following build flag to disable.
+ * -D DISABLE_STATIC_MEMORY or -DDISABLE_STATIC_MEMORY in PlatformIO
+ *
+ * 🏷️ For the heap profiler instrumentation build, the heap allocations of library are recorded with their
+ * call sites (see MailClient.printHeapProfile).
+ * - ESP_MAIL_HEAP_PROFILER_MAX_SITES is the maximum number of call sites.
+ * - ESP_MAIL_HEAP_PROFILER_MAX_LIVE is the maximum number of tracked live allocations (power of two).
+ *
+ * #define ESP_MAIL_HEAP_PROFILER
+ * #define ESP_MAIL_HEAP_PROFILER_MAX_SITES 64
+ * #define ESP_MAIL_HEAP_PROFILER_MAX_LIVE 512
+ *
+ * ⛔ Use following build flag to disable.
+ * -D DISABLE_HEAP_PROFILER or -DDISABLE_HEAP_PROFILER in PlatformIO
  */
 
 #define ENABLE_ESP8266_ENC28J60_ETH
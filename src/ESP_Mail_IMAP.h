@@ -41,6 +41,14 @@ extern uint8_t _FS_start;
 extern uint8_t _FS_end;
 #endif
 
+void esp_mail_imap_response_data::clear()
+{
+    // The response and lastBuf are the session buffers
+    MailClient.freeMem(&buf);
+    response = nullptr;
+    lastBuf = nullptr;
+}
+
 int ESP_Mail_Client::decodeChar(const char *s)
 {
     return 16 * hexval(*(s + 1)) + hexval(*(s + 2));
@@ -48,7 +56,6 @@ int ESP_Mail_Client::decodeChar(const char *s)
 
 void ESP_Mail_Client::decodeQP_UTF8(const char *buf, char *out)
 {
-    char *tmp = strP(esp_mail_str_47 /* "0123456789ABCDEF" */);
     int idx = 0;
     while (*buf)
     {
@@ -58,9 +65,9 @@ void ESP_Mail_Client::decodeQP_UTF8(const char *buf, char *out)
             buf += 3;
         else if (*(buf + 1) == '\n')
             buf += 2;
-        else if (!strchr(tmp, *(buf + 1)))
+        else if (PGM_Compare::indexOf(esp_mail_str_47 /* "0123456789ABCDEF" */, *(buf + 1)) < 0)
             out[idx++] = *buf++;
-        else if (!strchr(tmp, *(buf + 2)))
+        else if (PGM_Compare::indexOf(esp_mail_str_47 /* "0123456789ABCDEF" */, *(buf + 2)) < 0)
             out[idx++] = *buf++;
         else
         {
@@ -68,9 +75,6 @@ void ESP_Mail_Client::decodeQP_UTF8(const char *buf, char *out)
             buf += 3;
         }
     }
-
-    // release memory
-    freeMem(&tmp);
 }
 
 char *ESP_Mail_Client::decode7Bit_UTF8(char *buf)
@@ -120,6 +124,9 @@ char *ESP_Mail_Client::decode8Bit_UTF8(char *buf)
 
 void ESP_Mail_Client::decodeString(IMAPSession *imap, MB_String &str, const char *enc)
 {
+    // Nothing to decode
+    if (!imap->_charDecCallback && strlen(enc) == 0 && str.find("=?") == MB_String::npos)
+        return;
 
     size_t p1 = 0, p2 = 0;
     MB_String headerEnc;
@@ -139,14 +146,15 @@ void ESP_Mail_Client::decodeString(IMAPSession *imap, MB_String &str, const char
     else
         headerEnc = enc;
 
-    int bufSize = str.length() + 10;
+    // Content Q and B decodings, the encoded words in single-byte character sets are transcoded
+    // to UTF-8 in the same pass unless they will be decoded by user or the charset was specified
+    bool transcode = !imap->_charDecCallback && strlen(enc) == 0;
+    size_t bufSize = transcode ? RFC2047_Decoder::outputSize(str.length()) : str.length() + 1;
     char *buf = allocMem<char *>(bufSize);
 
-    // Content Q and B decodings
-    RFC2047Decoder.decode(mbfs, buf, str.c_str(), bufSize);
+    RFC2047Decoder.decode(buf, str.c_str(), bufSize, transcode ? charsetTableCallback : NULL, this);
 
     // Char set decoding
-    esp_mail_char_decoding_scheme scheme = getEncodingFromCharset(headerEnc.c_str());
     if (imap->_charDecCallback)
     {
         IMAP_Decoding_Info decoding;
@@ -165,24 +173,16 @@ void ESP_Mail_Client::decodeString(IMAPSession *imap, MB_String &str, const char
             buf = buf2;
         }
     }
-    else if (scheme == esp_mail_char_decoding_scheme_iso8859_1)
-    {
-        int len = strlen(buf);
-        int olen = (len + 1) * 2;
-        unsigned char *out = allocMem<unsigned char *>(olen);
-        decodeLatin1_UTF8(out, &olen, (unsigned char *)buf, &len);
-        // release memory and point to new buffer
-        freeMem(&buf);
-        buf = (char *)out;
-    }
-    else if (scheme == esp_mail_char_decoding_scheme_tis_620 || scheme == esp_mail_char_decoding_scheme_iso8859_11 || scheme == esp_mail_char_decoding_scheme_windows_874)
+    else if (!transcode)
     {
-        size_t len2 = strlen(buf);
-        char *tmp = allocMem<char *>((len2 + 1) * 3);
-        decodeTIS620_UTF8(tmp, buf, len2);
-        // release memory and point to new buffer
-        freeMem(&buf);
-        buf = tmp;
+        size_t olen = 0;
+        char *out = decodeCharset(getEncodingFromCharset(enc), buf, strlen(buf), olen);
+        if (out)
+        {
+            // release memory and point to new buffer
+            freeMem(&buf);
+            buf = out;
+        }
     }
 
     str = buf;
@@ -194,15 +194,107 @@ esp_mail_char_decoding_scheme ESP_Mail_Client::getEncodingFromCharset(const char
 {
     esp_mail_char_decoding_scheme scheme = esp_mail_char_decoding_scheme_default;
 
+    size_t matchLen = 0;
+
+    // The longest match wins e.g. iso-8859-15 over iso-8859-1
     for (int i = esp_mail_char_decoding_utf8; i < esp_mail_char_decoding_maxType; i++)
     {
-        if (strpos(enc, char_decodings[i].text, 0, false) > -1)
+        size_t len = strlen_P(char_decodings[i].text);
+        if (len > matchLen && strpos(enc, char_decodings[i].text, 0, false) > -1)
+        {
             scheme = (esp_mail_char_decoding_scheme)i;
+            matchLen = len;
+        }
     }
 
     return scheme;
 }
 
+const uint16_t *ESP_Mail_Client::getCharsetTable(esp_mail_char_decoding_scheme scheme, bool &supported)
+{
+    supported = true;
+
+    switch (scheme)
+    {
+    case esp_mail_char_decoding_scheme_iso8859_1:
+        return nullptr;
+    case esp_mail_char_decoding_scheme_iso8859_2:
+        return charset_table_iso8859_2;
+    case esp_mail_char_decoding_scheme_iso8859_5:
+        return charset_table_iso8859_5;
+    case esp_mail_char_decoding_scheme_iso8859_7:
+        return charset_table_iso8859_7;
+    case esp_mail_char_decoding_scheme_iso8859_9:
+        return charset_table_iso8859_9;
+    case esp_mail_char_decoding_scheme_iso8859_11:
+    case esp_mail_char_decoding_scheme_tis_620:
+        return charset_table_iso8859_11;
+    case esp_mail_char_decoding_scheme_iso8859_15:
+        return charset_table_iso8859_15;
+    case esp_mail_char_decoding_scheme_windows_874:
+        return charset_table_windows_874;
+    case esp_mail_char_decoding_scheme_windows_1250:
+        return charset_table_windows_1250;
+    case esp_mail_char_decoding_scheme_windows_1251:
+        return charset_table_windows_1251;
+    case esp_mail_char_decoding_scheme_windows_1252:
+        return charset_table_windows_1252;
+    case esp_mail_char_decoding_scheme_windows_1253:
+        return charset_table_windows_1253;
+    case esp_mail_char_decoding_scheme_windows_1254:
+        return charset_table_windows_1254;
+    case esp_mail_char_decoding_scheme_koi8_r:
+        return charset_table_koi8_r;
+    default:
+        break;
+    }
+
+    supported = false;
+    return nullptr;
+}
+
+bool ESP_Mail_Client::charsetTableCallback(void *param, const char *charset, const uint16_t *&table)
+{
+    ESP_Mail_Client *client = reinterpret_cast<ESP_Mail_Client *>(param);
+    bool supported = false;
+    table = client->getCharsetTable(client->getEncodingFromCharset(charset), supported);
+    return supported;
+}
+
+char *ESP_Mail_Client::decodeCharset(esp_mail_char_decoding_scheme scheme, const char *in, size_t len, size_t &olen)
+{
+    bool supported = false;
+    const uint16_t *table = getCharsetTable(scheme, supported);
+
+    // UTF-8 or unknown character set, leave the data as is
+    if (!supported)
+        return nullptr;
+
+    char *out = allocMem<char *>(Charset_Transcoder::outputSize(len) + 1, true, esp_mail_mem_purpose_decoded_body);
+    olen = Charset_Transcoder::decode(table, out, in, len);
+    return out;
+}
+
+int ESP_Mail_Client::decodeLatin1_UTF8(unsigned char *out, int *outlen, const unsigned char *in, int *inlen)
+{
+    // Decode as many characters as fit the output buffer, leaving the room for the longest character
+    int i = 0, j = 0;
+    while (i < *inlen && j + 5 < *outlen)
+        j += Charset_Transcoder::decodeChar(nullptr, in[i++], (char *)out + j);
+
+    *outlen = j;
+    *inlen = i;
+    return 0;
+}
+
+void ESP_Mail_Client::decodeTIS620_UTF8(char *out, const char *in, size_t len)
+{
+    // The output is not null terminated, its buffer should be at least Charset_Transcoder::outputSize(len) bytes
+    size_t j = 0;
+    for (size_t i = 0; i < len; i++)
+        j += Charset_Transcoder::decodeChar(charset_table_iso8859_11, (uint8_t)in[i], out + j);
+}
+
 int ESP_Mail_Client::encodeUnicode_UTF8(char *out, uint32_t utf)
 {
     if (utf <= 0x7F)
@@ -250,88 +342,22 @@ int ESP_Mail_Client::encodeUnicode_UTF8(char *out, uint32_t utf)
     }
 }
 
-void ESP_Mail_Client::decodeTIS620_UTF8(char *out, const char *in, size_t len)
-{
-    // output is the 3-byte value UTF-8
-    int j = 0;
-    for (size_t i = 0; i < len; i++)
-    {
-        if (in[i] < 0x80)
-            out[j++] = in[i];
-        else if ((in[i] >= 0xa0 && in[i] < 0xdb) || (in[i] > 0xde && in[i] < 0xfc))
-        {
-            int unicode = 0x0e00 + in[i] - 0xa0;
-            char o[5];
-            memset(o, 0, 5);
-            int r = encodeUnicode_UTF8(o, unicode);
-            for (int x = 0; x < r; x++)
-                out[j++] = o[x];
-        }
-    }
-}
-
-int ESP_Mail_Client::decodeLatin1_UTF8(unsigned char *out, int *outlen, const unsigned char *in, int *inlen)
-{
-    unsigned char *outstart = out;
-    const unsigned char *base = in;
-    const unsigned char *processed = in;
-    unsigned char *outend = out + *outlen;
-    const unsigned char *inend;
-    unsigned int c;
-    int bits;
-
-    inend = in + (*inlen);
-    while ((in < inend) && (out - outstart + 5 < *outlen))
-    {
-        c = *in++;
-
-        /* assertion: c is a single UTF-4 value */
-        if (out >= outend)
-            break;
-        if (c < 0x80)
-        {
-            *out++ = c;
-            bits = -6;
-        }
-        else
-        {
-            *out++ = ((c >> 6) & 0x1F) | 0xC0;
-            bits = 0;
-        }
-
-        for (; bits >= 0; bits -= 6)
-        {
-            if (out >= outend)
-                break;
-            *out++ = ((c >> bits) & 0x3F) | 0x80;
-        }
-        processed = (const unsigned char *)in;
-    }
-    *outlen = out - outstart;
-    *inlen = processed - base;
-    return (0);
-}
-
 bool ESP_Mail_Client::sendFetchCommand(IMAPSession *imap, int msgIndex, esp_mail_imap_command cmdCase)
 {
 
-    MB_String cmd, cmd2, cmd3;
-    appendHeadersFetchCommand(imap, cmd, msgIndex, false);
+    IMAP_Cmd cmd;
+    appendHeadersFetchCommand(imap, cmd, msgIndex, false, cmdCase == esp_mail_imap_cmd_fetch_body_attachment && cPart(imap)->binary_fetch);
 
     if (cmdCase == esp_mail_imap_cmd_fetch_body_mime)
-    {
-        joinStringDot(cmd2, 2, imap_commands[esp_mail_imap_command_header].text, imap_commands[esp_mail_imap_command_fields].text);
-        appendSpace(cmd2);
-        joinStringSpace(cmd3, false, 2, message_headers[esp_mail_message_header_field_content_type].text, message_headers[esp_mail_message_header_field_content_transfer_encoding].text);
-        appendString(cmd2, cmd3.c_str(), false, false, esp_mail_string_mark_type_round_bracket);
-    }
+        cmd.append({esp_mail_str_40 /* "[" */, imap_commands[esp_mail_imap_command_header].text, esp_mail_str_27 /* "." */,
+                    imap_commands[esp_mail_imap_command_fields].text, esp_mail_str_2 /* " " */, esp_mail_str_38 /* "(" */,
+                    message_headers[esp_mail_message_header_field_content_type].text, esp_mail_str_2 /* " " */,
+                    message_headers[esp_mail_message_header_field_content_transfer_encoding].text, esp_mail_str_39 /* ")" */,
+                    esp_mail_str_41 /* "]" */});
     else if (cmdCase == esp_mail_imap_cmd_fetch_body_text)
-        cmd2 = cPart(imap)->partNumFetchStr.length() > 0 ? cPart(imap)->partNumFetchStr.c_str() : imap_commands[esp_mail_imap_command_text].text;
-    else if (cmdCase == esp_mail_imap_cmd_fetch_body_attachment)
-        cmd2 = cPart(imap)->partNumFetchStr;
-
-    if (cmd2.length() > 0)
-        appendString(cmd, cmd2.c_str(), false, false, esp_mail_string_mark_type_square_bracket);
+        cmd.append({esp_mail_str_40 /* "[" */, cPart(imap)->partNumFetchStr.length() > 0 ? cPart(imap)->partNumFetchStr.c_str() : imap_commands[esp_mail_imap_command_text].text, esp_mail_str_41 /* "]" */});
+    else if (cmdCase == esp_mail_imap_cmd_fetch_body_attachment && cPart(imap)->partNumFetchStr.length() > 0)
+        cmd.append({esp_mail_str_40 /* "[" */, cPart(imap)->partNumFetchStr.c_str(), esp_mail_str_41 /* "]" */});
 
     bool allowPartialFetch = (cmdCase == esp_mail_imap_cmd_fetch_body_attachment && cPart(imap)->is_firmware_file) ? false : true;
 
@@ -342,12 +368,11 @@ bool ESP_Mail_Client::sendFetchCommand(IMAPSession *imap, int msgIndex, esp_mail
     {
         //  Apply partial fetch in case download was disabled.
         if (!imap->_storageReady && imap->_attDownload && cmdCase == esp_mail_imap_cmd_fetch_body_attachment)
-            cmd += esp_mail_str_48; /* "<0.0>" */ // This case should not happen because the memory storage was previousely checked.
+            cmd.append({esp_mail_str_48 /* "<0.0>" */}); // This case should not happen because the memory storage was previousely checked.
         else if ((!imap->_msgDownload && cmdCase == esp_mail_imap_cmd_fetch_body_text) || (imap->_msgDownload && !imap->_storageReady))
         {
-            cmd += esp_mail_str_49; /* "<0." */
-            cmd += imap->_imap_data->limit.msg_size;
-            cmd += esp_mail_str_20; /* ">" */
+            char num[11];
+            cmd.append({esp_mail_str_49 /* "<0." */, IMAP_Cmd::num(num, imap->_imap_data->limit.msg_size), esp_mail_str_20 /* ">" */});
         }
     }
 
@@ -362,6 +387,9 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
     if (!imap || !sessionExisted<IMAPSession *>(imap))
         return false;
 
+    // The temporary buffers of this operation are allocated from arena
+    Mem_Arena_Scope arenaScope(_arena, ESP_MAIL_ARENA_SIZE);
+
     imap->checkUID();
     imap->checkPath();
     imap->_cbData._success = false;
@@ -370,8 +398,12 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
         imap->_mailboxOpened = false;
 
     imap->_isFirmwareUpdated = false;
+#if defined(ESP_MAIL_OTA_UPDATE_ENABLED)
+    // Release the unfinished update of previous reading
+    imap->_otaSink.abort();
+#endif
 
-    MB_String buf, command, _uid;
+    MB_String buf, _uid;
 
     size_t readCount = 0;
     imap->_multipart_levels.clear();
@@ -385,7 +417,7 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
     if (!imap->_storageChecked)
     {
         imap->_storageChecked = true;
-        imap->_storageReady = imap->_imap_data->download.header || (!imap->_imap_data->fetch.headerOnly && (imap->_msgDownload || imap->_attDownload)) ? mbfs->checkStorageReady(mbfs_type imap->_imap_data->storage.type) : true;
+        imap->_storageReady = imap->_imap_data->download.header || imap->_imap_data->enable.header_cache || (!imap->_imap_data->fetch.headerOnly && (imap->_msgDownload || imap->_attDownload)) ? mbfs->checkStorageReady(mbfs_type imap->_imap_data->storage.type) : true;
     }
 
     bool readyToDownload = (imap->_msgDownload || imap->_attDownload) && imap->_storageReady;
@@ -393,7 +425,8 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
     if (!imap->_storageReady)
         sendStorageNotReadyError(imap, imap->_imap_data->storage.type);
 
-#if defined(MB_ARDUINO_ESP) || defined(MB_ARDUINO_PICO)
+    // In static memory build, the pool and arena sizes were checked at compile time
+#if (defined(MB_ARDUINO_ESP) || defined(MB_ARDUINO_PICO)) && !defined(ESP_MAIL_STATIC_MEMORY)
 
     int cmem = MailClient.getFreeHeap();
 
@@ -461,6 +494,8 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
     imap->_rfc822_part_count = 0;
     imap->_mbif._availableItems = 0;
     imap->_imap_msg_num.clear();
+    imap->_downloadFiles.clear();
+    imap->_downloadFileStart = 0;
     imap->_uidSearch = false;
     imap->_mbif._searchCount = 0;
 
@@ -477,7 +512,7 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
     {
         if (imap->_imap_data->search.criteria.length() > 0)
         {
-            command = esp_mail_imap_tag_str;
+            IMAP_Cmd command({esp_mail_imap_tag_str});
 
 #if !defined(SILENT_MODE)
             printDebug<IMAPSession *>(imap,
@@ -492,10 +527,10 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
             if (strposP(imap->_imap_data->search.criteria.c_str(), imap_cmd_post_tokens[esp_mail_imap_command_uid].c_str(), 0) != -1)
             {
                 imap->_uidSearch = true;
-                command += imap_cmd_pre_tokens[esp_mail_imap_command_uid];
+                command.join({imap_commands[esp_mail_imap_command_uid].text});
             }
 
-            command += imap_cmd_pre_tokens[esp_mail_imap_command_search];
+            command.join({imap_commands[esp_mail_imap_command_search].text});
 
             imap->_imap_data->search.criteria.trim();
 
@@ -518,17 +553,17 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
                         buf.clear();
 
                     if (strcmp(buf.c_str(), imap_commands[esp_mail_imap_command_search].text) != 0 && buf.length() > 0)
-                        prependSpace(command, buf.c_str());
+                        command.join({buf.c_str()});
 
                     buf.clear();
                 }
             }
 
             if (imap->_unseen && strpos(imap->_imap_data->search.criteria.c_str(), imap_cmd_pre_tokens[esp_mail_imap_command_new].c_str(), 0) == -1)
-                command += imap_cmd_pre_tokens[esp_mail_imap_command_new];
+                command.join({imap_commands[esp_mail_imap_command_new].text});
 
             if (buf.length() > 0)
-                prependSpace(command, buf.c_str());
+                command.join({buf.c_str()});
 
             if (!imap->isModseqSupported() && strpos(imap->_imap_data->search.criteria.c_str(), imap_cmd_pre_tokens[esp_mail_imap_command_modsec].c_str(), 0, false) != -1)
             {
@@ -548,8 +583,6 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
             if (imapSend(imap, command.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
                 return false;
 
-            command.clear();
-
             imap->_imap_cmd = esp_mail_imap_cmd_search;
 
             if (!handleIMAPResponse(imap, IMAP_STATUS_BAD_COMMAND, closeSession))
@@ -561,12 +594,9 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
                 callBackSendNewLine<IMAPSession *>(imap, false);
                 if (imap->_imap_msg_num.size() > 0)
                 {
-                    int bufLen = 100;
-                    char *buf = allocMem<char *>(bufLen);
-                    snprintf(buf, bufLen, pgm2Str(esp_mail_str_50 /* "Search limit: %d\nFound %d messages\nShow %d messages\n" */), (int)imap->_imap_data->limit.search, imap->_mbif._searchCount, (int)imap->_imap_msg_num.size());
+                    char buf[100];
+                    snprintf(buf, sizeof(buf), pgm2Str(esp_mail_str_50 /* "Search limit: %d\nFound %d messages\nShow %d messages\n" */), (int)imap->_imap_data->limit.search, imap->_mbif._searchCount, (int)imap->_imap_msg_num.size());
                     sendCallback<IMAPSession *>(imap, buf, false, false);
-                    // release memory
-                    freeMem(&buf);
                 }
                 else
                     sendCallback<IMAPSession *>(imap, esp_mail_error_imap_str_9 /* "no messages found for the specified search criteria" */, false, false);
@@ -629,13 +659,24 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
     if (imap->_imap_data->fetch.headerOnly)
         imap->_headerOnly = true;
 
+    // The message numbers and flags of the cached UIDs are fetched at once
+    fetchHeaderCacheFlags(imap);
+
     for (size_t i = 0; i < imap->_imap_msg_num.size(); i++)
     {
         imap->_cMsgIdx = i;
         imap->_totalRead++;
 
-#if defined(MB_ARDUINO_ESP) || defined(MB_ARDUINO_PICO)
-        if (MailClient.getFreeHeap() - (imap->_imap_data->limit.msg_size * (i + 1)) < ESP_MAIL_MIN_MEM)
+#if defined(ESP_MAIL_STATIC_MEMORY)
+        // The number of messages kept is limited and the message text should fit the pool
+        if ((imap->_messageCallback ? 1 : i + 1) > ESP_MAIL_STATIC_MAX_MESSAGES || ESP_Mail_Static_Pool::available() < imap->_imap_data->limit.msg_size)
+        {
+            errorStatusCB<IMAPSession *, IMAPSession *>(imap, nullptr, MAIL_CLIENT_ERROR_OUT_OF_MEMORY, true);
+            goto out;
+        }
+#elif defined(MB_ARDUINO_ESP) || defined(MB_ARDUINO_PICO)
+        // Only one message is kept at a time when the messages are delivered via callback
+        if (MailClient.getFreeHeap() - (imap->_imap_data->limit.msg_size * (imap->_messageCallback ? 1 : i + 1)) < ESP_MAIL_MIN_MEM)
         {
             errorStatusCB<IMAPSession *, IMAPSession *>(imap, nullptr, MAIL_CLIENT_ERROR_OUT_OF_MEMORY, true);
             goto out;
@@ -646,94 +687,136 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
         if (imap->_statusCallback)
         {
             readCount++;
-            int bufLen = 100;
             PGM_P p = imap->_uidSearch || imap->_imap_msg_num[i].type == esp_mail_imap_msg_num_type_uid ? esp_mail_str_52 /* "Fetch message %d, UID: %d" */ : esp_mail_str_53 /* "Fetch message %d, Number: %d" */;
-            char *buf = allocMem<char *>(bufLen);
-            snprintf(buf, bufLen, pgm2Str(p), imap->_totalRead, (int)imap->_imap_msg_num[i].value);
+            char buf[100];
+            snprintf(buf, sizeof(buf), pgm2Str(p), imap->_totalRead, (int)imap->_imap_msg_num[i].value);
             sendCallback<IMAPSession *>(imap, buf, true, false);
-            // release memory
-            freeMem(&buf);
         }
 
         if (imap->_debug)
             esp_mail_debug_print_tag(esp_mail_dbg_str_37 /* "send IMAP command, FETCH" */, esp_mail_debug_tag_type_client, true);
 #endif
-        MB_String cmd;
-        appendHeadersFetchCommand(imap, cmd, i, true);
-
-        // We fetch only known RFC822 headers because
-        // using Fetch RFC822.HEADER reurns all included unused headers
-        // which required more memory and network bandwidth.
-        MB_String cmd2;
-        appendRFC822HeadersFetchCommand(cmd2);
+        // The message that was fetched on demand before reuses its parsed header and part structure.
+        bool structureReused = imap->_onDemand && imap->_onDemandHeader.message_uid == imap->_imap_msg_num[i].value &&
+                               imap->_onDemandHeader.part_headers.size() > 0 && imap->_onDemandUIDValidity == imap->_mbif._uidValidity &&
+                               strcmp(imap->_onDemandFolder.c_str(), imap->_currentFolder.c_str()) == 0;
+        if (structureReused)
+            imap->_headers.push_back(imap->_onDemandHeader);
+
+        // The cached header can be used only when the message UID is known
+        // and no CHANGEDSINCE conditional test is required.
+        bool cachedHeader = structureReused;
+        int cacheIdx = -1;
+        if (!structureReused && (imap->_uidSearch || imap->_imap_msg_num[i].type == esp_mail_imap_msg_num_type_uid))
+            cacheIdx = getHeaderCacheFlags(imap, imap->_imap_msg_num[i].value);
+
+        if (cacheIdx > -1)
+        {
+            // The message number and flags are not cached as they can be changed, they were fetched
+            // for all cached UIDs before. The cached UID that was expunged has no message number,
+            // its cache entry is removed and the message is fetched as usual.
+            struct esp_mail_imap_header_cache_flags_t *cached = &imap->_hcFlags[cacheIdx];
 
-        appendString(cmd, cmd2.c_str(), false, false, esp_mail_string_mark_type_square_bracket);
+            if (cached->msg_no > 0)
+                cachedHeader = readHeaderCache(imap, cached->item);
+            else
+                imap->_hc.remove(cached->item.uid);
 
-        imap->addModifier(cmd, esp_mail_imap_command_changedsince, imap->_imap_data->fetch.modsequence);
+            if (cachedHeader && cHeader(imap))
+            {
+                cHeader(imap)->flags = cached->flags;
+                cHeader(imap)->message_no = cached->msg_no;
+            }
+        }
 
-        if (imapSend(imap, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
+        if (!cachedHeader)
         {
-            if (i < imap->_imap_msg_num.size() - 1)
-                continue;
-            return false;
-        }
+            IMAP_Cmd cmd;
+            appendHeadersFetchCommand(imap, cmd, i, true);
 
-        imap->_imap_cmd = esp_mail_imap_cmd_fetch_body_header;
+            // We fetch only known RFC822 headers because
+            // using Fetch RFC822.HEADER reurns all included unused headers
+            // which required more memory and network bandwidth.
+            cmd.append({esp_mail_str_40 /* "[" */});
+            appendRFC822HeadersFetchCommand(cmd);
+            cmd.append({esp_mail_str_41 /* "]" */});
 
-        int err = imap->_headerOnly ? IMAP_STATUS_IMAP_RESPONSE_FAILED : IMAP_STATUS_BAD_COMMAND;
+            imap->addModifier(cmd, esp_mail_imap_command_changedsince, imap->_imap_data->fetch.modsequence);
 
-        if (!handleIMAPResponse(imap, err, closeSession))
-        {
-            if (i < imap->_imap_msg_num.size() - 1)
-                continue;
-            return false;
+            if (imapSend(imap, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
+            {
+                if (i < imap->_imap_msg_num.size() - 1)
+                    continue;
+                return false;
+            }
+
+            imap->_imap_cmd = esp_mail_imap_cmd_fetch_body_header;
+
+            int err = imap->_headerOnly ? IMAP_STATUS_IMAP_RESPONSE_FAILED : IMAP_STATUS_BAD_COMMAND;
+
+            if (!handleIMAPResponse(imap, err, closeSession))
+            {
+                if (i < imap->_imap_msg_num.size() - 1)
+                    continue;
+                return false;
+            }
         }
 
         if (!cHeader(imap))
             continue;
 
-        if (imap->_imap_msg_num[i].type == esp_mail_imap_msg_num_type_number)
-            cHeader(imap)->message_uid = imap->mGetUID(cHeader(imap)->message_no);
+        if (!cachedHeader)
+        {
+            if (imap->_imap_msg_num[i].type == esp_mail_imap_msg_num_type_number)
+                cHeader(imap)->message_uid = imap->mGetUID(cHeader(imap)->message_no);
+
+            writeHeaderCache(imap, cHeader(imap));
 
-        cHeader(imap)->flags = imap->getFlags(cHeader(imap)->message_no);
+            cHeader(imap)->flags = imap->getFlags(cHeader(imap)->message_no);
+        }
 
         if (!imap->_headerOnly)
         {
             imap->_cPartIdx = 0;
 
             // Reset attachment state if it was set by "multipart/mixed" content type header
-            cHeader(imap)->hasAttachment = false;
+            if (!structureReused)
+                cHeader(imap)->hasAttachment = false;
 
 #if !defined(SILENT_MODE)
             if (imap->_debug)
                 debugPrintNewLine();
 #endif
 
-            // multipart
-            if (cHeader(imap)->multipart)
+            // The reused part structure was kept after its part headers were fetched
+            if (!structureReused)
             {
-                struct esp_mail_imap_multipart_level_t mlevel;
-                mlevel.level = 1;
-                mlevel.fetch_rfc822_header = false;
-                mlevel.append_body_text = false;
-                imap->_multipart_levels.push_back(mlevel);
+                // multipart
+                if (cHeader(imap)->multipart)
+                {
+                    struct esp_mail_imap_multipart_level_t mlevel;
+                    mlevel.level = 1;
+                    mlevel.fetch_rfc822_header = false;
+                    mlevel.append_body_text = false;
+                    imap->_multipart_levels.push_back(mlevel);
 
-                if (!fetchMultipartBodyHeader(imap, i))
-                    return false;
-            }
-            else
-            {
-                // single part
-                if (imap->_debug)
-                    printBodyPartFechingDubug(imap, "1", false);
+                    if (!fetchMultipartBodyHeader(imap, i))
+                        return false;
+                }
+                else
+                {
+                    // single part
+                    if (imap->_debug)
+                        printBodyPartFechingDubug(imap, "1", false);
 
-                cHeader(imap)->partNumStr.clear();
-                if (!sendFetchCommand(imap, i, esp_mail_imap_cmd_fetch_body_mime))
-                    return false;
+                    cHeader(imap)->partNumStr.clear();
+                    if (!sendFetchCommand(imap, i, esp_mail_imap_cmd_fetch_body_mime))
+                        return false;
 
-                imap->_imap_cmd = esp_mail_imap_cmd_fetch_body_mime;
-                if (!handleIMAPResponse(imap, IMAP_STATUS_BAD_COMMAND, closeSession))
-                    return false;
+                    imap->_imap_cmd = esp_mail_imap_cmd_fetch_body_mime;
+                    if (!handleIMAPResponse(imap, IMAP_STATUS_BAD_COMMAND, closeSession))
+                        return false;
+                }
             }
 
             if (readyToDownload && imap->_imap_data->storage.saved_path.length() == 0)
@@ -744,21 +827,16 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
 
                 cHeader(imap)->sd_alias_file_count = 0;
 
-                imap->_sdFileList.clear();
-                if (!mbfs->longNameSupported())
-                    imap->_sdFileList = esp_mail_str_40; /* "[" */
+                imap->_downloadFileStart = imap->_downloadFiles.size();
 
 #if !defined(SILENT_MODE)
 
                 if (cHeader(imap)->attachment_count > 0 && imap->_statusCallback)
                 {
-                    int bufLen = 100;
-                    char *buf = allocMem<char *>(bufLen);
-                    snprintf(buf, bufLen, pgm2Str(esp_mail_str_54 /* "Attachments (%d)" */), cHeader(imap)->attachment_count);
+                    char buf[100];
+                    snprintf(buf, sizeof(buf), pgm2Str(esp_mail_str_54 /* "Attachments (%d)" */), cHeader(imap)->attachment_count);
                     callBackSendNewLine<IMAPSession *>(imap, false);
                     sendCallback<IMAPSession *>(imap, buf, false, false);
-                    // release memory
-                    freeMem(&buf);
 
                     int count = 0;
 
@@ -822,9 +900,34 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
                     checkFirmwareFile(imap, cPart(imap)->filename.c_str(), *cPart(imap), true);
                 }
 
+                // Keep the structure of message fetched on demand before its contents were fetched
+                if (imap->_onDemand && !structureReused)
+                {
+                    imap->_onDemandHeader = *cHeader(imap);
+                    imap->_onDemandFolder = imap->_currentFolder;
+                    imap->_onDemandUIDValidity = imap->_mbif._uidValidity;
+                }
+
                 int attach_count = 0;
                 int ccnt = 0;
 
+                // The part of attachment that requested on demand, counted as in IMAP_MSG_Item attachments list
+                int onDemandPart = -1;
+                if (imap->_onDemandAttachment > -1)
+                {
+                    int count = 0;
+                    for (size_t j = 0; j < cHeader(imap)->part_headers.size() && onDemandPart == -1; j++)
+                    {
+                        struct esp_mail_message_part_info_t *part = &cHeader(imap)->part_headers[j];
+                        if (part->attach_type != esp_mail_att_type_none && (part->attach_type == esp_mail_att_type_attachment || (!part->rfc822_part && part->message_sub_type != esp_mail_imap_message_sub_type_rfc822)))
+                        {
+                            if (count == imap->_onDemandAttachment)
+                                onDemandPart = j;
+                            count++;
+                        }
+                    }
+                }
+
                 for (size_t j = 0; j < cHeader(imap)->part_headers.size(); j++)
                 {
                     imap->_cPartIdx = j;
@@ -886,6 +989,8 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
                     }
                     else if (cPart(imap)->attach_type != esp_mail_att_type_none && (imap->_storageReady || cPart(imap)->is_firmware_file))
                     {
+                        if (imap->_onDemandAttachment > -1 && (int)j != onDemandPart)
+                            continue;
 
                         if (cPart(imap)->is_firmware_file || (imap->_imap_data->download.attachment && cPart(imap)->attach_type == esp_mail_att_type_attachment) || (imap->_imap_data->download.inlineImg && cPart(imap)->attach_type == esp_mail_att_type_inline))
                         {
@@ -899,12 +1004,9 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
                                 if (imap->_debug)
                                 {
                                     debugPrintNewLine();
-                                    int bufLen = 100;
-                                    char *buf = allocMem<char *>(bufLen);
-                                    snprintf(buf, bufLen, pgm2Str(esp_mail_dbg_str_70 /* "download attachment %d of %d" */), attach_count + 1, (int)cHeader(imap)->attachment_count);
+                                    char buf[100];
+                                    snprintf(buf, sizeof(buf), pgm2Str(esp_mail_dbg_str_70 /* "download attachment %d of %d" */), attach_count + 1, (int)cHeader(imap)->attachment_count);
                                     esp_mail_debug_print_tag(buf, esp_mail_debug_tag_type_client, true);
-                                    // release memory
-                                    freeMem(&buf);
 
                                     MB_String filePath = imap->_imap_data->storage.saved_path;
                                     filePath += esp_mail_str_10; /* "/" */
@@ -929,12 +1031,43 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
                                         if (cHeader(imap)->part_headers[j + 1].octetLen > (int)imap->_imap_data->limit.attachment_size)
                                             cHeader(imap)->downloaded_bytes += cHeader(imap)->part_headers[j + 1].octetLen;
 
-                                    if (!sendFetchCommand(imap, i, esp_mail_imap_cmd_fetch_body_attachment))
-                                        return false;
+                                    // Fetch the base64 encoded attachment as raw octets when server supports BINARY (rfc3516).
+                                    if (cPart(imap)->xencoding == esp_mail_msg_xencoding_base64 && imap->_feature_capability[esp_mail_imap_read_capability_binary])
+                                    {
+                                        cPart(imap)->binary_fetch = true;
+                                        cPart(imap)->xencoding = esp_mail_msg_xencoding_binary;
+                                    }
+
+                                    if (imap->_imap_data->enable.resumable_download && imap->_storageReady && cPart(imap)->save_to_file && !cPart(imap)->is_firmware_file)
+                                    {
+                                        if (!fetchAttachmentRanges(imap, i, closeSession))
+                                            return false;
+                                    }
+                                    else
+                                    {
+                                        if (!sendFetchCommand(imap, i, esp_mail_imap_cmd_fetch_body_attachment))
+                                            return false;
+
+                                        imap->_imap_cmd = esp_mail_imap_cmd_fetch_body_attachment;
+                                        if (!handleIMAPResponse(imap, IMAP_STATUS_IMAP_RESPONSE_FAILED, closeSession))
+                                        {
+                                            // The server may not be able to decode the content (NO [UNKNOWN-CTE]),
+                                            // fetch the encoded content instead.
+                                            if (!cPart(imap)->binary_fetch || cPart(imap)->octetCount > 0 || !imap->connected())
+                                                return false;
+
+                                            cPart(imap)->binary_fetch = false;
+                                            cPart(imap)->xencoding = esp_mail_msg_xencoding_base64;
+
+                                            if (!sendFetchCommand(imap, i, esp_mail_imap_cmd_fetch_body_attachment))
+                                                return false;
+
+                                            if (!handleIMAPResponse(imap, IMAP_STATUS_IMAP_RESPONSE_FAILED, closeSession))
+                                                return false;
+                                        }
+                                    }
 
-                                    imap->_imap_cmd = esp_mail_imap_cmd_fetch_body_attachment;
-                                    if (!handleIMAPResponse(imap, IMAP_STATUS_IMAP_RESPONSE_FAILED, closeSession))
-                                        return false;
+                                    finishAttachmentDigest(imap);
 
                                     yield_impl();
                                 }
@@ -962,20 +1095,35 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
                 saveHeader(imap, true);
             }
 
-            // save files list to file
-            if (imap->_storageReady && imap->_sdFileList.length() > 0)
+            // save the renamed files list of this message to file
+            if (imap->_storageReady && imap->hasRenamedFile(imap->_downloadFileStart))
             {
                 MB_String filepath = cHeader(imap)->message_uid;
                 filepath += mimeinfo[esp_mail_file_extension_txt].endsWith;
                 if (mbfs->open(filepath, mbfs_type imap->_imap_data->storage.type, mb_fs_open_mode_write) > -1)
                 {
-                    mbfs->print(mbfs_type imap->_imap_data->storage.type, imap->_sdFileList.c_str());
+                    Header_Writer w;
+                    w.begin(headerWriterCallback, imap);
+                    imap->writeDownloadFiles(w, imap->_downloadFileStart, true);
+                    w.flush();
                     mbfs->close(mbfs_type imap->_imap_data->storage.type);
                 }
             }
 
             imap->_cMsgIdx++;
         }
+
+        // Deliver the message and release its data
+        if (imap->_messageCallback && imap->_headers.size() > 0)
+        {
+            struct esp_mail_imap_msg_item_t itm;
+            imap->getMessageItem(0, itm);
+            imap->_messageCallback(itm);
+
+            imap->_headers[0].part_headers.clear();
+            imap->_headers.clear();
+        }
+
 #if !defined(SILENT_MODE)
         if (imap->_debug)
         {
@@ -985,9 +1133,12 @@ bool ESP_Mail_Client::readMail(IMAPSession *imap, bool closeSession)
         }
 #endif
     }
-#if defined(MB_ARDUINO_ESP) || defined(MB_ARDUINO_PICO)
+#if defined(MB_ARDUINO_ESP) || defined(MB_ARDUINO_PICO) || defined(ESP_MAIL_STATIC_MEMORY)
 out:
 #endif
+    imap->_hcFlags.clear();
+    imap->_hc.flush();
+
     if (readCount < imap->_imap_msg_num.size())
     {
         imap->_mbif._availableItems = readCount;
@@ -1021,41 +1172,37 @@ out:
     return true;
 }
 
-void ESP_Mail_Client::appendHeadersFetchCommand(IMAPSession *imap, MB_String &cmd, int index, bool debug)
+void ESP_Mail_Client::appendHeadersFetchCommand(IMAPSession *imap, IMAP_Cmd &cmd, int index, bool debug, bool binary)
 {
+    cmd.join({esp_mail_imap_tag_str});
     if (imap->_uidSearch || imap->_imap_msg_num[index].type == esp_mail_imap_msg_num_type_uid)
-        appendSpace(cmd, true, 2, imap_commands[esp_mail_imap_command_uid].text, imap_commands[esp_mail_imap_command_fetch].text);
-    else
-        appendSpace(cmd, true, imap_commands[esp_mail_imap_command_fetch].text);
+        cmd.join({imap_commands[esp_mail_imap_command_uid].text});
 #if !defined(SILENT_MODE)
     if (debug && imap->_debug)
         esp_mail_debug_print_tag(esp_mail_dbg_str_26 /* "fetch message header" */, esp_mail_debug_tag_type_client, true);
 #endif
-    joinStringSpace(cmd, false, 2, MB_String((int)imap->_imap_msg_num[index].value).c_str(), imap_commands[esp_mail_imap_command_body].text);
+    char num[11];
+    cmd.join({imap_commands[esp_mail_imap_command_fetch].text, IMAP_Cmd::num(num, imap->_imap_msg_num[index].value), imap_commands[binary ? esp_mail_imap_command_binary : esp_mail_imap_command_body].text});
 
     if (!imap->_imap_data->fetch.set_seen)
-        prependDot(cmd, imap_commands[esp_mail_imap_command_peek].text);
+        cmd.append({esp_mail_str_27 /* "." */, imap_commands[esp_mail_imap_command_peek].text});
 }
 
-void ESP_Mail_Client::appendRFC822HeadersFetchCommand(MB_String &cmd)
+void ESP_Mail_Client::appendRFC822HeadersFetchCommand(IMAP_Cmd &cmd)
 {
-    joinStringDot(cmd, 2, imap_commands[esp_mail_imap_command_header].text, imap_commands[esp_mail_imap_command_fields].text);
-    appendSpace(cmd);
-
-    MB_String cmd2;
+    cmd.append({imap_commands[esp_mail_imap_command_header].text, esp_mail_str_27 /* "." */, imap_commands[esp_mail_imap_command_fields].text, esp_mail_str_2 /* " " */, esp_mail_str_38 /* "(" */});
 
     for (int i = 0; i < esp_mail_rfc822_header_field_maxType; i++)
-        appendSpace(cmd2, false, rfc822_headers[i].text);
-
-    joinStringSpace(cmd2, false, 4, message_headers[esp_mail_message_header_field_content_type].text,
-                    message_headers[esp_mail_message_header_field_content_transfer_encoding].text,
-                    message_headers[esp_mail_message_header_field_content_language].text,
-                    message_headers[esp_mail_message_header_field_accept_language].text);
+        cmd.append({rfc822_headers[i].text, esp_mail_str_2 /* " " */});
 
-    appendString(cmd, cmd2.c_str(), false, false, esp_mail_string_mark_type_round_bracket);
+    cmd.append({message_headers[esp_mail_message_header_field_content_type].text});
+    cmd.join({message_headers[esp_mail_message_header_field_content_transfer_encoding].text,
+              message_headers[esp_mail_message_header_field_content_language].text,
+              message_headers[esp_mail_message_header_field_accept_language].text});
+    cmd.append({esp_mail_str_39 /* ")" */});
 }
 
-bool ESP_Mail_Client::getMultipartFechCmd(IMAPSession *imap, int msgIdx, MB_String &partText)
+bool ESP_Mail_Client::getMultipartFechCmd(IMAPSession *imap, int msgIdx, IMAP_Cmd &cmd)
 {
     if (imap->_multipart_levels.size() == 0)
         return false;
@@ -1064,32 +1211,27 @@ bool ESP_Mail_Client::getMultipartFechCmd(IMAPSession *imap, int msgIdx, MB_Stri
 
     cHeader(imap)->partNumStr.clear();
 
-    appendHeadersFetchCommand(imap, partText, msgIdx, false);
+    appendHeadersFetchCommand(imap, cmd, msgIdx, false);
 
-    MB_String cmd1;
     for (size_t i = 0; i < imap->_multipart_levels.size(); i++)
     {
         if (i > 0)
-        {
-            cmd1 += esp_mail_str_27;                      /* "." */
             cHeader(imap)->partNumStr += esp_mail_str_27; /* "." */
-        }
 
-        cmd1 += imap->_multipart_levels[i].level;
         cHeader(imap)->partNumStr += imap->_multipart_levels[i].level;
     }
 
+    cmd.append({esp_mail_str_40 /* "[" */, cHeader(imap)->partNumStr.c_str(), esp_mail_str_27 /* "." */});
+
     if (imap->_multipart_levels[cLevel].fetch_rfc822_header)
     {
-        MB_String cmd2;
-        appendRFC822HeadersFetchCommand(cmd2);
-        prependDot(cmd1, cmd2.c_str());
+        appendRFC822HeadersFetchCommand(cmd);
         imap->_multipart_levels[cLevel].append_body_text = true;
     }
     else
-        prependDot(cmd1, imap_commands[esp_mail_imap_command_mime].text);
+        cmd.append({imap_commands[esp_mail_imap_command_mime].text});
 
-    appendString(partText, cmd1.c_str(), false, false, esp_mail_string_mark_type_square_bracket);
+    cmd.append({esp_mail_str_41 /* "]" */});
 
     imap->_multipart_levels[cLevel].fetch_rfc822_header = false;
 
@@ -1123,7 +1265,14 @@ bool ESP_Mail_Client::fetchMultipartBodyHeader(IMAPSession *imap, int msgIdx)
     do
     {
 
-#if defined(MB_ARDUINO_ESP) || defined(MB_ARDUINO_PICO)
+#if defined(ESP_MAIL_STATIC_MEMORY)
+        // The number of parts is limited
+        if (cHeader(imap)->part_headers.size() >= ESP_MAIL_STATIC_MAX_PARTS)
+        {
+            errorStatusCB<IMAPSession *, IMAPSession *>(imap, nullptr, MAIL_CLIENT_ERROR_OUT_OF_MEMORY, true);
+            break;
+        }
+#elif defined(MB_ARDUINO_ESP) || defined(MB_ARDUINO_PICO)
         // Prevent stack overflow
         if (MailClient.getFreeHeap() < ESP_MAIL_MIN_MEM)
         {
@@ -1135,7 +1284,7 @@ bool ESP_Mail_Client::fetchMultipartBodyHeader(IMAPSession *imap, int msgIdx)
         struct esp_mail_message_part_info_t *_cpart = &cHeader(imap)->part_headers[cHeader(imap)->message_data_count - 1];
         bool rfc822_body_subtype = _cpart->message_sub_type == esp_mail_imap_message_sub_type_rfc822 && _cpart->attach_type != esp_mail_att_type_attachment;
 
-        MB_String cmd;
+        IMAP_Cmd cmd;
         if (!getMultipartFechCmd(imap, msgIdx, cmd))
             return true;
 
@@ -1220,6 +1369,7 @@ bool ESP_Mail_Client::imapAuth(IMAPSession *imap, bool &ssl)
         return false;
 
     imap->_auth_capability[esp_mail_auth_capability_login] = false;
+    imap->_feature_capability[esp_mail_imap_read_capability_auto_caps] = false;
 
     imap->_session_cfg->int_start_tls = imap->_session_cfg->secure.startTLS;
     imap->_session_cfg->int_mode = imap->_session_cfg->secure.mode;
@@ -1404,8 +1554,7 @@ unauthenticate:
         if (imap->_debug)
             esp_mail_debug_print_tag(esp_mail_dbg_str_34 /* "send IMAP command, LOGIN" */, esp_mail_debug_tag_type_client, true);
 #endif
-        MB_String cmd;
-        joinStringSpace(cmd, true, 3, imap_commands[esp_mail_imap_command_login].text, imap->_session_cfg->login.email.c_str(), imap->_session_cfg->login.password.c_str());
+        IMAP_Cmd cmd({esp_mail_imap_tag_str, imap_commands[esp_mail_imap_command_login].text, imap->_session_cfg->login.email.c_str(), imap->_session_cfg->login.password.c_str()});
 
         if (imapSend(imap, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
             return false;
@@ -1416,7 +1565,9 @@ unauthenticate:
     }
 
     // auto capabilities after login?
-    if (!imap->_feature_capability[esp_mail_imap_read_capability_auto_caps])
+    // The COMPRESS capability is usually advertised only after login (RFC 4978), re-read the capabilities
+    // before deciding when it was not listed.
+    if (!imap->_feature_capability[esp_mail_imap_read_capability_auto_caps] || (imap->_compress && !imap->_feature_capability[esp_mail_imap_read_capability_compress_deflate]))
     {
         if (!imap->checkCapabilities())
             return false;
@@ -1428,12 +1579,55 @@ unauthenticate:
             return false;
     }
 
+    if (imap->_compress && imap->_feature_capability[esp_mail_imap_read_capability_compress_deflate])
+    {
+        if (!imapCompress(imap))
+            return false;
+    }
+
     if (supported_sasl)
         imap->_authenticated = true;
 
     return true;
 }
 
+bool ESP_Mail_Client::imapCompress(IMAPSession *imap)
+{
+#if defined(ENABLE_IMAP_COMPRESS)
+
+    if (imap->client.isCompressed())
+        return true;
+
+#if !defined(SILENT_MODE)
+    if (imap->_debug)
+        esp_mail_debug_print_tag(esp_mail_dbg_str_85 /* "send IMAP command, COMPRESS" */, esp_mail_debug_tag_type_client, true);
+#endif
+
+    IMAP_Cmd cmd({esp_mail_imap_tag_str, imap_commands[esp_mail_imap_command_compress].text, imap_commands[esp_mail_imap_command_deflate].text});
+
+    if (imapSend(imap, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
+        return false;
+
+    imap->_imap_cmd = esp_mail_imap_cmd_compress;
+
+    // The server may reject the command e.g. NO [COMPRESSIONACTIVE], continue without compression.
+    if (!handleIMAPResponse(imap, IMAP_STATUS_BAD_COMMAND, false))
+        return imap->connected();
+
+    // Both sides start the compression immediately after the tagged OK response.
+    // The server stream is already compressed, the session cannot continue when the compression failed to start.
+    if (!imap->client.beginCompression(imap->_inflateWindowBits, imap->_deflateWindowBits))
+    {
+        closeTCPSession<IMAPSession *>(imap);
+        errorStatusCB<IMAPSession *, IMAPSession *>(imap, nullptr, MAIL_CLIENT_ERROR_OUT_OF_MEMORY, false);
+        return false;
+    }
+
+#endif
+
+    return true;
+}
+
 bool ESP_Mail_Client::imapLogout(IMAPSession *imap)
 {
 
@@ -1738,7 +1932,7 @@ end_search:
 }
 
 #if !defined(MB_USE_STD_VECTOR)
-void ESP_Mail_Client::numDecSort(_vectorImpl<struct esp_mail_imap_msg_num_t> &arr)
+void ESP_Mail_Client::numDecSort(esp_mail_imap_msg_num_list_t &arr)
 {
 
     struct esp_mail_imap_msg_num_t tmp;
@@ -1767,118 +1961,72 @@ struct esp_mail_message_part_info_t *ESP_Mail_Client::cPart(IMAPSession *imap)
 
 struct esp_mail_message_header_t *ESP_Mail_Client::cHeader(IMAPSession *imap)
 {
-    if (cIdx(imap) < (int)imap->_headers.size())
-        return &imap->_headers[cIdx(imap)];
+    // Only the current message is kept when the messages are delivered via callback
+    int index = imap->_messageCallback ? 0 : cIdx(imap);
+    if (index < (int)imap->_headers.size())
+        return &imap->_headers[index];
     return nullptr;
 }
 
-bool ESP_Mail_Client::parseHeaderField(IMAPSession *imap, const char *buf, PGM_P beginToken, bool caseSensitive, struct esp_mail_message_header_t &header, int &headerState, int state)
+void ESP_Mail_Client::parseHeaderResponse(IMAPSession *imap, esp_mail_imap_response_data &res, char *buf, bool caseSensitive)
 {
-    if (strcmpP(buf, 0, beginToken, caseSensitive))
-    {
-        headerState = state;
-        char *tmp = subStr(buf, beginToken, NULL, 0, -1, caseSensitive);
-        if (tmp)
-        {
-            collectHeaderField(imap, tmp, header, headerState);
-            // release memory
-            freeMem(&tmp);
-            return true;
-        }
-    }
+    // The field name is hashed once instead of comparing the line with every known field name.
+    int valuePos = 0;
+    int field = esp_mail_get_header_field_hash(buf, valuePos, caseSensitive);
 
-    return false;
-}
+    if (field == 0)
+        return;
 
-void ESP_Mail_Client::parseHeaderResponse(IMAPSession *imap, esp_mail_imap_response_data &res, bool caseSensitive)
-{
-    char *tmp = nullptr;
-    if (res.chunkIdx == 0)
+    if ((field & 0x80) == 0)
     {
-        MB_String str;
-        joinStringDot(str, 2, imap_commands[esp_mail_imap_command_header].text, imap_commands[esp_mail_imap_command_fields].text);
-
-        if (!res.isUntaggedResponse && strposP(res.response, str.c_str(), 0, caseSensitive) != -1 && res.response[0] == '*')
-            res.isUntaggedResponse = true;
-
-        if (res.isUntaggedResponse && res.response[strlen(res.response) - 1] == '}')
-            res.untaggedRespCompleted = true;
-
-        if (res.isUntaggedResponse && res.header.message_no == 0)
-        {
-            tmp = subStr(res.response, imap_responses[esp_mail_imap_response_untagged].text, imap_responses[esp_mail_imap_response_fetch].text, 0);
-            if (tmp)
-            {
-                res.header.message_no = atoi(tmp);
-                // release memory
-                freeMem(&tmp);
-            }
-        }
-
-        if (res.isUntaggedResponse && res.untaggedRespCompleted)
-        {
-            tmp = subStr(res.response, esp_mail_str_36 /* "{" */, esp_mail_str_37 /* "}" */, 0, 0, caseSensitive);
-            if (tmp)
-            {
-                res.octetCount = 2;
-                res.header.header_data_len = atoi(tmp);
-                // release memory
-                freeMem(&tmp);
-                res.chunkIdx++;
-            }
-        }
+        res.headerState = field - 1;
+        collectHeaderField(imap, buf + valuePos, res.header, res.headerState);
+        return;
     }
-    else
-    {
-        if (res.octetCount > res.header.header_data_len + 2)
-            return;
 
-        res.chunkIdx++;
+    switch (field & 0x7f)
+    {
+    case esp_mail_message_header_field_content_transfer_encoding:
+        res.headerState = esp_mail_imap_state_content_transfer_encoding;
+        collectHeaderField(imap, buf + valuePos, res.header, res.headerState);
+        break;
 
-        MB_String field;
+    case esp_mail_message_header_field_accept_language:
+        res.headerState = esp_mail_imap_state_accept_language;
+        collectHeaderField(imap, buf + valuePos, res.header, res.headerState);
+        break;
 
-        for (int i = esp_mail_rfc822_header_field_from; i < esp_mail_rfc822_header_field_maxType; i++)
-        {
-            appendHeaderName(field, rfc822_headers[i].text, true, false, false);
-            if (parseHeaderField(imap, res.response, field.c_str(), caseSensitive, res.header, res.headerState, i))
-                return;
-        }
+    case esp_mail_message_header_field_content_language:
+        res.headerState = esp_mail_imap_state_content_language;
+        collectHeaderField(imap, buf + valuePos, res.header, res.headerState);
+        break;
 
-        appendHeaderName(field, message_headers[esp_mail_message_header_field_content_transfer_encoding].text, true, true, false);
+    case esp_mail_message_header_field_content_type:
+    {
+        res.headerState = esp_mail_imap_state_content_type;
 
-        if (parseHeaderField(imap, res.response, field.c_str(), caseSensitive, res.header, res.headerState, esp_mail_imap_state_content_transfer_encoding))
-            return;
+        // Check the media type (up to ";") in place.
+        char *value = buf + valuePos;
+        char *sc = strchr(value, ';');
+        if (sc)
+            *sc = 0;
 
-        appendHeaderName(field, message_headers[esp_mail_message_header_field_accept_language].text, true, true, false);
+        // We set attachment status here as attachment should be included in multipart/mixed message,
+        // unless no real attachments included which we don't know until fetching the sub part.
+        if (strpos(value, esp_mail_imap_multipart_sub_type_t::mixed, 0, caseSensitive) != -1)
+            res.header.hasAttachment = true;
 
-        if (parseHeaderField(imap, res.response, field.c_str(), caseSensitive, res.header, res.headerState, esp_mail_imap_state_accept_language))
-            return;
+        if (sc)
+            *sc = ';';
 
-        appendHeaderName(field, message_headers[esp_mail_message_header_field_content_language].text, true, true, false);
+        collectHeaderField(imap, buf, res.header, res.headerState);
+        break;
+    }
 
-        if (parseHeaderField(imap, res.response, field.c_str(), caseSensitive, res.header, res.headerState, esp_mail_imap_state_content_language))
-            return;
-
-        MB_String contentTypeName;
-        appendHeaderName(contentTypeName, message_headers[esp_mail_message_header_field_content_type].text, false, false, false);
-        if (strcmpP(res.response, 0, contentTypeName.c_str(), caseSensitive))
-        {
-            res.headerState = esp_mail_imap_state_content_type;
-            tmp = subStr(res.response, contentTypeName.c_str(), esp_mail_str_35 /* ";" */, 0, 0, caseSensitive);
-            if (tmp)
-            {
-                // We set attachment status here as attachment should be included in multipart/mixed message,
-                // unless no real attachments included which we don't know until fetching the sub part.
-                if (strpos(tmp, esp_mail_imap_multipart_sub_type_t::mixed, 0, caseSensitive) != -1)
-                    res.header.hasAttachment = true;
-
-                collectHeaderField(imap, res.response, res.header, res.headerState);
-                // release memory
-                freeMem(&tmp);
-            }
-        }
-    }
-}
+    default:
+        break;
+    }
+}
 
 void ESP_Mail_Client::collectHeaderField(IMAPSession *imap, char *buf, struct esp_mail_message_header_t &header, int state)
 {
@@ -1958,411 +2106,350 @@ void ESP_Mail_Client::checkFirmwareFile(IMAPSession *imap, const char *filename,
     }
 }
 
-void ESP_Mail_Client::parsePartHeaderResponse(IMAPSession *imap, esp_mail_imap_response_data &res, bool caseSensitive)
+void ESP_Mail_Client::parsePartHeaderResponse(IMAPSession *imap, esp_mail_imap_response_data &res, char *buf, bool caseSensitive)
 {
-    char *tmp = nullptr;
-    if (res.chunkIdx == 0)
-    {
-        tmp = subStr(res.response, imap_responses[esp_mail_imap_response_fetch].text, NULL, 0, -1);
-        if (tmp)
-        {
-            // release memory
-            freeMem(&tmp);
-            tmp = subStr(res.response, esp_mail_str_36 /* "{" */, esp_mail_str_37 /* "}" */, 0);
-            if (tmp)
-            {
-                res.chunkIdx++;
-                res.part.octetLen = atoi(tmp);
-                res.octetCount = 2;
-                // release memory
-                freeMem(&tmp);
-            }
-        }
-    }
-    else
-    {
-        MB_String value, old_value;
-        bool valueStored = false;
-        res.chunkIdx++;
+    MB_String value, old_value;
+    bool valueStored = false;
 
-        // if all octets read
+    int valuePos = 0;
+    int field = esp_mail_get_header_field_hash(buf, valuePos, caseSensitive);
+    const char *fieldValue = buf + valuePos;
 
-        if (res.octetCount > res.part.octetLen)
+    // Content header field parse
+    if (strcmpP(buf, 0, esp_mail_str_56 /* "content-" */, caseSensitive))
+    {
+        // Content-Type
+        if (field == ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_content_type))
         {
 
-            // Is inline attachment without content id or name or filename?
-            // It is supposed to be the inline message txt content, reset attach type to none
-
-            if (res.part.attach_type == esp_mail_att_type_inline && res.part.CID.length() == 0)
-                res.part.attach_type = esp_mail_att_type_none;
+            res.part.cur_content_hdr = esp_mail_message_part_info_t::content_header_field_type;
+            resetStringPtr(res.part);
 
-            // Is attachment file extension missing?
-            // append extension
-
-            if (res.part.attach_type == esp_mail_att_type_inline || res.part.attach_type == esp_mail_att_type_attachment)
+            res.part.content_type.clear();
+            res.part.content_type.append(fieldValue, strcspn(fieldValue, ";"));
+            int p1 = strposP(res.part.content_type.c_str(), esp_mail_imap_composite_media_type_t::multipart, 0, caseSensitive);
+            if (p1 != -1)
             {
-                if (res.part.filename.length() > 0 && res.part.filename.find('.') == MB_String::npos)
-                {
-                    MB_String ext;
-                    getExtfromMIME(res.part.content_type.c_str(), ext);
-                    res.part.filename += ext;
-                }
+                p1 += strlen(esp_mail_imap_composite_media_type_t::multipart) + 1;
+                res.part.multipart = true;
+                // inline or embedded images
+                if (strpos(res.part.content_type.c_str(), esp_mail_imap_multipart_sub_type_t::related, p1, caseSensitive) != -1)
+                    res.part.multipart_sub_type = esp_mail_imap_multipart_sub_type_related;
+                // multiple text formats e.g. plain, html, enriched
+                else if (strpos(res.part.content_type.c_str(), esp_mail_imap_multipart_sub_type_t::alternative, p1, caseSensitive) != -1)
+                    res.part.multipart_sub_type = esp_mail_imap_multipart_sub_type_alternative;
+                // medias
+                else if (strpos(res.part.content_type.c_str(), esp_mail_imap_multipart_sub_type_t::parallel, p1, caseSensitive) != -1)
+                    res.part.multipart_sub_type = esp_mail_imap_multipart_sub_type_parallel;
+                // rfc822 encapsulated
+                else if (strpos(res.part.content_type.c_str(), esp_mail_imap_multipart_sub_type_t::digest, p1, caseSensitive) != -1)
+                    res.part.multipart_sub_type = esp_mail_imap_multipart_sub_type_digest;
+                else if (strpos(res.part.content_type.c_str(), esp_mail_imap_multipart_sub_type_t::report, p1, caseSensitive) != -1)
+                    res.part.multipart_sub_type = esp_mail_imap_multipart_sub_type_report;
+                // others can be attachments
+                else if (strpos(res.part.content_type.c_str(), esp_mail_imap_multipart_sub_type_t::mixed, p1, caseSensitive) != -1)
+                    res.part.multipart_sub_type = esp_mail_imap_multipart_sub_type_mixed;
+            }
 
-                checkFirmwareFile(imap, res.part.filename.c_str(), res.part);
+            p1 = strposP(res.part.content_type.c_str(), esp_mail_imap_composite_media_type_t::message, 0, caseSensitive);
+            if (p1 != -1)
+            {
+                p1 += strlen(esp_mail_imap_composite_media_type_t::message) + 1;
+                if (strpos(res.part.content_type.c_str(), esp_mail_imap_message_sub_type_t::rfc822, p1, caseSensitive) != -1)
+                    res.part.message_sub_type = esp_mail_imap_message_sub_type_rfc822;
+                else if (strpos(res.part.content_type.c_str(), esp_mail_imap_message_sub_type_t::Partial, p1, caseSensitive) != -1)
+                    res.part.message_sub_type = esp_mail_imap_message_sub_type_partial;
+                else if (strpos(res.part.content_type.c_str(), esp_mail_imap_message_sub_type_t::External_Body, p1, caseSensitive) != -1)
+                    res.part.message_sub_type = esp_mail_imap_message_sub_type_external_body;
+                else if (strpos(res.part.content_type.c_str(), esp_mail_imap_message_sub_type_t::delivery_status, p1, caseSensitive) != -1)
+                    res.part.message_sub_type = esp_mail_imap_message_sub_type_delivery_status;
             }
 
-            return;
+            p1 = strpos(res.part.content_type.c_str(), esp_mail_imap_descrete_media_type_t::text, 0, caseSensitive);
+            if (p1 != -1)
+            {
+                p1 += strlen(esp_mail_imap_descrete_media_type_t::text) + 1;
+                if (strpos(res.part.content_type.c_str(), esp_mail_imap_media_text_sub_type_t::plain, p1, caseSensitive) != -1)
+                    res.part.msg_type = esp_mail_msg_type_plain;
+                else if (strpos(res.part.content_type.c_str(), esp_mail_imap_media_text_sub_type_t::enriched, p1, caseSensitive) != -1)
+                    res.part.msg_type = esp_mail_msg_type_enriched;
+                else if (strpos(res.part.content_type.c_str(), esp_mail_imap_media_text_sub_type_t::html, p1, caseSensitive) != -1)
+                    res.part.msg_type = esp_mail_msg_type_html;
+                else
+                    res.part.msg_type = esp_mail_msg_type_plain;
+            }
         }
 
-        // Content header field parse
-        if (strcmpP(res.response, 0, esp_mail_str_56 /* "content-" */, caseSensitive))
+        // Content-Description
+        if (field == ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_content_description))
         {
-            // Content-Type
-            MB_String contentTypeName;
-            appendHeaderName(contentTypeName, message_headers[esp_mail_message_header_field_content_type].text, false, false, false);
-            if (strcmpP(res.response, 0, contentTypeName.c_str(), caseSensitive))
-            {
-
-                res.part.cur_content_hdr = esp_mail_message_part_info_t::content_header_field_type;
-                resetStringPtr(res.part);
-
-                tmp = subStr(res.response, contentTypeName.c_str(), esp_mail_str_35 /* ";" */, 0, 0, caseSensitive);
-                if (tmp)
-                {
-                    res.part.content_type = tmp;
-                    // release memory
-                    freeMem(&tmp);
-                    int p1 = strposP(res.part.content_type.c_str(), esp_mail_imap_composite_media_type_t::multipart, 0, caseSensitive);
-                    if (p1 != -1)
-                    {
-                        p1 += strlen(esp_mail_imap_composite_media_type_t::multipart) + 1;
-                        res.part.multipart = true;
-                        // inline or embedded images
-                        if (strpos(res.part.content_type.c_str(), esp_mail_imap_multipart_sub_type_t::related, p1, caseSensitive) != -1)
-                            res.part.multipart_sub_type = esp_mail_imap_multipart_sub_type_related;
-                        // multiple text formats e.g. plain, html, enriched
-                        else if (strpos(res.part.content_type.c_str(), esp_mail_imap_multipart_sub_type_t::alternative, p1, caseSensitive) != -1)
-                            res.part.multipart_sub_type = esp_mail_imap_multipart_sub_type_alternative;
-                        // medias
-                        else if (strpos(res.part.content_type.c_str(), esp_mail_imap_multipart_sub_type_t::parallel, p1, caseSensitive) != -1)
-                            res.part.multipart_sub_type = esp_mail_imap_multipart_sub_type_parallel;
-                        // rfc822 encapsulated
-                        else if (strpos(res.part.content_type.c_str(), esp_mail_imap_multipart_sub_type_t::digest, p1, caseSensitive) != -1)
-                            res.part.multipart_sub_type = esp_mail_imap_multipart_sub_type_digest;
-                        else if (strpos(res.part.content_type.c_str(), esp_mail_imap_multipart_sub_type_t::report, p1, caseSensitive) != -1)
-                            res.part.multipart_sub_type = esp_mail_imap_multipart_sub_type_report;
-                        // others can be attachments
-                        else if (strpos(res.part.content_type.c_str(), esp_mail_imap_multipart_sub_type_t::mixed, p1, caseSensitive) != -1)
-                            res.part.multipart_sub_type = esp_mail_imap_multipart_sub_type_mixed;
-                    }
+            res.part.descr = fieldValue;
+            // decode header text
+            decodeString(imap, res.part.descr);
 
-                    p1 = strposP(res.part.content_type.c_str(), esp_mail_imap_composite_media_type_t::message, 0, caseSensitive);
-                    if (p1 != -1)
-                    {
-                        p1 += strlen(esp_mail_imap_composite_media_type_t::message) + 1;
-                        if (strpos(res.part.content_type.c_str(), esp_mail_imap_message_sub_type_t::rfc822, p1, caseSensitive) != -1)
-                            res.part.message_sub_type = esp_mail_imap_message_sub_type_rfc822;
-                        else if (strpos(res.part.content_type.c_str(), esp_mail_imap_message_sub_type_t::Partial, p1, caseSensitive) != -1)
-                            res.part.message_sub_type = esp_mail_imap_message_sub_type_partial;
-                        else if (strpos(res.part.content_type.c_str(), esp_mail_imap_message_sub_type_t::External_Body, p1, caseSensitive) != -1)
-                            res.part.message_sub_type = esp_mail_imap_message_sub_type_external_body;
-                        else if (strpos(res.part.content_type.c_str(), esp_mail_imap_message_sub_type_t::delivery_status, p1, caseSensitive) != -1)
-                            res.part.message_sub_type = esp_mail_imap_message_sub_type_delivery_status;
-                    }
+            res.part.cur_content_hdr = esp_mail_message_part_info_t::content_header_field_description;
 
-                    p1 = strpos(res.part.content_type.c_str(), esp_mail_imap_descrete_media_type_t::text, 0, caseSensitive);
-                    if (p1 != -1)
-                    {
-                        p1 += strlen(esp_mail_imap_descrete_media_type_t::text) + 1;
-                        if (strpos(res.part.content_type.c_str(), esp_mail_imap_media_text_sub_type_t::plain, p1, caseSensitive) != -1)
-                            res.part.msg_type = esp_mail_msg_type_plain;
-                        else if (strpos(res.part.content_type.c_str(), esp_mail_imap_media_text_sub_type_t::enriched, p1, caseSensitive) != -1)
-                            res.part.msg_type = esp_mail_msg_type_enriched;
-                        else if (strpos(res.part.content_type.c_str(), esp_mail_imap_media_text_sub_type_t::html, p1, caseSensitive) != -1)
-                            res.part.msg_type = esp_mail_msg_type_html;
-                        else
-                            res.part.msg_type = esp_mail_msg_type_plain;
-                    }
-                }
-            }
+            value = fieldValue;
+            res.part.stringPtr = toAddr(res.part.content_description);
+            value.trim();
+            if (value.length() == 0)
+                return;
+        }
 
-            // Content-Description
-            MB_String contentDescrName;
-            appendHeaderName(contentDescrName, message_headers[esp_mail_message_header_field_content_description].text, false, true, false);
-            if (getDecodedHeader(imap, res.response, contentDescrName.c_str(), res.part.descr, caseSensitive))
-            {
-                res.part.cur_content_hdr = esp_mail_message_part_info_t::content_header_field_description;
+        // Content-ID
+        if (field == ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_content_id))
+        {
+            res.part.CID = fieldValue;
+            res.part.CID.trim();
 
-                tmp = subStr(res.response, contentDescrName.c_str(), NULL, 0, -1, caseSensitive);
-                if (tmp)
-                {
-                    value = tmp;
-                    // release memory
-                    freeMem(&tmp);
+            if (res.part.CID[0] == '<')
+                res.part.CID.erase(0, 1);
 
-                    res.part.stringPtr = toAddr(res.part.content_description);
-                    value.trim();
-                    if (value.length() == 0)
-                        return;
-                }
-            }
+            if (res.part.CID[res.part.CID.length() - 1] == '>')
+                res.part.CID.erase(res.part.CID.length() - 1, 1);
 
-            // Content-ID
-            MB_String contentIdName;
-            appendHeaderName(contentIdName, message_headers[esp_mail_message_header_field_content_id].text, false, true, false);
-            if (strcmpP(res.response, 0, contentIdName.c_str(), caseSensitive))
+            // if inline attachment file name was not assigned
+            if (res.part.attach_type == esp_mail_att_type_inline && res.part.filename.length() == 0)
             {
-                tmp = subStr(res.response, contentIdName.c_str(), NULL, 0, -1, caseSensitive);
-                if (tmp)
-                {
-                    res.part.CID = tmp;
-                    // release memory
-                    freeMem(&tmp);
-                    res.part.CID.trim();
-
-                    if (res.part.CID[0] == '<')
-                        res.part.CID.erase(0, 1);
+                // set filename from content id and append extension later
+                res.part.filename = res.part.CID;
+                res.part.name = res.part.filename;
+            }
 
-                    if (res.part.CID[res.part.CID.length() - 1] == '>')
-                        res.part.CID.erase(res.part.CID.length() - 1, 1);
+            res.part.cur_content_hdr = esp_mail_message_part_info_t::content_header_field_id;
+            resetStringPtr(res.part);
+        }
 
-                    // if inline attachment file name was not assigned
-                    if (res.part.attach_type == esp_mail_att_type_inline && res.part.filename.length() == 0)
-                    {
-                        // set filename from content id and append extension later
-                        res.part.filename = res.part.CID;
-                        res.part.name = res.part.filename;
-                    }
-                }
+        // Content-Disposition
+        if (field == ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_content_disposition))
+        {
 
-                res.part.cur_content_hdr = esp_mail_message_part_info_t::content_header_field_id;
-                resetStringPtr(res.part);
-            }
+            res.part.cur_content_hdr = esp_mail_message_part_info_t::content_header_field_disposition;
+            resetStringPtr(res.part);
 
-            // Content-Disposition
-            MB_String contentDispositionName;
-            appendHeaderName(contentDispositionName, message_headers[esp_mail_message_header_field_content_disposition].text, false, true, false);
-            if (strcmpP(res.response, 0, contentDispositionName.c_str(), caseSensitive))
+            // don't count altenative part text and html as embedded contents
+            if (cHeader(imap)->multipart_sub_type != esp_mail_imap_multipart_sub_type_alternative)
             {
-
-                res.part.cur_content_hdr = esp_mail_message_part_info_t::content_header_field_disposition;
-                resetStringPtr(res.part);
-
-                tmp = subStr(res.response, contentDispositionName.c_str(), esp_mail_str_35 /* ";" */, 0, 0, caseSensitive);
-                if (tmp)
+                res.part.content_disposition.clear();
+                res.part.content_disposition.append(fieldValue, strcspn(fieldValue, ";"));
+                const char *disposition = res.part.content_disposition.c_str();
+                if (caseSensitive)
                 {
-                    // don't count altenative part text and html as embedded contents
-                    if (cHeader(imap)->multipart_sub_type != esp_mail_imap_multipart_sub_type_alternative)
-                    {
-                        res.part.content_disposition = tmp;
-                        if (caseSensitive)
-                        {
-                            if (strcmp(tmp, esp_mail_content_disposition_type_t::attachment) == 0)
-                                res.part.attach_type = esp_mail_att_type_attachment;
-                            else if (strcmp(tmp, esp_mail_content_disposition_type_t::inline_) == 0)
-                                res.part.attach_type = esp_mail_att_type_inline;
-                        }
-                        else
-                        {
-                            if (strcasecmp(tmp, esp_mail_content_disposition_type_t::attachment) == 0)
-                                res.part.attach_type = esp_mail_att_type_attachment;
-                            else if (strcasecmp(tmp, esp_mail_content_disposition_type_t::inline_) == 0)
-                                res.part.attach_type = esp_mail_att_type_inline;
-                        }
-                    }
-                    // release memory
-                    freeMem(&tmp);
+                    if (strcmp(disposition, esp_mail_content_disposition_type_t::attachment) == 0)
+                        res.part.attach_type = esp_mail_att_type_attachment;
+                    else if (strcmp(disposition, esp_mail_content_disposition_type_t::inline_) == 0)
+                        res.part.attach_type = esp_mail_att_type_inline;
                 }
-            }
-
-            // Content-Transfer-Encoding
-            MB_String contentTEName;
-            appendHeaderName(contentTEName, message_headers[esp_mail_message_header_field_content_transfer_encoding].text, false, true, false);
-            if (strcmpP(res.response, 0, contentTEName.c_str(), caseSensitive))
-            {
-                // store last text field
-
-                res.part.cur_content_hdr = esp_mail_message_part_info_t::content_header_field_transfer_enc;
-                resetStringPtr(res.part);
-
-                tmp = subStr(res.response, contentTEName.c_str(), NULL, 0, -1, caseSensitive);
-                if (tmp)
+                else
                 {
-                    res.part.content_transfer_encoding = tmp;
-
-                    if (strcmpP(tmp, 0, esp_mail_transfer_encoding_t::enc_base64))
-                        res.part.xencoding = esp_mail_msg_xencoding_base64;
-                    else if (strcmpP(tmp, 0, esp_mail_transfer_encoding_t::enc_qp))
-                        res.part.xencoding = esp_mail_msg_xencoding_qp;
-                    else if (strcmpP(tmp, 0, esp_mail_transfer_encoding_t::enc_7bit))
-                        res.part.xencoding = esp_mail_msg_xencoding_7bit;
-                    else if (strcmpP(tmp, 0, esp_mail_transfer_encoding_t::enc_8bit))
-                        res.part.xencoding = esp_mail_msg_xencoding_8bit;
-                    else if (strcmpP(tmp, 0, esp_mail_transfer_encoding_t::enc_binary))
-                        res.part.xencoding = esp_mail_msg_xencoding_binary;
-                    // release memory
-                    freeMem(&tmp);
+                    if (strcasecmp(disposition, esp_mail_content_disposition_type_t::attachment) == 0)
+                        res.part.attach_type = esp_mail_att_type_attachment;
+                    else if (strcasecmp(disposition, esp_mail_content_disposition_type_t::inline_) == 0)
+                        res.part.attach_type = esp_mail_att_type_inline;
                 }
             }
         }
-        else
+
+        // Content-Transfer-Encoding
+        if (field == ESP_MAIL_HEADER_HASH_MESSAGE(esp_mail_message_header_field_content_transfer_encoding))
         {
+            // store last text field
+
+            res.part.cur_content_hdr = esp_mail_message_part_info_t::content_header_field_transfer_enc;
+            resetStringPtr(res.part);
+
+            res.part.content_transfer_encoding = fieldValue;
+
+            if (strcmpP(fieldValue, 0, esp_mail_transfer_encoding_t::enc_base64))
+                res.part.xencoding = esp_mail_msg_xencoding_base64;
+            else if (strcmpP(fieldValue, 0, esp_mail_transfer_encoding_t::enc_qp))
+                res.part.xencoding = esp_mail_msg_xencoding_qp;
+            else if (strcmpP(fieldValue, 0, esp_mail_transfer_encoding_t::enc_7bit))
+                res.part.xencoding = esp_mail_msg_xencoding_7bit;
+            else if (strcmpP(fieldValue, 0, esp_mail_transfer_encoding_t::enc_8bit))
+                res.part.xencoding = esp_mail_msg_xencoding_8bit;
+            else if (strcmpP(fieldValue, 0, esp_mail_transfer_encoding_t::enc_binary))
+                res.part.xencoding = esp_mail_msg_xencoding_binary;
+        }
+    }
+    else
+    {
 
-            if (res.part.cur_content_hdr == esp_mail_message_part_info_t::content_header_field_none)
-            {
+        if (res.part.cur_content_hdr == esp_mail_message_part_info_t::content_header_field_none)
+        {
 
-                resetStringPtr(res.part);
+            resetStringPtr(res.part);
 
-                MB_String field;
-                for (int i = esp_mail_rfc822_header_field_from; i < esp_mail_rfc822_header_field_maxType; i++)
+            if (field > 0 && (field & 0x80) == 0)
+            {
+                int ptr = getRFC822HeaderPtr(field - 1, res.part.rfc822Header(true));
+                if (ptr > 0)
                 {
-                    field = rfc822_headers[i].text;
-                    field += esp_mail_str_34; /* ":" */
-                    ;
-
-                    int ptr = getRFC822HeaderPtr(i, &res.part.rfc822_header);
-                    if (ptr > 0)
-                    {
-                        if (getDecodedHeader(imap, res.response, field.c_str(), *(addrTo<MB_String *>(ptr)), caseSensitive))
-                            return;
-                    }
+                    *(addrTo<MB_String *>(ptr)) = fieldValue;
+                    // decode header text
+                    decodeString(imap, *(addrTo<MB_String *>(ptr)));
+                    return;
                 }
             }
         }
+    }
 
-        // parse content type header sub type properties
-        if (res.part.cur_content_hdr == esp_mail_message_part_info_t::content_header_field_type)
-        {
+    // parse content type header sub type properties
+    if (res.part.cur_content_hdr == esp_mail_message_part_info_t::content_header_field_type)
+    {
 
-            if (res.part.msg_type == esp_mail_msg_type_plain || res.part.msg_type == esp_mail_msg_type_enriched)
+        if (res.part.msg_type == esp_mail_msg_type_plain || res.part.msg_type == esp_mail_msg_type_enriched)
+        {
+            MB_String charset;
+            appendLowerCaseString(charset, message_headers[esp_mail_message_header_field_charset].text, false);
+            // We have to check for both quotes string or non quote string
+            if (getPartHeaderProperties(imap, buf, charset.c_str(), esp_mail_str_11 /* "\"" */, false, value, old_value, res.part.stringEnc, caseSensitive))
             {
-                MB_String charset;
-                appendLowerCaseString(charset, message_headers[esp_mail_message_header_field_charset].text, false);
-                // We have to check for both quotes string or non quote string
-                if (getPartHeaderProperties(imap, res.response, charset.c_str(), esp_mail_str_11 /* "\"" */, false, value, old_value, res.part.stringEnc, caseSensitive))
-                {
-                    res.part.charset = value;
-                    resetStringPtr(res.part);
-                }
-                else if (getPartHeaderProperties(imap, res.response, charset.c_str(), esp_mail_str_35 /* ";" */, true, value, old_value, res.part.stringEnc, caseSensitive))
-                {
-                    res.part.charset = value;
-                    resetStringPtr(res.part);
-                }
-
-                if (strposP(res.response, esp_mail_str_59 /* "format=flowed" */, 0, caseSensitive) > -1 || strposP(res.response, esp_mail_str_58 /* "format=\"flowed\"" */, 0, caseSensitive) > -1)
-                {
-                    res.part.plain_flowed = true;
-                    resetStringPtr(res.part);
-                }
-
-                if (strposP(res.response, esp_mail_str_61 /* "delsp=yes" */, 0, caseSensitive) > -1 || strposP(res.response, esp_mail_str_60 /* "delsp=\"yes\"" */, 0, caseSensitive) > -1)
-                {
-                    res.part.plain_delsp = true;
-                    resetStringPtr(res.part);
-                }
+                res.part.charset = value.c_str();
+                resetStringPtr(res.part);
             }
-
-            if (res.part.charset.length() == 0)
+            else if (getPartHeaderProperties(imap, buf, charset.c_str(), esp_mail_str_35 /* ";" */, true, value, old_value, res.part.stringEnc, caseSensitive))
             {
-                MB_String charset;
-                appendLowerCaseString(charset, message_headers[esp_mail_message_header_field_charset].text, false);
-                // We have to check for both quotes string or non quote string
-                if (getPartHeaderProperties(imap, res.response, charset.c_str(), esp_mail_str_11 /* "\"" */, false, value, old_value, res.part.stringEnc, caseSensitive))
-                {
-                    res.part.charset = value;
-                    resetStringPtr(res.part);
-                }
-                else if (getPartHeaderProperties(imap, res.response, charset.c_str(), esp_mail_str_35 /* ";" */, true, value, old_value, res.part.stringEnc, caseSensitive))
-                {
-                    res.part.charset = value;
-                    resetStringPtr(res.part);
-                }
+                res.part.charset = value.c_str();
+                resetStringPtr(res.part);
             }
 
-            MB_String name;
-            appendLowerCaseString(name, message_headers[esp_mail_message_header_field_name].text, false);
-            // We have to check for both quotes string or non quote string
-            if (getPartHeaderProperties(imap, res.response, name.c_str(), esp_mail_str_11 /* "\"" */, false, value, old_value, res.part.stringEnc, caseSensitive))
+            if (strposP(buf, esp_mail_str_59 /* "format=flowed" */, 0, caseSensitive) > -1 || strposP(buf, esp_mail_str_58 /* "format=\"flowed\"" */, 0, caseSensitive) > -1)
             {
-                res.part.stringPtr = toAddr(res.part.name);
-                value.trim();
-                if (value.length() == 0)
-                    return;
+                res.part.plain_flowed = true;
+                resetStringPtr(res.part);
             }
-            else if (getPartHeaderProperties(imap, res.response, name.c_str(), esp_mail_str_35 /* ";" */, true, value, old_value, res.part.stringEnc, caseSensitive))
+
+            if (strposP(buf, esp_mail_str_61 /* "delsp=yes" */, 0, caseSensitive) > -1 || strposP(buf, esp_mail_str_60 /* "delsp=\"yes\"" */, 0, caseSensitive) > -1)
             {
-                res.part.stringPtr = toAddr(res.part.name);
-                value.trim();
-                if (value.length() == 0)
-                    return;
+                res.part.plain_delsp = true;
+                resetStringPtr(res.part);
             }
         }
 
-        // parse content disposition header sub type properties
-        if (res.part.cur_content_hdr == esp_mail_message_part_info_t::content_header_field_disposition && res.part.content_disposition.length() > 0)
+        if (res.part.charset.length() == 0)
         {
-            // filename prop
-            MB_String filename;
-            appendLowerCaseString(filename, message_headers[esp_mail_message_header_field_filename].text, false);
+            MB_String charset;
+            appendLowerCaseString(charset, message_headers[esp_mail_message_header_field_charset].text, false);
             // We have to check for both quotes string or non quote string
-            if (getPartHeaderProperties(imap, res.response, filename.c_str(), esp_mail_str_11 /* "\"" */, false, value, old_value, res.part.stringEnc, caseSensitive))
+            if (getPartHeaderProperties(imap, buf, charset.c_str(), esp_mail_str_11 /* "\"" */, false, value, old_value, res.part.stringEnc, caseSensitive))
             {
-                res.part.stringPtr = toAddr(res.part.filename);
-                value.trim();
-                if (value.length() == 0)
-                    return;
+                res.part.charset = value.c_str();
+                resetStringPtr(res.part);
             }
-            else if (getPartHeaderProperties(imap, res.response, filename.c_str(), esp_mail_str_35 /* ";" */, true, value, old_value, res.part.stringEnc, caseSensitive))
+            else if (getPartHeaderProperties(imap, buf, charset.c_str(), esp_mail_str_35 /* ";" */, true, value, old_value, res.part.stringEnc, caseSensitive))
             {
-                res.part.stringPtr = toAddr(res.part.filename);
-                value.trim();
-                if (value.length() == 0)
-                    return;
+                res.part.charset = value.c_str();
+                resetStringPtr(res.part);
             }
+        }
+
+        MB_String name;
+        appendLowerCaseString(name, message_headers[esp_mail_message_header_field_name].text, false);
+        // We have to check for both quotes string or non quote string
+        if (getPartHeaderProperties(imap, buf, name.c_str(), esp_mail_str_11 /* "\"" */, false, value, old_value, res.part.stringEnc, caseSensitive))
+        {
+            res.part.stringPtr = toAddr(res.part.name);
+            value.trim();
+            if (value.length() == 0)
+                return;
+        }
+        else if (getPartHeaderProperties(imap, buf, name.c_str(), esp_mail_str_35 /* ";" */, true, value, old_value, res.part.stringEnc, caseSensitive))
+        {
+            res.part.stringPtr = toAddr(res.part.name);
+            value.trim();
+            if (value.length() == 0)
+                return;
+        }
+    }
 
-            // size prop
-            MB_String size;
-            appendLowerCaseString(size, message_headers[esp_mail_message_header_field_size].text, false);
+    // parse content disposition header sub type properties
+    if (res.part.cur_content_hdr == esp_mail_message_part_info_t::content_header_field_disposition && res.part.content_disposition.length() > 0)
+    {
+        // filename prop
+        MB_String filename;
+        appendLowerCaseString(filename, message_headers[esp_mail_message_header_field_filename].text, false);
+        // We have to check for both quotes string or non quote string
+        if (getPartHeaderProperties(imap, buf, filename.c_str(), esp_mail_str_11 /* "\"" */, false, value, old_value, res.part.stringEnc, caseSensitive))
+        {
+            res.part.stringPtr = toAddr(res.part.filename);
+            value.trim();
+            if (value.length() == 0)
+                return;
+        }
+        else if (getPartHeaderProperties(imap, buf, filename.c_str(), esp_mail_str_35 /* ";" */, true, value, old_value, res.part.stringEnc, caseSensitive))
+        {
+            res.part.stringPtr = toAddr(res.part.filename);
+            value.trim();
+            if (value.length() == 0)
+                return;
+        }
 
-            if (getPartHeaderProperties(imap, res.response, size.c_str(), esp_mail_str_35 /* ";" */, true, value, old_value, res.part.stringEnc, caseSensitive))
-            {
-                res.part.attach_data_size = atoi(value.c_str());
-                cHeader(imap)->total_attach_data_size += res.part.attach_data_size;
-                res.part.sizeProp = true;
+        // size prop
+        MB_String size;
+        appendLowerCaseString(size, message_headers[esp_mail_message_header_field_size].text, false);
 
-                if (!valueStored && old_value.length() > 0)
-                    valueStored = storeStringPtr(imap, res.part.stringPtr, old_value, res.response);
-                resetStringPtr(res.part);
-            }
+        if (getPartHeaderProperties(imap, buf, size.c_str(), esp_mail_str_35 /* ";" */, true, value, old_value, res.part.stringEnc, caseSensitive))
+        {
+            res.part.attach_data_size = atoi(value.c_str());
+            cHeader(imap)->total_attach_data_size += res.part.attach_data_size;
+            res.part.sizeProp = true;
 
-            // creation date prop
-            MB_String creationDate;
-            appendLowerCaseString(creationDate, message_headers[esp_mail_message_header_field_creation_date].text, false);
+            if (!valueStored && old_value.length() > 0)
+                valueStored = storeStringPtr(imap, res.part.stringPtr, old_value, buf);
+            resetStringPtr(res.part);
+        }
 
-            if (getPartHeaderProperties(imap, res.response, creationDate.c_str(), esp_mail_str_11 /* "\"" */, false, value, old_value, res.part.stringEnc, caseSensitive))
-            {
-                res.part.creation_date = value;
-                if (!valueStored && old_value.length() > 0)
-                    valueStored = storeStringPtr(imap, res.part.stringPtr, old_value, res.response);
-                resetStringPtr(res.part);
-            }
+        // creation date prop
+        MB_String creationDate;
+        appendLowerCaseString(creationDate, message_headers[esp_mail_message_header_field_creation_date].text, false);
 
-            // mod date prop
-            MB_String modDate;
-            appendLowerCaseString(modDate, message_headers[esp_mail_message_header_field_modification_date].text, false);
+        if (getPartHeaderProperties(imap, buf, creationDate.c_str(), esp_mail_str_11 /* "\"" */, false, value, old_value, res.part.stringEnc, caseSensitive))
+        {
+            res.part.creation_date = value;
+            if (!valueStored && old_value.length() > 0)
+                valueStored = storeStringPtr(imap, res.part.stringPtr, old_value, buf);
+            resetStringPtr(res.part);
+        }
 
-            if (getPartHeaderProperties(imap, res.response, modDate.c_str(), esp_mail_str_11 /* "\"" */, false, value, old_value, res.part.stringEnc, caseSensitive))
-            {
-                res.part.modification_date = value;
-                if (!valueStored && old_value.length() > 0)
-                    valueStored = storeStringPtr(imap, res.part.stringPtr, old_value, res.response);
-                resetStringPtr(res.part);
-            }
+        // mod date prop
+        MB_String modDate;
+        appendLowerCaseString(modDate, message_headers[esp_mail_message_header_field_modification_date].text, false);
+
+        if (getPartHeaderProperties(imap, buf, modDate.c_str(), esp_mail_str_11 /* "\"" */, false, value, old_value, res.part.stringEnc, caseSensitive))
+        {
+            res.part.modification_date = value;
+            if (!valueStored && old_value.length() > 0)
+                valueStored = storeStringPtr(imap, res.part.stringPtr, old_value, buf);
+            resetStringPtr(res.part);
+        }
+    }
+
+    if (!valueStored && (res.part.cur_content_hdr == esp_mail_message_part_info_t::content_header_field_description || res.part.cur_content_hdr == esp_mail_message_part_info_t::content_header_field_type || res.part.cur_content_hdr == esp_mail_message_part_info_t::content_header_field_disposition))
+        storeStringPtr(imap, res.part.stringPtr, value, buf);
+}
+
+void ESP_Mail_Client::completePartHeader(IMAPSession *imap, esp_mail_imap_response_data &res)
+{
+    // Is inline attachment without content id or name or filename?
+    // It is supposed to be the inline message txt content, reset attach type to none
+
+    if (res.part.attach_type == esp_mail_att_type_inline && res.part.CID.length() == 0)
+        res.part.attach_type = esp_mail_att_type_none;
+
+    // Is attachment file extension missing?
+    // append extension
+
+    if (res.part.attach_type == esp_mail_att_type_inline || res.part.attach_type == esp_mail_att_type_attachment)
+    {
+        if (res.part.filename.length() > 0 && res.part.filename.find('.') == MB_String::npos)
+        {
+            MB_String ext;
+            getExtfromMIME(res.part.content_type.c_str(), ext);
+            res.part.filename += ext;
         }
 
-        if (!valueStored && (res.part.cur_content_hdr == esp_mail_message_part_info_t::content_header_field_description || res.part.cur_content_hdr == esp_mail_message_part_info_t::content_header_field_type || res.part.cur_content_hdr == esp_mail_message_part_info_t::content_header_field_disposition))
-            storeStringPtr(imap, res.part.stringPtr, value, res.response);
+        checkFirmwareFile(imap, res.part.filename.c_str(), res.part);
     }
 }
 
@@ -2506,24 +2593,16 @@ bool ESP_Mail_Client::getPartHeaderProperties(IMAPSession *imap, const char *buf
                             tmp = buf2;
                         }
                     }
-                    else if (scheme == esp_mail_char_decoding_scheme_iso8859_1)
-                    {
-                        int ilen = strlen(tmp);
-                        int olen = (ilen + 1) * 2;
-                        char *buf2 = allocMem<char *>(olen);
-                        decodeLatin1_UTF8((unsigned char *)buf2, &olen, (unsigned char *)tmp, &ilen);
-                        // release memory and point to new buffer
-                        freeMem(&tmp);
-                        tmp = buf2;
-                    }
-                    else if (scheme == esp_mail_char_decoding_scheme_tis_620 || scheme == esp_mail_char_decoding_scheme_iso8859_11 || scheme == esp_mail_char_decoding_scheme_windows_874)
+                    else
                     {
-                        int ilen = strlen(tmp);
-                        char *buf2 = allocMem<char *>((ilen + 1) * 3);
-                        decodeTIS620_UTF8(buf2, tmp, ilen);
-                        // release memory and point to new buffer
-                        freeMem(&tmp);
-                        tmp = buf2;
+                        size_t olen = 0;
+                        char *buf2 = decodeCharset(scheme, tmp, strlen(tmp), olen);
+                        if (buf2)
+                        {
+                            // release memory and point to new buffer
+                            freeMem(&tmp);
+                            tmp = buf2;
+                        }
                     }
                 }
             }
@@ -2595,6 +2674,9 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
     esp_mail_imap_response_data res(imap->client.available());
     imap->_lastProgress = -1;
 
+    // Free the response buffer grown by the overflown lines when the response is handled
+    Session_Buffer_Limit respLimit(imap->_respBuf, imap->_respBufSize + 1);
+
     // Flag used for CRLF inclusion in response reading in case 8bit/binary attachment and base64 encoded and binary messages
     bool withLineBreak = imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_text && (cPart(imap)->xencoding == esp_mail_msg_xencoding_base64 || cPart(imap)->xencoding == esp_mail_msg_xencoding_binary);
     withLineBreak |= imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_attachment && cPart(imap)->xencoding != esp_mail_msg_xencoding_base64;
@@ -2649,12 +2731,22 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
             imap->_imap_msg_num.clear();
         }
 
-        // response buffer
-        res.chunkBufSize = ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE;
-        res.response = allocMem<char *>(res.chunkBufSize + 1);
+        // The response buffers of session are reused
+        res.chunkBufSize = imap->_respBufSize;
+        res.response = reuseMem<char *>(imap->_respBuf, res.chunkBufSize + 1);
 
         if (imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_attachment || imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_inline)
-            res.lastBuf = allocMem<char *>(BASE64_CHUNKED_LEN + 1);
+            res.lastBuf = reuseMem<char *>(imap->_lastBuf, BASE64_CHUNKED_LEN + 1);
+
+        // The mailbox list, status and header fields (message and part MIME headers) fetch responses are parsed incrementally by tokenizer
+        bool tokenized = imap->_imap_cmd == esp_mail_imap_cmd_list || imap->_imap_cmd == esp_mail_imap_cmd_lsub || imap->_imap_cmd == esp_mail_imap_cmd_status;
+        tokenized |= imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_header || imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_mime;
+
+        if (tokenized)
+        {
+            res.session = imap;
+            res.tokenizer.begin(imapTokenCallback, &res);
+        }
 
         while (!res.completedResponse) // looking for operation finishing
         {
@@ -2695,7 +2787,10 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
 
             if (res.chunkBufSize > 0)
             {
-                res.chunkBufSize = ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE;
+                res.chunkBufSize = imap->_respBufSize;
+
+                // The literal data of BINARY fetch
+                bool rawLiteral = imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_attachment && (cPart(imap)->binary_fetch || cPart(imap)->range_fetch) && res.chunkIdx > 0 && res.octetCount < res.octetLength;
 
                 if (imap->_imap_cmd == esp_mail_imap_cmd_search)
                 {
@@ -2717,6 +2812,57 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
                         }
                     }
                 }
+                else if (tokenized)
+                {
+                    // Read the available data as is, the quoted strings and literals can span across the chunks
+                    int len = imap->client.available();
+                    if (len > res.chunkBufSize)
+                        len = res.chunkBufSize;
+
+                    res.readLen = imap->client.readBytes(res.response, len);
+                    if (res.readLen < 0)
+                        res.readLen = 0;
+
+                    if (res.readLen > 0)
+                    {
+                        if (imap->_debug && imap->_debugLevel > esp_mail_debug_level_basic && !imap->_customCmdResCallback)
+                            esp_mail_debug_print((const char *)res.response, false);
+
+                        res.tokenizer.feed(res.response, res.readLen);
+                        res.imapResp = res.tokenResp;
+                    }
+                }
+                else if (rawLiteral)
+                {
+                    // BINARY literal data read as is, the binary data can contain CR, LF or NUL
+                    int len = res.octetLength - res.octetCount;
+                    if (len > res.chunkBufSize)
+                        len = res.chunkBufSize;
+
+                    res.readLen = imap->client.readBytes(res.response, len);
+                    if (res.readLen < 0)
+                        res.readLen = 0;
+
+                    res.octetCount += res.readLen;
+
+                    if (cPart(imap)->range_fetch)
+                    {
+                        if (cPart(imap)->xencoding == esp_mail_msg_xencoding_base64)
+                        {
+                            res.readLen = decodeRangeBase64(imap, res, res.readLen);
+                            cPart(imap)->range_tail = res.b64CarryLen > 0 ? res.octetLength - res.b64CarryPos : 0;
+                        }
+
+                        // Discard the data that already written before resume
+                        if (cPart(imap)->range_skip > 0 && res.readLen > 0)
+                        {
+                            int n = cPart(imap)->range_skip < res.readLen ? cPart(imap)->range_skip : res.readLen;
+                            memmove(res.response, res.response + n, res.readLen - n);
+                            res.readLen -= n;
+                            cPart(imap)->range_skip -= n;
+                        }
+                    }
+                }
                 else
                 {
                     // response read as chunk ended with CRLF or complete buffer size
@@ -2732,9 +2878,7 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
                     // If buffer overflown, copy from overflow buffer
                     if (ovfBuf.length() > 0)
                     {
-                        // release memory
-                        freeMem(&res.response);
-                        res.response = allocMem<char *>(ovfBuf.length() + 1);
+                        res.response = reuseMem<char *>(imap->_respBuf, ovfBuf.length() + 1);
                         strcpy(res.response, ovfBuf.c_str());
                         ovfBuf.clear();
                     }
@@ -2748,16 +2892,22 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
 
                 if (res.readLen)
                 {
-                    if (imap->_debug && imap->_debugLevel > esp_mail_debug_level_basic && !imap->_customCmdResCallback)
+                    if (imap->_debug && imap->_debugLevel > esp_mail_debug_level_basic && !imap->_customCmdResCallback && !tokenized)
                     {
                         if (imap->_imap_cmd != esp_mail_imap_cmd_search && imap->_imap_cmd != esp_mail_imap_cmd_fetch_body_text && imap->_imap_cmd != esp_mail_imap_cmd_fetch_body_attachment && imap->_imap_cmd != esp_mail_imap_cmd_fetch_body_inline)
                             esp_mail_debug_print((const char *)res.response, true);
                     }
 
-                    if (imap->_imap_cmd != esp_mail_imap_cmd_search || (imap->_imap_cmd == esp_mail_imap_cmd_search && res.endSearch))
+                    if (!rawLiteral && !tokenized && (imap->_imap_cmd != esp_mail_imap_cmd_search || (imap->_imap_cmd == esp_mail_imap_cmd_search && res.endSearch)))
                         res.imapResp = imapResponseStatus(imap, res.response, esp_mail_imap_tag_str);
 
-                    if (res.imapResp != esp_mail_imap_resp_unknown)
+                    // Wait for the tagged responses of all pipelined commands
+                    if (res.imapResp != esp_mail_imap_resp_unknown && imap->_pipelined_cmd_count > 1)
+                    {
+                        imap->_pipelined_cmd_count--;
+                        res.imapResp = esp_mail_imap_resp_unknown;
+                    }
+                    else if (res.imapResp != esp_mail_imap_resp_unknown)
                     {
 
                         // We've got the right response,
@@ -2784,9 +2934,7 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
                             // If buffer overflown, copy from overflow buffer
                             if (ovfBuf.length() > 0)
                             {
-                                // release memory
-                                freeMem(&res.response);
-                                res.response = allocMem<char *>(ovfBuf.length() + 1);
+                                res.response = reuseMem<char *>(imap->_respBuf, ovfBuf.length() + 1);
                                 strcpy(res.response, ovfBuf.c_str());
                                 ovfBuf.clear();
                             }
@@ -2851,10 +2999,6 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
                         }
                         else if (imap->_imap_cmd == esp_mail_imap_cmd_capability)
                             parseCapabilityResponse(imap, res.response, res.chunkIdx);
-                        else if (imap->_imap_cmd == esp_mail_imap_cmd_list)
-                            parseFoldersResponse(imap, res.response, true);
-                        else if (imap->_imap_cmd == esp_mail_imap_cmd_lsub)
-                            parseFoldersResponse(imap, res.response, false);
                         else if (imap->_imap_cmd == esp_mail_imap_cmd_select || imap->_imap_cmd == esp_mail_imap_cmd_examine)
                             parseExamineResponse(imap, res.response);
                         else if (imap->_imap_cmd == esp_mail_imap_cmd_get_uid)
@@ -2869,6 +3013,8 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
                             appendFetchString(str, false);
                             parseCmdResponse(imap, res.response, str.c_str());
                         }
+                        else if (imap->_imap_cmd == esp_mail_imap_cmd_get_cached_flags)
+                            parseHeaderCacheFlags(imap, res.response);
                         else if (imap->_imap_cmd == esp_mail_imap_cmd_get_quota)
                             parseCmdResponse(imap, res.response, imap_responses[esp_mail_imap_response_quota].text);
                         else if (imap->_imap_cmd == esp_mail_imap_cmd_id)
@@ -2901,32 +3047,19 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
                             appendFetchString(str, true);
                             parseCmdResponse(imap, res.response, str.c_str());
                         }
-                        else if (imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_header)
-                        {
-
-                            if (res.headerState == 0 && cMSG(imap).type == esp_mail_imap_msg_num_type_uid)
-                                res.header.message_uid = cMSG(imap).value;
-
-                            int _st = res.headerState;
-                            parseHeaderResponse(imap, res, imap->_imap_data->enable.header_case_sensitive);
-                            if (_st == res.headerState && res.headerState > 0 && res.octetCount <= res.header.header_data_len)
-                                collectHeaderField(imap, res.response, res.header, res.headerState);
-                        }
-                        else if (imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_mime)
-                            parsePartHeaderResponse(imap, res, imap->_imap_data->enable.header_case_sensitive);
                         else if (imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_text)
                             decodeText(imap, res);
                         else if (imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_attachment || imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_inline)
                         {
 
-                            if (cPart(imap)->xencoding == esp_mail_msg_xencoding_base64)
+                            if (cPart(imap)->xencoding == esp_mail_msg_xencoding_base64 && !rawLiteral)
                             {
                                 // Multi-line chunked base64 string attachment handle
                                 if (res.octetCount < res.octetLength && res.readLen < BASE64_CHUNKED_LEN)
                                 {
                                     if (strlen(res.lastBuf) > 0)
                                     {
-                                        res.buf = allocMem<char *>(res.readLen + strlen(res.lastBuf) + 2);
+                                        res.buf = allocMem<char *>(res.readLen + strlen(res.lastBuf) + 2, true, esp_mail_mem_purpose_decoded_body);
                                         strcpy(res.buf, res.lastBuf);
                                         strcat(res.buf, res.response);
                                         res.readLen = strlen(res.buf);
@@ -2980,10 +3113,13 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
 
 #if !defined(SILENT_MODE)
 
-        if (imap->_statusCallback && imap->_imap_cmd != esp_mail_imap_cmd_fetch_body_mime)
+        // The failed BINARY fetch will be retried without error report.
+        bool report = imap->_imap_cmd != esp_mail_imap_cmd_fetch_body_mime && !(imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_attachment && cPart(imap)->binary_fetch);
+
+        if (imap->_statusCallback && report)
             sendErrorCB<IMAPSession *>(imap, imap->errorReason().c_str(), false, false);
 
-        if (imap->_debug && imap->_imap_cmd != esp_mail_imap_cmd_fetch_body_mime)
+        if (imap->_debug && report)
             esp_mail_debug_print_tag(imap->errorReason().c_str(), esp_mail_debug_tag_type_error, true);
 
 #endif
@@ -3100,7 +3236,7 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
                     decodeString(imap, res.header.header_fields.header_items[i]);
             }
 
-            imap->_headers.push_back(res.header);
+            imap->_headers.push_back(std::move(res.header));
         }
 
         if (imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_mime)
@@ -3185,48 +3321,48 @@ bool ESP_Mail_Client::handleIMAPResponse(IMAPSession *imap, int errCode, bool cl
     return true;
 }
 
-void ESP_Mail_Client::addHeader(MB_String &s, PGM_P name, const char *s_value, int num_value, bool trim, bool isJson)
+void ESP_Mail_Client::addHeader(Header_Writer &w, PGM_P name, const char *s_value, int num_value, bool trim, bool isJson)
 {
+    bool next = w.nextField();
+
     if (isJson)
     {
-        s += (s.length() > 0) ? esp_mail_str_77 /* ",\"" */ : esp_mail_str_78 /* "{\"" */;
-        s += name;
+        w.printP(next ? esp_mail_str_77 /* ",\"" */ : esp_mail_str_78 /* "{\"" */);
+        w.printP(name);
 
         if (strlen(s_value) > 0)
         {
-            s += esp_mail_str_79; /* "\":\"" */
-            ;
-            if (trim)
-            {
-                MB_String t = s_value;
-                t.replaceAll("\"", "");
-                s += t;
-            }
-            else
-                s += s_value;
-            s += esp_mail_str_11; /* "\"" */
+            w.printP(esp_mail_str_79); /* "\":\"" */
+            w.printEscaped(s_value, trim);
+            w.printP(esp_mail_str_11); /* "\"" */
         }
         else
         {
-            s += esp_mail_str_34 /* ":" */;
-            appendSpace(s);
-            s += num_value;
+            w.printP(esp_mail_str_34); /* ":" */
+            w.write(' ');
+            w.print(num_value);
         }
     }
     else
     {
-        if (s.length() > 0)
-            appendNewline(s);
-        s += name;
-        s += esp_mail_str_34 /* ":" */;
-        appendSpace(s);
+        if (next)
+            w.write("\r\n", 2);
+        w.printP(name);
+        w.printP(esp_mail_str_34); /* ":" */
+        w.write(' ');
         if (strlen(s_value) > 0)
-            s += s_value;
+            w.print(s_value);
         else
-            s += num_value;
+            w.print(num_value);
     }
 }
 
+void ESP_Mail_Client::headerWriterCallback(void *param, const char *data, size_t len)
+{
+    IMAPSession *imap = reinterpret_cast<IMAPSession *>(param);
+    MailClient.mbfs->write(mbfs_type imap->_imap_data->storage.type, (uint8_t *)data, len);
+}
+
 void ESP_Mail_Client::saveHeader(IMAPSession *imap, bool json)
 {
     if (!imap->_storageReady)
@@ -3238,7 +3374,7 @@ void ESP_Mail_Client::saveHeader(IMAPSession *imap, bool json)
 
     headerFilePath += json ? esp_mail_str_65 /* "/header.json" */ : esp_mail_str_66 /* "/header.txt" */;
 
-    prepareFileList(imap, headerFilePath);
+    prepareFileList(imap, headerFilePath, false);
 
     int sz = mbfs->open(headerFilePath, mbfs_type imap->_imap_data->storage.type, mb_fs_open_mode_write);
     if (sz < 0)
@@ -3254,60 +3390,59 @@ void ESP_Mail_Client::saveHeader(IMAPSession *imap, bool json)
         return;
     }
 
-    MB_String s;
+    // The header records are written to file through the small buffer
+    Header_Writer w;
+    w.begin(headerWriterCallback, imap);
+
     for (size_t i = 0; i < imap->_headers.size(); i++)
-        addHeaderItem(s, &imap->_headers[i], json);
+    {
+        if (json)
+            w.printP(i > 0 ? esp_mail_str_8 /* "," */ : esp_mail_str_76 /* "{\"Messages\":[" */);
 
-    if (json)
-        s += esp_mail_str_75; /* "]}" */
+        addHeaderItem(w, &imap->_headers[i], json);
+    }
 
-    mbfs->print(mbfs_type imap->_imap_data->storage.type, s.c_str());
+    if (json)
+    {
+        if (imap->_headers.size() == 0)
+            w.printP(esp_mail_str_76); /* "{\"Messages\":[" */
+        w.printP(esp_mail_str_75); /* "]}" */
+    }
+
+    w.flush();
+    addDownloadFileSize(imap, w.length());
 
     mbfs->close(mbfs_type imap->_imap_data->storage.type);
 
     imap->_headerSaved = true;
 }
 
-void ESP_Mail_Client::addHeaderItem(MB_String &str, esp_mail_message_header_t *header, bool json)
+void ESP_Mail_Client::addHeaderItem(Header_Writer &w, esp_mail_message_header_t *header, bool json)
 {
-    MB_String s;
-    if (json)
-    {
-        if (str.length() > 0)
-            str += esp_mail_str_8; /* "," */
-        else
-            str = esp_mail_str_76; /* "{\"Messages\":[" */
-    }
+    w.beginFields();
 
-    addHeader(s, message_headers[esp_mail_message_header_field_number].text, "", header->message_no, false, json);
-    addHeader(s, message_headers[esp_mail_message_header_field_uid].text, "", header->message_uid, false, json);
+    addHeader(w, message_headers[esp_mail_message_header_field_number].text, "", header->message_no, false, json);
+    addHeader(w, message_headers[esp_mail_message_header_field_uid].text, "", header->message_uid, false, json);
 
     if (header->accept_language.length() > 0)
-        addHeader(s, message_headers[esp_mail_message_header_field_accept_language].text, header->accept_language.c_str(), 0, false, json);
+        addHeader(w, message_headers[esp_mail_message_header_field_accept_language].text, header->accept_language.c_str(), 0, false, json);
 
     if (header->content_language.length() > 0)
-        addHeader(s, message_headers[esp_mail_message_header_field_content_language].text, header->content_language.c_str(), 0, false, json);
+        addHeader(w, message_headers[esp_mail_message_header_field_content_language].text, header->content_language.c_str(), 0, false, json);
 
-    addRFC822Headers(s, &header->header_fields, json);
+    addRFC822Headers(w, &header->header_fields, json);
 
     for (size_t j = 0; j < header->part_headers.size(); j++)
     {
         if (header->part_headers[j].rfc822_part)
         {
-            MB_String s1;
-            addRFC822Headers(s1, &header->part_headers[j].rfc822_header, json);
+            w.printP(json ? esp_mail_str_69 /* ",\"RFC822\":" */ : esp_mail_str_70 /* "\r\n\r\nRFC822:\r\n" */);
+
+            w.beginFields();
+            addRFC822Headers(w, header->part_headers[j].rfc822Header(true), json);
 
             if (json)
-            {
-                s += esp_mail_str_69; /* ",\"RFC822\":" */
-                s += s1;
-                s += esp_mail_str_36; /* "}" */
-            }
-            else
-            {
-                s += esp_mail_str_70; /* "\r\n\r\nRFC822:\r\n" */
-                s += s1;
-            }
+                w.printP(esp_mail_str_36); /* "}" */
         }
     }
 
@@ -3315,15 +3450,15 @@ void ESP_Mail_Client::addHeaderItem(MB_String &str, esp_mail_message_header_t *h
     {
         if (json)
         {
-            s += esp_mail_str_71 /* ",\"Attachments\":{\"Count\":" */;
-            s += header->attachment_count;
-            s += esp_mail_str_72; /* ",\"Files\":[" */
+            w.printP(esp_mail_str_71); /* ",\"Attachments\":{\"Count\":" */
+            w.print(header->attachment_count);
+            w.printP(esp_mail_str_72); /* ",\"Files\":[" */
         }
         else
         {
-            s += esp_mail_str_73; /* "\r\n\r\nAttachments (" */
-            s += header->attachment_count;
-            s += esp_mail_str_74; /* ")\r\n" */
+            w.printP(esp_mail_str_73); /* "\r\n\r\nAttachments (" */
+            w.print(header->attachment_count);
+            w.printP(esp_mail_str_74); /* ")\r\n" */
         }
 
         int index = 0;
@@ -3336,44 +3471,38 @@ void ESP_Mail_Client::addHeaderItem(MB_String &str, esp_mail_message_header_t *h
             if (json)
             {
                 if (index > 0)
-                    s += esp_mail_str_8; /* "," */
-                s += esp_mail_str_67;    /* /"{\"Filename\":\"" */
-                s += header->part_headers[j].filename;
-                s += esp_mail_str_11; /* "\"" */
+                    w.printP(esp_mail_str_8); /* "," */
+                w.beginFields();
             }
             else
             {
                 if (index > 0)
-                    appendNewline(s);
-                appendNewline(s);
-                s += esp_mail_str_68; /* /"Index: " */
-                s += index + 1;
-                addHeader(s, message_headers[esp_mail_message_header_field_filename].text, header->part_headers[j].filename.c_str(), 0, false, json);
+                    w.write("\r\n", 2);
+                w.write("\r\n", 2);
+                w.printP(esp_mail_str_68); /* "Index: " */
+                w.print(index + 1);
             }
 
-            addHeader(s, message_headers[esp_mail_message_header_field_name].text, header->part_headers[j].name.c_str(), 0, false, json);
-            addHeader(s, message_headers[esp_mail_message_header_field_size].text, "", header->part_headers[j].attach_data_size, false, json);
-            addHeader(s, message_headers[esp_mail_message_header_field_mime].text, header->part_headers[j].content_type.c_str(), 0, false, json);
-            addHeader(s, message_headers[esp_mail_message_header_field_type].text, header->part_headers[j].attach_type == esp_mail_att_type_attachment ? esp_mail_content_disposition_type_t::attachment : esp_mail_content_disposition_type_t::inline_, 0, false, json);
-            addHeader(s, message_headers[esp_mail_message_header_field_description].text, header->part_headers[j].content_description.c_str(), 0, false, json);
-            addHeader(s, message_headers[esp_mail_message_header_field_creation_date].text, header->part_headers[j].creation_date.c_str(), 0, false, json);
+            addHeader(w, message_headers[esp_mail_message_header_field_filename].text, header->part_headers[j].filename.c_str(), 0, false, json);
+            addHeader(w, message_headers[esp_mail_message_header_field_name].text, header->part_headers[j].name.c_str(), 0, false, json);
+            addHeader(w, message_headers[esp_mail_message_header_field_size].text, "", header->part_headers[j].attach_data_size, false, json);
+            addHeader(w, message_headers[esp_mail_message_header_field_mime].text, header->part_headers[j].content_type.c_str(), 0, false, json);
+            addHeader(w, message_headers[esp_mail_message_header_field_type].text, header->part_headers[j].attach_type == esp_mail_att_type_attachment ? esp_mail_content_disposition_type_t::attachment : esp_mail_content_disposition_type_t::inline_, 0, false, json);
+            addHeader(w, message_headers[esp_mail_message_header_field_description].text, header->part_headers[j].content_description.c_str(), 0, false, json);
+            addHeader(w, message_headers[esp_mail_message_header_field_creation_date].text, header->part_headers[j].creation_date.c_str(), 0, false, json);
 
             if (json)
-                s += esp_mail_str_36; /* "}" */
+                w.printP(esp_mail_str_36); /* "}" */
 
             index++;
         }
 
         if (json)
-            s += esp_mail_str_75; /* "]}" */
+            w.printP(esp_mail_str_75); /* "]}" */
     }
 
     if (json)
-    {
-        s += esp_mail_str_36; /* "}" */
-    }
-
-    str += s;
+        w.printP(esp_mail_str_36); /* "}" */
 }
 
 int ESP_Mail_Client::getRFC822HeaderPtr(int index, esp_mail_imap_rfc822_msg_header_item_t *header)
@@ -3383,17 +3512,498 @@ int ESP_Mail_Client::getRFC822HeaderPtr(int index, esp_mail_imap_rfc822_msg_head
     return 0;
 }
 
-void ESP_Mail_Client::addRFC822Headers(MB_String &s, esp_mail_imap_rfc822_msg_header_item_t *header, bool json)
+void ESP_Mail_Client::addRFC822Headers(Header_Writer &w, esp_mail_imap_rfc822_msg_header_item_t *header, bool json)
 {
     for (int i = esp_mail_rfc822_header_field_from; i < esp_mail_rfc822_header_field_maxType; i++)
-        addRFC822HeaderItem(s, header, i, json);
+        addRFC822HeaderItem(w, header, i, json);
 }
 
-void ESP_Mail_Client::addRFC822HeaderItem(MB_String &s, esp_mail_imap_rfc822_msg_header_item_t *header, int index, bool json)
+void ESP_Mail_Client::addRFC822HeaderItem(Header_Writer &w, esp_mail_imap_rfc822_msg_header_item_t *header, int index, bool json)
 {
     int ptr = getRFC822HeaderPtr(index, header);
     if (ptr > 0)
-        addHeader(s, rfc822_headers[index].text, addrTo<MB_String *>(ptr)->c_str(), 0, rfc822_headers[index].trim, json);
+        addHeader(w, rfc822_headers[index].text, addrTo<MB_String *>(ptr)->c_str(), 0, rfc822_headers[index].trim, json);
+}
+
+void ESP_Mail_Client::getHeaderCachePath(IMAPSession *imap, MB_String &path)
+{
+    path = imap->_imap_data->storage.saved_path;
+    if (path.length() > 0 && path[path.length() - 1] == '/')
+        path.erase(path.length() - 1, 1);
+
+    // Use the CRC of folder name as file name which is also valid for short file name filesystem
+    path += esp_mail_str_100; /* "/hcache/" */
+    path += (int)mbfs->calCRC(imap->_currentFolder.c_str());
+}
+
+bool ESP_Mail_Client::headerCacheReady(IMAPSession *imap)
+{
+    if (!imap->_imap_data->enable.header_cache || !imap->_storageReady || imap->_mbif._uidValidity == 0)
+        return false;
+
+    if (imap->_hc.ready() && imap->_hcUIDValidity == imap->_mbif._uidValidity && strcmp(imap->_hcFolder.c_str(), imap->_currentFolder.c_str()) == 0)
+        return true;
+
+    // The pending UIDs of the previous mailbox or UIDVALIDITY are discarded
+    imap->_hcFlags.clear();
+    imap->_hcFolder.clear();
+    imap->_hcUIDValidity = 0;
+
+    MB_String path;
+    getHeaderCachePath(imap, path);
+
+    if (!imap->_hc.begin(mbfs, mbfs_type imap->_imap_data->storage.type, path, imap->_mbif._uidValidity))
+        return false;
+
+    imap->_hcFolder = imap->_currentFolder;
+    imap->_hcUIDValidity = imap->_mbif._uidValidity;
+
+    return true;
+}
+
+bool ESP_Mail_Client::findHeaderCache(IMAPSession *imap, uint32_t uid, struct header_cache_index_t &item)
+{
+    return headerCacheReady(imap) && imap->_hc.find(uid, item);
+}
+
+void ESP_Mail_Client::fetchHeaderCacheFlags(IMAPSession *imap)
+{
+    imap->_hcFlags.clear();
+
+    // The cached header can be used only when the message UID is known
+    // and no CHANGEDSINCE conditional test is required.
+    if (!headerCacheReady(imap) || (imap->_imap_data->fetch.modsequence > 0 && imap->isModseqSupported()))
+        return;
+
+    IMAP_Cmd cmd({esp_mail_imap_tag_str, imap_commands[esp_mail_imap_command_uid].text, imap_commands[esp_mail_imap_command_fetch].text});
+    char num[11];
+
+    for (size_t i = 0; i < imap->_imap_msg_num.size(); i++)
+    {
+        struct esp_mail_imap_header_cache_flags_t cached;
+        if ((!imap->_uidSearch && imap->_imap_msg_num[i].type != esp_mail_imap_msg_num_type_uid) || !findHeaderCache(imap, imap->_imap_msg_num[i].value, cached.item))
+            continue;
+
+        // The UID set e.g. 345,350,351
+        if (imap->_hcFlags.size() > 0)
+            cmd.append({esp_mail_str_8 /* "," */, IMAP_Cmd::num(num, cached.item.uid)});
+        else
+            cmd.join({IMAP_Cmd::num(num, cached.item.uid)});
+
+        imap->_hcFlags.push_back(cached);
+    }
+
+    if (imap->_hcFlags.size() == 0)
+        return;
+
+    cmd.append({esp_mail_str_2 /* " " */, esp_mail_str_38 /* "(" */, imap_commands[esp_mail_imap_command_uid].text, esp_mail_str_2 /* " " */,
+                imap_commands[esp_mail_imap_command_flags].text, esp_mail_str_39 /* ")" */});
+
+    // The cached UID that was expunged has no FETCH response, its message number remains 0.
+    // The cached headers are not used when the flags could not be fetched.
+    if (imapSend(imap, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
+    {
+        imap->_hcFlags.clear();
+        return;
+    }
+
+    imap->_imap_cmd = esp_mail_imap_cmd_get_cached_flags;
+    if (!handleIMAPResponse(imap, IMAP_STATUS_BAD_COMMAND, false))
+        imap->_hcFlags.clear();
+}
+
+int ESP_Mail_Client::getHeaderCacheFlags(IMAPSession *imap, uint32_t uid)
+{
+    for (size_t i = 0; i < imap->_hcFlags.size(); i++)
+    {
+        if (imap->_hcFlags[i].item.uid == uid)
+            return i;
+    }
+    return -1;
+}
+
+void ESP_Mail_Client::parseHeaderCacheFlags(IMAPSession *imap, char *buf)
+{
+    // The untagged response e.g. * 12 FETCH (UID 345 FLAGS (\Seen))
+    if (buf[0] != '*')
+        return;
+
+    MB_String uidToken, flagsToken;
+    appendFetchString(uidToken, true);
+    appendFetchString(flagsToken, false);
+
+    int p1 = strposP(buf, uidToken.c_str(), 0);
+    int p2 = strposP(buf, flagsToken.c_str(), 0);
+    if (p1 == -1 || p2 == -1)
+        return;
+
+    p2 += flagsToken.length();
+    int p3 = strposP(buf, esp_mail_str_39 /* ")" */, p2);
+    if (p3 == -1)
+        return;
+
+    uint32_t uid = atoi(buf + p1 + uidToken.length());
+
+    for (size_t i = 0; i < imap->_hcFlags.size(); i++)
+    {
+        if (imap->_hcFlags[i].item.uid == uid)
+        {
+            imap->_hcFlags[i].msg_no = atoi(&buf[2]);
+            imap->_hcFlags[i].flags.clear();
+            imap->_hcFlags[i].flags.append(buf + p2, p3 - p2);
+        }
+    }
+}
+
+bool ESP_Mail_Client::readHeaderCache(IMAPSession *imap, const struct header_cache_index_t &item)
+{
+    struct esp_mail_message_header_t header;
+
+    // Record: UID, header data length, flags and sub types, RFC822 header fields and the MIME header fields
+    uint32_t values[2];
+    MB_String *strings[esp_mail_rfc822_header_field_maxType + 7];
+
+    for (int i = 0; i < esp_mail_rfc822_header_field_maxType; i++)
+        strings[i] = &header.header_fields.header_items[i];
+
+    MB_String *mime[] = {&header.content_type, &header.content_transfer_encoding, &header.boundary, &header.accept_language,
+                         &header.content_language, &header.char_set, &header.msgID};
+    memcpy(strings + esp_mail_rfc822_header_field_maxType, mime, sizeof(mime));
+
+    if (!imap->_hc.read(item, values, 2, strings, esp_mail_rfc822_header_field_maxType + 7))
+        return false;
+
+    header.message_uid = item.uid;
+    header.header_data_len = values[0];
+    header.multipart = values[1] & 0x01;
+    header.rfc822_part = values[1] & 0x02;
+    header.hasAttachment = values[1] & 0x04;
+    header.multipart_sub_type = (esp_mail_imap_multipart_sub_type)((values[1] >> 8) & 0xff);
+    header.message_sub_type = (esp_mail_imap_message_sub_type)((values[1] >> 16) & 0xff);
+
+    imap->_headers.push_back(std::move(header));
+
+    return true;
+}
+
+void ESP_Mail_Client::writeHeaderCache(IMAPSession *imap, esp_mail_message_header_t *header)
+{
+    if (!header || header->message_uid == 0 || !headerCacheReady(imap))
+        return;
+
+    uint32_t values[2] = {(uint32_t)header->header_data_len,
+                          (header->multipart ? 0x01 : 0) | (header->rfc822_part ? 0x02 : 0) | (header->hasAttachment ? 0x04 : 0) | ((uint32_t)header->multipart_sub_type << 8) | ((uint32_t)header->message_sub_type << 16)};
+
+    const MB_String *strings[esp_mail_rfc822_header_field_maxType + 7];
+
+    for (int i = 0; i < esp_mail_rfc822_header_field_maxType; i++)
+        strings[i] = &header->header_fields.header_items[i];
+
+    const MB_String *mime[] = {&header->content_type, &header->content_transfer_encoding, &header->boundary, &header->accept_language,
+                               &header->content_language, &header->char_set, &header->msgID};
+    memcpy(strings + esp_mail_rfc822_header_field_maxType, mime, sizeof(mime));
+
+    // The UID that was already cached is not written again
+    imap->_hc.write(header->message_uid, values, 2, strings, esp_mail_rfc822_header_field_maxType + 7);
+}
+
+void ESP_Mail_Client::writeCacheValue(esp_mail_file_storage_type type, uint32_t value)
+{
+    uint8_t buf[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    mbfs->write(mbfs_type type, buf, 4);
+}
+
+void ESP_Mail_Client::writeCacheString(esp_mail_file_storage_type type, const MB_String &str)
+{
+    size_t len = str.length() > 0xffff ? 0xffff : str.length();
+    uint8_t buf[2] = {(uint8_t)len, (uint8_t)(len >> 8)};
+    mbfs->write(mbfs_type type, buf, 2);
+    if (len > 0)
+        mbfs->write(mbfs_type type, (uint8_t *)str.c_str(), len);
+}
+
+bool ESP_Mail_Client::readCacheValue(esp_mail_file_storage_type type, uint32_t &value)
+{
+    uint8_t buf[4];
+    if (mbfs->read(mbfs_type type, buf, 4) != 4)
+        return false;
+    value = (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24);
+    return true;
+}
+
+bool ESP_Mail_Client::readCacheString(esp_mail_file_storage_type type, MB_String &str)
+{
+    uint8_t buf[2];
+    if (mbfs->read(mbfs_type type, buf, 2) != 2)
+        return false;
+
+    size_t len = buf[0] | (buf[1] << 8);
+    str.clear();
+    if (len == 0)
+        return true;
+
+    char *tmp = allocMem<char *>(len + 1);
+    bool ret = mbfs->read(mbfs_type type, (uint8_t *)tmp, len) == (int)len;
+    if (ret)
+        str = tmp;
+    // release memory
+    freeMem(&tmp);
+    return ret;
+}
+
+bool ESP_Mail_Client::fetchAttachmentRanges(IMAPSession *imap, int msgIdx, bool closeSession)
+{
+    esp_mail_file_storage_type type = imap->_imap_data->storage.type;
+
+    MB_String filePath = imap->_imap_data->storage.saved_path;
+    filePath += esp_mail_str_10; /* "/" */
+    filePath += cHeader(imap)->message_uid;
+    filePath += esp_mail_str_10; /* "/" */
+    filePath += cPart(imap)->filename;
+
+    prepareFileList(imap, filePath);
+
+    MB_String rangePath = filePath;
+    rangePath += esp_mail_str_105; /* ".rng" */
+
+    uint32_t offset = 0, size = 0;
+
+    beginAttachmentDigest(imap);
+
+    if (readRangeProgress(imap, rangePath, offset, size))
+    {
+        // The file may contain the data of incompleted range after the last progress saved.
+        int sz = mbfs->open(filePath, mbfs_type type, mb_fs_open_mode_read);
+
+        // The data that already written is read back once to continue the digest
+        if (cPart(imap)->digest && sz >= (int)size && sz > 0)
+        {
+            uint8_t *buf = allocMem<uint8_t *>(ESP_MAIL_CLIENT_STREAM_CHUNK_SIZE, true, esp_mail_mem_purpose_attachment_staging);
+            int readLen = 0;
+            while ((readLen = mbfs->read(mbfs_type type, buf, ESP_MAIL_CLIENT_STREAM_CHUNK_SIZE)) > 0)
+                updateAttachmentDigest(imap, buf, readLen);
+            // release memory
+            freeMem(&buf);
+        }
+
+        mbfs->close(mbfs_type type);
+
+        if (sz < (int)size)
+            offset = size = 0;
+        else
+        {
+            cPart(imap)->range_skip = sz - size;
+            // The data that already written
+            addDownloadFileSize(imap, sz);
+        }
+    }
+
+    cPart(imap)->range_fetch = true;
+    cPart(imap)->range_offset = offset;
+    // The BINARY content size is the decoded size
+    cPart(imap)->range_size = cPart(imap)->binary_fetch ? (cPart(imap)->sizeProp ? cPart(imap)->attach_data_size : cPart(imap)->octetLen * 3 / 4) : cPart(imap)->octetLen;
+    cHeader(imap)->total_download_size += cPart(imap)->octetLen;
+    imap->_lastProgress = -1;
+
+    int chunkSize = imap->_rangeChunkSize;
+    bool ret = true;
+
+    while (ret)
+    {
+        if (mbfs->open(filePath, mbfs_type type, offset > 0 ? mb_fs_open_mode_append : mb_fs_open_mode_write) < 0)
+        {
+            ret = false;
+            break;
+        }
+
+        cPart(imap)->file_open_write = true;
+        cPart(imap)->range_offset = offset;
+        cPart(imap)->range_length = 0;
+        cPart(imap)->range_tail = 0;
+
+        IMAP_Cmd cmd;
+        char num1[11], num2[11];
+        appendHeadersFetchCommand(imap, cmd, msgIdx, false, cPart(imap)->binary_fetch);
+        cmd.append({esp_mail_str_40 /* "[" */, cPart(imap)->partNumFetchStr.c_str(), esp_mail_str_41 /* "]" */,
+                    esp_mail_str_19 /* "<" */, IMAP_Cmd::num(num1, offset), esp_mail_str_27 /* "." */,
+                    IMAP_Cmd::num(num2, chunkSize), esp_mail_str_20 /* ">" */});
+
+        if (imapSend(imap, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
+        {
+            mbfs->close(mbfs_type type);
+            ret = false;
+            break;
+        }
+
+        unsigned long ms = millis();
+
+        imap->_imap_cmd = esp_mail_imap_cmd_fetch_body_attachment;
+        if (!handleIMAPResponse(imap, IMAP_STATUS_IMAP_RESPONSE_FAILED, closeSession))
+        {
+            mbfs->close(mbfs_type type);
+
+            // The server may not be able to decode the content (NO [UNKNOWN-CTE]),
+            // fetch the encoded content instead.
+            if (cPart(imap)->binary_fetch && offset == 0 && cPart(imap)->range_length == 0 && imap->connected())
+            {
+                cPart(imap)->binary_fetch = false;
+                cPart(imap)->xencoding = esp_mail_msg_xencoding_base64;
+                cPart(imap)->range_size = cPart(imap)->octetLen;
+                continue;
+            }
+
+            ret = false;
+            break;
+        }
+
+        offset += cPart(imap)->range_length - cPart(imap)->range_tail;
+
+        // The last range
+        if (cPart(imap)->range_length < chunkSize)
+            break;
+
+        int sz = mbfs->open(filePath, mbfs_type type, mb_fs_open_mode_read);
+        mbfs->close(mbfs_type type);
+
+        if (sz > -1)
+            writeRangeProgress(imap, rangePath, offset, sz);
+
+        // Adjust the range size for the download speed
+        unsigned long elapsed = millis() - ms;
+        if (elapsed < ESP_MAIL_IMAP_RANGE_FETCH_TARGET_MS / 2 && chunkSize < ESP_MAIL_IMAP_RANGE_FETCH_MAX_CHUNK_SIZE)
+            chunkSize *= 2;
+        else if (elapsed > ESP_MAIL_IMAP_RANGE_FETCH_TARGET_MS * 2 && chunkSize > ESP_MAIL_IMAP_RANGE_FETCH_MIN_CHUNK_SIZE)
+            chunkSize /= 2;
+
+        imap->_rangeChunkSize = chunkSize;
+    }
+
+    // Keep the progress file for the next download if failed
+    if (ret)
+        mbfs->remove(rangePath, mbfs_type type);
+
+    cPart(imap)->range_fetch = false;
+
+    return ret;
+}
+
+bool ESP_Mail_Client::readRangeProgress(IMAPSession *imap, const MB_String &path, uint32_t &offset, uint32_t &size)
+{
+    esp_mail_file_storage_type type = imap->_imap_data->storage.type;
+
+    if (mbfs->open(path, mbfs_type type, mb_fs_open_mode_read) <= 0)
+        return false;
+
+    uint32_t magic = 0, uid = 0, binary = 0;
+    MB_String folder, part;
+
+    bool ret = readCacheValue(type, magic) && magic == ESP_MAIL_RANGE_FETCH_MAGIC &&
+               readCacheValue(type, uid) && readCacheValue(type, binary) &&
+               readCacheValue(type, offset) && readCacheValue(type, size) &&
+               readCacheString(type, folder) && readCacheString(type, part);
+
+    mbfs->close(mbfs_type type);
+
+    // The progress of different part or different fetch mode
+    if (ret)
+        ret = uid == cHeader(imap)->message_uid && (binary > 0) == cPart(imap)->binary_fetch &&
+              strcmp(folder.c_str(), imap->_currentFolder.c_str()) == 0 && strcmp(part.c_str(), cPart(imap)->partNumFetchStr.c_str()) == 0;
+
+    if (!ret)
+        offset = size = 0;
+
+    return ret;
+}
+
+void ESP_Mail_Client::writeRangeProgress(IMAPSession *imap, const MB_String &path, uint32_t offset, uint32_t size)
+{
+    esp_mail_file_storage_type type = imap->_imap_data->storage.type;
+
+    if (mbfs->open(path, mbfs_type type, mb_fs_open_mode_write) < 0)
+        return;
+
+    writeCacheValue(type, ESP_MAIL_RANGE_FETCH_MAGIC);
+    writeCacheValue(type, cHeader(imap)->message_uid);
+    writeCacheValue(type, cPart(imap)->binary_fetch ? 1 : 0);
+    writeCacheValue(type, offset);
+    writeCacheValue(type, size);
+    writeCacheString(type, imap->_currentFolder);
+    writeCacheString(type, cPart(imap)->partNumFetchStr);
+    mbfs->close(mbfs_type type);
+}
+
+int ESP_Mail_Client::decodeRangeBase64(IMAPSession *imap, esp_mail_imap_response_data &res, int len)
+{
+    // The literal position of the data
+    int pos = res.octetCount - len;
+
+    // Find the end of the last complete quantum, CRLF is ignored
+    int count = res.b64CarryLen, end = 0;
+    for (int i = 0; i < len; i++)
+    {
+        if (base64Value(res.response[i]) > -1)
+        {
+            count++;
+            if (count % 4 == 0)
+                end = i + 1;
+        }
+    }
+
+    int olen = 0;
+    uint8_t *out = nullptr;
+
+    if (end > 0)
+    {
+        // The quanta are decoded into the session buffer that is reused for all chunks,
+        // the data is not decoded in place as the carried characters come first.
+        out = reuseMem<uint8_t *>(imap->_rangeBuf, count / 4 * 3, false, esp_mail_mem_purpose_decoded_body);
+        if (!out)
+            return 0;
+
+        uint8_t quad[4];
+        int q = 0, pad = 0;
+        for (int i = 0; i < res.b64CarryLen + end; i++)
+        {
+            char c = i < res.b64CarryLen ? res.b64Carry[i] : res.response[i - res.b64CarryLen];
+            int v = base64Value(c);
+            if (v < 0)
+                continue;
+
+            if (c == '=')
+                pad++;
+            quad[q++] = v;
+
+            if (q == 4)
+            {
+                out[olen++] = (quad[0] << 2) | (quad[1] >> 4);
+                if (pad < 2)
+                    out[olen++] = (quad[1] << 4) | (quad[2] >> 2);
+                if (pad < 1)
+                    out[olen++] = (quad[2] << 6) | quad[3];
+                q = 0;
+                pad = 0;
+            }
+        }
+
+        res.b64CarryLen = 0;
+    }
+
+    // Keep the incomplete quantum before the buffer was overwritten by decoded data
+    for (int i = end; i < len; i++)
+    {
+        char c = res.response[i];
+        if (base64Value(c) > -1)
+        {
+            if (res.b64CarryLen == 0)
+                res.b64CarryPos = pos + i;
+            res.b64Carry[res.b64CarryLen++] = c;
+        }
+    }
+
+    if (olen > 0)
+        memcpy(res.response, out, olen);
+
+    return olen;
 }
 
 esp_mail_imap_response_status ESP_Mail_Client::imapResponseStatus(IMAPSession *imap, char *response, PGM_P tag)
@@ -3421,9 +4031,7 @@ esp_mail_imap_response_status ESP_Mail_Client::imapResponseStatus(IMAPSession *i
 
     if (status != esp_mail_imap_resp_unknown)
     {
-        test = imap->prependTag(imap_responses[type].text, tag);
-
-        imap->_responseStatus.text = &response[test.length()];
+        imap->_responseStatus.text = &response[imap->prependTag(imap_responses[type].text, tag).length()];
         if (imap->_responseStatus.text[imap->_responseStatus.text.length() - 2] == '\r')
             imap->_responseStatus.text[imap->_responseStatus.text.length() - 2] = 0;
 
@@ -3492,62 +4100,275 @@ char *ESP_Mail_Client::getList(char *buf, bool &isList)
     return buf;
 }
 
-void ESP_Mail_Client::parseFoldersResponse(IMAPSession *imap, char *buf, bool list)
+void ESP_Mail_Client::imapTokenCallback(void *param, const imap_token_t &token)
+{
+    esp_mail_imap_response_data *res = reinterpret_cast<esp_mail_imap_response_data *>(param);
+    IMAPSession *imap = reinterpret_cast<IMAPSession *>(res->session);
+    if (imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_header || imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_mime)
+        MailClient.parseFetchToken(imap, *res, token);
+    else
+        MailClient.parseFolderToken(imap, *res, token);
+}
+
+void ESP_Mail_Client::parseFetchToken(IMAPSession *imap, esp_mail_imap_response_data &res, const imap_token_t &token)
 {
-    struct esp_mail_folder_info_t fd;
-    int pos = list ? strposP(buf, imap_responses[esp_mail_imap_response_list].text, 0) : strposP(buf, imap_responses[esp_mail_imap_response_lsub].text, 0);
-    bool isList = false, delimOk = false;
-    if (pos != -1)
+    bool header = imap->_imap_cmd == esp_mail_imap_cmd_fetch_body_header;
+
+    // The literal of header fields in FETCH response, its lines are parsed when they are completed,
+    // the line can span across the literal fragments and the response chunks.
+    if (token.type == imap_token_literal && res.tokenLine == esp_mail_imap_token_line_fetch)
     {
-        char *p = allocMem<char *>(strlen(buf));
-        strcpy(p, buf);
-        char *pp = p;
-        char *end = p;
-        int count = 0;
-        int tkPos = 3;
+        if (token.first)
+        {
+            if (header)
+            {
+                // * n FETCH (UID uid BODY[HEADER.FIELDS (...)] {size}
+                res.header.message_no = atoi(res.tokenKey.c_str());
+                res.header.header_data_len = token.size;
+                if (cMSG(imap).type == esp_mail_imap_msg_num_type_uid)
+                    res.header.message_uid = cMSG(imap).value;
+            }
+            else
+                res.part.octetLen = token.size;
 
-        while (pp != NULL)
+            res.tokenValue.clear();
+        }
+
+        const char *p = token.data;
+        size_t n = token.len;
+        while (n > 0)
         {
-            // See RFC2047.h
-            ESP_MAIL_STRSEP(&end, " ");
-            count++;
+            const char *lf = reinterpret_cast<const char *>(memchr(p, '\n', n));
+            size_t len = lf ? lf - p : n;
+            res.tokenValue.append(p, len);
+            if (!lf)
+                break;
+            parseFetchLine(imap, res, header);
+            p = lf + 1;
+            n -= len + 1;
+        }
 
-            if (count >= tkPos && strlen(pp) > 0)
+        if (token.last)
+        {
+            parseFetchLine(imap, res, header);
+            if (!header)
+                completePartHeader(imap, res);
+        }
+        return;
+    }
+
+    parseFolderToken(imap, res, token);
+
+    // The message number and the FETCH keyword of untagged response, the other untagged responses
+    // e.g. EXISTS and the FETCH response of flags changes without literal are ignored.
+    if (token.last && token.depth == 0 && res.tokenLine == esp_mail_imap_token_line_other)
+    {
+        if (token.index == 1)
+            res.tokenKey = res.tokenValue;
+        else if (token.index == 2 && isTokenValue(res.tokenValue.c_str(), imap_responses[esp_mail_imap_response_fetch].text))
+            res.tokenLine = esp_mail_imap_token_line_fetch;
+    }
+}
+
+void ESP_Mail_Client::parseFetchLine(IMAPSession *imap, esp_mail_imap_response_data &res, bool header)
+{
+    size_t len = res.tokenValue.length();
+    if (len > 0 && res.tokenValue[len - 1] == '\r')
+        res.tokenValue.resize(len - 1);
+
+    // The empty line that ends the header is skipped
+    if (res.tokenValue.length() > 0)
+    {
+        char *line = &res.tokenValue[0];
+        bool caseSensitive = imap->_imap_data->enable.header_case_sensitive;
+
+        if (header)
+        {
+            int state = res.headerState;
+            parseHeaderResponse(imap, res, line, caseSensitive);
+
+            // The folded line that continues the last field value
+            if (state == res.headerState && res.headerState > 0)
+                collectHeaderField(imap, line, res.header, res.headerState);
+        }
+        else
+            parsePartHeaderResponse(imap, res, line, caseSensitive);
+    }
+
+    res.tokenValue.clear();
+}
+
+bool ESP_Mail_Client::isTokenValue(const char *value, PGM_P token)
+{
+    MB_String s = token;
+    s.trim();
+    return strcasecmp(value, s.c_str()) == 0;
+}
+
+void ESP_Mail_Client::parseFolderToken(IMAPSession *imap, esp_mail_imap_response_data &res, const imap_token_t &token)
+{
+    if (token.type == imap_token_line_end)
+    {
+        if (res.tokenLine == esp_mail_imap_token_line_list)
+            imap->_folders.add(res.folder);
+        else if (res.tokenLine == esp_mail_imap_token_line_status)
+        {
+            for (size_t i = 0; i < imap->_folders.size(); i++)
             {
-                if (count == tkPos && pp[0] == '(' && pp[1] != ')')
-                    fd.attributes = getList(pp, isList);
-                else if (isList)
+                esp_mail_folder_info_t *fd = &imap->_folders._folders[i];
+                if (strcmp(fd->name.c_str(), res.folder.name.c_str()) == 0)
                 {
-                    fd.attributes += ' ';
-                    fd.attributes += getList(pp, isList);
+                    fd->hasStatus = true;
+                    fd->messages = res.folder.messages;
+                    fd->unseen = res.folder.unseen;
+                    fd->uidNext = res.folder.uidNext;
+                    fd->highestModSeq = res.folder.highestModSeq;
+                    break;
                 }
-                else
+            }
+        }
+        else if (res.tokenLine == esp_mail_imap_token_line_tagged && res.tokenLineResp != esp_mail_imap_resp_unknown)
+        {
+            esp_mail_imap_response_types type = esp_mail_imap_response_bad;
+            if (res.tokenLineResp == esp_mail_imap_resp_ok)
+                type = esp_mail_imap_response_ok;
+            else if (res.tokenLineResp == esp_mail_imap_resp_no)
+                type = esp_mail_imap_response_no;
+
+            imap->_responseStatus.clear(false);
+            imap->_responseStatus.text = res.tokenText;
+            imap->_responseStatus.status = imap_responses[type].text;
+            imap->_responseStatus.status.trim();
+            imap->_responseStatus.completed = true;
+
+            // The tagged responses of pipelined STATUS commands are in sending order,
+            // the failed command is reported to its folder
+            int k = imap->_pipelined_folder_count - imap->_pipelined_cmd_count;
+            if (imap->_imap_cmd == esp_mail_imap_cmd_status && res.tokenLineResp != esp_mail_imap_resp_ok && k >= 0 && k < imap->_pipelined_folder_count && imap->_pipelined_folders[k] < imap->_folders.size())
+            {
+                esp_mail_folder_info_t *fd = &imap->_folders._folders[imap->_pipelined_folders[k]];
+                fd->hasStatus = false;
+                fd->statusError = imap->_responseStatus.status;
+                if (res.tokenText.length() > 0)
                 {
-                    if (pp[strlen(pp) - 1] == '"')
-                        pp[strlen(pp) - 1] = 0;
-
-                    const char *ptr = pp[0] == '"' ? &pp[1] : &pp[0];
-
-                    if (!delimOk)
-                    {
-                        delimOk = true;
-                        fd.delimiter = ptr;
-                    }
-                    else
-                    {
-                        if (fd.name.length() > 0)
-                            fd.name += ' ';
-                        fd.name += ptr;
-                    }
+                    fd->statusError += ' ';
+                    fd->statusError += res.tokenText;
+                }
+#if !defined(SILENT_MODE)
+                if (imap->_debug)
+                {
+                    MB_String e = fd->name;
+                    e += esp_mail_str_34; /* ":" */
+                    e += ' ';
+                    e += fd->statusError;
+                    esp_mail_debug_print_tag(e.c_str(), esp_mail_debug_tag_type_error, true);
                 }
+#endif
             }
-            pp = end;
+
+            // Wait for the tagged responses of all pipelined commands
+            if (imap->_pipelined_cmd_count > 1)
+                imap->_pipelined_cmd_count--;
+            else
+                res.tokenResp = res.tokenLineResp;
         }
 
-        // release memory
-        freeMem(&p);
+        res.folder = esp_mail_folder_info_t();
+        res.tokenLine = esp_mail_imap_token_line_none;
+        res.tokenLineResp = esp_mail_imap_resp_unknown;
+        res.tokenKey.clear();
+        res.tokenText.clear();
+        return;
+    }
 
-        imap->_folders.add(fd);
+    // The string of atom, quoted string and literal can be reported in fragments
+    if (token.first)
+        res.tokenValue.clear();
+
+    if (token.len > 0)
+        res.tokenValue.append(token.data, token.len);
+
+    if (!token.last || token.type == imap_token_list_end)
+        return;
+
+    const char *value = res.tokenValue.c_str();
+
+    if (token.depth == 0)
+    {
+        if (token.index == 0)
+        {
+            if (strcmp(value, "*") == 0)
+                res.tokenLine = esp_mail_imap_token_line_untagged;
+            else if (strcmp_P(value, esp_mail_imap_tag_str) == 0)
+                res.tokenLine = esp_mail_imap_token_line_tagged;
+            else
+                res.tokenLine = esp_mail_imap_token_line_other;
+        }
+        else if (token.index == 1 && res.tokenLine == esp_mail_imap_token_line_untagged)
+        {
+            if ((imap->_imap_cmd == esp_mail_imap_cmd_list && isTokenValue(value, imap_commands[esp_mail_imap_command_list].text)) ||
+                (imap->_imap_cmd == esp_mail_imap_cmd_lsub && isTokenValue(value, imap_commands[esp_mail_imap_command_lsub].text)))
+                res.tokenLine = esp_mail_imap_token_line_list;
+            else if (isTokenValue(value, imap_commands[esp_mail_imap_command_status].text))
+                res.tokenLine = esp_mail_imap_token_line_status;
+            else
+                res.tokenLine = esp_mail_imap_token_line_other;
+        }
+        else if (res.tokenLine == esp_mail_imap_token_line_tagged)
+        {
+            if (token.index == 1)
+            {
+                if (isTokenValue(value, imap_responses[esp_mail_imap_response_ok].text))
+                    res.tokenLineResp = esp_mail_imap_resp_ok;
+                else if (isTokenValue(value, imap_responses[esp_mail_imap_response_no].text))
+                    res.tokenLineResp = esp_mail_imap_resp_no;
+                else if (isTokenValue(value, imap_responses[esp_mail_imap_response_bad].text))
+                    res.tokenLineResp = esp_mail_imap_resp_bad;
+            }
+            else
+            {
+                if (res.tokenText.length() > 0)
+                    res.tokenText += ' ';
+                res.tokenText += value;
+            }
+        }
+        else if (res.tokenLine == esp_mail_imap_token_line_list)
+        {
+            // * LIST (attributes) delimiter name
+            if (token.index == 3)
+                res.folder.delimiter = value;
+            else if (token.index == 4)
+                res.folder.name = value;
+        }
+        else if (res.tokenLine == esp_mail_imap_token_line_status)
+        {
+            // * STATUS name (key value ...)
+            if (token.index == 2)
+                res.folder.name = value;
+        }
+    }
+    else if (token.depth == 1 && token.type != imap_token_list_begin)
+    {
+        // The attributes list is the only list before delimiter and name
+        if (res.tokenLine == esp_mail_imap_token_line_list && res.folder.name.length() == 0 && res.folder.delimiter.length() == 0)
+        {
+            if (res.folder.attributes.length() > 0)
+                res.folder.attributes += ' ';
+            res.folder.attributes += value;
+        }
+        else if (res.tokenLine == esp_mail_imap_token_line_status)
+        {
+            if (token.index % 2 == 0)
+                res.tokenKey = value;
+            else if (strcmp(res.tokenKey.c_str(), imap_commands[esp_mail_imap_command_messages].text) == 0)
+                res.folder.messages = atoi(value);
+            else if (strcmp(res.tokenKey.c_str(), imap_commands[esp_mail_imap_command_unseen].text) == 0)
+                res.folder.unseen = atoi(value);
+            else if (strcmp(res.tokenKey.c_str(), imap_commands[esp_mail_imap_command_uidnext].text) == 0)
+                res.folder.uidNext = atoi(value);
+            else if (strcmp(res.tokenKey.c_str(), imap_commands[esp_mail_imap_command_highestmodseq].text) == 0)
+                res.folder.highestModSeq = value;
+        }
     }
 }
 
@@ -3566,9 +4387,10 @@ bool ESP_Mail_Client::parseIdleResponse(IMAPSession *imap)
 
     if (chunkBufSize > 0)
     {
-        chunkBufSize = ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE;
+        chunkBufSize = imap->_respBufSize;
 
-        char *buf = allocMem<char *>(chunkBufSize + 1);
+        char *buf = reuseMem<char *>(imap->_respBuf, chunkBufSize + 1);
+        Session_Buffer_Limit respLimit(imap->_respBuf, chunkBufSize + 1);
 
         int octetCount = 0;
 
@@ -3580,9 +4402,7 @@ bool ESP_Mail_Client::parseIdleResponse(IMAPSession *imap)
         // If buffer overflown, copy from overflow buffer
         if (ovfBuf.length() > 0)
         {
-            // release memory
-            freeMem(&buf);
-            buf = allocMem<char *>(ovfBuf.length() + 1);
+            buf = reuseMem<char *>(imap->_respBuf, ovfBuf.length() + 1);
             strcpy(buf, ovfBuf.c_str());
             ovfBuf.clear();
         }
@@ -3657,9 +4477,6 @@ bool ESP_Mail_Client::parseIdleResponse(IMAPSession *imap)
 
             imap->_mbif._floderChangedState = (imap->_mbif._folderChanged && exists) || imap->_mbif._polling_status.type == imap_polling_status_type_fetch_message;
         }
-
-        // release memory
-        freeMem(&buf);
     }
 
     size_t imap_idle_tmo = imap->_imap_data->limit.imap_idle_timeout;
@@ -3740,7 +4557,14 @@ void ESP_Mail_Client::parseCmdResponse(IMAPSession *imap, char *buf, PGM_P find)
                 imap->_uid_tmp = atoi(tmp);
                 break;
             case esp_mail_imap_cmd_get_flags:
+                // The flags list may be followed by other data items e.g. UID
+                p1 = strposP(tmp, esp_mail_str_39 /* ")" */, 0);
+                if (p1 != -1)
+                    tmp[p1] = 0;
                 imap->_flags_tmp = tmp;
+                // The untagged response "* n FETCH" contains the message number
+                if (buf[0] == '*')
+                    imap->_msg_num_tmp = atoi(&buf[2]);
                 break;
             case esp_mail_imap_cmd_get_quota:
                 imap->_quota_tmp = tmp;
@@ -3925,8 +4749,14 @@ bool ESP_Mail_Client::handleIMAPError(IMAPSession *imap, int err, bool ret)
     return ret;
 }
 
-void ESP_Mail_Client::prepareFileList(IMAPSession *imap, MB_String &filePath)
+void ESP_Mail_Client::prepareFileList(IMAPSession *imap, MB_String &filePath, bool partFile)
 {
+    IMAP_Download_File file;
+    file.original = filePath;
+    file.uid = cHeader(imap)->message_uid;
+    if (partFile && cPart(imap))
+        file.part = cPart(imap)->partNumStr;
+
 #if defined(MBFS_SD_FS)
     if (!mbfs->longNameSupported())
     {
@@ -3934,24 +4764,54 @@ void ESP_Mail_Client::prepareFileList(IMAPSession *imap, MB_String &filePath)
         MB_String alias = cHeader(imap)->message_uid;
         alias += esp_mail_str_83; /* "_" */
         alias += cHeader(imap)->sd_alias_file_count;
-
-        if (imap->_sdFileList.length() > 0)
-        {
-            if (imap->_sdFileList[imap->_sdFileList.length() - 1] == ']')
-            {
-                imap->_sdFileList[imap->_sdFileList.length() - 1] = 0;
-                imap->_sdFileList += esp_mail_str_8; /* "," */
-            }
-        }
-        imap->_sdFileList += esp_mail_str_80; /* "{\"Renamed\":\"" */
-        imap->_sdFileList += alias;
-        imap->_sdFileList += esp_mail_str_81; /* "\",\"Original\":\"" */
-        imap->_sdFileList += filePath;
-        imap->_sdFileList += esp_mail_str_82; /* "\"}]" */
         // rename the original file
         filePath = alias;
     }
 #endif
+
+    file.path = filePath;
+    imap->_downloadFiles.push_back(file);
+}
+
+void ESP_Mail_Client::addDownloadFileSize(IMAPSession *imap, size_t size)
+{
+    if (imap->_downloadFiles.size() > 0)
+        imap->_downloadFiles[imap->_downloadFiles.size() - 1].size += size;
+}
+
+void ESP_Mail_Client::beginAttachmentDigest(IMAPSession *imap)
+{
+    cPart(imap)->sha256.clear();
+    cPart(imap)->digest = imap->_imap_data->enable.attachment_digest;
+
+    if (cPart(imap)->digest)
+        imap->_digest.begin();
+}
+
+void ESP_Mail_Client::updateAttachmentDigest(IMAPSession *imap, const void *data, size_t len)
+{
+    if (cPart(imap)->digest && len > 0)
+        imap->_digest.update(data, len);
+}
+
+void ESP_Mail_Client::finishAttachmentDigest(IMAPSession *imap)
+{
+    if (!cPart(imap)->digest)
+        return;
+
+    cPart(imap)->digest = false;
+
+    char hex[ESP_MAIL_SHA256_SIZE * 2 + 1];
+    imap->_digest.finishHex(hex);
+    cPart(imap)->sha256 = hex;
+
+    // The last file of download manifest is the file of this part when it was saved
+    if (imap->_downloadFiles.size() > imap->_downloadFileStart)
+    {
+        IMAP_Download_File &file = imap->_downloadFiles[imap->_downloadFiles.size() - 1];
+        if (strcmp(file.part.c_str(), cPart(imap)->partNumStr.c_str()) == 0 && file.uid == cHeader(imap)->message_uid)
+            file.sha256 = hex;
+    }
 }
 
 bool ESP_Mail_Client::parseAttachmentResponse(IMAPSession *imap, char *buf, esp_mail_imap_response_data &res)
@@ -3968,15 +4828,23 @@ bool ESP_Mail_Client::parseAttachmentResponse(IMAPSession *imap, char *buf, esp_
             res.octetLength = atoi(tmp);
             // release memory
             freeMem(&tmp);
-            cPart(imap)->octetLen = res.octetLength;
             cPart(imap)->octetCount = 0;
-            cHeader(imap)->total_download_size += res.octetLength;
-            imap->_lastProgress = -1;
+
+            if (cPart(imap)->range_fetch)
+                cPart(imap)->range_length = res.octetLength;
+            else
+            {
+                cPart(imap)->octetLen = res.octetLength;
+                cHeader(imap)->total_download_size += res.octetLength;
+                imap->_lastProgress = -1;
+                // The digest of range fetching continues between ranges
+                beginAttachmentDigest(imap);
+            }
 
 #if defined(ESP_MAIL_OTA_UPDATE_ENABLED)
             if (cPart(imap)->is_firmware_file)
             {
-                cPart(imap)->is_firmware_file = Update.begin(cPart(imap)->attach_data_size);
+                cPart(imap)->is_firmware_file = imap->_otaSink.begin(cPart(imap)->attach_data_size);
 
                 if (!cPart(imap)->is_firmware_file)
                 {
@@ -4060,7 +4928,12 @@ bool ESP_Mail_Client::parseAttachmentResponse(IMAPSession *imap, char *buf, esp_
 
         if (imap->_imap_data->enable.download_status)
         {
-            if (imap->_debug)
+            if (imap->_debug && cPart(imap)->range_fetch)
+            {
+                int progress = cPart(imap)->range_size > 0 ? 100 * (cPart(imap)->range_offset + cPart(imap)->octetCount) / cPart(imap)->range_size : 0;
+                downloadReport(imap, progress > 100 ? 100 : progress);
+            }
+            else if (imap->_debug)
                 downloadReport(imap, 100 * cPart(imap)->octetCount / res.octetLength);
         }
 
@@ -4069,7 +4942,8 @@ bool ESP_Mail_Client::parseAttachmentResponse(IMAPSession *imap, char *buf, esp_
 
         bool write_error = false, fw_write_error = false;
 
-        if (cPart(imap)->xencoding == esp_mail_msg_xencoding_base64)
+        // The base64 data of range fetching was already decoded
+        if (cPart(imap)->xencoding == esp_mail_msg_xencoding_base64 && !cPart(imap)->range_fetch)
         {
 
             size_t olen = 0;
@@ -4086,12 +4960,14 @@ bool ESP_Mail_Client::parseAttachmentResponse(IMAPSession *imap, char *buf, esp_
 
                 sendStreamCB(imap, (void *)decoded, olen, res.chunkIdx, false);
 
+                updateAttachmentDigest(imap, decoded, olen);
+
                 size_t write = olen;
 
                 if (cPart(imap)->is_firmware_file)
                 {
 #if defined(ESP_MAIL_OTA_UPDATE_ENABLED)
-                    size_t fw_write = Update.write((uint8_t *)decoded, olen);
+                    size_t fw_write = imap->_otaSink.write((uint8_t *)decoded, olen);
                     cPart(imap)->firmware_downloaded_byte += fw_write == olen ? olen : 0;
                     fw_write_error = fw_write != olen;
 #endif
@@ -4100,7 +4976,11 @@ bool ESP_Mail_Client::parseAttachmentResponse(IMAPSession *imap, char *buf, esp_
                 if (cPart(imap)->save_to_file)
                 {
                     if (mbfs->ready(mbfs_type imap->_imap_data->storage.type))
+                    {
                         write = mbfs->write(mbfs_type imap->_imap_data->storage.type, (uint8_t *)decoded, olen);
+                        if ((int)write > 0)
+                            addDownloadFileSize(imap, write);
+                    }
                 }
 
                 yield_impl();
@@ -4124,12 +5004,14 @@ bool ESP_Mail_Client::parseAttachmentResponse(IMAPSession *imap, char *buf, esp_
 
             sendStreamCB(imap, (void *)buf, bufLen, res.chunkIdx, false);
 
+            updateAttachmentDigest(imap, buf, bufLen);
+
             int write = bufLen;
 
             if (cPart(imap)->is_firmware_file)
             {
 #if defined(ESP_MAIL_OTA_UPDATE_ENABLED)
-                int fw_write = Update.write((uint8_t *)buf, bufLen);
+                int fw_write = imap->_otaSink.write((uint8_t *)buf, bufLen);
                 cPart(imap)->firmware_downloaded_byte += fw_write == bufLen ? (size_t)bufLen : 0;
                 fw_write_error = fw_write != bufLen;
 #endif
@@ -4138,7 +5020,11 @@ bool ESP_Mail_Client::parseAttachmentResponse(IMAPSession *imap, char *buf, esp_
             if (cPart(imap)->save_to_file)
             {
                 if (mbfs->ready(mbfs_type imap->_imap_data->storage.type))
+                {
                     write = mbfs->write(mbfs_type imap->_imap_data->storage.type, (uint8_t *)buf, bufLen);
+                    if (write > 0)
+                        addDownloadFileSize(imap, write);
+                }
             }
 
             yield_impl();
@@ -4157,7 +5043,7 @@ bool ESP_Mail_Client::parseAttachmentResponse(IMAPSession *imap, char *buf, esp_
             if (!imap->_isFirmwareUpdated && update_result_ok &&
                 (cPart(imap)->firmware_downloaded_byte == (size_t)cPart(imap)->attach_data_size || cPart(imap)->octetCount >= res.octetLength))
             {
-                update_result_ok = Update.end(cPart(imap)->octetCount >= res.octetLength);
+                update_result_ok = imap->_otaSink.end(cPart(imap)->octetCount >= res.octetLength, imap->_imap_data->firmware_update.sha256.c_str());
                 if (update_result_ok)
                     imap->_isFirmwareUpdated = true;
             }
@@ -4166,7 +5052,15 @@ bool ESP_Mail_Client::parseAttachmentResponse(IMAPSession *imap, char *buf, esp_
             {
                 cPart(imap)->is_firmware_file = false;
 
-                imap->_responseStatus.errorCode = fw_write_error ? IMAP_STATUS_FIRMWARE_UPDATE_WRITE_FAILED : IMAP_STATUS_FIRMWARE_UPDATE_END_FAILED;
+                // Release the buffers and abort the update if not finished
+                imap->_otaSink.abort();
+
+                if (fw_write_error)
+                    imap->_responseStatus.errorCode = IMAP_STATUS_FIRMWARE_UPDATE_WRITE_FAILED;
+                else if (imap->_otaSink.digestMismatch())
+                    imap->_responseStatus.errorCode = IMAP_STATUS_FIRMWARE_UPDATE_DIGEST_MISMATCH;
+                else
+                    imap->_responseStatus.errorCode = IMAP_STATUS_FIRMWARE_UPDATE_END_FAILED;
                 imap->_responseStatus.text.clear();
 
 #if !defined(SILENT_MODE)
@@ -4335,7 +5229,7 @@ void ESP_Mail_Client::decodeText(IMAPSession *imap, esp_mail_imap_response_data
             }
             else if (cPart(imap)->xencoding == esp_mail_msg_xencoding_qp)
             {
-                decoded = allocMem<char *>(bufLen + 10);
+                decoded = allocMem<char *>(bufLen + 10, true, esp_mail_mem_purpose_decoded_body);
                 decodeQP_UTF8(res.response, decoded);
                 olen = strlen(decoded);
             }
@@ -4388,28 +5282,16 @@ void ESP_Mail_Client::decodeText(IMAPSession *imap, esp_mail_imap_response_data
                     {
                         esp_mail_char_decoding_scheme scheme = getEncodingFromCharset(cPart(imap)->charset.c_str());
 
-                        if (scheme == esp_mail_char_decoding_scheme_iso8859_1)
-                        {
-                            int ilen = olen;
-                            int olen2 = (ilen + 1) * 2;
-                            unsigned char *tmp = allocMem<unsigned char *>(olen2);
-                            decodeLatin1_UTF8(tmp, &olen2, (unsigned char *)decoded, &ilen);
+                        size_t olen2 = 0;
+                        char *out = decodeCharset(scheme, decoded, olen, olen2);
 
+                        if (out)
+                        {
                             if (decoded && !dontDeleteOrModify)
                                 // release memory
                                 freeMem(&decoded);
 
                             olen = olen2;
-                            decoded = (char *)tmp;
-                        }
-                        else if (scheme == esp_mail_char_decoding_scheme_tis_620 || scheme == esp_mail_char_decoding_scheme_iso8859_11 || scheme == esp_mail_char_decoding_scheme_windows_874)
-                        {
-                            char *out = allocMem<char *>((olen + 1) * 3);
-                            decodeTIS620_UTF8(out, decoded, olen);
-                            olen = strlen(out);
-                            if (decoded && !dontDeleteOrModify)
-                                // release memory
-                                freeMem(&decoded);
                             decoded = out;
                         }
                     }
@@ -4447,10 +5329,13 @@ void ESP_Mail_Client::decodeText(IMAPSession *imap, esp_mail_imap_response_data
                 {
                     if (mbfs->ready(mbfs_type imap->_imap_data->storage.type))
                     {
+                        int write = 0;
                         if (olen > 0)
-                            mbfs->write(mbfs_type imap->_imap_data->storage.type, (uint8_t *)decoded, olen);
+                            write += mbfs->write(mbfs_type imap->_imap_data->storage.type, (uint8_t *)decoded, olen);
                         if (hrdBrk)
-                            mbfs->write(mbfs_type imap->_imap_data->storage.type, (uint8_t *)"\r\n", 2);
+                            write += mbfs->write(mbfs_type imap->_imap_data->storage.type, (uint8_t *)"\r\n", 2);
+                        if (write > 0)
+                            addDownloadFileSize(imap, write);
                     }
                 }
 
@@ -4608,6 +5493,13 @@ bool IMAPSession::connected()
     return client.connected();
 }
 
+void IMAPSession::releaseBuffers()
+{
+    _respBuf.release();
+    _lastBuf.release();
+    _rangeBuf.release();
+}
+
 bool IMAPSession::connect(Session_Config *session_config, IMAP_Data *imap_data, bool login)
 {
     _sessionSSL = false;
@@ -4889,7 +5781,7 @@ bool IMAPSession::connect(bool &ssl)
 
     if (chunkBufSize > 0)
     {
-        char *buf = MailClient.allocMem<char *>(chunkBufSize + 1);
+        char *buf = MailClient.allocMem<char *>(chunkBufSize + 1, true, esp_mail_mem_purpose_response_buffer);
         client.readBytes(buf, chunkBufSize);
         if (_debug && _debugLevel > esp_mail_debug_level_basic && !_customCmdResCallback)
             esp_mail_debug_print((const char *)buf, true);
@@ -4981,6 +5873,12 @@ void IMAPSession::setTCPTimeout(unsigned long timeoutSec)
     tcpTimeout = timeoutSec;
 }
 
+void IMAPSession::setResponseBufferSize(size_t size)
+{
+    if (size >= ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE)
+        _respBufSize = size;
+}
+
 void IMAPSession::setClient(Client *client)
 {
     this->client.setClient(client);
@@ -5017,6 +5915,13 @@ void IMAPSession::setSSLBufferSize(int rx, int tx)
     this->client.setIOBufferSize(rx, tx);
 }
 
+void IMAPSession::setCompression(bool enable, uint8_t inflateWindowBits, uint8_t deflateWindowBits)
+{
+    _compress = enable;
+    _inflateWindowBits = inflateWindowBits;
+    _deflateWindowBits = deflateWindowBits;
+}
+
 bool IMAPSession::mOpenFolder(MB_StringPtr folderName, bool readOnly)
 {
     if (!connected())
@@ -5032,11 +5937,11 @@ bool IMAPSession::mOpenFolder(MB_StringPtr folderName, bool readOnly)
         return openMailbox(folderName, esp_mail_imap_auth_mode::esp_mail_imap_mode_select, true, false);
 }
 
-bool IMAPSession::getFolders(FoldersCollection &folders)
+bool IMAPSession::getFolders(FoldersCollection &folders, bool withStatus)
 {
     if (!connected())
         return false;
-    return getMailboxes(folders);
+    return getMailboxes(folders, withStatus);
 }
 
 bool IMAPSession::mCloseFolder(bool expunge)
@@ -5297,30 +6202,129 @@ struct esp_mail_imap_msg_list_t IMAPSession::data()
     for (size_t i = 0; i < _headers.size(); i++)
     {
 
-#if defined(MB_ARDUINO_ESP) || defined(MB_ARDUINO_PICO)
+        // In static memory build, the number of messages is limited
+#if (defined(MB_ARDUINO_ESP) || defined(MB_ARDUINO_PICO)) && !defined(ESP_MAIL_STATIC_MEMORY)
         if (MailClient.getFreeHeap() < ESP_MAIL_MIN_MEM)
             continue;
 #endif
         struct esp_mail_imap_msg_item_t itm;
-        itm.setRFC822Headers(&_headers[i].header_fields);
-        itm.UID = _headers[i].message_uid;
-        itm.msgNo = _headers[i].message_no;
-        itm.flags = _headers[i].flags.c_str();
-        itm.acceptLang = _headers[i].accept_language.c_str();
-        itm.contentLang = _headers[i].content_language.c_str();
-        itm.hasAttachment = _headers[i].hasAttachment;
-        itm.fetchError = _headers[i].error_msg.c_str();
+        getMessageItem(i, itm);
+        ret.msgItems.push_back(itm);
+    }
+
+    return ret;
+}
 
-        getMessages(i, itm);
+IMAP_Message_Handle IMAPSession::messageHandle(uint32_t uid)
+{
+    IMAP_Message_Handle handle;
+    handle._session = this;
+    handle._uid = uid;
+    return handle;
+}
 
-        getRFC822Messages(i, itm);
+bool IMAPSession::fetchOnDemand(uint32_t uid, esp_mail_imap_on_demand_type type, int index, MB_StringPtr path, MB_String &out)
+{
+    out.clear();
 
-        ret.msgItems.push_back(itm);
+    if (!_imap_data || uid == 0)
+        return false;
+
+    // Keep the user configs and read only the requested content of message
+    esp_mail_imap_fetch_config_t fetch = _imap_data->fetch;
+    esp_mail_imap_enable_config_t enable = _imap_data->enable;
+    esp_mail_imap_download_config_t download = _imap_data->download;
+    MB_String savedPath = _imap_data->storage.saved_path;
+    imapMessageCallback messageCallback = _messageCallback;
+
+    _imap_data->fetch.uid = uid;
+    _imap_data->fetch.number.clear();
+    _imap_data->fetch.sequence_set.string.clear();
+    _imap_data->fetch.headerOnly = false;
+
+    _imap_data->enable.text = type == esp_mail_imap_on_demand_text;
+    _imap_data->enable.html = type == esp_mail_imap_on_demand_html;
+    _imap_data->enable.rfc822 = false;
+
+    _imap_data->download.text = false;
+    _imap_data->download.html = false;
+    _imap_data->download.rfc822 = false;
+    _imap_data->download.header = false;
+    _imap_data->download.attachment = type == esp_mail_imap_on_demand_attachment;
+    _imap_data->download.inlineImg = type == esp_mail_imap_on_demand_attachment;
+
+    if (type == esp_mail_imap_on_demand_attachment)
+    {
+        MB_String p = path;
+        if (p.length() > 0)
+            _imap_data->storage.saved_path = p;
+
+        // The storage was not checked if the previous reading was header only
+        _storageChecked = false;
+    }
+
+    _onDemandAttachment = type == esp_mail_imap_on_demand_attachment ? index : -1;
+    _onDemand = true;
+    _messageCallback = NULL;
+
+    // The message is read into the scratch list, the listed messages and the data
+    // that were taken from them are kept valid.
+    _internalVectorImpl<struct esp_mail_message_header_t> headers;
+    headers.swap(_headers);
+    esp_mail_imap_msg_num_list_t msgNums = std::move(_imap_msg_num);
+    size_t availableItems = _mbif._availableItems;
+
+    bool ret = MailClient.readMail(this, false);
+
+    if (ret && _headers.size() > 0)
+    {
+        struct esp_mail_imap_msg_item_t itm;
+        getMessages(0, itm);
+
+        if (type == esp_mail_imap_on_demand_text)
+            out = itm.text.content;
+        else if (type == esp_mail_imap_on_demand_html)
+            out = itm.html.content;
+        else
+            ret = index < (int)itm.attachments.size();
     }
+    else
+        ret = false;
+
+    _headers.swap(headers);
+    _imap_msg_num = std::move(msgNums);
+    _mbif._availableItems = availableItems;
+
+    _onDemandAttachment = -1;
+    _onDemand = false;
+    _messageCallback = messageCallback;
+    _imap_data->fetch = fetch;
+    _imap_data->enable = enable;
+    _imap_data->download = download;
+    _imap_data->storage.saved_path = savedPath;
 
     return ret;
 }
 
+void IMAPSession::getMessageItem(uint16_t messageIndex, struct esp_mail_imap_msg_item_t &msg)
+{
+    if (messageIndex >= _headers.size())
+        return;
+
+    msg.setRFC822Headers(&_headers[messageIndex].header_fields);
+    msg.UID = _headers[messageIndex].message_uid;
+    msg.msgNo = _headers[messageIndex].message_no;
+    msg.flags = _headers[messageIndex].flags.c_str();
+    msg.acceptLang = _headers[messageIndex].accept_language.c_str();
+    msg.contentLang = _headers[messageIndex].content_language.c_str();
+    msg.hasAttachment = _headers[messageIndex].hasAttachment;
+    msg.fetchError = _headers[messageIndex].error_msg.c_str();
+
+    getMessages(messageIndex, msg);
+
+    getRFC822Messages(messageIndex, msg);
+}
+
 SelectedFolderInfo IMAPSession::selectedFolder()
 {
     return _mbif;
@@ -5336,6 +6340,11 @@ void IMAPSession::characterDecodingCallback(imapCharacterDecodingCallback callba
     _charDecCallback = callback;
 }
 
+void IMAPSession::messageCallback(imapMessageCallback callback)
+{
+    _messageCallback = callback;
+}
+
 void IMAPSession::mimeDataStreamCallback(MIMEDataStreamCallback mimeDataStreamCallback)
 {
     _mimeDataStreamCallback = mimeDataStreamCallback;
@@ -5404,6 +6413,7 @@ void IMAPSession::getMessages(uint16_t messageIndex, struct esp_mail_imap_msg_it
                         att.description = _headers[messageIndex].part_headers[i].content_description.c_str();
                         att.creationDate = _headers[messageIndex].part_headers[i].creation_date.c_str();
                         att.type = _headers[messageIndex].part_headers[i].attach_type;
+                        att.sha256 = _headers[messageIndex].part_headers[i].sha256.c_str();
                         msg.attachments.push_back(att);
                     }
                 }
@@ -5433,7 +6443,7 @@ void IMAPSession::getRFC822Messages(uint16_t messageIndex, struct esp_mail_imap_
                         cIdx = i;
                         partIdx++;
                         _rfc822 = new IMAP_MSG_Item();
-                        _rfc822->setRFC822Headers(&_headers[messageIndex].part_headers[i].rfc822_header);
+                        _rfc822->setRFC822Headers(_headers[messageIndex].part_headers[i].rfc822Header(true));
                     }
                     else
                     {
@@ -5466,6 +6476,7 @@ void IMAPSession::getRFC822Messages(uint16_t messageIndex, struct esp_mail_imap_
                                 att.description = _headers[messageIndex].part_headers[i].content_description.c_str();
                                 att.creationDate = _headers[messageIndex].part_headers[i].creation_date.c_str();
                                 att.type = _headers[messageIndex].part_headers[i].attach_type;
+                                att.sha256 = _headers[messageIndex].part_headers[i].sha256.c_str();
                                 _rfc822->attachments.push_back(att);
                             }
                         }
@@ -5635,7 +6646,7 @@ bool IMAPSession::openMailbox(MB_StringPtr folder, esp_mail_imap_auth_mode mode,
     return true;
 }
 
-bool IMAPSession::getMailboxes(FoldersCollection &folders)
+bool IMAPSession::getMailboxes(FoldersCollection &folders, bool withStatus)
 {
 #if !defined(SILENT_MODE)
     MailClient.printDebug<IMAPSession *>(this,
@@ -5652,6 +6663,24 @@ bool IMAPSession::getMailboxes(FoldersCollection &folders)
     MailClient.appendString(cmd, NULL, false, false, esp_mail_string_mark_type_double_quote);
     MailClient.prependSpace(cmd, esp_mail_str_3 /* "*" */);
 
+    bool listStatus = withStatus && _feature_capability[esp_mail_imap_read_capability_list_status];
+
+    if (listStatus)
+    {
+        // RFC 5819, LIST "" * RETURN (STATUS (MESSAGES UNSEEN UIDNEXT HIGHESTMODSEQ))
+        MB_String items, status;
+        MailClient.joinStringSpace(items, false, 3, imap_commands[esp_mail_imap_command_messages].text, imap_commands[esp_mail_imap_command_unseen].text, imap_commands[esp_mail_imap_command_uidnext].text);
+        if (_feature_capability[esp_mail_imap_read_capability_condstore])
+            MailClient.prependSpace(items, imap_commands[esp_mail_imap_command_highestmodseq].text);
+
+        MailClient.appendSpace(status, false, imap_commands[esp_mail_imap_command_status].text);
+        MailClient.appendString(status, items.c_str(), false, false, esp_mail_string_mark_type_round_bracket);
+
+        cmd += imap_cmd_pre_tokens[esp_mail_imap_command_return];
+        MailClient.appendSpace(cmd);
+        MailClient.appendString(cmd, status.c_str(), false, false, esp_mail_string_mark_type_round_bracket);
+    }
+
     if (MailClient.imapSend(this, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
         return false;
 
@@ -5659,10 +6688,83 @@ bool IMAPSession::getMailboxes(FoldersCollection &folders)
     if (!MailClient.handleIMAPResponse(this, IMAP_STATUS_LIST_MAILBOXS_FAILED, false))
         return false;
 
+    // The folders status error is not fatal, the folders list is still valid.
+    if (withStatus && !listStatus)
+        getMailboxesStatus();
+
     folders = _folders;
     return true;
 }
 
+bool IMAPSession::getMailboxesStatus()
+{
+#if !defined(SILENT_MODE)
+    if (_debug)
+        esp_mail_debug_print_tag(esp_mail_dbg_str_84 /* "send IMAP command, STATUS" */, esp_mail_debug_tag_type_client, true);
+#endif
+
+    MB_String items;
+    MailClient.joinStringSpace(items, false, 3, imap_commands[esp_mail_imap_command_messages].text, imap_commands[esp_mail_imap_command_unseen].text, imap_commands[esp_mail_imap_command_uidnext].text);
+    if (_feature_capability[esp_mail_imap_read_capability_condstore])
+        MailClient.prependSpace(items, imap_commands[esp_mail_imap_command_highestmodseq].text);
+
+    bool ret = true;
+    size_t i = 0;
+
+    while (i < _folders.size())
+    {
+        _pipelined_cmd_count = 0;
+        _pipelined_folder_count = 0;
+
+        // Send the STATUS commands in batch without waiting for each response
+        while (i < _folders.size() && _pipelined_cmd_count < ESP_MAIL_IMAP_MAX_PIPELINED_COMMANDS)
+        {
+            esp_mail_folder_info_t *fd = &_folders._folders[i++];
+
+            // Skip the non-selectable folders which STATUS command is not allowed
+            if (MailClient.strposP(fd->attributes.c_str(), esp_mail_str_103 /* "\\Noselect" */, 0, false) > -1 || MailClient.strposP(fd->attributes.c_str(), esp_mail_str_104 /* "\\NonExistent" */, 0, false) > -1)
+                continue;
+
+            MB_String cmd;
+            MailClient.appendSpace(cmd, true, imap_commands[esp_mail_imap_command_status].text);
+            MailClient.appendString(cmd, fd->name.c_str(), false, false, esp_mail_string_mark_type_double_quote);
+            MailClient.appendSpace(cmd);
+            MailClient.appendString(cmd, items.c_str(), false, false, esp_mail_string_mark_type_round_bracket);
+
+            if (MailClient.imapSend(this, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
+            {
+                _pipelined_cmd_count = 0;
+                _pipelined_folder_count = 0;
+                return false;
+            }
+
+            fd->statusError.clear();
+            _pipelined_folders[_pipelined_cmd_count++] = i - 1;
+        }
+
+        if (_pipelined_cmd_count == 0)
+            break;
+
+        _pipelined_folder_count = _pipelined_cmd_count;
+
+        _imap_cmd = esp_mail_imap_cmd_status;
+        if (!MailClient.handleIMAPResponse(this, IMAP_STATUS_BAD_COMMAND, false))
+            ret = false;
+
+        _pipelined_cmd_count = 0;
+        _pipelined_folder_count = 0;
+    }
+
+    // The STATUS command of any folder was failed
+    for (size_t j = 0; j < _folders.size(); j++)
+    {
+        if (_folders._folders[j].statusError.length() > 0)
+            ret = false;
+    }
+
+    return ret;
+}
+
 bool IMAPSession::mGetSubscribesMailboxes(MB_StringPtr reference, MB_StringPtr mailbox, FoldersCollection &folders)
 {
 #if !defined(SILENT_MODE)
@@ -5782,12 +6884,9 @@ bool IMAPSession::mFetchSequenceSet()
     return true;
 }
 
-MB_String IMAPSession::prependTag(PGM_P cmd, PGM_P tag)
+IMAP_Cmd IMAPSession::prependTag(PGM_P cmd, PGM_P tag)
 {
-    MB_String s = (tag == NULL) ? esp_mail_imap_tag_str : tag;
-    MailClient.appendSpace(s);
-    s += cmd;
-    return s;
+    return IMAP_Cmd({(tag == NULL) ? esp_mail_imap_tag_str : tag, cmd});
 }
 
 bool IMAPSession::checkCapabilities()
@@ -5820,8 +6919,8 @@ bool IMAPSession::mCreateFolder(MB_StringPtr folderName)
                                          true,
                                          false);
 #endif
-    MB_String cmd;
-    MailClient.joinStringSpace(cmd, true, 2, imap_commands[esp_mail_imap_command_create].text, folderName);
+    MB_String folder = folderName;
+    IMAP_Cmd cmd({esp_mail_imap_tag_str, imap_commands[esp_mail_imap_command_create].text, folder.c_str()});
 
     if (MailClient.imapSend(this, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
         return false;
@@ -5909,8 +7008,8 @@ int IMAPSession::mGetUID(int msgNum)
     if (_currentFolder.length() == 0)
         return 0;
 
-    MB_String cmd;
-    MailClient.joinStringSpace(cmd, true, 3, imap_commands[esp_mail_imap_command_fetch].text, MB_String(msgNum).c_str(), imap_commands[esp_mail_imap_command_uid].text);
+    char num[11];
+    IMAP_Cmd cmd({esp_mail_imap_tag_str, imap_commands[esp_mail_imap_command_fetch].text, IMAP_Cmd::num(num, msgNum), imap_commands[esp_mail_imap_command_uid].text});
 
     if (MailClient.imapSend(this, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
         return 0;
@@ -5933,14 +7032,23 @@ const char *IMAPSession::getFlags(int msgNum)
                                          false);
 #endif
 
+    return mGetFlags(msgNum, false);
+}
+
+const char *IMAPSession::mGetFlags(int num, bool uid)
+{
     _flags_tmp.clear();
+    _msg_num_tmp = 0;
     if (_currentFolder.length() == 0)
         return _flags_tmp.c_str();
 
     MB_String cmd, cmd2;
-    MailClient.appendSpace(cmd, true, imap_commands[esp_mail_imap_command_fetch].text);
+    if (uid)
+        MailClient.appendSpace(cmd, true, 2, imap_commands[esp_mail_imap_command_uid].text, imap_commands[esp_mail_imap_command_fetch].text);
+    else
+        MailClient.appendSpace(cmd, true, imap_commands[esp_mail_imap_command_fetch].text);
     MailClient.appendString(cmd2, imap_commands[esp_mail_imap_command_flags].text, false, false, esp_mail_string_mark_type_round_bracket);
-    MailClient.joinStringSpace(cmd, false, 2, MB_String(msgNum).c_str(), cmd2.c_str());
+    MailClient.joinStringSpace(cmd, false, 2, MB_String(num).c_str(), cmd2.c_str());
 
     if (MailClient.imapSend(this, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
         return _flags_tmp.c_str();
@@ -5979,7 +7087,7 @@ bool IMAPSession::mSendCustomCommand(MB_StringPtr cmd, imapResponseCallback call
         _responseStatus.tag = tag;
         _responseStatus.tag.trim();
         if (MailClient.strpos(_cmd.c_str(), _responseStatus.tag.c_str(), 0, false) == -1)
-            _cmd = prependTag(_cmd.c_str(), _responseStatus.tag.c_str());
+            _cmd = prependTag(_cmd.c_str(), _responseStatus.tag.c_str()).c_str();
     }
 
     // filter for specific command
@@ -6097,8 +7205,8 @@ bool IMAPSession::mDeleteFolder(MB_StringPtr folderName)
                                          true,
                                          false);
 #endif
-    MB_String cmd;
-    MailClient.joinStringSpace(cmd, true, 2, imap_commands[esp_mail_imap_command_delete].text, MB_String(folderName).c_str());
+    MB_String folder = folderName;
+    IMAP_Cmd cmd({esp_mail_imap_tag_str, imap_commands[esp_mail_imap_command_delete].text, folder.c_str()});
 
     if (MailClient.imapSend(this, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
         return false;
@@ -6131,6 +7239,16 @@ void IMAPSession::addModifier(MB_String &cmd, esp_mail_imap_command_types type,
     }
 }
 
+void IMAPSession::addModifier(IMAP_Cmd &cmd, esp_mail_imap_command_types type, int32_t modsequence)
+{
+    if (modsequence > -1 && isModseqSupported())
+    {
+        char num[11];
+        cmd.append({esp_mail_str_2 /* " " */, esp_mail_str_38 /* "(" */, imap_commands[type].text, esp_mail_str_2 /* " " */,
+                    IMAP_Cmd::num(num, modsequence), esp_mail_str_39 /* ")" */});
+    }
+}
+
 bool IMAPSession::deleteMsg(MessageList *toDelete, const char *sequenceSet, bool UID, bool expunge, int32_t modsequence)
 {
     if ((toDelete && toDelete->_list.size() == 0) || (!toDelete && strlen(sequenceSet) == 0))
@@ -6157,7 +7275,7 @@ bool IMAPSession::deleteMsg(MessageList *toDelete, const char *sequenceSet, bool
         MailClient.appendSpace(cmd, true, 2, imap_commands[esp_mail_imap_command_uid].text, imap_commands[esp_mail_imap_command_store].text);
 
         if (toDelete && toDelete->_list.size() > 0)
-            MailClient.appendList<int>(cmd, toDelete->_list);
+            MailClient.appendList(cmd, toDelete->_list);
     }
     else if (!toDelete && strlen(sequenceSet) > 0)
         MailClient.appendSpace(cmd, true, imap_commands[esp_mail_imap_command_store].text);
@@ -6233,7 +7351,7 @@ bool IMAPSession::copyMsg(MessageList *toCopy, const char *sequenceSet, bool UID
         MailClient.appendSpace(cmd, true, 2, imap_commands[esp_mail_imap_command_uid].text, imap_commands[esp_mail_imap_command_copy].text);
 
         if (toCopy && toCopy->_list.size() > 0)
-            MailClient.appendList<int>(cmd, toCopy->_list);
+            MailClient.appendList(cmd, toCopy->_list);
     }
     else if (!toCopy && strlen(sequenceSet) > 0)
         MailClient.appendSpace(cmd, true, imap_commands[esp_mail_imap_command_copy].text);
@@ -6302,7 +7420,7 @@ bool IMAPSession::moveMsg(MessageList *toMove, const char *sequenceSet, bool UID
     {
         MailClient.appendSpace(cmd, true, 2, imap_commands[esp_mail_imap_command_uid].text, imap_commands[esp_mail_imap_command_move].text);
         if (toMove && toMove->_list.size() > 0)
-            MailClient.appendList<int>(cmd, toMove->_list);
+            MailClient.appendList(cmd, toMove->_list);
     }
     else if (!toMove && strlen(sequenceSet) > 0)
         MailClient.appendSpace(cmd, true, imap_commands[esp_mail_imap_command_move].text);
@@ -6670,8 +7788,7 @@ bool IMAPSession::mEnable(MB_StringPtr capability)
 
     MB_String _cap = capability;
 
-    MB_String cmd;
-    MailClient.joinStringSpace(cmd, true, 2, imap_commands[esp_mail_imap_command_enable].text, _cap.c_str());
+    IMAP_Cmd cmd({esp_mail_imap_tag_str, imap_commands[esp_mail_imap_command_enable].text, _cap.c_str()});
 
     if (MailClient.imapSend(this, cmd.c_str(), true) == ESP_MAIL_CLIENT_TRANSFER_DATA_FAILED)
         return false;
@@ -6709,7 +7826,8 @@ void IMAPSession::empty()
     _acl_tmp.clear();
     _ns_tmp.clear();
     _server_id_tmp.clear();
-    _sdFileList.clear();
+    _downloadFiles.clear();
+    _downloadFileStart = 0;
     clearMessageData();
 }
 
@@ -6720,7 +7838,104 @@ IMAP_Status IMAPSession::status()
 
 String IMAPSession::fileList()
 {
-    return _sdFileList.c_str();
+    MB_String list;
+
+    if (hasRenamedFile(0))
+    {
+        Header_Writer w;
+        w.begin(stringWriterCallback, &list);
+        writeDownloadFiles(w, 0, true);
+        w.flush();
+    }
+
+    return list.c_str();
+}
+
+size_t IMAPSession::downloadFileCount()
+{
+    return _downloadFiles.size();
+}
+
+IMAP_Download_File IMAPSession::downloadFile(size_t index)
+{
+    IMAP_Download_File file;
+    if (index < _downloadFiles.size())
+        file = _downloadFiles[index];
+    return file;
+}
+
+bool IMAPSession::mSaveDownloadManifest(MB_StringPtr path)
+{
+    if (!_imap_data)
+        return false;
+
+    MB_String filePath = path;
+
+    if (MailClient.mbfs->open(filePath, mbfs_type _imap_data->storage.type, mb_fs_open_mode_write) < 0)
+        return false;
+
+    Header_Writer w;
+    w.begin(MailClient.headerWriterCallback, this);
+    writeDownloadFiles(w, 0, false);
+    w.flush();
+
+    MailClient.mbfs->close(mbfs_type _imap_data->storage.type);
+
+    return true;
+}
+
+bool IMAPSession::hasRenamedFile(size_t from)
+{
+    for (size_t i = from; i < _downloadFiles.size(); i++)
+    {
+        if (_downloadFiles[i].path != _downloadFiles[i].original)
+            return true;
+    }
+    return false;
+}
+
+void IMAPSession::writeDownloadFiles(Header_Writer &w, size_t from, bool renamedOnly)
+{
+    w.printP(esp_mail_str_40); /* "[" */
+    w.beginFields();
+
+    for (size_t i = from; i < _downloadFiles.size(); i++)
+    {
+        IMAP_Download_File &file = _downloadFiles[i];
+
+        if (renamedOnly && file.path == file.original)
+            continue;
+
+        if (w.nextField())
+            w.printP(esp_mail_str_8); /* "," */
+
+        w.printP(renamedOnly ? esp_mail_str_80 /* "{\"Renamed\":\"" */ : esp_mail_str_106 /* "{\"Path\":\"" */);
+        w.printEscaped(file.path.c_str(), false);
+        w.printP(esp_mail_str_81); /* "\",\"Original\":\"" */
+        w.printEscaped(file.original.c_str(), false);
+
+        if (!renamedOnly)
+        {
+            w.printP(esp_mail_str_107); /* "\",\"UID\":" */
+            w.print((unsigned long)file.uid);
+            w.printP(esp_mail_str_108); /* ",\"Part\":\"" */
+            w.print(file.part.c_str());
+            w.printP(esp_mail_str_109); /* "\",\"Size\":" */
+            w.print((unsigned long)file.size);
+            w.printP(esp_mail_str_110); /* ",\"SHA256\":\"" */
+            w.print(file.sha256.c_str());
+        }
+
+        w.printP(esp_mail_str_111); /* "\"}" */
+    }
+
+    w.printP(esp_mail_str_41); /* "]" */
+}
+
+void IMAPSession::stringWriterCallback(void *param, const char *data, size_t len)
+{
+    MB_String *str = reinterpret_cast<MB_String *>(param);
+    str->append(data, len);
 }
 
 void IMAPSession::clearMessageData()
@@ -6778,6 +7993,39 @@ void IMAP_Status::empty()
     _info.clear();
 }
 
+String IMAP_Message_Handle::text()
+{
+    MB_String out;
+    if (_session)
+        _session->fetchOnDemand(_uid, esp_mail_imap_on_demand_text, -1, toStringPtr(""), out);
+    return out.c_str();
+}
+
+String IMAP_Message_Handle::html()
+{
+    MB_String out;
+    if (_session)
+        _session->fetchOnDemand(_uid, esp_mail_imap_on_demand_html, -1, toStringPtr(""), out);
+    return out.c_str();
+}
+
+IMAP_Attachment_Handle IMAP_Message_Handle::attachment(int index)
+{
+    IMAP_Attachment_Handle att;
+    att._session = _session;
+    att._uid = _uid;
+    att._index = index;
+    return att;
+}
+
+bool IMAP_Attachment_Handle::mSaveTo(MB_StringPtr path)
+{
+    MB_String out;
+    if (!_session || _index < 0)
+        return false;
+    return _session->fetchOnDemand(_uid, esp_mail_imap_on_demand_attachment, _index, path, out);
+}
+
 #endif
 
 #endif /* ESP_MAIL_IMAP_H */
\ No newline at end of file
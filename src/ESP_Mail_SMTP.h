@@ -320,6 +320,10 @@ bool ESP_Mail_Client::addSendingResult(SMTPSession *smtp, SMTP_Message *msg, boo
 
     if (msg->_rcp.size())
         status.recipients = msg->_rcp[0].email.c_str();
+
+    status.attachments = smtp->_attachDigests;
+    smtp->_attachDigests.clear();
+
     smtp->sendingResult.add(&status);
 
     smtp->_cbData._sentSuccess = smtp->_sentSuccessCount;
@@ -434,6 +438,9 @@ bool ESP_Mail_Client::mSendMail(SMTPSession *smtp, SMTP_Message *msg, bool close
     if (!smtp)
         return false;
 
+    // The temporary buffers of this operation are allocated from arena
+    Mem_Arena_Scope arenaScope(_arena, ESP_MAIL_ARENA_SIZE);
+
     smtp->_responseStatus.errorCode = 0;
     smtp->_responseStatus.statusCode = 0;
     smtp->_responseStatus.text.clear();
@@ -1138,6 +1145,7 @@ bool ESP_Mail_Client::sendBlobAttachment(SMTPSession *smtp, SMTP_Message *msg, S
 {
     bool cb = altIsCB(smtp);
     uint32_t addr = altProgressPtr(smtp);
+    SHA256_Digest *digest = beginAttachmentDigest(smtp, msg);
 
     if (strcmp(att->descr.transfer_encoding.c_str(), Content_Transfer_Encoding::enc_base64) == 0 && strcmp(att->descr.transfer_encoding.c_str(), att->descr.content_encoding.c_str()) != 0)
     {
@@ -1147,6 +1155,7 @@ bool ESP_Mail_Client::sendBlobAttachment(SMTPSession *smtp, SMTP_Message *msg, S
         data_info.size = att->blob.size;
         data_info.flashMem = att->_int.flash_blob;
         data_info.filename = att->descr.filename.c_str();
+        data_info.digest = digest;
 
         if (!sendBase64(smtp, msg, data_info, true, cb))
             return false;
@@ -1165,6 +1174,7 @@ bool ESP_Mail_Client::sendBlobAttachment(SMTPSession *smtp, SMTP_Message *msg, S
                 data_info.size = att->blob.size;
                 data_info.flashMem = att->_int.flash_blob;
                 data_info.filename = att->descr.filename.c_str();
+                data_info.digest = digest;
 
                 if (!sendBase64(smtp, msg, data_info, false, cb))
                     return false;
@@ -1176,7 +1186,7 @@ bool ESP_Mail_Client::sendBlobAttachment(SMTPSession *smtp, SMTP_Message *msg, S
 
                 size_t chunkSize = ESP_MAIL_CLIENT_STREAM_CHUNK_SIZE;
                 size_t writeLen = 0;
-                uint8_t *buf = allocMem<uint8_t *>(chunkSize);
+                uint8_t *buf = allocMem<uint8_t *>(chunkSize, true, esp_mail_mem_purpose_attachment_staging);
                 while (writeLen < att->blob.size)
                 {
                     if (writeLen > att->blob.size - chunkSize)
@@ -1186,6 +1196,9 @@ bool ESP_Mail_Client::sendBlobAttachment(SMTPSession *smtp, SMTP_Message *msg, S
                         break;
                     memcpy_P(buf, att->blob.data, chunkSize);
 
+                    if (digest)
+                        digest->update(buf, chunkSize);
+
                     if (!altSendData(buf, chunkSize, smtp, msg, false, false, esp_mail_smtp_cmd_undefined, esp_mail_smtp_status_code_0, SMTP_STATUS_UNDEFINED))
                         break;
 
@@ -1212,6 +1225,7 @@ bool ESP_Mail_Client::sendFile(SMTPSession *smtp, SMTP_Message *msg, SMTP_Attach
 {
     bool cb = altIsCB(smtp);
     uint32_t addr = altProgressPtr(smtp);
+    SHA256_Digest *digest = beginAttachmentDigest(smtp, msg);
 
     if (strcmp(att->descr.transfer_encoding.c_str(), Content_Transfer_Encoding::enc_base64) == 0 && strcmp(att->descr.transfer_encoding.c_str(), att->descr.content_encoding.c_str()) != 0)
     {
@@ -1219,6 +1233,7 @@ bool ESP_Mail_Client::sendFile(SMTPSession *smtp, SMTP_Message *msg, SMTP_Attach
 
         data_info.filename = att->descr.filename.c_str();
         data_info.storageType = att->file.storage_type;
+        data_info.digest = digest;
 
         if (!sendBase64(smtp, msg, data_info, true, cb))
             return false;
@@ -1235,6 +1250,7 @@ bool ESP_Mail_Client::sendFile(SMTPSession *smtp, SMTP_Message *msg, SMTP_Attach
 
                 data_info.filename = att->descr.filename.c_str();
                 data_info.storageType = att->file.storage_type;
+                data_info.digest = digest;
 
                 if (!sendBase64(smtp, msg, data_info, false, cb))
                     return false;
@@ -1251,7 +1267,7 @@ bool ESP_Mail_Client::sendFile(SMTPSession *smtp, SMTP_Message *msg, SMTP_Attach
                 if (fileSize < chunkSize)
                     chunkSize = fileSize;
 
-                uint8_t *buf = allocMem<uint8_t *>(chunkSize);
+                uint8_t *buf = allocMem<uint8_t *>(chunkSize, true, esp_mail_mem_purpose_attachment_staging);
 
                 while (writeLen < fileSize && mbfs->available(mbfs_type att->file.storage_type))
                 {
@@ -1264,6 +1280,9 @@ bool ESP_Mail_Client::sendFile(SMTPSession *smtp, SMTP_Message *msg, SMTP_Attach
                         break;
                     }
 
+                    if (digest)
+                        digest->update(buf, chunkSize);
+
                     if (!sendBDAT(smtp, msg, chunkSize, false))
                         break;
 
@@ -1290,6 +1309,29 @@ bool ESP_Mail_Client::sendFile(SMTPSession *smtp, SMTP_Message *msg, SMTP_Attach
     return false;
 }
 
+SHA256_Digest *ESP_Mail_Client::beginAttachmentDigest(SMTPSession *smtp, SMTP_Message *msg)
+{
+    if (!msg->enable.attachment_digest)
+        return nullptr;
+
+    smtp->_digest.begin();
+    return &smtp->_digest;
+}
+
+void ESP_Mail_Client::addAttachmentDigest(SMTPSession *smtp, SMTP_Message *msg, SMTP_Attachment *att)
+{
+    if (!msg->enable.attachment_digest)
+        return;
+
+    char hex[ESP_MAIL_SHA256_SIZE * 2 + 1];
+    smtp->_digest.finishHex(hex);
+
+    SMTP_Attach_Digest item;
+    item.filename = att->descr.filename;
+    item.sha256 = hex;
+    smtp->_attachDigests.push_back(item);
+}
+
 bool ESP_Mail_Client::sendParallelAttachments(SMTPSession *smtp, SMTP_Message *msg, const MB_String &boundary)
 {
     if (msg->_parallel.size() == 0)
@@ -1369,6 +1411,8 @@ bool ESP_Mail_Client::sendAttachments(SMTPSession *smtp, SMTP_Message *msg, cons
                 if (!sendBlobAttachment(smtp, msg, att))
                     return false;
 
+                addAttachmentDigest(smtp, msg, att);
+
                 if (!sendBDAT(smtp, msg, 2, false))
                     return false;
 
@@ -1403,6 +1447,8 @@ bool ESP_Mail_Client::sendAttachments(SMTPSession *smtp, SMTP_Message *msg, cons
                     if (!sendFile(smtp, msg, att))
                         return false;
 
+                    addAttachmentDigest(smtp, msg, att);
+
                     if (!sendBDAT(smtp, msg, 2, false))
                         return false;
 
@@ -1634,6 +1680,8 @@ bool ESP_Mail_Client::sendInline(SMTPSession *smtp, SMTP_Message *msg, const MB_
                     if (!sendBlobAttachment(smtp, msg, att))
                         return false;
 
+                    addAttachmentDigest(smtp, msg, att);
+
                     if (!sendBDAT(smtp, msg, 2, false))
                         return false;
 
@@ -1668,6 +1716,8 @@ bool ESP_Mail_Client::sendInline(SMTPSession *smtp, SMTP_Message *msg, const MB_
                         if (!sendFile(smtp, msg, att))
                             return false;
 
+                        addAttachmentDigest(smtp, msg, att);
+
                         if (!sendBDAT(smtp, msg, 2, false))
                             return false;
 
@@ -1946,7 +1996,7 @@ bool ESP_Mail_Client::sendBlobBody(SMTPSession *smtp, SMTP_Message *msg, uint8_t
 
     int available = len;
     int sz = len;
-    uint8_t *buf = allocMem<uint8_t *>(bufLen + 1);
+    uint8_t *buf = allocMem<uint8_t *>(bufLen + 1, true, esp_mail_mem_purpose_attachment_staging);
     while (available)
     {
         if (available > bufLen)
@@ -2024,7 +2074,7 @@ bool ESP_Mail_Client::sendFileBody(SMTPSession *smtp, SMTP_Message *msg, uint8_t
             if (fileSize < chunkSize)
                 chunkSize = fileSize;
 
-            uint8_t *buf = allocMem<uint8_t *>(chunkSize);
+            uint8_t *buf = allocMem<uint8_t *>(chunkSize, true, esp_mail_mem_purpose_attachment_staging);
 
             while (writeLen < fileSize && mbfs->available(mbfs_type msg->text.file.type))
             {
@@ -2094,7 +2144,7 @@ bool ESP_Mail_Client::sendFileBody(SMTPSession *smtp, SMTP_Message *msg, uint8_t
             if (fileSize < chunkSize)
                 chunkSize = fileSize;
 
-            uint8_t *buf = allocMem<uint8_t *>(chunkSize);
+            uint8_t *buf = allocMem<uint8_t *>(chunkSize, true, esp_mail_mem_purpose_attachment_staging);
 
             while (writeLen < fileSize && mbfs->available(mbfs_type msg->html.file.type))
             {
@@ -2154,7 +2204,7 @@ void ESP_Mail_Client::encodingText(SMTPSession *smtp, SMTP_Message *msg, uint8_t
                 content += encodeBase64Str((const unsigned char *)s.c_str(), s.length());
             else if (strcmp(msg->text.transfer_encoding.c_str(), Content_Transfer_Encoding::enc_qp) == 0)
             {
-                char *out = allocMem<char *>(s.length() * 3 + 1);
+                char *out = allocMem<char *>(s.length() * 3 + 1, true, esp_mail_mem_purpose_decoded_body);
                 encodeQP(s.c_str(), out);
                 content += out;
 
@@ -2200,7 +2250,7 @@ void ESP_Mail_Client::encodingText(SMTPSession *smtp, SMTP_Message *msg, uint8_t
                 content += encodeBase64Str((const unsigned char *)s.c_str(), s.length());
             else if (strcmp(msg->html.transfer_encoding.c_str(), Content_Transfer_Encoding::enc_qp) == 0)
             {
-                char *out = allocMem<char *>(msg->html.content.length() * 3 + 1);
+                char *out = allocMem<char *>(msg->html.content.length() * 3 + 1, true, esp_mail_mem_purpose_decoded_body);
                 encodeQP(msg->html.content.c_str(), out);
                 content += out;
 
@@ -2273,8 +2323,9 @@ void ESP_Mail_Client::formatFlowedText(MB_String &content)
     MB_String qms;
     int j = 0;
     _vectorImpl<MB_String> tokens;
-    char *stk = strP(esp_mail_str_18); /* "\r\n" */
-    char *qm = strP(esp_mail_str_20);  /* ">" */
+    char stk[3], qm[2];
+    PGM_Compare::copy(stk, sizeof(stk), esp_mail_str_18); /* "\r\n" */
+    PGM_Compare::copy(qm, sizeof(qm), esp_mail_str_20);   /* ">" */
     splitToken(content.c_str(), tokens, stk);
     content.clear();
     for (size_t i = 0; i < tokens.size(); i++)
@@ -2298,16 +2349,14 @@ void ESP_Mail_Client::formatFlowedText(MB_String &content)
         count++;
     }
 
-    // release memory
-    freeMem(&stk);
-    freeMem(&qm);
     tokens.clear();
 }
 
 void ESP_Mail_Client::softBreak(MB_String &content, const char *quoteMarks)
 {
     size_t len = 0;
-    char *stk = strP(esp_mail_str_2); /* " " */
+    char stk[2];
+    PGM_Compare::copy(stk, sizeof(stk), esp_mail_str_2); /* " " */
     _vectorImpl<MB_String> tokens;
     splitToken(content.c_str(), tokens, stk);
     content.clear();
@@ -2340,8 +2389,6 @@ void ESP_Mail_Client::softBreak(MB_String &content, const char *quoteMarks)
         }
     }
 
-    // release memory
-    freeMem(&stk);
     tokens.clear();
 }
 
@@ -2626,6 +2673,9 @@ bool ESP_Mail_Client::handleSMTPResponse(SMTPSession *smtp, esp_mail_smtp_comman
     if (!reconnect(smtp))
         return false;
 
+    // Free the response buffer grown by the joined or overflown lines when the response is handled
+    Session_Buffer_Limit respLimit(smtp->_respBuf, smtp->_respBufSize + 1);
+
     bool ret = false;
     char *response = nullptr;
     int readLen = 0;
@@ -2689,8 +2739,9 @@ bool ESP_Mail_Client::handleSMTPResponse(SMTPSession *smtp, esp_mail_smtp_comman
             if (chunkBufSize > 0)
             {
 
-                chunkBufSize = ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE;
-                response = allocMem<char *>(chunkBufSize + 1);
+                // The response buffer of session is reused
+                chunkBufSize = smtp->_respBufSize;
+                response = reuseMem<char *>(smtp->_respBuf, chunkBufSize + 1);
 
             read_line:
 
@@ -2705,9 +2756,7 @@ bool ESP_Mail_Client::handleSMTPResponse(SMTPSession *smtp, esp_mail_smtp_comman
                 // If buffer overflown, copy from overflow buffer
                 if (ovfBuf.length() > 0)
                 {
-                    // release memory
-                    freeMem(&response);
-                    response = allocMem<char *>(ovfBuf.length() + 1);
+                    response = reuseMem<char *>(smtp->_respBuf, ovfBuf.length() + 1);
                     strcpy(response, ovfBuf.c_str());
                     ovfBuf.clear();
                 }
@@ -2736,7 +2785,8 @@ bool ESP_Mail_Client::handleSMTPResponse(SMTPSession *smtp, esp_mail_smtp_comman
                             if (r.length() > 0)
                             {
                                 r += response;
-                                memset(response, 0, chunkBufSize);
+                                // The joined lines can be longer than the response buffer
+                                response = reuseMem<char *>(smtp->_respBuf, r.length() + 1);
                                 strcpy(response, r.c_str());
                             }
 #if !defined(SILENT_MODE)
@@ -2839,9 +2889,6 @@ bool ESP_Mail_Client::handleSMTPResponse(SMTPSession *smtp, esp_mail_smtp_comman
                     if (smtp->_chunkedEnable && smtp->_smtp_cmd == esp_mail_smtp_command::esp_mail_smtp_cmd_chunk_termination)
                         completedResponse = smtp->_chunkCount == chunkIndex;
                 }
-
-                // release memory
-                freeMem(&response);
             }
         }
 
@@ -3011,10 +3058,10 @@ bool ESP_Mail_Client::sendBase64(SMTPSession *smtp, SMTP_Message *msg, esp_mail_
             chunkSize = data_info.size;
     }
 
-    uint8_t *buf = allocMem<uint8_t *>(chunkSize);
-    memset(buf, 0, chunkSize);
+    // The upload chunk buffer of session is reused
+    uint8_t *buf = reuseMem<uint8_t *>(smtp->_stageBuf, chunkSize, true, esp_mail_mem_purpose_attachment_staging);
 
-    uint8_t *rawChunk = allocMem<uint8_t *>(base64 ? 3 : 4);
+    uint8_t rawChunk[4] = {0};
 
     if (report)
         uploadReport(data_info.filename, addr, data_info.dataIndex / data_info.size);
@@ -3032,6 +3079,10 @@ bool ESP_Mail_Client::sendBase64(SMTPSession *smtp, SMTP_Message *msg, esp_mail_
             if (!read)
                 goto ex;
 
+            // Hash the raw data before it was encoded
+            if (data_info.digest && read > 0)
+                data_info.digest->update(rawChunk, read);
+
             getBuffer(base64, buf, rawChunk, encodedCount, bufIndex, dataReady, read, chunkSize);
 
             if (dataReady)
@@ -3055,6 +3106,9 @@ bool ESP_Mail_Client::sendBase64(SMTPSession *smtp, SMTP_Message *msg, esp_mail_
             read = getChunk(smtp, data_info, rawChunk, base64);
             if (!read)
                 goto ex;
+
+            if (data_info.digest && read > 0)
+                data_info.digest->update(rawChunk, read);
         }
     }
 
@@ -3102,10 +3156,6 @@ bool ESP_Mail_Client::sendBase64(SMTPSession *smtp, SMTP_Message *msg, esp_mail_
         uploadReport(data_info.filename, addr, 100);
 
 ex:
-    // release memory
-    freeMem(&buf);
-    freeMem(&rawChunk);
-
     if (!ret)
         closeChunk(data_info);
 
@@ -3531,6 +3581,12 @@ bool SMTPSession::connected()
     return client.connected();
 }
 
+void SMTPSession::releaseBuffers()
+{
+    _respBuf.release();
+    _stageBuf.release();
+}
+
 void SMTPSession::callback(smtpStatusCallback smtpCallback)
 {
     _statusCallback = smtpCallback;
@@ -3561,6 +3617,12 @@ void SMTPSession::setTCPTimeout(unsigned long timeoutSec)
     tcpTimeout = timeoutSec;
 }
 
+void SMTPSession::setResponseBufferSize(size_t size)
+{
+    if (size >= ESP_MAIL_CLIENT_RESPONSE_BUFFER_SIZE)
+        _respBufSize = size;
+}
+
 void SMTPSession::setClient(Client *client)
 {
     this->client.setClient(client);
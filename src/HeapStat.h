@@ -141,6 +141,15 @@ public:
     {
         MailClient.printf("#### Heap Info\n#### Current: %d, Min: %d, Max: %d, Diff_1: %d, Diff_%d: %d\n", current(), min(), max(), diff1(), count(), diffN());
     }
+
+#if defined(ESP_MAIL_HEAP_PROFILER)
+    // Print the library heap allocations by call site in the heap profiler build
+    void printProfile(Print &out)
+    {
+        MailClient.printHeapProfile(out);
+        out.println();
+    }
+#endif
 };
 
 #endif
\ No newline at end of file
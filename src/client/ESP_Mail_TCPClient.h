@@ -58,6 +58,10 @@
 #include "./client/SSLClient/ESP_SSLClient.h"
 #endif
 
+#if defined(ENABLE_IMAP) && defined(ENABLE_IMAP_COMPRESS)
+#include "./extras/RFC1951.h"
+#endif
+
 class ESP_Mail_TCPClient
 {
 public:
@@ -71,6 +75,7 @@ public:
     ~ESP_Mail_TCPClient()
     {
         clear();
+        endCompression();
 #if !defined(ESP_MAIL_DISABLE_SSL)
         if (_tcp_client)
             delete _tcp_client;
@@ -659,8 +664,60 @@ public:
     {
         if (_tcp_client)
             _tcp_client->stop();
+        endCompression();
+    }
+
+    /**
+     * Start the DEFLATE compression (RFC 4978) of the connected stream.
+     * @param inflateWindowBits The receive history buffer size in bits (8 to 15).
+     * @param deflateWindowBits The transmit window size in bits (8 to 12).
+     * @return true for success or false for error.
+     */
+    bool beginCompression(uint8_t inflateWindowBits, uint8_t deflateWindowBits)
+    {
+#if defined(ENABLE_IMAP) && defined(ENABLE_IMAP_COMPRESS)
+        if (!_mbfs || !connected())
+            return false;
+
+        endCompression();
+
+        // The compression state is allocated only when it is used
+        _inflater = new RFC1951_Inflater();
+        _deflater = new RFC1951_Deflater();
+
+        _compressed = _inflater && _deflater && _inflater->begin(_mbfs, inflateWindowBits) && _deflater->begin(_mbfs, deflateWindowBits);
+
+        if (!_compressed)
+            endCompression();
+
+        return _compressed;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * Stop the DEFLATE compression and free its state and buffers.
+     */
+    void endCompression()
+    {
+#if defined(ENABLE_IMAP) && defined(ENABLE_IMAP_COMPRESS)
+        if (_inflater)
+            delete _inflater;
+        _inflater = nullptr;
+        if (_deflater)
+            delete _deflater;
+        _deflater = nullptr;
+#endif
+        _compressed = false;
     }
 
+    /**
+     * Get the DEFLATE compression status.
+     * @return true when the stream was compressed.
+     */
+    bool isCompressed() { return _compressed; }
+
     /**
      * Get the TCP connection status.
      * @return true for connected or false for not connected.
@@ -690,6 +747,15 @@ public:
         if (!connect(isSecure(), isVerify()))
             return TCP_CLIENT_ERROR_CONNECTION_REFUSED;
 
+#if defined(ENABLE_IMAP) && defined(ENABLE_IMAP_COMPRESS)
+        if (_compressed)
+        {
+            if (_deflater->write(_tcp_client, data, len) != len)
+                return TCP_CLIENT_ERROR_SEND_DATA_FAILED;
+            return len;
+        }
+#endif
+
         int toSend = _chunkSize;
         int sent = 0;
         while (sent < len)
@@ -773,6 +839,11 @@ public:
         if (!_basic_client)
             return TCP_CLIENT_ERROR_NOT_INITIALIZED;
 
+#if defined(ENABLE_IMAP) && defined(ENABLE_IMAP_COMPRESS)
+        if (_compressed)
+            return _inflater->available(_tcp_client);
+#endif
+
         return _tcp_client->available();
     }
 
@@ -785,6 +856,15 @@ public:
         if (!_basic_client)
             return TCP_CLIENT_ERROR_NOT_INITIALIZED;
 
+#if defined(ENABLE_IMAP) && defined(ENABLE_IMAP_COMPRESS)
+        if (_compressed)
+        {
+            if (_inflater->available(_tcp_client) <= 0)
+                return -1;
+            return _inflater->read();
+        }
+#endif
+
         return _tcp_client->read();
     }
 
@@ -799,6 +879,15 @@ public:
         if (!_basic_client)
             return TCP_CLIENT_ERROR_NOT_INITIALIZED;
 
+#if defined(ENABLE_IMAP) && defined(ENABLE_IMAP_COMPRESS)
+        if (_compressed)
+        {
+            if (_inflater->available(_tcp_client) <= 0)
+                return -1;
+            return _inflater->read(buf, len);
+        }
+#endif
+
         return _tcp_client->read(buf, len);
     }
 
@@ -1208,6 +1297,11 @@ private:
     bool _use_insecure = false;
     int _debug_level = 0;
     int _chunkSize = 1024;
+    bool _compressed = false;
+#if defined(ENABLE_IMAP) && defined(ENABLE_IMAP_COMPRESS)
+    RFC1951_Inflater *_inflater = nullptr;
+    RFC1951_Deflater *_deflater = nullptr;
+#endif
     bool _clock_ready = false;
     int _last_error = 0;
     volatile bool _network_status = false;
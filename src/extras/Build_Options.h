@@ -7,11 +7,14 @@
 #undef ENABLE_IMAP 
 #undef ENABLE_SMTP 
 #undef ESP_MAIL_USE_PSRAM
+#undef ENABLE_IMAP_COMPRESS
 #undef ESP_MAIL_DEFAULT_SD_FS
 #undef ESP_MAIL_CARD_TYPE_SD
 #undef ESP_MAIL_CARD_TYPE_SD_MMC
 #undef ESP_MAIL_DEFAULT_FLASH_FS
 #undef ESP_MAIL_DEFAULT_DEBUG_PORT
+#undef ESP_MAIL_STATIC_MEMORY
+#undef ESP_MAIL_HEAP_PROFILER
 #endif
 
 #if defined(DISABLE_NTP_TIME)
@@ -34,6 +37,10 @@
 #undef ESP_MAIL_USE_PSRAM 
 #endif
 
+#if defined(DISABLE_IMAP_COMPRESS)
+#undef ENABLE_IMAP_COMPRESS
+#endif
+
 #if defined(DISABLE_SD)
 #undef ESP_MAIL_DEFAULT_SD_FS
 #undef ESP_MAIL_CARD_TYPE_SD_MMC
@@ -48,5 +55,20 @@
 #undef ESP_MAIL_DEFAULT_DEBUG_PORT
 #endif
 
+#if defined(DISABLE_STATIC_MEMORY)
+#undef ESP_MAIL_STATIC_MEMORY
+#endif
+
+#if defined(DISABLE_HEAP_PROFILER)
+#undef ESP_MAIL_HEAP_PROFILER
+#endif
+
+#if defined(ESP_MAIL_HEAP_PROFILER)
+#include "Heap_Profiler.h"
+#endif
+
+// The static pool (in static memory build) and the allocator of library helper containers
+#include "Static_Pool.h"
+
 
 #endif
\ No newline at end of file
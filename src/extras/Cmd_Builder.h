@@ -0,0 +1,163 @@
+#pragma once
+
+#ifndef CMD_BUILDER_H
+#define CMD_BUILDER_H
+
+/**
+ * The command builder that joins the command tokens into one buffer of compile-time size (N).
+ *
+ * The length of all tokens is computed before writing, then the tokens are copied once into the inline
+ * buffer and the command is sent from it without allocation. Only the command that is longer than the
+ * inline buffer (e.g. the long login or folder name) is written to the heap (or static pool) buffer.
+ *
+ * The tokens can be in flash (PROGMEM) or RAM, the nullptr token is the empty token.
+ */
+
+#include <Arduino.h>
+#include <initializer_list>
+
+template <size_t N>
+class Cmd_Builder
+{
+public:
+  Cmd_Builder() { _inline[0] = 0; }
+
+  /**
+   * Join the tokens with separator.
+   * @param tokens The tokens in flash or RAM.
+   * @param sep The separator character.
+   */
+  Cmd_Builder(std::initializer_list<const char *> tokens, char sep = ' ')
+  {
+    _inline[0] = 0;
+    join(tokens, sep);
+  }
+
+  Cmd_Builder(const Cmd_Builder &other) = delete;
+  Cmd_Builder &operator=(const Cmd_Builder &other) = delete;
+
+  Cmd_Builder(Cmd_Builder &&other) noexcept
+  {
+    _len = other._len;
+    _heap = other._heap;
+    _heapLen = other._heapLen;
+    memcpy(_inline, other._inline, N);
+    other._heap = nullptr;
+    other._heapLen = 0;
+    other._len = 0;
+  }
+
+  ~Cmd_Builder() { memFree(_heap); }
+
+  /**
+   * Append the tokens with separator, the separator is also placed before the first token
+   * when the command is not empty.
+   * @param tokens The tokens in flash or RAM.
+   * @param sep The separator character.
+   * @return The builder.
+   */
+  Cmd_Builder &join(std::initializer_list<const char *> tokens, char sep = ' ') { return add(tokens, sep); }
+
+  /**
+   * Append the tokens without separator.
+   * @param tokens The tokens in flash or RAM.
+   * @return The builder.
+   */
+  Cmd_Builder &append(std::initializer_list<const char *> tokens) { return add(tokens, 0); }
+
+  const char *c_str() const { return _heap ? _heap : _inline; }
+
+  size_t length() const { return _len; }
+
+  /**
+   * Get the decimal string of number.
+   * @param out The 11-byte output buffer.
+   * @param value The number.
+   * @return The output buffer.
+   */
+  static const char *num(char *out, uint32_t value)
+  {
+    char tmp[10];
+    int i = 0;
+    do
+    {
+      tmp[i++] = '0' + value % 10;
+      value /= 10;
+    } while (value > 0);
+
+    int j = 0;
+    while (i > 0)
+      out[j++] = tmp[--i];
+    out[j] = 0;
+    return out;
+  }
+
+private:
+  char _inline[N];
+  char *_heap = nullptr;
+  size_t _heapLen = 0;
+  size_t _len = 0;
+
+  char *buf() { return _heap ? _heap : _inline; }
+
+  // Append the tokens, the separator (if not 0) is placed before each token when the command is not empty
+  Cmd_Builder &add(std::initializer_list<const char *> tokens, char sep)
+  {
+    size_t n = _len;
+    for (const char *t : tokens)
+    {
+      if (sep && n > 0)
+        n++;
+      if (t)
+        n += strlen_P(t);
+    }
+
+    if (!reserve(n))
+      return *this;
+
+    char *p = buf();
+    for (const char *t : tokens)
+    {
+      if (sep && _len > 0)
+        p[_len++] = sep;
+
+      if (t)
+      {
+        size_t len = strlen_P(t);
+        memcpy_P(p + _len, t, len);
+        _len += len;
+      }
+    }
+    p[_len] = 0;
+    return *this;
+  }
+
+  static ESP_MAIL_MEM_NOINLINE void *memAlloc(size_t len) { return ESP_Mail_Mem::alloc(len, "Cmd_Builder", false, ESP_MAIL_MEM_SITE); }
+
+  static void memFree(void *p) { ESP_Mail_Mem::dealloc(p); }
+
+  // Make room for the command of n characters, the buffer is at least doubled to build the long command
+  // (e.g. the header fields FETCH) from many appends with few reallocations
+  bool reserve(size_t n)
+  {
+    size_t cap = _heap ? _heapLen : N;
+    if (n < cap)
+      return true;
+
+    size_t len = n + 1 > 2 * cap ? n + 1 : 2 * cap;
+    char *p = (char *)memAlloc(len);
+    if (!p)
+      return false;
+
+    memcpy(p, c_str(), _len + 1);
+    memFree(_heap);
+    _heap = p;
+    _heapLen = len;
+    return true;
+  }
+};
+
+// The IMAP command that fits 64 bytes is built without allocation
+typedef Cmd_Builder<64> IMAP_Cmd;
+
+#endif
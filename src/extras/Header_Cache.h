@@ -0,0 +1,467 @@
+#pragma once
+
+#ifndef HEADER_CACHE_H
+#define HEADER_CACHE_H
+
+/**
+ * The persistent header cache of mailbox in the index and data files.
+ *
+ * The data file contains the records (UID, the 32-bit values and the length prefixed strings) that are
+ * appended. The index file contains the magic number and UIDVALIDITY followed by the UID and record offset
+ * pairs which are sorted by UID, the UID is found by binary search in the index file without loading it.
+ *
+ * Only one file can be opened at a time (MB_FS), the added and removed UIDs are kept in the small pending
+ * lists until flush(). The added UIDs that are greater than all indexed UIDs (e.g. the new messages) are
+ * appended to the index file, otherwise the index file is copied and merged back in chunks.
+ */
+
+#include <Arduino.h>
+#include "./ESP_Mail_FS.h"
+#include "./extras/MB_FS.h"
+
+#define HEADER_CACHE_MAGIC 0x32434845 // "EHC2"
+#define HEADER_CACHE_MAX_PENDING 16
+#define HEADER_CACHE_COPY_CHUNK_SIZE 2048
+
+struct header_cache_index_t
+{
+  uint32_t uid = 0;
+  uint32_t offset = 0;
+};
+
+class Header_Cache
+{
+public:
+  Header_Cache(){};
+  ~Header_Cache(){};
+
+  /**
+   * Open the cache files, the cache is cleared when the index file is not valid or UIDVALIDITY was changed.
+   * The pending UIDs of the previous cache files are discarded.
+   * @param mbfs The MB_FS object.
+   * @param type The file storage type.
+   * @param path The file path of cache files without extension.
+   * @param uidValidity The UIDVALIDITY of mailbox.
+   * @return The ready status.
+   */
+  bool begin(MB_FS *mbfs, mbfs_file_type type, const MB_String &path, uint32_t uidValidity)
+  {
+    end();
+
+    _mbfs = mbfs;
+    _type = type;
+    _uidValidity = uidValidity;
+    _idxPath = path;
+    _idxPath += ".idx";
+    _datPath = path;
+    _datPath += ".dat";
+    _tmpPath = path;
+    _tmpPath += ".tmp";
+
+    bool valid = false;
+    int sz = _mbfs->open(_idxPath, _type, mb_fs_open_mode_read);
+
+    if (sz >= 8)
+    {
+      uint32_t magic = 0, value = 0;
+      valid = readValue(magic) && readValue(value) && magic == HEADER_CACHE_MAGIC && value == _uidValidity;
+      if (valid)
+        _count = (sz - 8) / 8;
+    }
+
+    if (sz >= 0)
+      _mbfs->close(_type);
+
+    // The cache is new or the UIDVALIDITY was changed which all cached UIDs are no longer valid
+    if (!valid)
+    {
+      _mbfs->remove(_datPath, _type);
+      if (!writeIndexHeader(_idxPath))
+        return false;
+    }
+
+    _ready = true;
+    return true;
+  }
+
+  /**
+   * Close the cache without merging the pending UIDs.
+   */
+  void end()
+  {
+    _ready = false;
+    _count = 0;
+    _addedCount = 0;
+    _removedCount = 0;
+  }
+
+  bool ready() const { return _ready; }
+
+  /**
+   * Get the number of cached UIDs.
+   * @return The number of indexed and added UIDs.
+   */
+  int count() const { return _count + _addedCount; }
+
+  /**
+   * Find the index entry of UID.
+   * @param uid The UID.
+   * @param item The index entry that was found.
+   * @return The found status.
+   */
+  bool find(uint32_t uid, header_cache_index_t &item)
+  {
+    if (!_ready || uid == 0)
+      return false;
+
+    for (int i = 0; i < _removedCount; i++)
+    {
+      if (_removed[i] == uid)
+        return false;
+    }
+
+    for (int i = 0; i < _addedCount; i++)
+    {
+      if (_added[i].uid == uid)
+      {
+        item = _added[i];
+        return true;
+      }
+    }
+
+    if (_count == 0 || _mbfs->open(_idxPath, _type, mb_fs_open_mode_read) < 0)
+      return false;
+
+    search(uid, item);
+    _mbfs->close(_type);
+
+    return item.uid == uid;
+  }
+
+  /**
+   * Write the record of UID to data file, the UID that was already cached is not written.
+   * @param uid The UID.
+   * @param values The 32-bit values of record.
+   * @param valueCount The number of values.
+   * @param strings The strings of record.
+   * @param stringCount The number of strings.
+   * @return The write status.
+   */
+  bool write(uint32_t uid, const uint32_t *values, int valueCount, const MB_String *const *strings, int stringCount)
+  {
+    header_cache_index_t item;
+    if (!_ready || uid == 0 || find(uid, item))
+      return false;
+
+    // The record will be appended at the end of data file
+    item.uid = uid;
+    item.offset = 0;
+
+    int sz = _mbfs->open(_datPath, _type, mb_fs_open_mode_read);
+    if (sz > 0)
+      item.offset = sz;
+    if (sz >= 0)
+      _mbfs->close(_type);
+
+    if (_mbfs->open(_datPath, _type, mb_fs_open_mode_append) < 0)
+      return false;
+
+    writeValue(uid);
+    for (int i = 0; i < valueCount; i++)
+      writeValue(values[i]);
+    for (int i = 0; i < stringCount; i++)
+      writeString(*strings[i]);
+
+    _mbfs->close(_type);
+
+    // The added UIDs are kept sorted
+    int i = _addedCount;
+    while (i > 0 && _added[i - 1].uid > uid)
+    {
+      _added[i] = _added[i - 1];
+      i--;
+    }
+    _added[i] = item;
+    _addedCount++;
+
+    if (_addedCount == HEADER_CACHE_MAX_PENDING)
+      flush();
+
+    return true;
+  }
+
+  /**
+   * Read the record of index entry from data file.
+   * @param item The index entry.
+   * @param values The 32-bit values of record.
+   * @param valueCount The number of values.
+   * @param strings The strings of record.
+   * @param stringCount The number of strings.
+   * @return The read status.
+   */
+  bool read(const header_cache_index_t &item, uint32_t *values, int valueCount, MB_String *const *strings, int stringCount)
+  {
+    if (!_ready)
+      return false;
+
+    int sz = _mbfs->open(_datPath, _type, mb_fs_open_mode_read);
+    if (sz < 0)
+      return false;
+
+    uint32_t uid = 0;
+    bool ret = sz > (int)item.offset && _mbfs->seek(_type, item.offset) && readValue(uid) && uid == item.uid;
+
+    for (int i = 0; ret && i < valueCount; i++)
+      ret = readValue(values[i]);
+
+    for (int i = 0; ret && i < stringCount; i++)
+      ret = readString(*strings[i]);
+
+    _mbfs->close(_type);
+    return ret;
+  }
+
+  /**
+   * Remove the UID e.g. the UID that was expunged, its record in data file is no longer referenced.
+   * @param uid The UID.
+   */
+  void remove(uint32_t uid)
+  {
+    if (!_ready)
+      return;
+
+    for (int i = 0; i < _addedCount; i++)
+    {
+      if (_added[i].uid == uid)
+      {
+        _addedCount--;
+        memmove(_added + i, _added + i + 1, (_addedCount - i) * sizeof(header_cache_index_t));
+        return;
+      }
+    }
+
+    _removed[_removedCount++] = uid;
+
+    if (_removedCount == HEADER_CACHE_MAX_PENDING)
+      flush();
+  }
+
+  /**
+   * Merge the added and removed UIDs into the index file.
+   */
+  void flush()
+  {
+    if (!_ready || (_addedCount == 0 && _removedCount == 0))
+      return;
+
+    bool append = _removedCount == 0;
+    if (append && _count > 0)
+    {
+      uint32_t uid = 0;
+      int sz = _mbfs->open(_idxPath, _type, mb_fs_open_mode_read);
+      append = sz >= 16 && _mbfs->seek(_type, sz - 8) && readValue(uid) && uid < _added[0].uid;
+      if (sz >= 0)
+        _mbfs->close(_type);
+    }
+
+    if (append)
+    {
+      if (_mbfs->open(_idxPath, _type, mb_fs_open_mode_append) >= 0)
+      {
+        for (int i = 0; i < _addedCount; i++)
+        {
+          writeValue(_added[i].uid);
+          writeValue(_added[i].offset);
+        }
+        _mbfs->close(_type);
+        _count += _addedCount;
+      }
+    }
+    else if (copy(_idxPath, _tmpPath, false) && !copy(_tmpPath, _idxPath, true))
+    {
+      // The index file that was partially written is cleared with the data file
+      _mbfs->remove(_datPath, _type);
+      _count = writeIndexHeader(_idxPath) ? 0 : _count;
+      _ready = _count == 0;
+    }
+
+    _mbfs->remove(_tmpPath, _type);
+    _addedCount = 0;
+    _removedCount = 0;
+  }
+
+private:
+  MB_FS *_mbfs = nullptr;
+  mbfs_file_type _type = mbfs_type mb_fs_mem_storage_type_undefined;
+  MB_String _idxPath, _datPath, _tmpPath;
+  uint32_t _uidValidity = 0;
+  bool _ready = false;
+  int _count = 0;
+  header_cache_index_t _added[HEADER_CACHE_MAX_PENDING];
+  uint32_t _removed[HEADER_CACHE_MAX_PENDING];
+  int _addedCount = 0;
+  int _removedCount = 0;
+
+  // Binary search the opened index file for the first entry that its UID is not less than UID
+  int search(uint32_t uid, header_cache_index_t &item)
+  {
+    int lo = 0, hi = _count;
+    while (lo < hi)
+    {
+      int mid = (lo + hi) / 2;
+      uint32_t value = 0;
+      if (!_mbfs->seek(_type, 8 + mid * 8) || !readValue(value))
+        return _count;
+
+      if (value < uid)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    item.uid = 0;
+    item.offset = 0;
+
+    if (lo < _count && !(_mbfs->seek(_type, 8 + lo * 8) && readValue(item.uid) && readValue(item.offset)))
+      item.uid = 0;
+
+    return lo;
+  }
+
+  // Copy the index entries from file to file, the pending UIDs are merged if merge is true
+  bool copy(const MB_String &src, const MB_String &dst, bool merge)
+  {
+    if (!writeIndexHeader(dst))
+      return false;
+
+    uint8_t *buf = (uint8_t *)_mbfs->newP(HEADER_CACHE_COPY_CHUNK_SIZE, false);
+    int pos = 8, count = 0, added = 0;
+    bool ret = buf != nullptr;
+
+    while (ret)
+    {
+      int len = -1;
+      int sz = _mbfs->open(src, _type, mb_fs_open_mode_read);
+      if (sz >= 0)
+      {
+        len = sz - pos < HEADER_CACHE_COPY_CHUNK_SIZE ? sz - pos : HEADER_CACHE_COPY_CHUNK_SIZE;
+        len -= len % 8;
+        if (len > 0 && !(_mbfs->seek(_type, pos) && _mbfs->read(_type, buf, len) == len))
+          len = -1;
+        _mbfs->close(_type);
+      }
+
+      if (len < 0 || _mbfs->open(dst, _type, mb_fs_open_mode_append) < 0)
+      {
+        ret = false;
+        break;
+      }
+
+      pos += len;
+
+      for (int i = 0; i < len; i += 8)
+      {
+        if (merge)
+        {
+          uint32_t uid = getValue(buf + i);
+
+          while (added < _addedCount && _added[added].uid < uid)
+          {
+            writeValue(_added[added].uid);
+            writeValue(_added[added++].offset);
+            count++;
+          }
+
+          // The indexed UID that was removed or written again
+          bool skip = added < _addedCount && _added[added].uid == uid;
+          for (int j = 0; !skip && j < _removedCount; j++)
+            skip = _removed[j] == uid;
+
+          if (skip)
+            continue;
+        }
+
+        _mbfs->write(_type, buf + i, 8);
+        count++;
+      }
+
+      // The remaining added UIDs are greater than all indexed UIDs
+      while (merge && len == 0 && added < _addedCount)
+      {
+        writeValue(_added[added].uid);
+        writeValue(_added[added++].offset);
+        count++;
+      }
+
+      _mbfs->close(_type);
+
+      if (len == 0)
+        break;
+    }
+
+    _mbfs->delP(&buf);
+
+    if (ret && merge)
+      _count = count;
+
+    return ret;
+  }
+
+  bool writeIndexHeader(const MB_String &path)
+  {
+    if (_mbfs->open(path, _type, mb_fs_open_mode_write) < 0)
+      return false;
+
+    writeValue(HEADER_CACHE_MAGIC);
+    writeValue(_uidValidity);
+    _mbfs->close(_type);
+    return true;
+  }
+
+  static uint32_t getValue(const uint8_t *buf) { return (uint32_t)buf[0] | ((uint32_t)buf[1] << 8) | ((uint32_t)buf[2] << 16) | ((uint32_t)buf[3] << 24); }
+
+  // Write 32-bit value to opened file
+  void writeValue(uint32_t value)
+  {
+    uint8_t buf[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+    _mbfs->write(_type, buf, 4);
+  }
+
+  // Write length prefixed string to opened file
+  void writeString(const MB_String &str)
+  {
+    size_t len = str.length() > 0xffff ? 0xffff : str.length();
+    uint8_t buf[2] = {(uint8_t)len, (uint8_t)(len >> 8)};
+    _mbfs->write(_type, buf, 2);
+    if (len > 0)
+      _mbfs->write(_type, (uint8_t *)str.c_str(), len);
+  }
+
+  // Read 32-bit value from opened file
+  bool readValue(uint32_t &value)
+  {
+    uint8_t buf[4];
+    if (_mbfs->read(_type, buf, 4) != 4)
+      return false;
+    value = getValue(buf);
+    return true;
+  }
+
+  // Read length prefixed string from opened file
+  bool readString(MB_String &str)
+  {
+    uint8_t buf[2];
+    if (_mbfs->read(_type, buf, 2) != 2)
+      return false;
+
+    size_t len = buf[0] | (buf[1] << 8);
+    str.clear();
+    if (len == 0)
+      return true;
+
+    str.resize(len);
+    return _mbfs->read(_type, (uint8_t *)&str[0], len) == (int)len;
+  }
+};
+
+#endif
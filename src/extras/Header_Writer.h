@@ -0,0 +1,186 @@
+#pragma once
+
+#ifndef HEADER_WRITER_H
+#define HEADER_WRITER_H
+
+/**
+ * The streaming writer for message header text and JSON records.
+ *
+ * The data is collected in small fixed buffer and passed to the sink (Print object or callback)
+ * when the buffer is full, then no record or file content need to be fully buffered.
+ */
+
+#include <Arduino.h>
+
+#define HEADER_WRITER_BUF_SIZE 128
+
+typedef void (*Header_Writer_Callback)(void *param, const char *data, size_t len);
+
+class Header_Writer
+{
+public:
+  Header_Writer(){};
+  ~Header_Writer() { flush(); };
+
+  /**
+   * Set the callback sink.
+   * @param cb The callback function that accepts the user parameter, data and its length.
+   * @param param The user parameter.
+   */
+  void begin(Header_Writer_Callback cb, void *param)
+  {
+    _cb = cb;
+    _param = param;
+    _print = nullptr;
+    reset();
+  }
+
+  /**
+   * Set the Print sink.
+   * @param print The Print object e.g. File or Serial.
+   */
+  void begin(Print *print)
+  {
+    _cb = NULL;
+    _param = nullptr;
+    _print = print;
+    reset();
+  }
+
+  /**
+   * Write the data.
+   * @param data The data to write.
+   * @param len The length of data.
+   */
+  void write(const char *data, size_t len)
+  {
+    while (len > 0)
+    {
+      if (_bufLen == HEADER_WRITER_BUF_SIZE)
+        flush();
+
+      size_t n = HEADER_WRITER_BUF_SIZE - _bufLen;
+      if (n > len)
+        n = len;
+
+      memcpy(_buf + _bufLen, data, n);
+      _bufLen += n;
+      data += n;
+      len -= n;
+    }
+  }
+
+  void write(char c)
+  {
+    if (_bufLen == HEADER_WRITER_BUF_SIZE)
+      flush();
+    _buf[_bufLen++] = c;
+  }
+
+  // Write the string in RAM
+  void print(const char *s) { write(s, strlen(s)); }
+
+  // Write the string in flash
+  void printP(PGM_P s)
+  {
+    char c;
+    while ((c = pgm_read_byte(s++)) != 0)
+      write(c);
+  }
+
+  void print(int v)
+  {
+    char num[12];
+    snprintf(num, sizeof(num), "%d", v);
+    print(num);
+  }
+
+  void print(unsigned long v)
+  {
+    char num[12];
+    snprintf(num, sizeof(num), "%lu", v);
+    print(num);
+  }
+
+  /**
+   * Write the string as JSON string content.
+   * @param s The string to write.
+   * @param trim The option to remove the double quotes from string.
+   */
+  void printEscaped(const char *s, bool trim)
+  {
+    uint8_t c;
+    while ((c = (uint8_t)*s++) != 0)
+    {
+      if (c == '"')
+      {
+        if (!trim)
+          write("\\\"", 2);
+      }
+      else if (c == '\\')
+        write("\\\\", 2);
+      else if (c == '\n')
+        write("\\n", 2);
+      else if (c == '\r')
+        write("\\r", 2);
+      else if (c == '\t')
+        write("\\t", 2);
+      else if (c < 0x20)
+      {
+        char hex[7];
+        snprintf(hex, sizeof(hex), "\\u%04x", c);
+        write(hex, 6);
+      }
+      else
+        write((char)c);
+    }
+  }
+
+  // Start the new record or object, the next field will be the first field
+  void beginFields() { _fields = false; }
+
+  // Get whether the field was written before and mark the field as written
+  bool nextField()
+  {
+    bool ret = _fields;
+    _fields = true;
+    return ret;
+  }
+
+  // Get the total number of bytes passed to the sink
+  size_t length() const { return _length; }
+
+  // Pass the buffered data to the sink
+  void flush()
+  {
+    if (_bufLen == 0)
+      return;
+
+    _length += _bufLen;
+
+    if (_cb)
+      _cb(_param, _buf, _bufLen);
+    else if (_print)
+      _print->write((const uint8_t *)_buf, _bufLen);
+
+    _bufLen = 0;
+  }
+
+private:
+  Header_Writer_Callback _cb = NULL;
+  void *_param = nullptr;
+  Print *_print = nullptr;
+  char _buf[HEADER_WRITER_BUF_SIZE];
+  size_t _bufLen = 0;
+  size_t _length = 0;
+  bool _fields = false;
+
+  void reset()
+  {
+    _bufLen = 0;
+    _length = 0;
+    _fields = false;
+  }
+};
+
+#endif
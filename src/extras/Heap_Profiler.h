@@ -0,0 +1,422 @@
+#pragma once
+
+#ifndef HEAP_PROFILER_H
+#define HEAP_PROFILER_H
+
+/**
+ * The heap allocation profiler for the instrumentation build (ESP_MAIL_HEAP_PROFILER).
+ *
+ * The allocations of MB_FS (newP/delP), MB_String and the library containers are recorded with their call site,
+ * the call site is the allocator tag and the return address of the caller when it is known. The return address
+ * can be resolved to the source line with addr2line (or the exception decoder) of the firmware ELF file.
+ * The blocks of library pool in static memory build are not heap allocations and are not recorded.
+ *
+ * The number of allocations and frees, the live allocations and bytes, the peak bytes and the total bytes are
+ * kept for each call site and in total, the heap fragmentation is estimated from the largest free block.
+ *
+ * The profiler uses the fixed-size tables (ESP_MAIL_HEAP_PROFILER_MAX_SITES and ESP_MAIL_HEAP_PROFILER_MAX_LIVE)
+ * and does not allocate, the allocation that does not fit the tables is counted as untracked.
+ */
+
+#include <Arduino.h>
+
+#if !defined(ESP_MAIL_HEAP_PROFILER_MAX_SITES)
+#define ESP_MAIL_HEAP_PROFILER_MAX_SITES 64
+#endif
+
+// The maximum number of live allocations that are tracked, should be the power of two
+#if !defined(ESP_MAIL_HEAP_PROFILER_MAX_LIVE)
+#define ESP_MAIL_HEAP_PROFILER_MAX_LIVE 512
+#endif
+
+static_assert((ESP_MAIL_HEAP_PROFILER_MAX_LIVE & (ESP_MAIL_HEAP_PROFILER_MAX_LIVE - 1)) == 0, "ESP_MAIL_HEAP_PROFILER_MAX_LIVE should be the power of two");
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#include <esp_heap_caps.h>
+#endif
+
+struct heap_profiler_site_t
+{
+  // The allocator tag e.g. newP or MB_String
+  const char *tag = nullptr;
+  // The return address of caller, nullptr when it is unknown
+  const void *addr = nullptr;
+  uint32_t allocations = 0;
+  uint32_t frees = 0;
+  // The number of allocations that are not freed
+  uint32_t live = 0;
+  size_t live_bytes = 0;
+  size_t peak_bytes = 0;
+  size_t total_bytes = 0;
+};
+
+struct heap_profiler_stats_t
+{
+  uint32_t allocations = 0;
+  uint32_t frees = 0;
+  uint32_t live = 0;
+  size_t live_bytes = 0;
+  size_t peak_bytes = 0;
+  size_t total_bytes = 0;
+  // The allocations that do not fit the site or live allocation table
+  uint32_t untracked = 0;
+  // The number of call sites
+  uint32_t sites = 0;
+  size_t free_heap = 0;
+  size_t largest_free_block = 0;
+  // The fragmentation estimate in percent, 0 when the largest free block is unknown
+  uint8_t fragmentation = 0;
+};
+
+class ESP_Mail_Heap_Profiler
+{
+public:
+  /**
+   * Record the allocation.
+   * @param tag The allocator tag.
+   * @param addr The return address of caller or nullptr.
+   * @param ptr The allocated memory.
+   * @param size The allocated size.
+   */
+  static void onAlloc(const char *tag, const void *addr, const void *ptr, size_t size)
+  {
+    if (!ptr)
+      return;
+
+    data_t &d = data();
+    lock();
+
+    d.stats.allocations++;
+    d.stats.total_bytes += size;
+
+    // The memory was freed without the hook
+    int old = findLive(d, ptr);
+    if (old >= 0)
+      untrack(d, old);
+
+    int s = findSite(d, tag, addr);
+    live_t *e = s < 0 ? nullptr : insertLive(d, ptr);
+
+    if (!e)
+      d.stats.untracked++;
+    else
+    {
+      e->ptr = ptr;
+      e->size = size;
+      e->site = s;
+
+      heap_profiler_site_t &site = d.sites[s];
+      site.allocations++;
+      site.live++;
+      site.live_bytes += size;
+      site.total_bytes += size;
+      if (site.live_bytes > site.peak_bytes)
+        site.peak_bytes = site.live_bytes;
+
+      d.stats.live++;
+      d.stats.live_bytes += size;
+      if (d.stats.live_bytes > d.stats.peak_bytes)
+        d.stats.peak_bytes = d.stats.live_bytes;
+    }
+
+    unlock();
+  }
+
+  // Record the free of memory
+  static void onFree(const void *ptr)
+  {
+    if (!ptr)
+      return;
+
+    data_t &d = data();
+    lock();
+
+    d.stats.frees++;
+
+    int i = findLive(d, ptr);
+    if (i >= 0)
+    {
+      d.sites[d.live[i].site].frees++;
+      untrack(d, i);
+    }
+
+    unlock();
+  }
+
+  /**
+   * Record the reallocation, the old memory is freed when the reallocation succeeded.
+   * @param tag The allocator tag.
+   * @param addr The return address of caller or nullptr.
+   * @param old The old memory.
+   * @param ptr The reallocated memory.
+   * @param size The reallocated size.
+   */
+  static void onRealloc(const char *tag, const void *addr, const void *old, const void *ptr, size_t size)
+  {
+    if (!ptr)
+      return;
+    onFree(old);
+    onAlloc(tag, addr, ptr, size);
+  }
+
+  // Get the total statistics
+  static heap_profiler_stats_t stats()
+  {
+    data_t &d = data();
+    lock();
+    heap_profiler_stats_t s = d.stats;
+    s.sites = d.siteCount;
+    unlock();
+
+    getHeapInfo(s.free_heap, s.largest_free_block);
+    if (s.free_heap > 0 && s.largest_free_block > 0)
+      s.fragmentation = 100 - (uint8_t)(100.0 * s.largest_free_block / s.free_heap);
+
+    return s;
+  }
+
+  // The number of call sites
+  static size_t siteCount()
+  {
+    data_t &d = data();
+    lock();
+    size_t n = d.siteCount;
+    unlock();
+    return n;
+  }
+
+  // Get the statistics of call site at index
+  static heap_profiler_site_t site(size_t index)
+  {
+    heap_profiler_site_t s;
+    data_t &d = data();
+    lock();
+    if (index < d.siteCount)
+      s = d.sites[index];
+    unlock();
+    return s;
+  }
+
+  // Reset the counters, the live allocations are kept
+  static void reset()
+  {
+    data_t &d = data();
+    lock();
+    for (size_t i = 0; i < d.siteCount; i++)
+    {
+      heap_profiler_site_t &s = d.sites[i];
+      s.allocations = 0;
+      s.frees = 0;
+      s.total_bytes = 0;
+      s.peak_bytes = s.live_bytes;
+    }
+    d.stats.allocations = 0;
+    d.stats.frees = 0;
+    d.stats.total_bytes = 0;
+    d.stats.untracked = 0;
+    d.stats.peak_bytes = d.stats.live_bytes;
+    unlock();
+  }
+
+  /**
+   * Print the statistics and call sites in JSON.
+   * @param out The Print object e.g. Serial.
+   */
+  static void printJSON(Print &out)
+  {
+    heap_profiler_stats_t s = stats();
+
+    out.print("{\"allocations\":");
+    out.print((unsigned long)s.allocations);
+    printField(out, "frees", s.frees);
+    printField(out, "live", s.live);
+    printField(out, "live_bytes", s.live_bytes);
+    printField(out, "peak_bytes", s.peak_bytes);
+    printField(out, "total_bytes", s.total_bytes);
+    printField(out, "untracked", s.untracked);
+    printField(out, "free_heap", s.free_heap);
+    printField(out, "largest_free_block", s.largest_free_block);
+    printField(out, "fragmentation", s.fragmentation);
+    out.print(",\"sites\":[");
+
+    for (size_t i = 0; i < s.sites; i++)
+    {
+      heap_profiler_site_t st = site(i);
+      if (i > 0)
+        out.print(",");
+      out.print("{\"tag\":\"");
+      out.print(st.tag ? st.tag : "");
+      out.print("\",\"addr\":\"0x");
+      out.print((unsigned long)(uintptr_t)st.addr, HEX);
+      out.print("\"");
+      printField(out, "allocations", st.allocations);
+      printField(out, "frees", st.frees);
+      printField(out, "live", st.live);
+      printField(out, "live_bytes", st.live_bytes);
+      printField(out, "peak_bytes", st.peak_bytes);
+      printField(out, "total_bytes", st.total_bytes);
+      out.print("}");
+    }
+
+    out.print("]}");
+  }
+
+private:
+  struct live_t
+  {
+    const void *ptr = nullptr;
+    uint32_t size = 0;
+    uint16_t site = 0;
+  };
+
+  struct data_t
+  {
+    heap_profiler_site_t sites[ESP_MAIL_HEAP_PROFILER_MAX_SITES];
+    size_t siteCount = 0;
+    live_t live[ESP_MAIL_HEAP_PROFILER_MAX_LIVE];
+    size_t liveCount = 0;
+    heap_profiler_stats_t stats;
+  };
+
+  static data_t &data()
+  {
+    static data_t d;
+    return d;
+  }
+
+  static void printField(Print &out, const char *name, unsigned long value)
+  {
+    out.print(",\"");
+    out.print(name);
+    out.print("\":");
+    out.print(value);
+  }
+
+  static void getHeapInfo(size_t &freeHeap, size_t &largest)
+  {
+#if defined(ESP32)
+    freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    largest = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+#elif defined(ESP8266)
+    freeHeap = ESP.getFreeHeap();
+    largest = ESP.getMaxFreeBlockSize();
+#else
+    freeHeap = 0;
+    largest = 0;
+#endif
+  }
+
+  // Find or add the call site, returns -1 when the site table is full
+  static int findSite(data_t &d, const char *tag, const void *addr)
+  {
+    for (size_t i = 0; i < d.siteCount; i++)
+    {
+      heap_profiler_site_t &s = d.sites[i];
+      if (s.addr == addr && (s.tag == tag || (s.tag && tag && strcmp(s.tag, tag) == 0)))
+        return i;
+    }
+
+    if (d.siteCount == ESP_MAIL_HEAP_PROFILER_MAX_SITES)
+      return -1;
+
+    heap_profiler_site_t &s = d.sites[d.siteCount];
+    s.tag = tag;
+    s.addr = addr;
+    return d.siteCount++;
+  }
+
+  static size_t slot(const void *ptr)
+  {
+    uintptr_t h = (uintptr_t)ptr >> 2;
+    h ^= h >> 9;
+    return h & (ESP_MAIL_HEAP_PROFILER_MAX_LIVE - 1);
+  }
+
+  // Get the empty slot of live allocation table (open addressing), nullptr when the table is full
+  static live_t *insertLive(data_t &d, const void *ptr)
+  {
+    // Keep one slot empty to stop the search
+    if (d.liveCount >= ESP_MAIL_HEAP_PROFILER_MAX_LIVE - 1)
+      return nullptr;
+
+    size_t i = slot(ptr);
+    while (d.live[i].ptr)
+      i = (i + 1) & (ESP_MAIL_HEAP_PROFILER_MAX_LIVE - 1);
+
+    d.liveCount++;
+    return &d.live[i];
+  }
+
+  static int findLive(data_t &d, const void *ptr)
+  {
+    size_t i = slot(ptr);
+    while (d.live[i].ptr)
+    {
+      if (d.live[i].ptr == ptr)
+        return i;
+      i = (i + 1) & (ESP_MAIL_HEAP_PROFILER_MAX_LIVE - 1);
+    }
+    return -1;
+  }
+
+  // Remove the live allocation at index from statistics and table
+  static void untrack(data_t &d, size_t i)
+  {
+    live_t &e = d.live[i];
+    heap_profiler_site_t &site = d.sites[e.site];
+    site.live--;
+    site.live_bytes -= e.size;
+    d.stats.live--;
+    d.stats.live_bytes -= e.size;
+    removeLive(d, i);
+  }
+
+  // Remove the entry and move the following entries back to keep the search chain
+  static void removeLive(data_t &d, size_t i)
+  {
+    const size_t mask = ESP_MAIL_HEAP_PROFILER_MAX_LIVE - 1;
+    size_t j = i;
+
+    while (true)
+    {
+      j = (j + 1) & mask;
+      if (!d.live[j].ptr)
+        break;
+
+      size_t k = slot(d.live[j].ptr);
+      // The entry at j can be moved to i when its home slot k is not in (i, j]
+      if ((j > i && (k <= i || k > j)) || (j < i && (k <= i && k > j)))
+      {
+        d.live[i] = d.live[j];
+        i = j;
+      }
+    }
+
+    d.live[i] = live_t();
+    d.liveCount--;
+  }
+
+#if defined(ESP32)
+  static portMUX_TYPE &mux()
+  {
+    static portMUX_TYPE m = portMUX_INITIALIZER_UNLOCKED;
+    return m;
+  }
+  static void lock() { portENTER_CRITICAL(&mux()); }
+  static void unlock() { portEXIT_CRITICAL(&mux()); }
+#else
+  static void lock() {}
+  static void unlock() {}
+#endif
+};
+
+// The allocation hooks of MB_FS and MB_String
+#define MB_HEAP_PROFILE_SITE __builtin_return_address(0)
+// The allocation wrapper that takes the call site (MB_HEAP_PROFILE_SITE) should not be inlined
+#define MB_HEAP_PROFILE_NOINLINE __attribute__((noinline))
+#define MB_HEAP_PROFILE_ALLOC(tag, addr, ptr, size) ESP_Mail_Heap_Profiler::onAlloc(tag, addr, ptr, size)
+#define MB_HEAP_PROFILE_REALLOC(tag, addr, old, ptr, size) ESP_Mail_Heap_Profiler::onRealloc(tag, addr, old, ptr, size)
+#define MB_HEAP_PROFILE_FREE(ptr) ESP_Mail_Heap_Profiler::onFree(ptr)
+
+#endif
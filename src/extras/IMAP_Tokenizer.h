@@ -0,0 +1,300 @@
+#pragma once
+
+#ifndef IMAP_TOKENIZER_H
+#define IMAP_TOKENIZER_H
+
+/**
+ * The incremental IMAP response tokenizer (RFC 3501 section 9 formal syntax).
+ *
+ * The response data can be fed in chunks of any size, the tokenizer keeps its state between chunks
+ * and reports the atoms, quoted strings, literals, parenthesized lists and line ends via callback.
+ *
+ * The atom and quoted string data that exceed the token buffer, and the literal data are reported in
+ * fragments, the first and last fragments are flagged, then no response line need to be fully buffered.
+ */
+
+#include <Arduino.h>
+
+#define IMAP_TOKENIZER_BUF_SIZE 64
+#define IMAP_TOKENIZER_MAX_DEPTH 8
+
+enum imap_token_type
+{
+    imap_token_atom,
+    imap_token_quoted,
+    imap_token_literal,
+    imap_token_list_begin,
+    imap_token_list_end,
+    imap_token_line_end
+};
+
+struct imap_token_t
+{
+    imap_token_type type = imap_token_atom;
+    // The token data (unescaped for quoted string) and its length in this fragment
+    const char *data = nullptr;
+    size_t len = 0;
+    // The first and last fragments of token
+    bool first = true;
+    bool last = true;
+    // The literal size
+    size_t size = 0;
+    // The parenthesized list nesting level (capped at IMAP_TOKENIZER_MAX_DEPTH) and the token index in its level
+    int depth = 0;
+    int index = 0;
+};
+
+typedef void (*IMAP_TokenCallback)(void *param, const imap_token_t &token);
+
+class IMAP_Tokenizer
+{
+public:
+  IMAP_Tokenizer(){};
+  ~IMAP_Tokenizer(){};
+
+  /**
+   * Set the token callback and reset the state.
+   * @param cb The callback function that accepts the user parameter and imap_token_t data.
+   * @param param The user parameter.
+   */
+  void begin(IMAP_TokenCallback cb, void *param)
+  {
+    _cb = cb;
+    _param = param;
+    reset();
+  }
+
+  /**
+   * Reset the state to the begining of response line.
+   */
+  void reset()
+  {
+    _state = state_none;
+    _bufLen = 0;
+    _first = true;
+    _depth = 0;
+    _overflow = 0;
+    _literalSize = 0;
+    _literalRemaining = 0;
+    memset(_index, 0, sizeof(_index));
+  }
+
+  /**
+   * Feed the response data.
+   * @param data The response data.
+   * @param len The length of data.
+   */
+  void feed(const char *data, size_t len)
+  {
+    size_t i = 0;
+    while (i < len)
+    {
+      if (_state == state_literal_data)
+      {
+        // Literal data is passed through as is, the CR, LF and NUL included
+        size_t n = len - i < _literalRemaining ? len - i : _literalRemaining;
+        _literalRemaining -= n;
+        emit(imap_token_literal, data + i, n, _literalRemaining == 0);
+        i += n;
+        if (_literalRemaining == 0)
+          _state = state_none;
+        continue;
+      }
+
+      char c = data[i++];
+
+      switch (_state)
+      {
+      case state_none:
+        consume(c);
+        break;
+
+      case state_atom:
+        if (isAtomChar(c))
+          append(c, imap_token_atom);
+        else
+        {
+          flush(imap_token_atom, true);
+          _state = state_none;
+          consume(c);
+        }
+        break;
+
+      case state_quoted:
+        if (c == '\\')
+          _state = state_quoted_escape;
+        else if (c == '"')
+        {
+          flush(imap_token_quoted, true);
+          _state = state_none;
+        }
+        else
+          append(c, imap_token_quoted);
+        break;
+
+      case state_quoted_escape:
+        append(c, imap_token_quoted);
+        _state = state_quoted;
+        break;
+
+      case state_literal_size:
+        if (c >= '0' && c <= '9')
+          _literalSize = _literalSize * 10 + (c - '0');
+        else if (c == '}')
+          _state = state_literal_cr;
+        else if (c != '+')
+        {
+          // Not a literal, e.g. the text of resp-text
+          _state = state_none;
+          consume(c);
+        }
+        break;
+
+      case state_literal_cr:
+        if (c == '\n')
+        {
+          _literalRemaining = _literalSize;
+          _state = state_literal_data;
+          if (_literalSize == 0)
+          {
+            emit(imap_token_literal, nullptr, 0, true);
+            _state = state_none;
+          }
+        }
+        break;
+
+      case state_tilde:
+        if (c == '{')
+        {
+          _literalSize = 0;
+          _state = state_literal_size;
+        }
+        else
+        {
+          // Not a literal8, the tilde is the atom char
+          _state = state_atom;
+          append('~', imap_token_atom);
+          i--;
+        }
+        break;
+
+      default:
+        break;
+      }
+    }
+  }
+
+private:
+  enum tokenizer_state
+  {
+    state_none,
+    state_atom,
+    state_quoted,
+    state_quoted_escape,
+    state_literal_size,
+    state_literal_cr,
+    state_literal_data,
+    state_tilde
+  };
+
+  IMAP_TokenCallback _cb = NULL;
+  void *_param = nullptr;
+  tokenizer_state _state = state_none;
+  char _buf[IMAP_TOKENIZER_BUF_SIZE];
+  size_t _bufLen = 0;
+  bool _first = true;
+  int _depth = 0;
+  // The number of lists opened beyond IMAP_TOKENIZER_MAX_DEPTH
+  int _overflow = 0;
+  int _index[IMAP_TOKENIZER_MAX_DEPTH + 1];
+  size_t _literalSize = 0;
+  size_t _literalRemaining = 0;
+
+  bool isAtomChar(char c)
+  {
+    return c > ' ' && c != '(' && c != ')' && c != '{' && c != '"' && c != 0x7f;
+  }
+
+  // The character that begins the token or separates the tokens
+  void consume(char c)
+  {
+    if (c == '(')
+    {
+      emit(imap_token_list_begin, nullptr, 0, true);
+      // The deeper lists are reported in the last level and counted to keep their closing balanced
+      if (_depth < IMAP_TOKENIZER_MAX_DEPTH)
+      {
+        _depth++;
+        _index[_depth] = 0;
+      }
+      else
+        _overflow++;
+    }
+    else if (c == ')')
+    {
+      if (_overflow > 0)
+        _overflow--;
+      else if (_depth > 0)
+        _depth--;
+      emit(imap_token_list_end, nullptr, 0, true);
+    }
+    else if (c == '"')
+      _state = state_quoted;
+    else if (c == '{')
+    {
+      _literalSize = 0;
+      _state = state_literal_size;
+    }
+    else if (c == '~')
+      _state = state_tilde;
+    else if (c == '\n')
+    {
+      _depth = 0;
+      _overflow = 0;
+      emit(imap_token_line_end, nullptr, 0, true);
+      memset(_index, 0, sizeof(_index));
+    }
+    else if (isAtomChar(c))
+    {
+      _state = state_atom;
+      append(c, imap_token_atom);
+    }
+  }
+
+  void append(char c, imap_token_type type)
+  {
+    if (_bufLen == IMAP_TOKENIZER_BUF_SIZE)
+      flush(type, false);
+    _buf[_bufLen++] = c;
+  }
+
+  void flush(imap_token_type type, bool last)
+  {
+    emit(type, _buf, _bufLen, last);
+    _bufLen = 0;
+  }
+
+  void emit(imap_token_type type, const char *data, size_t len, bool last)
+  {
+    imap_token_t token;
+    token.type = type;
+    token.data = data;
+    token.len = len;
+    token.first = _first;
+    token.last = last;
+    token.size = _literalSize;
+    token.depth = _depth;
+    token.index = _index[_depth];
+
+    if (_cb)
+      _cb(_param, token);
+
+    _first = last;
+
+    // The list begin and list end are counted as one token in their level
+    if (last && type != imap_token_list_begin)
+      _index[_depth]++;
+  }
+};
+
+#endif
@@ -0,0 +1,227 @@
+#pragma once
+
+#ifndef INTERNED_STRING_H
+#define INTERNED_STRING_H
+
+/**
+ * The interned string for the low-cardinality values e.g. the charset, content type, transfer encoding
+ * and disposition of message parts.
+ *
+ * The string is kept once in the shared table and referenced by its 2-byte ID, then the parts that have
+ * the same value share one buffer. The table entry is reference counted and its slot is reused when
+ * no string refers to it, the entry buffer is not moved then the c_str() pointer is valid while
+ * the string (or its copy) holds the value.
+ *
+ * The table is shared by all sessions, on ESP32 it is guarded by the recursive mutex because the sessions
+ * may run in different tasks.
+ */
+
+#include <Arduino.h>
+#include "Small_Vector.h"
+
+class Interned_String
+{
+public:
+  Interned_String(){};
+
+  Interned_String(const Interned_String &other)
+  {
+    _id = other._id;
+    acquire(_id);
+  }
+
+  Interned_String(Interned_String &&other) noexcept
+  {
+    _id = other._id;
+    other._id = 0;
+  }
+
+  ~Interned_String() { release(_id); };
+
+  Interned_String &operator=(const Interned_String &other)
+  {
+    acquire(other._id);
+    release(_id);
+    _id = other._id;
+    return *this;
+  }
+
+  Interned_String &operator=(Interned_String &&other) noexcept
+  {
+    if (this != &other)
+    {
+      release(_id);
+      _id = other._id;
+      other._id = 0;
+    }
+    return *this;
+  }
+
+  Interned_String &operator=(const char *s)
+  {
+    assign(s, s ? strlen(s) : 0);
+    return *this;
+  }
+
+  const char *c_str() const
+  {
+    if (_id == 0)
+      return "";
+
+    Lock lock;
+    return table()[_id - 1].str;
+  }
+
+  size_t length() const
+  {
+    if (_id == 0)
+      return 0;
+
+    Lock lock;
+    return table()[_id - 1].len;
+  }
+
+  void clear()
+  {
+    release(_id);
+    _id = 0;
+  }
+
+  /**
+   * Append the string.
+   * @param s The string to append.
+   * @param n The number of characters to append.
+   */
+  void append(const char *s, size_t n)
+  {
+    if (!s || n == 0)
+      return;
+
+    // The current value and the appended characters are looked up as two pieces,
+    // no temporary buffer is needed for the joined value.
+    Lock lock;
+    const char *cur = _id > 0 ? table()[_id - 1].str : nullptr;
+    size_t len = _id > 0 ? table()[_id - 1].len : 0;
+    uint16_t id = intern(cur, len, s, n);
+    release(_id);
+    _id = id;
+  }
+
+  // The number of distinct values in table
+  static size_t count()
+  {
+    Lock lock;
+    size_t n = 0;
+    for (size_t i = 0; i < table().size(); i++)
+      n += table()[i].refs > 0 ? 1 : 0;
+    return n;
+  }
+
+private:
+  struct entry_t
+  {
+    char *str = nullptr;
+    uint16_t len = 0;
+    uint32_t refs = 0;
+  };
+
+  // The entry index + 1, 0 for empty string
+  uint16_t _id = 0;
+
+  static Small_Vector<entry_t, 16> &table()
+  {
+    static Small_Vector<entry_t, 16> t;
+    return t;
+  }
+
+  // The table is shared by all sessions, it is resized and its buffers are allocated while locked
+  typedef ESP_Mail_Mem::Lock Lock;
+
+  static ESP_MAIL_MEM_NOINLINE void *memAlloc(size_t len) { return ESP_Mail_Mem::alloc(len, "Interned_String", false, ESP_MAIL_MEM_SITE); }
+
+  static void memFree(void *p) { ESP_Mail_Mem::dealloc(p); }
+
+  void assign(const char *s, size_t n)
+  {
+    Lock lock;
+    uint16_t id = intern(nullptr, 0, s, n);
+    release(_id);
+    _id = id;
+  }
+
+  // Find or add the value of joined pieces (head and s), the reference count of returned entry is increased.
+  // The table should be locked.
+  static uint16_t intern(const char *head, size_t headLen, const char *s, size_t n)
+  {
+    if (!s || n == 0 || headLen + n > 0xffff)
+      return 0;
+
+    Small_Vector<entry_t, 16> &t = table();
+    size_t free_slot = t.size();
+
+    for (size_t i = 0; i < t.size(); i++)
+    {
+      if (t[i].refs == 0)
+      {
+        if (free_slot == t.size())
+          free_slot = i;
+      }
+      else if (t[i].len == headLen + n && (headLen == 0 || memcmp(t[i].str, head, headLen) == 0) &&
+               memcmp(t[i].str + headLen, s, n) == 0)
+      {
+        t[i].refs++;
+        return i + 1;
+      }
+    }
+
+    if (free_slot == t.size())
+    {
+      if (t.size() >= 0xffff)
+        return 0;
+
+      t.push_back(entry_t());
+      if (free_slot == t.size())
+        return 0;
+    }
+
+    char *str = (char *)memAlloc(headLen + n + 1);
+    if (!str)
+      return 0;
+
+    if (headLen > 0)
+      memcpy(str, head, headLen);
+    memcpy(str + headLen, s, n);
+    str[headLen + n] = 0;
+
+    t[free_slot].str = str;
+    t[free_slot].len = headLen + n;
+    t[free_slot].refs = 1;
+    return free_slot + 1;
+  }
+
+  static void acquire(uint16_t id)
+  {
+    if (id == 0)
+      return;
+
+    Lock lock;
+    table()[id - 1].refs++;
+  }
+
+  static void release(uint16_t id)
+  {
+    if (id == 0)
+      return;
+
+    Lock lock;
+    entry_t &e = table()[id - 1];
+    if (e.refs > 0 && --e.refs == 0)
+    {
+      memFree(e.str);
+      e.str = nullptr;
+      e.len = 0;
+    }
+  }
+};
+
+#endif
@@ -50,6 +50,7 @@ using namespace mb_string;
 
 #if defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
 #include <esp32-hal-psram.h>
+#include <esp_heap_caps.h>
 #endif
 
 #define MB_FS_ERROR_FILE_IO_ERROR -300
@@ -333,7 +334,7 @@ public:
         flash_rdy = MBFS_FLASH_FS.begin();
 #endif
 
-#elif defined(ESP8266) || defined(MB_ARDUINO_PICO)
+#else
         flash_rdy = MBFS_FLASH_FS.begin();
 #endif
 
@@ -803,22 +804,28 @@ public:
         void **p = (void **)ptr;
         if (*p)
         {
+#if defined(MB_HEAP_PROFILE_FREE)
+            MB_HEAP_PROFILE_FREE(*p);
+#endif
             free(*p);
             *p = 0;
         }
     }
 
-    // Allocate memory
-    void *newP(size_t len, bool clear = true)
+    // Allocate memory, the memory is allocated from internal RAM when psram is false,
+    // the site is the caller address for the heap profiler (the caller of newP when it is nullptr)
+    void *newP(size_t len, bool clear = true, bool psram = true, const void *site = nullptr)
     {
         void *p;
         size_t newLen = getReservedLen(len);
 #if defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
 
-        if (ESP.getPsramSize() > 0)
+        if (ESP.getPsramSize() == 0)
+            p = (void *)malloc(newLen);
+        else if (psram)
             p = (void *)ps_malloc(newLen);
         else
-            p = (void *)malloc(newLen);
+            p = heap_caps_malloc(newLen, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
 
         if (!p)
             return NULL;
@@ -826,20 +833,31 @@ public:
 #else
 
 #if defined(ESP8266_USE_EXTERNAL_HEAP)
-        ESP.setExternalHeap();
+        if (psram)
+            ESP.setExternalHeap();
+#else
+        (void)psram;
 #endif
 
         p = (void *)malloc(newLen);
         bool nn = p ? true : false;
 
 #if defined(ESP8266_USE_EXTERNAL_HEAP)
-        ESP.resetHeap();
+        if (psram)
+            ESP.resetHeap();
 #endif
 
         if (!nn)
             return NULL;
 
 #endif
+
+#if defined(MB_HEAP_PROFILE_ALLOC)
+        MB_HEAP_PROFILE_ALLOC("newP", site ? site : MB_HEAP_PROFILE_SITE, p, newLen);
+#else
+        (void)site;
+#endif
+
         if (clear)
             memset(p, 0, newLen);
         return p;
@@ -1,11 +1,18 @@
 
 /**
- * Mobizt's SRAM/PSRAM supported String, version 1.2.10
+ * Mobizt's SRAM/PSRAM supported String, version 1.2.11
  *
  * Created November 15, 2023
  *
  * Changes Log
  *
+ * v1.2.11
+ * - Add inline buffer for short string (MB_STRING_SSO_SIZE) and geometric buffer growth
+ * - Add external allocator option (MB_STRING_ALLOCATOR)
+ * - Add move constructor and move assignment, the c_str() pointer of moved short (inline) string is invalidated
+ * - Add PSRAM minimum buffer size (MB_STRING_PSRAM_MIN_SIZE), the smaller buffer is allocated from internal RAM
+ * - Add heap profiler hooks (MB_HEAP_PROFILE_ALLOC, MB_HEAP_PROFILE_REALLOC and MB_HEAP_PROFILE_FREE), the buffer
+ *   of external allocator is not recorded
  * 
  * v1.2.10
  * - add support Arduino UNO WiFi R4
@@ -98,6 +105,31 @@
 #define ESP8266_USE_EXTERNAL_HEAP
 #endif
 
+#if defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
+#include <esp_heap_caps.h>
+#endif
+
+// The heap profiler hooks record the buffer with the return address of memAlloc and memRealloc caller,
+// they are not inlined then
+#if defined(MB_HEAP_PROFILE_SITE) && !defined(MB_STRING_ALLOCATOR)
+#define MB_STRING_PROFILE_HOOKS
+#define MB_STRING_NOINLINE MB_HEAP_PROFILE_NOINLINE
+#else
+#define MB_STRING_NOINLINE
+#endif
+
+// The minimum buffer size that is allocated from PSRAM
+#if !defined(MB_STRING_PSRAM_MIN_SIZE)
+#define MB_STRING_PSRAM_MIN_SIZE 0
+#endif
+
+// The inline buffer size for short string which requires no heap allocation,
+// the object size is the pointer size plus this size (16 bytes on 32-bit MCU).
+#if !defined(MB_STRING_SSO_SIZE) || MB_STRING_SSO_SIZE < 4
+#undef MB_STRING_SSO_SIZE
+#define MB_STRING_SSO_SIZE 12
+#endif
+
 #if defined(ESP8266) || defined(ESP32)
 #define MBSTRING_FLASH_MCR FPSTR
 #elif defined(ARDUINO_ARCH_SAMD) || defined(__AVR_ATmega4809__) || defined(ARDUINO_NANO_RP2040_CONNECT)
@@ -526,6 +558,11 @@ public:
         *this = value;
     }
 
+    MB_String(MB_String &&value) noexcept
+    {
+        move(value);
+    }
+
     MB_String(const __FlashStringHelper *str)
     {
         *this = str;
@@ -558,7 +595,7 @@ public:
         int len = 1 + 8 * sizeof(unsigned char);
         reserve(len);
 
-        if (bufLen > 0)
+        if (bufferLength() > 0)
             utoa(value, buf, base);
     }
 
@@ -567,7 +604,7 @@ public:
         int len = 2 + 8 * sizeof(int);
         reserve(len);
 
-        if (bufLen > 0)
+        if (bufferLength() > 0)
         {
             if (base == 10)
                 sprintf(buf, (const char *)MBSTRING_FLASH_MCR("%d"), value);
@@ -581,7 +618,7 @@ public:
         int len = 1 + 8 * sizeof(unsigned int);
         reserve(len);
 
-        if (bufLen > 0)
+        if (bufferLength() > 0)
             utoa(value, buf, base);
     }
 
@@ -590,7 +627,7 @@ public:
         int len = 2 + 8 * sizeof(long);
         reserve(len);
 
-        if (bufLen > 0)
+        if (bufferLength() > 0)
         {
             if (base == 10)
                 sprintf(buf, (const char *)MBSTRING_FLASH_MCR("%ld"), value);
@@ -604,14 +641,14 @@ public:
         int len = 1 + 8 * sizeof(unsigned long);
         reserve(len);
 
-        if (bufLen > 0)
+        if (bufferLength() > 0)
             ultoa(value, buf, base);
     }
 
     MB_String(float value, unsigned char decimalPlaces = 2)
     {
         reserve(33);
-        if (bufLen > 0)
+        if (bufferLength() > 0)
         {
             char *v = toFloatStr(value, 0, decimalPlaces);
             if (v)
@@ -626,7 +663,7 @@ public:
     {
         reserve(33);
 
-        if (bufLen > 0)
+        if (bufferLength() > 0)
         {
             char *v = toFloatStr(value, 1, decimalPlaces);
             if (v)
@@ -640,7 +677,7 @@ public:
     MB_String(long double value, unsigned char decimalPlaces = 3)
     {
         reserve(65);
-        if (bufLen > 0)
+        if (bufferLength() > 0)
         {
             char *v = toFloatStr(value, 2, decimalPlaces);
             if (v)
@@ -750,6 +787,13 @@ public:
         return *this;
     }
 
+    MB_String &operator=(MB_String &&rhs) noexcept
+    {
+        if (this != &rhs)
+            move(rhs);
+        return *this;
+    }
+
     MB_String &operator+=(const MB_String &rhs)
     {
         concat(rhs);
@@ -835,7 +879,7 @@ public:
             unsigned int newlen = length() + len;
             reserve(newlen);
 
-            if (bufLen > 0)
+            if (bufferLength() > 0)
                 memcpy_P(buf + length(), (PGM_P)pstr, len + 1);
         }
 
@@ -1087,7 +1131,7 @@ public:
 
     char operator[](size_t index) const
     {
-        if (index >= bufLen || !buf)
+        if (index >= bufferLength() || !buf)
             return 0;
         return buf[index];
     }
@@ -1095,7 +1139,7 @@ public:
     char &operator[](size_t index)
     {
         static char c;
-        if (index >= bufLen || !buf)
+        if (index >= bufferLength() || !buf)
         {
             c = '\0';
             return c;
@@ -1121,7 +1165,6 @@ public:
             size_t slen = length();
             if (slen > 0)
                 buf[slen - 1] = '\0';
-            _reserve(slen, true);
         }
     }
 
@@ -1132,7 +1175,9 @@ public:
 
     size_t bufferLength() const
     {
-        return bufLen;
+        if (!buf)
+            return 0;
+        return isInline() ? MB_STRING_SSO_SIZE : _heapLen;
     }
 
     size_t find(const MB_String &s, size_t index = 0) const
@@ -1175,9 +1220,8 @@ public:
 
         memmove(buf + index, buf + index + len, rightLen);
 
+        // The buffer is kept for the next appends, use shrink_to_fit to release it
         buf[index + rightLen] = '\0';
-
-        _reserve(length(), true);
     }
 
     size_t length() const
@@ -1218,16 +1262,28 @@ public:
     {
         if (len == 0)
             len = 4;
+
+        if (len <= MB_STRING_SSO_SIZE)
+        {
+            allocate(0, false);
+            allocate(len, false);
+            buf[0] = '\0';
+            return;
+        }
+
+        if (isInline())
+            buf = NULL;
+
         ESP.setExternalHeap();
         if (buf)
-            buf = (char *)realloc(buf, len);
+            buf = (char *)memRealloc(buf, len);
         else
-            buf = (char *)malloc(len);
+            buf = (char *)memAlloc(len);
         ESP.resetHeap();
 
         if (buf)
         {
-            bufLen = len;
+            _heapLen = len;
             memset(buf, 0, len);
         }
     }
@@ -1478,6 +1534,12 @@ public:
 
     static const size_t npos = -1;
 
+    // Set the minimum buffer size that is allocated from PSRAM, the smaller buffer is allocated from internal RAM
+    static void setPSRAMMinSize(size_t size)
+    {
+        psramMinSize() = size;
+    }
+
 private:
 #if defined(ARDUINO_ARCH_SAMD) || defined(__AVR_ATmega4809__) || defined(ARDUINO_NANO_RP2040_CONNECT) || defined(ARDUINO_UNOWIFIR4)
 
@@ -1574,33 +1636,21 @@ private:
 
     void *newP(size_t len)
     {
-        void *p;
         size_t newLen = getReservedLen(len);
-#if defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
-        if (ESP.getPsramSize() > 0)
-            p = (void *)ps_malloc(newLen);
-        else
-            p = (void *)malloc(newLen);
-        if (!p)
-            return NULL;
-
-#else
 
 #if defined(ESP8266_USE_EXTERNAL_HEAP)
         ESP.setExternalHeap();
 #endif
 
-        p = (void *)malloc(newLen);
-        bool nn = p ? true : false;
+        void *p = memAlloc(newLen);
 
 #if defined(ESP8266_USE_EXTERNAL_HEAP)
         ESP.resetHeap();
 #endif
 
-        if (!nn)
+        if (!p)
             return NULL;
 
-#endif
         memset(p, 0, newLen);
         return p;
     }
@@ -1610,7 +1660,7 @@ private:
         void **p = (void **)ptr;
         if (*p)
         {
-            free(*p);
+            memFree(*p);
             *p = 0;
         }
     }
@@ -1683,25 +1733,93 @@ private:
         concat(cstr, strlen(cstr));
     }
 
+    // The heap buffer is taken from rhs, then the c_str() pointer that was taken from rhs
+    // stays valid only when rhs was not inline.
     void move(MB_String &rhs)
     {
-        if (buf)
+        // The inline string or the string that fits the current buffer is copied
+        if (rhs.isInline() || (buf && bufferLength() >= rhs.bufferLength()))
         {
-            if (bufLen >= rhs.bufLen)
-            {
-                strcpy(buf, rhs.buf);
-                bufLen = rhs.bufLen;
-                rhs.bufLen = 0;
-                return;
-            }
-            else
-            {
-                free(buf);
-            }
+            copy(rhs.c_str(), rhs.length());
+            rhs.allocate(0, false);
+            return;
         }
+
+        allocate(0, false);
         buf = rhs.buf;
-        bufLen = rhs.bufLen;
+        _heapLen = rhs._heapLen;
         rhs.buf = NULL;
+        rhs._heapLen = 0;
+    }
+
+    bool isInline() const
+    {
+        return buf == _sso;
+    }
+
+    static size_t &psramMinSize()
+    {
+        static size_t size = MB_STRING_PSRAM_MIN_SIZE;
+        return size;
+    }
+
+    // The buffer is allocated by the external allocator (MB_STRING_ALLOCATOR) or from PSRAM when available
+    // and the buffer is not smaller than the PSRAM minimum size
+    static MB_STRING_NOINLINE void *memAlloc(size_t len)
+    {
+        void *p = nullptr;
+#if defined(MB_STRING_ALLOCATOR)
+        p = MB_STRING_ALLOCATOR::alloc(len);
+#elif defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
+        if (ESP.getPsramSize() == 0)
+            p = malloc(len);
+        else if (len >= psramMinSize())
+            p = ps_malloc(len);
+        else
+            p = heap_caps_malloc(len, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+        p = malloc(len);
+#endif
+
+#if defined(MB_STRING_PROFILE_HOOKS)
+        MB_HEAP_PROFILE_ALLOC("MB_String", MB_HEAP_PROFILE_SITE, p, len);
+#endif
+        return p;
+    }
+
+    static MB_STRING_NOINLINE void *memRealloc(void *p, size_t len)
+    {
+        void *np = nullptr;
+#if defined(MB_STRING_ALLOCATOR)
+        np = MB_STRING_ALLOCATOR::resize(p, len);
+#elif defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
+        // The buffer is moved to the other memory when its new size crosses the PSRAM minimum size
+        if (ESP.getPsramSize() == 0)
+            np = realloc(p, len);
+        else if (len >= psramMinSize())
+            np = ps_realloc(p, len);
+        else
+            np = heap_caps_realloc(p, len, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+        np = realloc(p, len);
+#endif
+
+#if defined(MB_STRING_PROFILE_HOOKS)
+        MB_HEAP_PROFILE_REALLOC("MB_String", MB_HEAP_PROFILE_SITE, p, np, len);
+#endif
+        return np;
+    }
+
+    static void memFree(void *p)
+    {
+#if defined(MB_STRING_PROFILE_HOOKS)
+        MB_HEAP_PROFILE_FREE(p);
+#endif
+#if defined(MB_STRING_ALLOCATOR)
+        MB_STRING_ALLOCATOR::dealloc(p);
+#else
+        free(p);
+#endif
     }
 
     void allocate(size_t len, bool shrink)
@@ -1709,52 +1827,74 @@ private:
 
         if (len == 0)
         {
-            if (buf)
-                free(buf);
+            if (buf && !isInline())
+                memFree(buf);
             buf = NULL;
-            bufLen = 0;
+            _heapLen = 0;
+            return;
+        }
+
+        // The short string is kept in the inline buffer
+        if (len <= MB_STRING_SSO_SIZE && (!buf || isInline() || shrink))
+        {
+            if (!isInline())
+            {
+                size_t slen = buf ? strlen(buf) : 0;
+                if (slen > MB_STRING_SSO_SIZE - 1)
+                    slen = MB_STRING_SSO_SIZE - 1;
+
+                if (buf)
+                {
+                    memcpy(_sso, buf, slen);
+                    memFree(buf);
+                }
+
+                _sso[slen] = '\0';
+                buf = _sso;
+            }
+
             return;
         }
 
-        if (len > bufLen || shrink)
+        if (len > bufferLength() || shrink)
         {
 
 #if defined(ESP8266_USE_EXTERNAL_HEAP)
             ESP.setExternalHeap();
 #endif
 
-            if (shrink || (bufLen > 0 && buf))
+            if (isInline())
             {
-                int slen = length();
+                // The inline string is moved to the heap buffer
+                char *p = (char *)memAlloc(len);
+                if (p)
+                {
+                    strcpy(p, _sso);
+                    buf = p;
+                    _heapLen = len;
+                }
+            }
+            else if (buf)
+            {
+                // The string is cut when the buffer is shrunk below its length
+                size_t slen = length() < len ? length() : len - 1;
 
-#if defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
-                if (ESP.getPsramSize() > 0)
-                    buf = (char *)ps_realloc(buf, len);
-                else
-                    buf = (char *)realloc(buf, len);
-#else
-                buf = (char *)realloc(buf, len);
-#endif
-                if (buf)
+                // The old buffer is kept when it can not be resized
+                char *p = (char *)memRealloc(buf, len);
+                if (p)
                 {
+                    buf = p;
                     buf[slen] = '\0';
-                    bufLen = len;
+                    _heapLen = len;
                 }
             }
             else
             {
-#if defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
-                if (ESP.getPsramSize() > 0)
-                    buf = (char *)ps_malloc(len);
-                else
-                    buf = (char *)malloc(len);
-#else
-                buf = (char *)malloc(len);
-#endif
+                buf = (char *)memAlloc(len);
                 if (buf)
                 {
                     buf[0] = '\0';
-                    bufLen = len;
+                    _heapLen = len;
                 }
             }
 
@@ -1785,10 +1925,15 @@ private:
         size_t newlen = getReservedLen(len);
         if (shrink)
             allocate(newlen, true);
-        else if (newlen > bufLen)
-            allocate(newlen, false);
+        else if (newlen > bufferLength())
+        {
+            // Grow the existing buffer by half of its size at least to amortize the appends
+            size_t bufLen = bufferLength();
+            size_t growLen = bufLen + bufLen / 2;
+            allocate(bufLen > 0 && growLen > newlen ? getReservedLen(growLen) : newlen, false);
+        }
 
-        return newlen <= bufLen;
+        return newlen <= bufferLength();
     }
 
     int strpos(const char *haystack, const char *needle, int offset) const
@@ -2031,7 +2176,12 @@ private:
 #endif
 
     char *buf = NULL;
-    size_t bufLen = 0;
+    // The heap buffer length shares the memory with the inline buffer that is in use when buf is _sso
+    union
+    {
+        size_t _heapLen = 0;
+        char _sso[MB_STRING_SSO_SIZE];
+    };
 };
 
 inline MB_String operator+(const MB_String &lhs, const MB_String &rhs)
@@ -2054,13 +2204,13 @@ inline MB_String operator+(MB_String &&lhs, const MB_String &rhs)
 inline MB_String operator+(MB_String &lhs, MB_String &&rhs)
 {
     lhs += rhs;
-    return std::move(lhs);
+    return lhs;
 }
 
 inline MB_String operator+(MB_String &lhs, char rhs)
 {
     lhs += rhs;
-    return std::move(lhs);
+    return lhs;
 }
 
 inline MB_String operator+(char lhs, MB_String &rhs)
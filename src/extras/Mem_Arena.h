@@ -0,0 +1,234 @@
+#pragma once
+
+#ifndef MEM_ARENA_H
+#define MEM_ARENA_H
+
+/**
+ * The arena (bump) allocator for the temporary buffers of one mail operation e.g. sendMail or readMail.
+ *
+ * The memory block is allocated when the outermost operation begins and released when it ends, then
+ * the heap is not fragmented by the temporary buffers that are allocated and freed during the operation.
+ *
+ * The freed buffers at the top of arena are reclaimed immediately, the other freed buffers are reclaimed
+ * when the buffers above them are freed. The buffer that does not fit the remaining space or is larger than
+ * a quarter of arena is not allocated from arena, the caller should allocate it from heap (or PSRAM) instead.
+ *
+ * The memory block is allocated from internal RAM, the arena only holds the small buffers which are accessed often.
+ *
+ * The buffers that are not freed when the operation ends keep the memory block until they are freed.
+ *
+ * The arena of MailClient is shared by all sessions. The operations of sessions that run in different tasks
+ * are nested as the operations of one session (the memory block is released when the last one ends) and
+ * every call is guarded by the recursive mutex of library shared state (ESP_Mail_Mem::Lock) that also guards
+ * the intern table, the arena is not per session as the memory block would be allocated for every session.
+ */
+
+#include <Arduino.h>
+
+#if defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
+#include <esp_heap_caps.h>
+#endif
+
+struct mem_arena_stats_t
+{
+  // The size of arena memory block
+  size_t capacity = 0;
+  // The bytes in use (including the buffer headers)
+  size_t used = 0;
+  // The maximum bytes in use
+  size_t peak = 0;
+  // The number of buffers allocated from arena
+  size_t allocations = 0;
+  // The number of buffers that were allocated from heap instead
+  size_t fallbacks = 0;
+  // The number of buffers that are not freed
+  size_t live = 0;
+};
+
+class Mem_Arena
+{
+public:
+  Mem_Arena(){};
+  ~Mem_Arena()
+  {
+    Lock lock;
+    release();
+  };
+
+  /**
+   * Begin the operation, the memory block is allocated by the outermost operation.
+   * @param size The size of memory block, 0 for no arena.
+   */
+  void begin(size_t size)
+  {
+    Lock lock;
+    if (_depth++ > 0)
+      return;
+
+    if (_stats.live == 0)
+    {
+      size_t capacity = _stats.capacity;
+      _stats = mem_arena_stats_t();
+      _stats.capacity = capacity;
+      _top = 0;
+    }
+
+    if (!_base && _static)
+    {
+      _base = _static;
+      _stats.capacity = _staticSize;
+    }
+    else if (!_base && size >= 64)
+    {
+      size = size & ~(size_t)3;
+
+#if defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
+      _base = (uint8_t *)heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+      _base = (uint8_t *)malloc(size);
+#endif
+
+      _stats.capacity = _base ? size : 0;
+    }
+  }
+
+  /**
+   * Set the static memory block that is used instead of the allocated memory block.
+   * @param buf The memory block.
+   * @param size The size of memory block.
+   */
+  void setBuffer(uint8_t *buf, size_t size)
+  {
+    Lock lock;
+    _static = size >= 64 ? buf : nullptr;
+    _staticSize = size & ~(size_t)3;
+  }
+
+  // End the operation, the memory block is released by the outermost operation when all buffers were freed
+  void end()
+  {
+    Lock lock;
+    if (_depth == 0 || --_depth > 0)
+      return;
+
+    if (_stats.live == 0)
+      release();
+  }
+
+  /**
+   * Allocate the buffer.
+   * @param size The buffer size.
+   * @param clear The option to clear the buffer.
+   * @return The buffer or nullptr if the buffer should be allocated from heap.
+   */
+  void *alloc(size_t size, bool clear)
+  {
+    Lock lock;
+    if (!_base || _depth == 0)
+      return nullptr;
+
+    size_t n = size > 0 ? (size + 3) & ~(size_t)3 : 4;
+
+    if (n > _stats.capacity / 4 || _top + n + 2 * sizeof(uint32_t) > _stats.capacity)
+    {
+      _stats.fallbacks++;
+      return nullptr;
+    }
+
+    // The buffer size is kept in the header and footer to reclaim the freed buffers from the top
+    *reinterpret_cast<uint32_t *>(_base + _top) = n;
+    uint8_t *p = _base + _top + sizeof(uint32_t);
+    *reinterpret_cast<uint32_t *>(p + n) = n;
+    _top += n + 2 * sizeof(uint32_t);
+
+    _stats.allocations++;
+    _stats.live++;
+    _stats.used = _top;
+    if (_top > _stats.peak)
+      _stats.peak = _top;
+
+    if (clear)
+      memset(p, 0, n);
+
+    return p;
+  }
+
+  // The buffer was allocated from arena
+  bool owns(const void *ptr) const
+  {
+    Lock lock;
+    return _base && ptr >= _base && ptr < _base + _stats.capacity;
+  }
+
+  // Free the buffer that was allocated from arena
+  void dealloc(void *ptr)
+  {
+    Lock lock;
+    if (!owns(ptr) || _stats.live == 0)
+      return;
+
+    uint32_t *header = reinterpret_cast<uint32_t *>((uint8_t *)ptr - sizeof(uint32_t));
+    if (*header & 1)
+      return;
+
+    // The freed flag
+    *header |= 1;
+    _stats.live--;
+
+    if (_stats.live == 0)
+      _top = 0;
+
+    while (_top > 0)
+    {
+      uint32_t n = *reinterpret_cast<uint32_t *>(_base + _top - sizeof(uint32_t));
+      uint32_t *h = reinterpret_cast<uint32_t *>(_base + _top - n - 2 * sizeof(uint32_t));
+      if (!(*h & 1))
+        break;
+      _top -= n + 2 * sizeof(uint32_t);
+    }
+
+    _stats.used = _top;
+
+    if (_stats.live == 0 && _depth == 0)
+      release();
+  }
+
+  // Get the statistics of current or last operation
+  mem_arena_stats_t stats() const
+  {
+    Lock lock;
+    return _stats;
+  }
+
+private:
+  typedef ESP_Mail_Mem::Lock Lock;
+
+  uint8_t *_base = nullptr;
+  uint8_t *_static = nullptr;
+  size_t _staticSize = 0;
+  size_t _top = 0;
+  int _depth = 0;
+  mem_arena_stats_t _stats;
+
+  void release()
+  {
+    if (_base && _base != _static)
+      free(_base);
+    _base = nullptr;
+    _top = 0;
+    _stats.used = 0;
+  }
+};
+
+// Begin the arena operation in the scope and end it when the scope exits
+class Mem_Arena_Scope
+{
+public:
+  Mem_Arena_Scope(Mem_Arena &arena, size_t size) : _arena(arena) { _arena.begin(size); };
+  ~Mem_Arena_Scope() { _arena.end(); };
+
+private:
+  Mem_Arena &_arena;
+};
+
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+
+#ifndef MEM_PLACEMENT_H
+#define MEM_PLACEMENT_H
+
+/**
+ * The placement policy of library buffers on the device with PSRAM.
+ *
+ * Every buffer is allocated for one purpose and each purpose has its memory tier, the buffer of auto tier
+ * is allocated from PSRAM when it is not smaller than the threshold. The string buffers of the message header
+ * records are placed by the header_record tier (MB_String::setPSRAMMinSize).
+ */
+
+#include <Arduino.h>
+#include "./ESP_Mail_FS.h"
+
+/* The purposes of library buffers enum used in memory placement */
+enum esp_mail_mem_purpose
+{
+  // The short-lived buffers e.g. the formatted status and the parsing buffers
+  esp_mail_mem_purpose_general,
+  // The server response read buffers that are accessed for every byte read
+  esp_mail_mem_purpose_response_buffer,
+  // The chunk buffers of attachment and content upload, download and digest
+  esp_mail_mem_purpose_attachment_staging,
+  // The output buffers of decoded or encoded message body
+  esp_mail_mem_purpose_decoded_body
+};
+
+/* The memory tiers enum used in memory placement */
+enum esp_mail_mem_tier
+{
+  // PSRAM when the buffer is not smaller than the policy threshold, otherwise internal RAM
+  esp_mail_mem_tier_auto,
+  esp_mail_mem_tier_internal,
+  esp_mail_mem_tier_psram
+};
+
+#if !defined(ESP_MAIL_PSRAM_THRESHOLD)
+#define ESP_MAIL_PSRAM_THRESHOLD 2048
+#endif
+
+/* The placement policy of library buffers on the device with PSRAM */
+struct esp_mail_mem_placement_policy_t
+{
+  // The buffer size in bytes that the buffer of auto tier is allocated from PSRAM
+  size_t psram_threshold = ESP_MAIL_PSRAM_THRESHOLD;
+  esp_mail_mem_tier general = esp_mail_mem_tier_auto;
+  esp_mail_mem_tier response_buffer = esp_mail_mem_tier_internal;
+  esp_mail_mem_tier attachment_staging = esp_mail_mem_tier_psram;
+  esp_mail_mem_tier decoded_body = esp_mail_mem_tier_auto;
+  // The string buffers of message header records and other strings
+  esp_mail_mem_tier header_record = esp_mail_mem_tier_auto;
+
+  /**
+   * Check whether the buffer should be allocated from PSRAM when PSRAM is available.
+   * @param size The buffer size.
+   * @param purpose The buffer purpose.
+   * @return The PSRAM placement.
+   */
+  bool placeInPSRAM(size_t size, esp_mail_mem_purpose purpose) const
+  {
+    esp_mail_mem_tier tier = general;
+
+    switch (purpose)
+    {
+    case esp_mail_mem_purpose_response_buffer:
+      tier = response_buffer;
+      break;
+    case esp_mail_mem_purpose_attachment_staging:
+      tier = attachment_staging;
+      break;
+    case esp_mail_mem_purpose_decoded_body:
+      tier = decoded_body;
+      break;
+    default:
+      break;
+    }
+
+    if (tier == esp_mail_mem_tier_auto)
+      return size >= psram_threshold;
+
+    return tier == esp_mail_mem_tier_psram;
+  }
+
+  /**
+   * Get the minimum string buffer size that is allocated from PSRAM (header_record tier).
+   * @return The buffer size, SIZE_MAX when no string is placed in PSRAM.
+   */
+  size_t stringPSRAMMinSize() const
+  {
+    if (header_record == esp_mail_mem_tier_internal)
+      return SIZE_MAX;
+    else if (header_record == esp_mail_mem_tier_psram)
+      return 0;
+    return psram_threshold;
+  }
+};
+
+#endif
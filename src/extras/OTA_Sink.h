@@ -0,0 +1,278 @@
+#pragma once
+
+#ifndef OTA_SINK_H
+#define OTA_SINK_H
+
+/**
+ * The firmware update (OTA) sink that writes the firmware data to Update in flash sector size (4 KB) blocks.
+ *
+ * In ESP32, the blocks are double-buffered and written by the writer task while the next block
+ * is being received. In other devices, the blocks are written synchronously.
+ *
+ * The last block is held until end() and written only when the SHA-256 digest of firmware data
+ * matches the expected digest, then the mismatched firmware is never finalized.
+ */
+
+#include <Arduino.h>
+#include "./extras/SHA256_Digest.h"
+
+#if defined(ESP_MAIL_OTA_UPDATE_ENABLED)
+
+#define OTA_SINK_BUF_SIZE 4096
+#define OTA_SINK_TASK_STACK_SIZE 4096
+
+class OTA_Sink
+{
+public:
+  OTA_Sink(){};
+  ~OTA_Sink() { release(); };
+
+  /**
+   * Start the firmware update.
+   * @param size The firmware size.
+   * @return The boolean value indicates the success of operation.
+   */
+  bool begin(size_t size)
+  {
+    release();
+
+    _error = false;
+    _mismatch = false;
+    _bufLen = 0;
+    _cur = 0;
+    _digest.begin();
+
+    // The second buffer is for double buffering
+    int count = 1;
+#if defined(ESP32)
+    count = 2;
+#endif
+
+    for (int i = 0; i < count; i++)
+    {
+      _buf[i] = (uint8_t *)malloc(OTA_SINK_BUF_SIZE);
+      if (!_buf[i])
+      {
+        release();
+        return false;
+      }
+    }
+
+    if (!Update.begin(size))
+    {
+      release();
+      return false;
+    }
+
+#if defined(ESP32)
+    _ready = xSemaphoreCreateBinary();
+    _done = xSemaphoreCreateBinary();
+    _stop = false;
+
+    if (_ready && _done && xTaskCreate(writerTask, "ota_sink", OTA_SINK_TASK_STACK_SIZE, this, uxTaskPriorityGet(NULL), &_task) == pdPASS)
+      xSemaphoreGive(_done);
+    else
+      _task = NULL; // write synchronously
+#endif
+
+    _active = true;
+    return true;
+  }
+
+  /**
+   * Write the firmware data.
+   * @param data The firmware data.
+   * @param len The length of data.
+   * @return The length of data accepted, 0 for write error.
+   */
+  size_t write(const uint8_t *data, size_t len)
+  {
+    if (!_active || _error)
+      return 0;
+
+    _digest.update(data, len);
+
+    size_t n = len;
+    while (len > 0)
+    {
+      // The full block is written when more data comes, the last block is held until end()
+      if (_bufLen == OTA_SINK_BUF_SIZE && !commit())
+        return 0;
+
+      size_t c = OTA_SINK_BUF_SIZE - _bufLen;
+      if (c > len)
+        c = len;
+
+      memcpy(_buf[_cur] + _bufLen, data, c);
+      _bufLen += c;
+      data += c;
+      len -= c;
+    }
+
+    return n;
+  }
+
+  /**
+   * Finish the firmware update.
+   * @param evenIfRemaining The option to finish the update even the firmware size is less than the size set in begin().
+   * @param sha256 The hex string of expected SHA-256 digest or empty string for no verification.
+   * @return The boolean value indicates the success of operation.
+   */
+  bool end(bool evenIfRemaining, const char *sha256)
+  {
+    if (!_active)
+      return false;
+
+    bool ret = wait() && !_error;
+
+    if (ret && sha256 && strlen(sha256) > 0 && !_digest.matchHex(sha256))
+    {
+      _mismatch = true;
+      ret = false;
+    }
+
+    if (ret && _bufLen > 0)
+      ret = Update.write(_buf[_cur], _bufLen) == _bufLen;
+
+    // Without the last block, the incomplete update will be aborted
+    ret = Update.end(ret ? evenIfRemaining : false) && ret;
+
+    release();
+    return ret;
+  }
+
+  // Abort the firmware update
+  void abort()
+  {
+    if (!_active)
+      return;
+
+    wait();
+    Update.end(false);
+    release();
+  }
+
+  // The firmware update is in progress
+  bool active() { return _active; }
+
+  // The SHA-256 digest of firmware data does not match the expected digest
+  bool digestMismatch() { return _mismatch; }
+
+private:
+  uint8_t *_buf[2] = {nullptr, nullptr};
+  size_t _bufLen = 0;
+  int _cur = 0;
+  bool _active = false;
+  volatile bool _error = false;
+  bool _mismatch = false;
+  SHA256_Digest _digest;
+
+#if defined(ESP32)
+  TaskHandle_t _task = NULL;
+  SemaphoreHandle_t _ready = NULL;
+  SemaphoreHandle_t _done = NULL;
+  uint8_t *_pending = nullptr;
+  size_t _pendingLen = 0;
+  volatile bool _stop = false;
+
+  static void writerTask(void *param)
+  {
+    OTA_Sink *sink = reinterpret_cast<OTA_Sink *>(param);
+
+    for (;;)
+    {
+      xSemaphoreTake(sink->_ready, portMAX_DELAY);
+
+      if (sink->_stop)
+        break;
+
+      if (Update.write(sink->_pending, sink->_pendingLen) != sink->_pendingLen)
+        sink->_error = true;
+
+      xSemaphoreGive(sink->_done);
+    }
+
+    xSemaphoreGive(sink->_done);
+    vTaskDelete(NULL);
+  }
+#endif
+
+  // Write the current block and switch to the other buffer
+  bool commit()
+  {
+#if defined(ESP32)
+    if (_task)
+    {
+      // Wait for the previous block to be written
+      xSemaphoreTake(_done, portMAX_DELAY);
+
+      if (_error)
+        return false;
+
+      _pending = _buf[_cur];
+      _pendingLen = _bufLen;
+      xSemaphoreGive(_ready);
+
+      _cur = 1 - _cur;
+      _bufLen = 0;
+      return true;
+    }
+#endif
+
+    if (Update.write(_buf[_cur], _bufLen) != _bufLen)
+    {
+      _error = true;
+      return false;
+    }
+
+    _bufLen = 0;
+    return true;
+  }
+
+  // Wait for the pending block to be written and stop the writer task
+  bool wait()
+  {
+#if defined(ESP32)
+    if (_task)
+    {
+      xSemaphoreTake(_done, portMAX_DELAY);
+      _stop = true;
+      xSemaphoreGive(_ready);
+      xSemaphoreTake(_done, portMAX_DELAY);
+      _task = NULL;
+    }
+#endif
+    return !_error;
+  }
+
+  void release()
+  {
+#if defined(ESP32)
+    if (_task)
+      wait();
+
+    if (_ready)
+      vSemaphoreDelete(_ready);
+
+    if (_done)
+      vSemaphoreDelete(_done);
+
+    _ready = NULL;
+    _done = NULL;
+#endif
+
+    for (int i = 0; i < 2; i++)
+    {
+      if (_buf[i])
+        free(_buf[i]);
+      _buf[i] = nullptr;
+    }
+
+    _bufLen = 0;
+    _active = false;
+  }
+};
+
+#endif
+
+#endif
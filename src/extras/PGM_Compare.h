@@ -0,0 +1,188 @@
+#pragma once
+
+#ifndef PGM_COMPARE_H
+#define PGM_COMPARE_H
+
+/**
+ * The non-allocating compare, search and case folding of the string in RAM with the token in flash (PROGMEM).
+ *
+ * The token is read byte by byte with pgm_read_byte, then no RAM copy of the token or the string is needed.
+ * The search is anchored by memchr on the first token character when the search is case sensitive
+ * or the first token character has no case.
+ */
+
+#include <Arduino.h>
+
+class PGM_Compare
+{
+public:
+  // The ASCII lower case character
+  static inline char fold(char c) { return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c; }
+
+  /**
+   * Compare the beginning of string with the token.
+   * @param s The string in RAM.
+   * @param token The token in flash.
+   * @param caseSensitive The case sensitive compare option.
+   * @return The boolean value indicates the string begins with the token.
+   */
+  static bool startsWith(const char *s, PGM_P token, bool caseSensitive = true)
+  {
+    if (!s || !token)
+      return false;
+
+    char c;
+    while ((c = pgm_read_byte(token++)) != 0)
+    {
+      // The end of string is a mismatch
+      if (!equals(*s++, c, caseSensitive))
+        return false;
+    }
+    return true;
+  }
+
+  /**
+   * Compare the string with the token.
+   * @param s The string in RAM.
+   * @param token The token in flash.
+   * @param caseSensitive The case sensitive compare option.
+   * @return The boolean value indicates the string equals the token.
+   */
+  static bool equals(const char *s, PGM_P token, bool caseSensitive = true)
+  {
+    return startsWith(s, token, caseSensitive) && s[strlen_P(token)] == 0;
+  }
+
+  /**
+   * Find the token in string.
+   * @param s The string in RAM.
+   * @param len The length of string.
+   * @param token The token in flash.
+   * @param ofs The offset in string to start the search.
+   * @param caseSensitive The case sensitive search option.
+   * @return The index of token in string or -1 if not found.
+   */
+  static int find(const char *s, size_t len, PGM_P token, size_t ofs, bool caseSensitive = true)
+  {
+    if (!s || !token)
+      return -1;
+    return search(s, len, token, strlen_P(token), ofs, caseSensitive, true);
+  }
+
+  // Find the token in flash in the null-terminated string
+  static int find(const char *s, PGM_P token, size_t ofs, bool caseSensitive = true)
+  {
+    if (!s)
+      return -1;
+    return find(s, strlen(s), token, ofs, caseSensitive);
+  }
+
+  // Find the token in RAM in the null-terminated string
+  static int findRAM(const char *s, const char *token, size_t ofs, bool caseSensitive = true)
+  {
+    if (!s || !token)
+      return -1;
+    return search(s, strlen(s), token, strlen(token), ofs, caseSensitive, false);
+  }
+
+  /**
+   * Find the character in token.
+   * @param token The token in flash.
+   * @param c The character to find.
+   * @return The index of character in token or -1 if not found (also for NUL character).
+   */
+  static int indexOf(PGM_P token, char c)
+  {
+    if (!token || c == 0)
+      return -1;
+
+    char t;
+    for (int i = 0; (t = pgm_read_byte(token + i)) != 0; i++)
+    {
+      if (t == c)
+        return i;
+    }
+    return -1;
+  }
+
+  /**
+   * Copy the token to buffer.
+   * @param dst The destination buffer.
+   * @param size The size of destination buffer, the copied token will be truncated to fit.
+   * @param token The token in flash.
+   * @param lowerCase The option to fold the token to lower case.
+   * @return The number of characters copied excluding the terminating NUL.
+   */
+  static size_t copy(char *dst, size_t size, PGM_P token, bool lowerCase = false)
+  {
+    if (!dst || size == 0)
+      return 0;
+
+    size_t i = 0;
+    char c;
+    while (token && i < size - 1 && (c = pgm_read_byte(token + i)) != 0)
+      dst[i++] = lowerCase ? fold(c) : c;
+
+    dst[i] = 0;
+    return i;
+  }
+
+private:
+  static inline bool equals(char a, char b, bool caseSensitive)
+  {
+    return caseSensitive ? a == b : fold(a) == fold(b);
+  }
+
+  static inline bool hasCase(char c)
+  {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+  }
+
+  static inline char tokenAt(const char *token, size_t i, bool pgm)
+  {
+    return pgm ? (char)pgm_read_byte(token + i) : token[i];
+  }
+
+  static int search(const char *s, size_t len, const char *token, size_t tlen, size_t ofs, bool caseSensitive, bool pgm)
+  {
+    if (tlen == 0 || ofs >= len || tlen > len - ofs)
+      return -1;
+
+    char first = tokenAt(token, 0, pgm);
+    // The first character of token that has no case is also anchored by memchr
+    bool anchored = caseSensitive || !hasCase(first);
+    char ffirst = fold(first);
+
+    // The last position that the token can begin
+    const char *end = s + len - tlen;
+    const char *p = s + ofs;
+
+    while (p <= end)
+    {
+      if (anchored)
+      {
+        p = (const char *)memchr(p, first, end - p + 1);
+        if (!p)
+          return -1;
+      }
+      else if (fold(*p) != ffirst)
+      {
+        p++;
+        continue;
+      }
+
+      size_t i = 1;
+      while (i < tlen && equals(p[i], tokenAt(token, i, pgm), caseSensitive))
+        i++;
+
+      if (i == tlen)
+        return p - s;
+
+      p++;
+    }
+
+    return -1;
+  }
+};
+
+#endif
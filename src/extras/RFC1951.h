@@ -0,0 +1,816 @@
+#pragma once
+
+#ifndef RFC1951_H
+#define RFC1951_H
+
+/**
+ * The raw DEFLATE (RFC 1951) stream inflater and deflater which used by IMAP COMPRESS=DEFLATE extension (RFC 4978).
+ *
+ * The inflater supports all block types and its history (sliding window) size is configurable.
+ * The history should not be smaller than the window that server uses (32 kB for zlib default) otherwise
+ * the stream error will occur when server refers to the data that is out of the window.
+ * The inflater never waits for the data, the decoding step that its input was not received yet is undone
+ * and it will be decoded again when more data is available.
+ *
+ * The deflater compresses the data with fixed Huffman codes and LZ77 matches in small bounded window,
+ * and the sync flush (empty stored block) is always performed after writing the data.
+ */
+
+#include <Arduino.h>
+#include <Client.h>
+#include "./ESP_Mail_FS.h"
+#include "./extras/MB_FS.h"
+
+#define RFC1951_MAX_BITS 15
+#define RFC1951_MAX_LCODES 286
+#define RFC1951_MAX_DCODES 30
+#define RFC1951_FIX_LCODES 288
+#define RFC1951_MIN_MATCH 3
+#define RFC1951_MAX_MATCH 258
+#define RFC1951_MAX_DEFLATE_WINDOW_BITS 12
+#define RFC1951_DEFLATE_HASH_SIZE 256
+#define RFC1951_DEFLATE_MAX_CHAIN 16
+#define RFC1951_DEFLATE_OUT_BUF_SIZE 256
+
+// The input buffer of inflater, should fit the largest dynamic block header (about 600 bytes)
+#define RFC1951_INFLATE_IN_BUF_SIZE 1024
+
+static const uint16_t rfc1951_length_base[29] PROGMEM = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t rfc1951_length_extra[29] PROGMEM = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t rfc1951_dist_base[30] PROGMEM = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const uint8_t rfc1951_dist_extra[30] PROGMEM = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const uint8_t rfc1951_code_length_order[19] PROGMEM = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+class RFC1951_Inflater
+{
+public:
+  RFC1951_Inflater(){};
+  ~RFC1951_Inflater() { end(); };
+
+  /**
+   * Allocate the history and input buffers.
+   * @param mbfs The MB_FS object for memory allocation.
+   * @param windowBits The history buffer size in bits (8 to 15).
+   * @return The boolean value which indicates the success of operation.
+   */
+  bool begin(MB_FS *mbfs, uint8_t windowBits)
+  {
+    end();
+
+    if (windowBits < 8)
+      windowBits = 8;
+    else if (windowBits > RFC1951_MAX_BITS)
+      windowBits = RFC1951_MAX_BITS;
+
+    _mbfs = mbfs;
+    _size = 1UL << windowBits;
+    _window = (uint8_t *)_mbfs->newP(_size, false);
+    _in = (uint8_t *)_mbfs->newP(RFC1951_INFLATE_IN_BUF_SIZE, false);
+
+    if (!_window || !_in)
+    {
+      end();
+      return false;
+    }
+
+    _mask = _size - 1;
+    return true;
+  }
+
+  /**
+   * Free the history and input buffers and reset the stream state.
+   */
+  void end()
+  {
+    if (_mbfs)
+    {
+      if (_window)
+        _mbfs->delP(&_window);
+      if (_in)
+        _mbfs->delP(&_in);
+    }
+    _window = nullptr;
+    _in = nullptr;
+    _inPos = 0;
+    _inLen = 0;
+    _short = false;
+    _wpos = 0;
+    _rpos = 0;
+    _total = 0;
+    _bitBuf = 0;
+    _bitCount = 0;
+    _state = state_header;
+    _final = false;
+    _error = false;
+    _stored = 0;
+    _copyLen = 0;
+    _copyDist = 0;
+  }
+
+  /**
+   * Inflate the compressed data that was received by client, this does not wait for the data.
+   * @param client The client to read the compressed data.
+   * @return The number of inflated bytes that available to read or -1 for stream error.
+   */
+  int available(Client *client)
+  {
+    if (!_window || _error)
+      return -1;
+
+    _client = client;
+
+    // Inflate while there is space in the history buffer for unread data
+    while (!_error && unread() < _size && !(_state == state_header && _final))
+    {
+      checkpoint_t cp;
+      save(cp);
+
+      step();
+
+      // The input of this step was not received yet, undo it and retry when more data is received
+      if (_short)
+      {
+        restore(cp);
+        if (!fill())
+          break;
+      }
+    }
+
+    return _error ? -1 : (int)unread();
+  }
+
+  /**
+   * Read one inflated byte.
+   * @return The byte value or -1 when no data available.
+   */
+  int read()
+  {
+    if (!_window || unread() == 0)
+      return -1;
+    return _window[_rpos++ & _mask];
+  }
+
+  /**
+   * Read the inflated data.
+   * @param buf The buffer to store data.
+   * @param len The size of buffer.
+   * @return The number of bytes read.
+   */
+  int read(uint8_t *buf, int len)
+  {
+    int n = 0;
+    while (n < len && _window && unread() > 0)
+      buf[n++] = _window[_rpos++ & _mask];
+    return n;
+  }
+
+private:
+  enum state_type
+  {
+    state_header,
+    state_stored,
+    state_codes
+  };
+
+  struct huffman_t
+  {
+    uint16_t count[RFC1951_MAX_BITS + 1];
+    uint16_t symbol[RFC1951_FIX_LCODES];
+  };
+
+  // The decoding state before the step, the output is written only when the step is completed
+  struct checkpoint_t
+  {
+    uint16_t inPos;
+    uint32_t bitBuf;
+    uint8_t bitCount;
+    state_type state;
+    bool final;
+    uint16_t stored;
+    uint16_t copyLen;
+    uint16_t copyDist;
+  };
+
+  MB_FS *_mbfs = nullptr;
+  Client *_client = nullptr;
+  uint8_t *_in = nullptr;
+  uint16_t _inPos = 0;
+  uint16_t _inLen = 0;
+  // The input of current step was not received yet
+  bool _short = false;
+  uint8_t *_window = nullptr;
+  uint32_t _size = 0;
+  uint32_t _mask = 0;
+  uint32_t _wpos = 0;
+  uint32_t _rpos = 0;
+  uint32_t _total = 0;
+  uint32_t _bitBuf = 0;
+  uint8_t _bitCount = 0;
+  state_type _state = state_header;
+  bool _final = false;
+  bool _error = false;
+  uint16_t _stored = 0;
+  uint16_t _copyLen = 0;
+  uint16_t _copyDist = 0;
+  huffman_t _lencode;
+  huffman_t _distcode;
+
+  uint32_t unread() { return _wpos - _rpos; }
+
+  void put(uint8_t c)
+  {
+    _window[_wpos++ & _mask] = c;
+    if (_total < _size)
+      _total++;
+  }
+
+  void save(checkpoint_t &cp)
+  {
+    cp.inPos = _inPos;
+    cp.bitBuf = _bitBuf;
+    cp.bitCount = _bitCount;
+    cp.state = _state;
+    cp.final = _final;
+    cp.stored = _stored;
+    cp.copyLen = _copyLen;
+    cp.copyDist = _copyDist;
+  }
+
+  void restore(const checkpoint_t &cp)
+  {
+    _inPos = cp.inPos;
+    _bitBuf = cp.bitBuf;
+    _bitCount = cp.bitCount;
+    _state = cp.state;
+    _final = cp.final;
+    _stored = cp.stored;
+    _copyLen = cp.copyLen;
+    _copyDist = cp.copyDist;
+    // The error from incomplete input is not the stream error
+    _error = false;
+    _short = false;
+  }
+
+  // Read the received data into input buffer, return false when no data was read
+  bool fill()
+  {
+    if (_inPos > 0)
+    {
+      memmove(_in, _in + _inPos, _inLen - _inPos);
+      _inLen -= _inPos;
+      _inPos = 0;
+    }
+
+    // The step input is larger than the input buffer
+    if (_inLen == RFC1951_INFLATE_IN_BUF_SIZE)
+    {
+      _error = true;
+      return false;
+    }
+
+    int n = _client->available();
+    if (n <= 0)
+      return false;
+
+    if (n > RFC1951_INFLATE_IN_BUF_SIZE - _inLen)
+      n = RFC1951_INFLATE_IN_BUF_SIZE - _inLen;
+
+    n = _client->read(_in + _inLen, n);
+    if (n <= 0)
+      return false;
+
+    _inLen += n;
+    return true;
+  }
+
+  // Decode one block header, stored byte, copied byte or symbol
+  void step()
+  {
+    _short = false;
+
+    if (_state == state_header)
+      readBlockHeader();
+    else if (_state == state_stored)
+    {
+      if (_stored == 0)
+      {
+        _state = state_header;
+        return;
+      }
+
+      uint8_t c = nextByte();
+      if (_short)
+        return;
+      put(c);
+      _stored--;
+    }
+    else if (_copyLen > 0)
+    {
+      put(_window[(_wpos - _copyDist) & _mask]);
+      _copyLen--;
+    }
+    else
+      decodeSymbol();
+  }
+
+  uint8_t nextByte()
+  {
+    if (_inPos >= _inLen)
+    {
+      _short = true;
+      return 0;
+    }
+    return _in[_inPos++];
+  }
+
+  uint32_t bits(uint8_t need)
+  {
+    while (_bitCount < need && !_error)
+    {
+      uint8_t c = nextByte();
+      if (_short)
+        return 0;
+      _bitBuf |= (uint32_t)c << _bitCount;
+      _bitCount += 8;
+    }
+    uint32_t val = _bitBuf & ((1UL << need) - 1);
+    _bitBuf >>= need;
+    _bitCount -= need;
+    return val;
+  }
+
+  // Canonical Huffman code decoding (bit by bit), see zlib's puff.c
+  int decode(huffman_t *h)
+  {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len <= RFC1951_MAX_BITS && !_error; len++)
+    {
+      code |= bits(1);
+      if (_short)
+        return -1;
+      int count = h->count[len];
+      if (code - count < first)
+        return h->symbol[index + (code - first)];
+      index += count;
+      first += count;
+      first <<= 1;
+      code <<= 1;
+    }
+    _error = true;
+    return -1;
+  }
+
+  bool construct(huffman_t *h, const uint8_t *length, int n)
+  {
+    uint16_t offs[RFC1951_MAX_BITS + 1];
+
+    memset(h->count, 0, sizeof(h->count));
+    for (int sym = 0; sym < n; sym++)
+      h->count[length[sym]]++;
+
+    if (h->count[0] == n)
+      return true;
+
+    int left = 1;
+    for (int len = 1; len <= RFC1951_MAX_BITS; len++)
+    {
+      left <<= 1;
+      left -= h->count[len];
+      // over-subscribed
+      if (left < 0)
+        return false;
+    }
+
+    offs[1] = 0;
+    for (int len = 1; len < RFC1951_MAX_BITS; len++)
+      offs[len + 1] = offs[len] + h->count[len];
+
+    for (int sym = 0; sym < n; sym++)
+    {
+      if (length[sym] != 0)
+        h->symbol[offs[length[sym]]++] = sym;
+    }
+
+    return true;
+  }
+
+  bool readBlockHeader()
+  {
+    _final = bits(1);
+    uint8_t type = bits(2);
+
+    if (type == 0)
+    {
+      // stored block, discard the remaining bits in current byte
+      _bitBuf = 0;
+      _bitCount = 0;
+      uint16_t len = nextByte();
+      len |= nextByte() << 8;
+      uint16_t nlen = nextByte();
+      nlen |= nextByte() << 8;
+      if (len != (uint16_t)~nlen)
+        _error = true;
+      _stored = len;
+      _state = state_stored;
+    }
+    else if (type == 1)
+    {
+      uint8_t lengths[RFC1951_FIX_LCODES];
+      int sym = 0;
+      for (; sym < 144; sym++)
+        lengths[sym] = 8;
+      for (; sym < 256; sym++)
+        lengths[sym] = 9;
+      for (; sym < 280; sym++)
+        lengths[sym] = 7;
+      for (; sym < RFC1951_FIX_LCODES; sym++)
+        lengths[sym] = 8;
+      construct(&_lencode, lengths, RFC1951_FIX_LCODES);
+
+      for (sym = 0; sym < RFC1951_MAX_DCODES; sym++)
+        lengths[sym] = 5;
+      construct(&_distcode, lengths, RFC1951_MAX_DCODES);
+      _state = state_codes;
+    }
+    else if (type == 2)
+    {
+      if (readDynamicTables())
+        _state = state_codes;
+      else
+        _error = true;
+    }
+    else
+      _error = true;
+
+    return !_error;
+  }
+
+  bool readDynamicTables()
+  {
+    uint8_t lengths[RFC1951_MAX_LCODES + RFC1951_MAX_DCODES];
+
+    int nlen = bits(5) + 257;
+    int ndist = bits(5) + 1;
+    int ncode = bits(4) + 4;
+
+    if (nlen > RFC1951_MAX_LCODES || ndist > RFC1951_MAX_DCODES)
+      return false;
+
+    memset(lengths, 0, sizeof(lengths));
+    for (int i = 0; i < ncode; i++)
+      lengths[pgm_read_byte(&rfc1951_code_length_order[i])] = bits(3);
+
+    if (!construct(&_lencode, lengths, 19))
+      return false;
+
+    int index = 0;
+    while (index < nlen + ndist && !_error)
+    {
+      int sym = decode(&_lencode);
+      if (sym < 0)
+        return false;
+
+      if (sym < 16)
+        lengths[index++] = sym;
+      else
+      {
+        uint8_t len = 0;
+        int repeat = 0;
+        if (sym == 16)
+        {
+          if (index == 0)
+            return false;
+          len = lengths[index - 1];
+          repeat = 3 + bits(2);
+        }
+        else if (sym == 17)
+          repeat = 3 + bits(3);
+        else
+          repeat = 11 + bits(7);
+
+        if (index + repeat > nlen + ndist)
+          return false;
+
+        while (repeat--)
+          lengths[index++] = len;
+      }
+    }
+
+    // no end-of-block code
+    if (_error || lengths[256] == 0)
+      return false;
+
+    return construct(&_lencode, lengths, nlen) && construct(&_distcode, lengths + nlen, ndist);
+  }
+
+  void decodeSymbol()
+  {
+    int sym = decode(&_lencode);
+
+    if (sym < 0)
+      return;
+
+    if (sym < 256)
+      put(sym);
+    else if (sym == 256)
+      _state = state_header;
+    else
+    {
+      sym -= 257;
+      if (sym >= 29)
+      {
+        _error = true;
+        return;
+      }
+
+      _copyLen = pgm_read_word(&rfc1951_length_base[sym]) + bits(pgm_read_byte(&rfc1951_length_extra[sym]));
+
+      int dsym = decode(&_distcode);
+      if (dsym < 0 || dsym >= RFC1951_MAX_DCODES)
+      {
+        _error = true;
+        return;
+      }
+
+      _copyDist = pgm_read_word(&rfc1951_dist_base[dsym]) + bits(pgm_read_byte(&rfc1951_dist_extra[dsym]));
+
+      // distance is too far back for the history buffer
+      if (_copyDist > _total)
+        _error = true;
+    }
+  }
+};
+
+class RFC1951_Deflater
+{
+public:
+  RFC1951_Deflater(){};
+  ~RFC1951_Deflater() { end(); };
+
+  /**
+   * Allocate the window and hash chain buffers.
+   * @param mbfs The MB_FS object for memory allocation.
+   * @param windowBits The window size in bits (8 to 12).
+   * @return The boolean value which indicates the success of operation.
+   */
+  bool begin(MB_FS *mbfs, uint8_t windowBits)
+  {
+    end();
+
+    if (windowBits < 8)
+      windowBits = 8;
+    else if (windowBits > RFC1951_MAX_DEFLATE_WINDOW_BITS)
+      windowBits = RFC1951_MAX_DEFLATE_WINDOW_BITS;
+
+    _mbfs = mbfs;
+    _size = 1UL << windowBits;
+    _mask = _size - 1;
+    _window = (uint8_t *)_mbfs->newP(_size, false);
+    _prev = (uint16_t *)_mbfs->newP(_size * sizeof(uint16_t));
+    _head = (uint32_t *)_mbfs->newP(RFC1951_DEFLATE_HASH_SIZE * sizeof(uint32_t));
+
+    if (!_window || !_prev || !_head)
+    {
+      end();
+      return false;
+    }
+
+    return true;
+  }
+
+  /**
+   * Free the buffers and reset the stream state.
+   */
+  void end()
+  {
+    if (_mbfs)
+    {
+      if (_window)
+        _mbfs->delP(&_window);
+      if (_prev)
+        _mbfs->delP(&_prev);
+      if (_head)
+        _mbfs->delP(&_head);
+    }
+    _window = nullptr;
+    _prev = nullptr;
+    _head = nullptr;
+    _pos = 0;
+    _bitBuf = 0;
+    _bitCount = 0;
+    _outLen = 0;
+    _error = false;
+  }
+
+  /**
+   * Compress and write the data to client with sync flush.
+   * @param client The client to write the compressed data.
+   * @param data The data to compress.
+   * @param len The length of data.
+   * @return The length of (uncompressed) data or -1 for error.
+   */
+  int write(Client *client, const uint8_t *data, int len)
+  {
+    if (!_window)
+      return -1;
+
+    _client = client;
+    _error = false;
+
+    // fixed Huffman codes block (BFINAL = 0, BTYPE = 01)
+    putBits(0, 1);
+    putBits(1, 2);
+
+    int i = 0;
+    while (i < len && !_error)
+    {
+      uint32_t dist = 0;
+      int matchLen = findMatch(data, i, len, dist);
+
+      if (matchLen >= RFC1951_MIN_MATCH)
+      {
+        putLength(matchLen);
+        putDistance(dist);
+        for (int j = 0; j < matchLen; j++)
+          insert(data, i++, len);
+      }
+      else
+      {
+        putLiteral(data[i]);
+        insert(data, i++, len);
+      }
+    }
+
+    // end of block
+    putLiteral(256);
+
+    // sync flush, empty stored block
+    putBits(0, 3);
+    if (_bitCount > 0)
+      putBits(0, 8 - _bitCount);
+    putByte(0x00);
+    putByte(0x00);
+    putByte(0xff);
+    putByte(0xff);
+
+    flush();
+
+    return _error ? -1 : len;
+  }
+
+private:
+  MB_FS *_mbfs = nullptr;
+  Client *_client = nullptr;
+  uint8_t *_window = nullptr;
+  uint16_t *_prev = nullptr;
+  uint32_t *_head = nullptr;
+  uint32_t _size = 0;
+  uint32_t _mask = 0;
+  uint32_t _pos = 0;
+  uint32_t _bitBuf = 0;
+  uint8_t _bitCount = 0;
+  uint8_t _out[RFC1951_DEFLATE_OUT_BUF_SIZE];
+  int _outLen = 0;
+  bool _error = false;
+
+  uint16_t hash(const uint8_t *p)
+  {
+    return ((p[0] << 5) ^ (p[1] << 2) ^ p[2]) & (RFC1951_DEFLATE_HASH_SIZE - 1);
+  }
+
+  // Get byte at stream position, the current data is used for position that not yet in window
+  uint8_t byteAt(const uint8_t *data, int i, uint32_t pos)
+  {
+    if (pos < _pos)
+      return _window[pos & _mask];
+    return data[i + (pos - _pos)];
+  }
+
+  int findMatch(const uint8_t *data, int i, int len, uint32_t &dist)
+  {
+    if (len - i < RFC1951_MIN_MATCH)
+      return 0;
+
+    int maxLen = len - i > RFC1951_MAX_MATCH ? RFC1951_MAX_MATCH : len - i;
+    int bestLen = 0;
+    // head stores position + 1, zero for empty
+    uint32_t cand = _head[hash(data + i)];
+    int chain = RFC1951_DEFLATE_MAX_CHAIN;
+
+    while (cand > 0 && chain-- > 0)
+    {
+      uint32_t p = cand - 1;
+      if (p >= _pos || _pos - p > _size)
+        break;
+
+      int l = 0;
+      while (l < maxLen && byteAt(data, i, p + l) == data[i + l])
+        l++;
+
+      if (l > bestLen)
+      {
+        bestLen = l;
+        dist = _pos - p;
+        if (l == maxLen)
+          break;
+      }
+
+      uint16_t d = _prev[p & _mask];
+      if (d == 0 || d > p)
+        break;
+      cand = p - d + 1;
+    }
+
+    return bestLen;
+  }
+
+  void insert(const uint8_t *data, int i, int len)
+  {
+    if (len - i >= RFC1951_MIN_MATCH)
+    {
+      uint16_t h = hash(data + i);
+      uint32_t last = _head[h];
+      _prev[_pos & _mask] = (last > 0 && _pos - (last - 1) < _size) ? _pos - (last - 1) : 0;
+      _head[h] = _pos + 1;
+    }
+    else
+      _prev[_pos & _mask] = 0;
+
+    _window[_pos & _mask] = data[i];
+    _pos++;
+  }
+
+  void putByte(uint8_t c)
+  {
+    _out[_outLen++] = c;
+    if (_outLen == RFC1951_DEFLATE_OUT_BUF_SIZE)
+      flush();
+  }
+
+  void flush()
+  {
+    if (_outLen > 0 && (int)_client->write(_out, _outLen) != _outLen)
+      _error = true;
+    _outLen = 0;
+  }
+
+  void putBits(uint32_t value, uint8_t n)
+  {
+    _bitBuf |= value << _bitCount;
+    _bitCount += n;
+    while (_bitCount >= 8)
+    {
+      putByte(_bitBuf & 0xff);
+      _bitBuf >>= 8;
+      _bitCount -= 8;
+    }
+  }
+
+  // Huffman codes are packed starting with the most significant bit
+  void putCode(uint32_t code, uint8_t n)
+  {
+    uint32_t rev = 0;
+    for (uint8_t i = 0; i < n; i++)
+    {
+      rev = (rev << 1) | (code & 1);
+      code >>= 1;
+    }
+    putBits(rev, n);
+  }
+
+  void putLiteral(uint16_t sym)
+  {
+    if (sym < 144)
+      putCode(0x30 + sym, 8);
+    else if (sym < 256)
+      putCode(0x190 + sym - 144, 9);
+    else if (sym < 280)
+      putCode(sym - 256, 7);
+    else
+      putCode(0xc0 + sym - 280, 8);
+  }
+
+  void putLength(int len)
+  {
+    int c = 28;
+    while (c > 0 && pgm_read_word(&rfc1951_length_base[c]) > len)
+      c--;
+    putLiteral(257 + c);
+    uint8_t extra = pgm_read_byte(&rfc1951_length_extra[c]);
+    if (extra > 0)
+      putBits(len - pgm_read_word(&rfc1951_length_base[c]), extra);
+  }
+
+  void putDistance(uint32_t dist)
+  {
+    int c = RFC1951_MAX_DCODES - 1;
+    while (c > 0 && pgm_read_word(&rfc1951_dist_base[c]) > dist)
+      c--;
+    putCode(c, 5);
+    uint8_t extra = pgm_read_byte(&rfc1951_dist_extra[c]);
+    if (extra > 0)
+      putBits(dist - pgm_read_word(&rfc1951_dist_base[c]), extra);
+  }
+};
+
+#endif
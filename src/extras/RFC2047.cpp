@@ -6,30 +6,33 @@
 RFC2047_Decoder::RFC2047_Decoder() {}
 RFC2047_Decoder::~RFC2047_Decoder() {}
 
-void RFC2047_Decoder::decode(MB_FS *mbfs, char *d, const char *s, size_t dlen)
+size_t RFC2047_Decoder::decode(char *d, const char *s, size_t dlen, RFC2047_CharsetCallback cb, void *param)
 {
-  if (!mbfs)
-    return;
-
-  this->mbfs = mbfs;
+  if (!d || !s || dlen == 0)
+    return 0;
 
-  const char *p, *q;
+  char *start = d;
+  const char *p, *c, *e, *q;
   size_t n;
-  int found_encoded = 0;
+  bool found_encoded = false;
 
   dlen--; /* save room for the terminal nul */
 
   while (*s && dlen > 0)
   {
     if ((p = strstr(s, "=?")) == NULL ||
-        (q = strchr(p + 2, '?')) == NULL ||
-        (q = strchr(q + 1, '?')) == NULL ||
-        (q = strstr(q + 1, "?=")) == NULL)
+        (c = strchr(p + 2, '?')) == NULL ||
+        (e = strchr(c + 1, '?')) == NULL ||
+        (q = strstr(e + 1, "?=")) == NULL)
     {
       /* no encoded words */
+      n = strlen(s);
+      if (n > dlen)
+        n = dlen;
       if (d != s)
-        strfcpy(d, s, dlen + 1);
-      return;
+        memmove(d, s, n);
+      d += n;
+      break;
     }
 
     if (p != s)
@@ -41,147 +44,131 @@ void RFC2047_Decoder::decode(MB_FS *mbfs, char *d, const char *s, size_t dlen)
         if (n > dlen)
           n = dlen;
         if (d != s)
-          memcpy(d, s, n);
+          memmove(d, s, n);
         d += n;
         dlen -= n;
       }
     }
 
-    rfc2047DecodeWord(d, p, dlen);
-    found_encoded = 1;
+    if (e != c + 2 || (toupper(c[1]) != 'Q' && toupper(c[1]) != 'B'))
+    {
+      /* not an encoded word, keep the delimiter as is */
+      n = dlen < 2 ? dlen : 2;
+      memmove(d, p, n);
+      d += n;
+      dlen -= n;
+      s = p + 2;
+      found_encoded = false;
+      continue;
+    }
+
+    setCharset(p + 2, c - p - 2, cb, param);
+
+    found_encoded = true;
     s = q + 2;
-    n = strlen(d);
-    dlen -= n;
-    d += n;
+
+    if (!decodeWord(d, dlen, e + 1, q, toupper(c[1])))
+      break;
   }
+
   *d = 0;
+  return d - start;
 }
 
-void RFC2047_Decoder::rfc2047DecodeWord(char *d, const char *s, size_t dlen)
+void RFC2047_Decoder::setCharset(const char *s, size_t len, RFC2047_CharsetCallback cb, void *param)
 {
+  char charset[32];
+
+  /* strip the RFC 2231 language */
+  const char *lang = (const char *)memchr(s, '*', len);
+  if (lang)
+    len = lang - s;
+
+  if (len >= sizeof(charset))
+    len = sizeof(charset) - 1;
+
+  memcpy(charset, s, len);
+  charset[len] = 0;
+
+  _table = nullptr;
+  _transcode = false;
+  _filter = false;
 
-  if (!mbfs)
+  if (strcasecmp(charset, Charset) == 0)
     return;
 
-  char *p = safe_strdup(s);
-  char *pp = p;
-  char *end = p;
-  char *pd = d;
-  size_t len = dlen;
-  int enc = 0, filter = 0, count = 0, c1, c2, c3, c4;
+  if (cb && cb(param, charset, _table))
+    _transcode = true;
+  else
+    _filter = true;
+}
 
-  while (pp != NULL)
+bool RFC2047_Decoder::decodeWord(char *&d, size_t &dlen, const char *s, const char *e, char enc)
+{
+  if (enc == 'Q')
   {
-    // See RFC2047.h
-    ESP_MAIL_STRSEP(&end, "?");
-    count++;
-    switch (count)
+    while (s < e)
     {
-    case 2:
-      if (strcasecmp(pp, Charset) != 0)
-      {
-        filter = 1;
-      }
-      break;
-    case 3:
-      if (toupper(*pp) == 'Q')
-        enc = ENCQUOTEDPRINTABLE;
-      else if (toupper(*pp) == 'B')
-        enc = ENCBASE64;
-      else
-        return;
-      break;
-    case 4:
-      if (enc == ENCQUOTEDPRINTABLE)
+      uint8_t c = *s++;
+      if (c == '_')
+        c = ' ';
+      else if (c == '=' && e - s >= 2 && (uint8_t)s[0] < 128 && (uint8_t)s[1] < 128 && hexval(s[0]) > -1 && hexval(s[1]) > -1)
       {
-        while (*pp && len > 0)
-        {
-          if (*pp == '_')
-          {
-            *pd++ = ' ';
-            len--;
-          }
-          else if (*pp == '=')
-          {
-            *pd++ = (hexval(pp[1]) << 4) | hexval(pp[2]);
-            len--;
-            pp += 2;
-          }
-          else
-          {
-            *pd++ = *pp;
-            len--;
-          }
-          pp++;
-        }
-        *pd = 0;
+        c = (hexval(s[0]) << 4) | hexval(s[1]);
+        s += 2;
       }
-      else if (enc == ENCBASE64)
-      {
-        while (*pp && len > 0)
-        {
-          c1 = base64val(pp[0]);
-          c2 = base64val(pp[1]);
-          *pd++ = (c1 << 2) | ((c2 >> 4) & 0x3);
-          if (--len == 0)
-            break;
-
-          if (pp[2] == '=')
-            break;
-
-          c3 = base64val(pp[2]);
-          *pd++ = ((c2 & 0xf) << 4) | ((c3 >> 2) & 0xf);
-          if (--len == 0)
-            break;
-
-          if (pp[3] == '=')
-            break;
-
-          c4 = base64val(pp[3]);
-          *pd++ = ((c3 & 0x3) << 6) | c4;
-          if (--len == 0)
-            break;
-
-          pp += 4;
-        }
-        *pd = 0;
-      }
-      break;
-    }
 
-    pp = end;
+      if (!put(d, dlen, c))
+        return false;
+    }
   }
-
-  mbfs->delP(&p);
-
-  if (filter)
+  else
   {
-    pd = d;
-    while (*pd)
+    uint32_t bits = 0;
+    int nbits = 0;
+
+    while (s < e && *s != '=')
     {
-      if (!IsPrint(*pd))
-        *pd = '?';
-      pd++;
+      uint8_t c = *s++;
+      int v = c < 128 ? base64val(c) : -1;
+      if (v < 0)
+        continue;
+
+      bits = (bits << 6) | v;
+      nbits += 6;
+
+      if (nbits >= 8)
+      {
+        nbits -= 8;
+        if (!put(d, dlen, (bits >> nbits) & 0xff))
+          return false;
+      }
     }
   }
-  return;
+
+  return true;
 }
 
-char *RFC2047_Decoder::safe_strdup(const char *s)
+bool RFC2047_Decoder::put(char *&d, size_t &dlen, uint8_t c)
 {
+  char buf[3];
+  size_t n = 1;
 
-  if (!mbfs)
-    return 0;
+  if (_transcode)
+    n = Charset_Transcoder::decodeChar(_table, c, buf);
+  else
+    buf[0] = _filter && !IsPrint(c) ? '?' : c;
 
-  char *p;
-  size_t l;
+  if (n > dlen)
+  {
+    dlen = 0;
+    return false;
+  }
 
-  if (!s || !*s)
-    return 0;
-  l = strlen(s) + 1;
-  p = (char *)mbfs->newP(l);
-  memcpy(p, s, l);
-  return (p);
+  memcpy(d, buf, n);
+  d += n;
+  dlen -= n;
+  return true;
 }
 
 #endif // RFC2047_CPP
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include "./ESP_Mail_FS.h"
 #include "./extras/MB_FS.h"
 #include "./extras/Networks.h"
+#include "./extras/Charset_Transcoder.h"
 
 #if defined(ESP32)
 #if defined(BOARD_HAS_PSRAM) && defined(ESP_Mail_USE_PSRAM)
@@ -73,18 +74,51 @@ __attribute__((used)) static int Index_64[128] = {
 #define hexval(c) Index_hex[(unsigned int)(c)]
 #define base64val(c) Index_64[(unsigned int)(c)]
 
+/**
+ * The callback to get the transcoder table of the encoded word character set.
+ * @param param The user parameter.
+ * @param charset The character set name.
+ * @param table The 128-entry code points table or nullptr for ISO-8859-1.
+ * @return true if the character set can be transcoded.
+ */
+typedef bool (*RFC2047_CharsetCallback)(void *param, const char *charset, const uint16_t *&table);
+
 class RFC2047_Decoder
 {
 
 public:
   RFC2047_Decoder();
   ~RFC2047_Decoder();
-  void decode(MB_FS *mbfs, char *d, const char *s, size_t dlen);
+
+  /**
+   * Decode the Q and B encoded words in one pass without memory allocation.
+   * The spaces between adjacent encoded words are ignored and the encoded words in single-byte
+   * character set are transcoded to UTF-8 when the charset callback was assigned.
+   * @param d The output buffer, can be the input buffer if no charset callback.
+   * @param s The input string.
+   * @param dlen The size of output buffer, see outputSize.
+   * @param cb The charset callback or NULL to keep the decoded data as is.
+   * @param param The user parameter of charset callback.
+   * @return The length of output string.
+   */
+  size_t decode(char *d, const char *s, size_t dlen, RFC2047_CharsetCallback cb = NULL, void *param = nullptr);
+
+  /**
+   * Get the output buffer size that is large enough for any transcoded input.
+   * @param len The length of input string.
+   * @return The output buffer size with the terminating null.
+   */
+  static size_t outputSize(size_t len) { return len * 3 + 1; }
 
 private:
-  void rfc2047DecodeWord(char *d, const char *s, size_t dlen);
-  char *safe_strdup(const char *s);
-  MB_FS *mbfs = nullptr;
+  // The encoded word character set handling
+  const uint16_t *_table = nullptr;
+  bool _transcode = false;
+  bool _filter = false;
+
+  void setCharset(const char *s, size_t len, RFC2047_CharsetCallback cb, void *param);
+  bool decodeWord(char *&d, size_t &dlen, const char *s, const char *e, char enc);
+  bool put(char *&d, size_t &dlen, uint8_t c);
 };
 
 #endif // RFC2047_H
\ No newline at end of file
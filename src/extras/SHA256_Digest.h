@@ -0,0 +1,99 @@
+#pragma once
+
+#ifndef SHA256_DIGEST_H
+#define SHA256_DIGEST_H
+
+/**
+ * The streaming SHA-256 digest using the BearSSL hash implementation of SSL engine in use
+ * (the ESP8266 and Raspberry Pi Pico core's BearSSL or the BearSSL library in SSLClient).
+ */
+
+#include <Arduino.h>
+#include "../client/SSLClient/ESP_SSLClient_FS.h"
+
+#if defined(USE_EMBED_SSL_ENGINE)
+#include <bearssl/bearssl.h>
+#define ESP_MAIL_SHA256_ENABLED
+#elif defined(USE_LIB_SSL_ENGINE)
+#include "../client/SSLClient/bssl/bearssl_hash.h"
+#define ESP_MAIL_SHA256_ENABLED
+#endif
+
+#define ESP_MAIL_SHA256_SIZE 32
+
+class SHA256_Digest
+{
+public:
+  SHA256_Digest(){};
+  ~SHA256_Digest(){};
+
+  // Start the new digest
+  void begin()
+  {
+#if defined(ESP_MAIL_SHA256_ENABLED)
+    br_sha256_init(&_ctx);
+#endif
+  }
+
+  /**
+   * Hash the data.
+   * @param data The data to hash.
+   * @param len The length of data.
+   */
+  void update(const void *data, size_t len)
+  {
+#if defined(ESP_MAIL_SHA256_ENABLED)
+    br_sha256_update(&_ctx, data, len);
+#endif
+  }
+
+  /**
+   * Get the digest of data hashed so far.
+   * @param out The 32-byte output buffer.
+   */
+  void finish(uint8_t *out)
+  {
+#if defined(ESP_MAIL_SHA256_ENABLED)
+    br_sha256_out(&_ctx, out);
+#else
+    memset(out, 0, ESP_MAIL_SHA256_SIZE);
+#endif
+  }
+
+  /**
+   * Get the lowercase hex string of digest of data hashed so far.
+   * @param out The 65-byte output buffer.
+   */
+  void finishHex(char *out)
+  {
+    uint8_t digest[ESP_MAIL_SHA256_SIZE];
+    finish(digest);
+
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < ESP_MAIL_SHA256_SIZE; i++)
+    {
+      out[i * 2] = hex[digest[i] >> 4];
+      out[i * 2 + 1] = hex[digest[i] & 0x0f];
+    }
+    out[ESP_MAIL_SHA256_SIZE * 2] = 0;
+  }
+
+  /**
+   * Compare the digest of data hashed so far with the hex string (case insensitive).
+   * @param hex The hex string of expected digest.
+   * @return The boolean value indicates the digest matched.
+   */
+  bool matchHex(const char *hex)
+  {
+    char out[ESP_MAIL_SHA256_SIZE * 2 + 1];
+    finishHex(out);
+    return strlen(hex) == ESP_MAIL_SHA256_SIZE * 2 && strcasecmp(out, hex) == 0;
+  }
+
+private:
+#if defined(ESP_MAIL_SHA256_ENABLED)
+  br_sha256_context _ctx;
+#endif
+};
+
+#endif
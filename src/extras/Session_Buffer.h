@@ -0,0 +1,90 @@
+#pragma once
+
+#ifndef SESSION_BUFFER_H
+#define SESSION_BUFFER_H
+
+/**
+ * The reusable I/O buffer that is owned by the session e.g. the server response buffer and the upload chunk buffer.
+ *
+ * The buffer is allocated when it is first used and kept by the session, then the following responses and
+ * chunks are read into the same buffer without allocation. The buffer only grows when the larger buffer is
+ * required (the old content is not kept) e.g. for the response line that overflows the response buffer, the
+ * grown buffer is freed when the response is handled (Session_Buffer_Limit), and all buffers are released
+ * when the TCP session is closed or the session is destroyed.
+ */
+
+#include <Arduino.h>
+
+class Session_Buffer
+{
+public:
+  Session_Buffer(){};
+  ~Session_Buffer() { release(); };
+
+  Session_Buffer(const Session_Buffer &other) = delete;
+  Session_Buffer &operator=(const Session_Buffer &other) = delete;
+
+  /**
+   * Get the buffer of at least len bytes.
+   * @param len The buffer size.
+   * @param clear The option to clear the first len bytes of buffer.
+   * @param psram The option to allocate the grown buffer from PSRAM.
+   * @return The buffer or nullptr if the memory is not enough.
+   */
+  ESP_MAIL_MEM_NOINLINE void *get(size_t len, bool clear, bool psram)
+  {
+    if (len > _capacity)
+    {
+      release();
+
+      size_t n = (len + 3) & ~(size_t)3;
+      _buf = ESP_Mail_Mem::alloc(n, "Session_Buffer", psram, ESP_MAIL_MEM_SITE);
+      if (!_buf)
+        return nullptr;
+      _capacity = n;
+    }
+
+    if (clear)
+      memset(_buf, 0, len);
+
+    return _buf;
+  }
+
+  // Free the buffer
+  void release()
+  {
+    ESP_Mail_Mem::dealloc(_buf);
+    _buf = nullptr;
+    _capacity = 0;
+  }
+
+  // Free the buffer if it was grown larger than len bytes
+  void shrink(size_t len)
+  {
+    if (_capacity > ((len + 3) & ~(size_t)3))
+      release();
+  }
+
+  size_t capacity() const { return _capacity; }
+
+private:
+  void *_buf = nullptr;
+  size_t _capacity = 0;
+};
+
+// Shrink the session buffer to len bytes when it goes out of scope i.e. when the response handling returns
+class Session_Buffer_Limit
+{
+public:
+  Session_Buffer_Limit(Session_Buffer &buf, size_t len) : _buf(buf), _len(len){};
+  ~Session_Buffer_Limit() { _buf.shrink(_len); };
+
+  Session_Buffer_Limit(const Session_Buffer_Limit &other) = delete;
+  Session_Buffer_Limit &operator=(const Session_Buffer_Limit &other) = delete;
+
+private:
+  Session_Buffer &_buf;
+  size_t _len;
+};
+
+#endif
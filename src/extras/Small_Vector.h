@@ -0,0 +1,208 @@
+#pragma once
+
+#ifndef SMALL_VECTOR_H
+#define SMALL_VECTOR_H
+
+/**
+ * The vector with inline capacity for the small lists e.g. the message parts, recipients and attachments.
+ *
+ * The first N elements are kept in the inline storage, then the list that is not larger than N
+ * requires no heap allocation. The larger list is moved to the heap buffer (or static pool in static
+ * memory build) that grows geometrically, the elements are moved (not copied) when the buffer grows.
+ */
+
+#include <Arduino.h>
+#include <new>
+#include <utility>
+
+template <typename T, size_t N>
+class Small_Vector
+{
+public:
+  typedef T value_type;
+  typedef T *iterator;
+  typedef const T *const_iterator;
+
+  Small_Vector() {}
+
+  Small_Vector(const Small_Vector &other)
+  {
+    if (!reserve(other._size))
+      return;
+    for (size_t i = 0; i < other._size; i++)
+      new (_data + i) T(other._data[i]);
+    _size = other._size;
+  }
+
+  Small_Vector(Small_Vector &&other) noexcept { take(other); }
+
+  ~Small_Vector() { release(); }
+
+  Small_Vector &operator=(const Small_Vector &other)
+  {
+    if (this != &other)
+    {
+      clear();
+      if (!reserve(other._size))
+        return *this;
+      for (size_t i = 0; i < other._size; i++)
+        new (_data + i) T(other._data[i]);
+      _size = other._size;
+    }
+    return *this;
+  }
+
+  Small_Vector &operator=(Small_Vector &&other) noexcept
+  {
+    if (this != &other)
+    {
+      release();
+      take(other);
+    }
+    return *this;
+  }
+
+  size_t size() const { return _size; }
+  size_t capacity() const { return _capacity; }
+  bool empty() const { return _size == 0; }
+
+  T &operator[](size_t i) { return _data[i]; }
+  const T &operator[](size_t i) const { return _data[i]; }
+
+  T &back() { return _data[_size - 1]; }
+  const T &back() const { return _data[_size - 1]; }
+
+  iterator begin() { return _data; }
+  iterator end() { return _data + _size; }
+  const_iterator begin() const { return _data; }
+  const_iterator end() const { return _data + _size; }
+
+  void push_back(const T &value)
+  {
+    if (_size == _capacity)
+    {
+      // The value may be the element of this list
+      T v(value);
+      if (!grow(_size + 1))
+        return;
+      new (_data + _size) T(std::move(v));
+    }
+    else
+      new (_data + _size) T(value);
+    _size++;
+  }
+
+  void push_back(T &&value)
+  {
+    if (_size == _capacity && !grow(_size + 1))
+      return;
+    new (_data + _size) T(std::move(value));
+    _size++;
+  }
+
+  void pop_back()
+  {
+    if (_size > 0)
+      _data[--_size].~T();
+  }
+
+  iterator erase(iterator pos) { return erase(pos, pos + 1); }
+
+  iterator erase(iterator first, iterator last)
+  {
+    if (first >= last)
+      return first;
+
+    iterator e = end();
+    iterator d = first;
+    for (iterator s = last; s < e; s++, d++)
+      *d = std::move(*s);
+
+    size_t n = last - first;
+    while (n-- > 0)
+      _data[--_size].~T();
+
+    return first;
+  }
+
+  void clear()
+  {
+    while (_size > 0)
+      _data[--_size].~T();
+  }
+
+  bool reserve(size_t n)
+  {
+    return n <= _capacity || grow(n);
+  }
+
+private:
+  alignas(T) uint8_t _inline[N * sizeof(T)];
+  T *_data = reinterpret_cast<T *>(_inline);
+  size_t _size = 0;
+  size_t _capacity = N;
+
+  bool isInline() const { return (const uint8_t *)_data == _inline; }
+
+  static ESP_MAIL_MEM_NOINLINE void *memAlloc(size_t len) { return ESP_Mail_Mem::alloc(len, "Small_Vector", false, ESP_MAIL_MEM_SITE); }
+
+  static void memFree(void *p) { ESP_Mail_Mem::dealloc(p); }
+
+  // Move the elements to the new buffer of at least n elements
+  bool grow(size_t n)
+  {
+    size_t cap = _capacity + _capacity / 2;
+    if (cap < n)
+      cap = n;
+
+    T *p = reinterpret_cast<T *>(memAlloc(cap * sizeof(T)));
+    if (!p)
+      return false;
+
+    for (size_t i = 0; i < _size; i++)
+    {
+      new (p + i) T(std::move(_data[i]));
+      _data[i].~T();
+    }
+
+    if (!isInline())
+      memFree(_data);
+
+    _data = p;
+    _capacity = cap;
+    return true;
+  }
+
+  // Take the elements of other list, the heap buffer is taken without moving the elements
+  void take(Small_Vector &other)
+  {
+    if (other.isInline())
+    {
+      _data = reinterpret_cast<T *>(_inline);
+      _capacity = N;
+      for (size_t i = 0; i < other._size; i++)
+        new (_data + i) T(std::move(other._data[i]));
+      _size = other._size;
+      other.clear();
+      return;
+    }
+
+    _data = other._data;
+    _size = other._size;
+    _capacity = other._capacity;
+    other._data = reinterpret_cast<T *>(other._inline);
+    other._size = 0;
+    other._capacity = N;
+  }
+
+  void release()
+  {
+    clear();
+    if (!isInline())
+      memFree(_data);
+    _data = reinterpret_cast<T *>(_inline);
+    _capacity = N;
+  }
+};
+
+#endif
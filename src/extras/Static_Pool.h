@@ -0,0 +1,449 @@
+#pragma once
+
+#ifndef STATIC_POOL_H
+#define STATIC_POOL_H
+
+/**
+ * The fixed-size memory pool for the static memory build (ESP_MAIL_STATIC_MEMORY).
+ *
+ * The pool memory is the compile-time sized static buffer (ESP_MAIL_STATIC_POOL_SIZE) that holds the
+ * session containers (_internalVectorImpl), the string buffers (MB_String), the helper buffers (ESP_Mail_Mem)
+ * and the temporary buffers that do not fit the arena, then the worst-case memory usage is known at compile time
+ * and the heap is not used by the library.
+ *
+ * The blocks are allocated by first-fit search and the adjacent free blocks are merged when the block is freed
+ * or during the search. The allocation that does not fit the pool fails and is counted as overflow in the pool
+ * statistics, the pool size or the limits should be increased when overflow occurs.
+ *
+ * ESP_Mail_Mem is the allocator of the library helper containers and buffers in all builds.
+ */
+
+#include <Arduino.h>
+
+#if defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
+#include <esp_heap_caps.h>
+#endif
+
+// The call site of helper allocation for heap profiler, the allocation wrapper that takes it is not inlined
+#if defined(MB_HEAP_PROFILE_SITE)
+#define ESP_MAIL_MEM_SITE MB_HEAP_PROFILE_SITE
+#define ESP_MAIL_MEM_NOINLINE MB_HEAP_PROFILE_NOINLINE
+#else
+#define ESP_MAIL_MEM_SITE nullptr
+#define ESP_MAIL_MEM_NOINLINE
+#endif
+
+#if defined(ESP_MAIL_STATIC_MEMORY)
+
+#if !defined(ESP_MAIL_STATIC_POOL_SIZE)
+#if defined(ESP32) || defined(MB_ARDUINO_PICO)
+#define ESP_MAIL_STATIC_POOL_SIZE 49152
+#else
+#define ESP_MAIL_STATIC_POOL_SIZE 16384
+#endif
+#endif
+
+// The maximum number of messages that are kept in IMAPSession
+#if !defined(ESP_MAIL_STATIC_MAX_MESSAGES)
+#define ESP_MAIL_STATIC_MAX_MESSAGES 10
+#endif
+
+// The maximum number of parts (including nested parts) of each message
+#if !defined(ESP_MAIL_STATIC_MAX_PARTS)
+#define ESP_MAIL_STATIC_MAX_PARTS 16
+#endif
+
+static_assert(ESP_MAIL_STATIC_POOL_SIZE >= 4096, "ESP_MAIL_STATIC_POOL_SIZE should be at least 4096 bytes");
+
+#if defined(ESP32)
+#include <freertos/FreeRTOS.h>
+#endif
+
+struct static_pool_stats_t
+{
+  // The size of pool memory
+  size_t capacity = 0;
+  // The bytes in use (including the block headers)
+  size_t used = 0;
+  // The maximum bytes in use
+  size_t peak = 0;
+  // The number of allocations that did not fit the pool and failed
+  size_t overflows = 0;
+};
+
+class Static_Pool
+{
+public:
+  Static_Pool(uint8_t *buf, size_t size)
+  {
+    _base = buf;
+    _stats.capacity = size & ~(size_t)(ALIGN - 1);
+    // The whole pool is one free block
+    setBlock(0, _stats.capacity, false, 0);
+  };
+  ~Static_Pool(){};
+
+  /**
+   * Allocate the block.
+   * @param size The block size.
+   * @return The block or nullptr if the block does not fit the pool.
+   */
+  void *alloc(size_t size)
+  {
+    size_t need = blockSize(size);
+    size_t ofs = 0;
+
+    while (ofs < _stats.capacity)
+    {
+      size_t n = sizeOf(ofs);
+
+      if (!isUsed(ofs))
+      {
+        n = merge(ofs);
+        if (n >= need)
+        {
+          split(ofs, n, need);
+          setBlock(ofs, sizeOf(ofs), true, size);
+          updateUsed(sizeOf(ofs), true);
+          return _base + ofs + HEADER_SIZE;
+        }
+      }
+
+      ofs += n;
+    }
+
+    return nullptr;
+  }
+
+  /**
+   * Resize the block, the block content is kept.
+   * @param ptr The block to resize.
+   * @param size The new block size.
+   * @return The resized block or nullptr if the new block does not fit the pool (the old block is not freed).
+   */
+  void *resize(void *ptr, size_t size)
+  {
+    if (!ptr)
+      return alloc(size);
+
+    size_t ofs = offsetOf(ptr);
+    size_t n = sizeOf(ofs);
+    size_t need = blockSize(size);
+
+    // Grow in place by merging the following free blocks
+    if (n < need && ofs + n < _stats.capacity && !isUsed(ofs + n))
+    {
+      size_t m = merge(ofs + n);
+      if (n + m >= need)
+      {
+        setBlock(ofs, n + m, true, size);
+        updateUsed(m, true);
+        n += m;
+      }
+    }
+
+    if (n >= need)
+    {
+      size_t old = n;
+      split(ofs, n, need);
+      setBlock(ofs, sizeOf(ofs), true, size);
+      updateUsed(old - sizeOf(ofs), false);
+      return ptr;
+    }
+
+    void *p = alloc(size);
+    if (p)
+    {
+      memcpy(p, ptr, requestedOf(ofs));
+      dealloc(ptr);
+    }
+    return p;
+  }
+
+  // Free the block
+  void dealloc(void *ptr)
+  {
+    if (!owns(ptr))
+      return;
+
+    size_t ofs = offsetOf(ptr);
+    if (!isUsed(ofs))
+      return;
+
+    updateUsed(sizeOf(ofs), false);
+    setBlock(ofs, sizeOf(ofs), false, 0);
+    merge(ofs);
+  }
+
+  // The block was allocated from pool
+  bool owns(const void *ptr) const
+  {
+    return ptr >= _base + HEADER_SIZE && ptr < _base + _stats.capacity;
+  }
+
+  // The requested size of block
+  size_t sizeOfBlock(const void *ptr) const { return owns(ptr) ? requestedOf(offsetOf(ptr)) : 0; }
+
+  // The bytes that are not in use
+  size_t available() const { return _stats.capacity - _stats.used; }
+
+  // Count the allocation that did not fit the pool
+  void overflow() { _stats.overflows++; }
+
+  // Get the pool statistics
+  static_pool_stats_t stats() const { return _stats; }
+
+private:
+  static const size_t ALIGN = 8;
+  // The block size and used flag, and the requested size
+  static const size_t HEADER_SIZE = 8;
+  // The remaining free block that is smaller than this is not split
+  static const size_t MIN_BLOCK_SIZE = HEADER_SIZE + ALIGN;
+
+  uint8_t *_base = nullptr;
+  static_pool_stats_t _stats;
+
+  static size_t blockSize(size_t size)
+  {
+    return ((size > 0 ? size : 1) + HEADER_SIZE + ALIGN - 1) & ~(ALIGN - 1);
+  }
+
+  uint32_t *header(size_t ofs) const { return reinterpret_cast<uint32_t *>(_base + ofs); }
+
+  size_t sizeOf(size_t ofs) const { return header(ofs)[0] & ~(uint32_t)1; }
+
+  bool isUsed(size_t ofs) const { return header(ofs)[0] & 1; }
+
+  size_t requestedOf(size_t ofs) const { return header(ofs)[1]; }
+
+  size_t offsetOf(const void *ptr) const { return (const uint8_t *)ptr - _base - HEADER_SIZE; }
+
+  void setBlock(size_t ofs, size_t size, bool used, size_t requested)
+  {
+    header(ofs)[0] = size | (used ? 1 : 0);
+    header(ofs)[1] = requested;
+  }
+
+  // Merge the free block with its following free blocks
+  size_t merge(size_t ofs)
+  {
+    size_t n = sizeOf(ofs);
+    while (ofs + n < _stats.capacity && !isUsed(ofs + n))
+      n += sizeOf(ofs + n);
+    header(ofs)[0] = n | (header(ofs)[0] & 1);
+    return n;
+  }
+
+  // Split the remaining space of block to the new free block
+  void split(size_t ofs, size_t n, size_t need)
+  {
+    if (n - need < MIN_BLOCK_SIZE)
+      return;
+
+    setBlock(ofs, need, isUsed(ofs), requestedOf(ofs));
+    setBlock(ofs + need, n - need, false, 0);
+  }
+
+  void updateUsed(size_t n, bool add)
+  {
+    _stats.used = add ? _stats.used + n : _stats.used - n;
+    if (_stats.used > _stats.peak)
+      _stats.peak = _stats.used;
+  }
+};
+
+// The library pool with static storage, the allocation that does not fit the pool returns nullptr
+class ESP_Mail_Static_Pool
+{
+public:
+  static Static_Pool &pool()
+  {
+    alignas(8) static uint8_t buf[ESP_MAIL_STATIC_POOL_SIZE];
+    static Static_Pool p(buf, sizeof(buf));
+    return p;
+  }
+
+  static void *alloc(size_t size)
+  {
+    Static_Pool &pl = pool();
+    lock();
+    void *p = pl.alloc(size);
+    if (!p)
+      pl.overflow();
+    unlock();
+    return p;
+  }
+
+  // The block is kept when it can not be resized (returns nullptr)
+  static void *resize(void *ptr, size_t size)
+  {
+    Static_Pool &pl = pool();
+    if (ptr && !pl.owns(ptr))
+      return nullptr;
+
+    lock();
+    void *p = pl.resize(ptr, size);
+    if (!p)
+      pl.overflow();
+    unlock();
+    return p;
+  }
+
+  static void dealloc(void *ptr)
+  {
+    if (!ptr)
+      return;
+
+    // The memory that was not allocated by library e.g. the file system buffer is freed to heap
+    Static_Pool &pl = pool();
+    if (!pl.owns(ptr))
+    {
+      free(ptr);
+      return;
+    }
+
+    lock();
+    pl.dealloc(ptr);
+    unlock();
+  }
+
+  static size_t available() { return pool().available(); }
+
+  static static_pool_stats_t stats() { return pool().stats(); }
+
+private:
+#if defined(ESP32)
+  static portMUX_TYPE &mux()
+  {
+    static portMUX_TYPE m = portMUX_INITIALIZER_UNLOCKED;
+    return m;
+  }
+  static void lock() { portENTER_CRITICAL(&mux()); }
+  static void unlock() { portEXIT_CRITICAL(&mux()); }
+#else
+  static void lock() {}
+  static void unlock() {}
+#endif
+};
+
+// The std allocator for the containers (_vectorImpl) that allocates from the library pool
+template <typename T>
+class Static_Pool_Allocator
+{
+public:
+  typedef T value_type;
+
+  Static_Pool_Allocator() {}
+  template <typename U>
+  Static_Pool_Allocator(const Static_Pool_Allocator<U> &) {}
+
+  T *allocate(size_t n)
+  {
+    T *p = reinterpret_cast<T *>(ESP_Mail_Static_Pool::alloc(n * sizeof(T)));
+    // The container can not handle the allocation failure, the pool size or the limits should be increased
+    if (!p)
+      abort();
+    return p;
+  }
+  void deallocate(T *p, size_t) { ESP_Mail_Static_Pool::dealloc(p); }
+
+  template <typename U>
+  bool operator==(const Static_Pool_Allocator<U> &) const { return true; }
+  template <typename U>
+  bool operator!=(const Static_Pool_Allocator<U> &) const { return false; }
+};
+
+// The string buffers of MB_String are allocated from the library pool
+#define MB_STRING_ALLOCATOR ESP_Mail_Static_Pool
+
+#endif
+
+// The allocator of the library helper containers and buffers (Small_Vector, Interned_String, Cmd_Builder and Session_Buffer),
+// the memory is allocated from the library pool in static memory build or from heap (PSRAM when requested and available).
+// The heap allocations are recorded by heap profiler, the pool usage is reported by the pool statistics instead.
+class ESP_Mail_Mem
+{
+public:
+  /**
+   * Allocate the memory.
+   * @param len The memory size.
+   * @param tag The owner name for heap profiler.
+   * @param psram The option to allocate from PSRAM.
+   * @param site The return address of caller (ESP_MAIL_MEM_SITE) for heap profiler.
+   * @return The memory or nullptr if the memory is not enough.
+   */
+  static void *alloc(size_t len, const char *tag, bool psram = false, const void *site = nullptr)
+  {
+    void *p = nullptr;
+#if defined(ESP_MAIL_STATIC_MEMORY)
+    (void)psram;
+    p = ESP_Mail_Static_Pool::alloc(len);
+#elif defined(BOARD_HAS_PSRAM) && defined(MB_STRING_USE_PSRAM)
+    if (ESP.getPsramSize() == 0)
+      p = malloc(len);
+    else if (psram)
+      p = ps_malloc(len);
+    else
+      p = heap_caps_malloc(len, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+    (void)psram;
+    p = malloc(len);
+#endif
+
+#if defined(MB_HEAP_PROFILE_ALLOC) && !defined(ESP_MAIL_STATIC_MEMORY)
+    if (p)
+      MB_HEAP_PROFILE_ALLOC(tag, site, p, len);
+#else
+    (void)tag;
+    (void)site;
+#endif
+    return p;
+  }
+
+  // Free the memory
+  static void dealloc(void *p)
+  {
+    if (!p)
+      return;
+#if defined(MB_HEAP_PROFILE_FREE)
+#if defined(ESP_MAIL_STATIC_MEMORY)
+    if (!ESP_Mail_Static_Pool::pool().owns(p))
+#endif
+      MB_HEAP_PROFILE_FREE(p);
+#endif
+#if defined(ESP_MAIL_STATIC_MEMORY)
+    ESP_Mail_Static_Pool::dealloc(p);
+#else
+    free(p);
+#endif
+  }
+
+#if defined(ESP32)
+  // The lock of the library state that is shared by all sessions (the intern table of Interned_String and the
+  // operation arena of Mem_Arena) which is held in the scope. The recursive mutex (not the critical section)
+  // as the buffers are allocated while locked.
+  class Lock
+  {
+  public:
+    Lock() { xSemaphoreTakeRecursive(mutex(), portMAX_DELAY); }
+    ~Lock() { xSemaphoreGiveRecursive(mutex()); }
+
+  private:
+    static SemaphoreHandle_t mutex()
+    {
+      static SemaphoreHandle_t m = xSemaphoreCreateRecursiveMutex();
+      return m;
+    }
+  };
+#else
+  // The user-provided constructor and destructor as the lock object is not used otherwise
+  class Lock
+  {
+  public:
+    Lock() {}
+    ~Lock() {}
+  };
+#endif
+};
+
+#endif
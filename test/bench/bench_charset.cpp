@@ -0,0 +1,124 @@
+/**
+ * Host benchmark of the table-driven charset transcoders (Charset_Transcoder) across character sets.
+ *
+ * Each character set is decoded from the generated text with its share of non-ASCII bytes (mostly ASCII
+ * for the Latin scripts, mostly non-ASCII for the Cyrillic, Greek and Thai scripts). The throughput of
+ * decode() with the ASCII fast path is reported for the whole text and for the 76-byte chunks of the
+ * streamed body, with the per-byte decodeChar() loop as the baseline. The chunked output is checked to
+ * equal the whole-text output.
+ *
+ * Build and run (from test/bench)
+ * g++ -std=c++11 -O2 -Ihost -I../../src bench_charset.cpp -o bench_charset && ./bench_charset
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include <vector>
+#include "extras/Charset_Transcoder.h"
+
+struct charset_t
+{
+  const char *name;
+  const uint16_t *table;
+  // The percentage of non-ASCII letters
+  int nonAscii;
+};
+
+static const charset_t charsets[] = {
+    {"us-ascii", nullptr, 0},
+    {"iso-8859-1", nullptr, 5},
+    {"iso-8859-2", charset_table_iso8859_2, 10},
+    {"iso-8859-15", charset_table_iso8859_15, 5},
+    {"windows-1252", charset_table_windows_1252, 5},
+    {"windows-1250", charset_table_windows_1250, 10},
+    {"iso-8859-9", charset_table_iso8859_9, 8},
+    {"windows-1251", charset_table_windows_1251, 85},
+    {"koi8-r", charset_table_koi8_r, 85},
+    {"iso-8859-5", charset_table_iso8859_5, 85},
+    {"windows-1253", charset_table_windows_1253, 80},
+    {"iso-8859-7", charset_table_iso8859_7, 80},
+    {"tis-620", charset_table_iso8859_11, 95},
+    {"windows-874", charset_table_windows_874, 95}};
+
+static const size_t textLen = 256 * 1024;
+static const size_t chunkLen = 76;
+
+// The words of 3 to 8 letters that are separated by space and the line breaks
+static std::vector<char> makeText(const charset_t &cs)
+{
+  std::vector<char> text;
+  uint32_t seed = 12345;
+  while (text.size() < textLen)
+  {
+    seed = seed * 1103515245 + 12345;
+    int word = 3 + (seed >> 16) % 6;
+    for (int i = 0; i < word && text.size() < textLen; i++)
+    {
+      seed = seed * 1103515245 + 12345;
+      uint32_t r = seed >> 8;
+      if ((int)(r % 100) < cs.nonAscii)
+        text.push_back((char)(0xC0 + (r >> 8) % 0x20));
+      else
+        text.push_back((char)('a' + (r >> 8) % 26));
+    }
+    text.push_back(text.size() % 72 < 8 ? '\n' : ' ');
+  }
+  text.resize(textLen);
+  return text;
+}
+
+template <typename F>
+static double mbps(F f)
+{
+  const int rounds = 50;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++)
+    f();
+  auto t1 = std::chrono::steady_clock::now();
+  return (double)textLen * rounds / std::chrono::duration<double, std::micro>(t1 - t0).count();
+}
+
+int main()
+{
+  std::vector<char> whole(Charset_Transcoder::outputSize(textLen) + 1), chunked(whole.size());
+  size_t sink = 0;
+
+  printf("%-13s %9s %14s %14s %14s\n", "charset", "non-ASCII", "per-byte MB/s", "decode MB/s", "chunked MB/s");
+
+  for (size_t c = 0; c < sizeof(charsets) / sizeof(charsets[0]); c++)
+  {
+    const charset_t &cs = charsets[c];
+    std::vector<char> text = makeText(cs);
+    size_t outLen = 0;
+
+    double base = mbps([&]()
+                       {
+                         size_t j = 0;
+                         for (size_t i = 0; i < textLen; i++)
+                           j += Charset_Transcoder::decodeChar(cs.table, (uint8_t)text[i], &whole[j]);
+                         sink += j; });
+
+    double fast = mbps([&]()
+                       { outLen = Charset_Transcoder::decode(cs.table, whole.data(), text.data(), textLen); });
+
+    size_t chunkedLen = 0;
+    double chunk = mbps([&]()
+                        {
+                          chunkedLen = 0;
+                          for (size_t i = 0; i < textLen; i += chunkLen)
+                          {
+                            size_t n = textLen - i < chunkLen ? textLen - i : chunkLen;
+                            chunkedLen += Charset_Transcoder::decode(cs.table, &chunked[chunkedLen], &text[i], n);
+                          } });
+
+    if (chunkedLen != outLen || memcmp(whole.data(), chunked.data(), outLen) != 0)
+    {
+      printf("%s: chunked output differs\n", cs.name);
+      return 1;
+    }
+
+    printf("%-13s %8d%% %14.1f %14.1f %14.1f\n", cs.name, cs.nonAscii, base, fast, chunk);
+  }
+
+  return sink == 0;
+}
@@ -0,0 +1,261 @@
+/**
+ * Host benchmark of the IMAP COMPRESS=DEFLATE stream (RFC 4978) with RFC1951_Inflater and RFC1951_Deflater.
+ *
+ * The recorded-like IMAP session (CAPABILITY, LIST, SELECT, UID SEARCH, the header listing of FETCH and the
+ * text body) is compressed by zlib as the server does (raw deflate with the sync flush after every response)
+ * and inflated by RFC1951_Inflater from the TCP segments of random size. The inflated stream is checked to
+ * equal the session and the bytes saved and the inflate throughput are reported, with zlib inflate as the
+ * reference. The client commands are compressed by RFC1951_Deflater (one sync flushed block per command)
+ * at the window sizes that can be set, checked by zlib inflate, the ratio and time per command are reported.
+ *
+ * Build and run (from test/bench)
+ * g++ -std=c++11 -O2 -Ihost -I../../src bench_compress.cpp -lz -o bench_compress && ./bench_compress
+ */
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "extras/RFC1951.h"
+
+static std::vector<std::string> responses, commands;
+
+static uint32_t seed = 12345;
+
+static uint32_t rnd(uint32_t n)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) % n;
+}
+
+static std::string fmt(const char *format, ...)
+{
+  char buf[512];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  return buf;
+}
+
+static void makeSession()
+{
+  static const char *names[] = {"Alice Smith", "Bob Jones", "Carol White", "Dave Brown", "Eve Black"};
+  static const char *words[] = {"weekly", "report", "meeting", "invoice", "order", "shipped", "review", "update",
+                                "project", "schedule", "the", "for", "and", "your", "new", "status"};
+
+  commands.push_back("A001 CAPABILITY\r\n");
+  responses.push_back("* CAPABILITY IMAP4rev1 LITERAL+ SASL-IR LOGIN-REFERRALS ID ENABLE IDLE SORT SORT=DISPLAY THREAD=REFERENCES "
+                      "THREAD=REFS THREAD=ORDEREDSUBJECT MULTIAPPEND URL-PARTIAL CATENATE UNSELECT CHILDREN NAMESPACE UIDPLUS "
+                      "LIST-EXTENDED I18NLEVEL=1 CONDSTORE QRESYNC ESEARCH ESORT SEARCHRES WITHIN CONTEXT=SEARCH LIST-STATUS "
+                      "BINARY MOVE SNIPPET=FUZZY PREVIEW=FUZZY SPECIAL-USE COMPRESS=DEFLATE\r\nA001 OK Capability completed.\r\n");
+
+  commands.push_back("A002 LIST \"\" \"*\"\r\n");
+  std::string list;
+  static const char *folders[] = {"INBOX", "Drafts", "Sent", "Trash", "Junk", "Archive", "Work", "Work/Projects", "Family", "Receipts"};
+  for (size_t i = 0; i < sizeof(folders) / sizeof(folders[0]); i++)
+    list += fmt("* LIST (\\HasNoChildren) \"/\" \"%s\"\r\n", folders[i]);
+  responses.push_back(list + "A002 OK List completed.\r\n");
+
+  commands.push_back("A003 SELECT \"INBOX\"\r\n");
+  responses.push_back("* FLAGS (\\Answered \\Flagged \\Deleted \\Seen \\Draft $Forwarded $Junk $NotJunk)\r\n"
+                      "* OK [PERMANENTFLAGS (\\Answered \\Flagged \\Deleted \\Seen \\Draft $Forwarded $Junk $NotJunk \\*)] Flags permitted.\r\n"
+                      "* 2500 EXISTS\r\n* 0 RECENT\r\n* OK [UNSEEN 2481] First unseen.\r\n* OK [UIDVALIDITY 1697000000] UIDs valid\r\n"
+                      "* OK [UIDNEXT 4001] Predicted next UID\r\n* OK [HIGHESTMODSEQ 98765] Highest\r\nA003 OK [READ-WRITE] Select completed.\r\n");
+
+  commands.push_back("A004 UID SEARCH UNSEEN\r\n");
+  std::string search = "* SEARCH";
+  for (int i = 0; i < 200; i++)
+    search += fmt(" %d", 1500 + i * 12 + (int)rnd(12));
+  responses.push_back(search + "\r\nA004 OK Search completed.\r\n");
+
+  // The header listing of 100 messages in the chunks of 20
+  for (int c = 0; c < 5; c++)
+  {
+    int tag = 5 + c;
+    commands.push_back(fmt("A%03d UID FETCH %d:%d (UID FLAGS RFC822.SIZE BODY.PEEK[HEADER.FIELDS (FROM TO SUBJECT DATE MESSAGE-ID)])\r\n",
+                           tag, 3000 + c * 20, 3019 + c * 20));
+    std::string fetch;
+    for (int m = 0; m < 20; m++)
+    {
+      int uid = 3000 + c * 20 + m;
+      const char *from = names[rnd(5)];
+      std::string subject;
+      for (int w = 0, n = 3 + rnd(5); w < n; w++)
+        subject += std::string(w ? " " : "") + words[rnd(16)];
+      std::string header = fmt("From: \"%s\" <%s@example.com>\r\nTo: team@example.com\r\nSubject: %s\r\n"
+                               "Date: Mon, %d Oct 2026 %02d:%02d:%02d +0000\r\nMessage-ID: <%08x.%d@mail.example.com>\r\n\r\n",
+                               from, from, subject.c_str(), 1 + rnd(28), rnd(24), rnd(60), rnd(60), rnd(0xffffffff), uid);
+      fetch += fmt("* %d FETCH (UID %d FLAGS (%s) RFC822.SIZE %d BODY[HEADER.FIELDS (FROM TO SUBJECT DATE MESSAGE-ID)] {%zu}\r\n",
+                   uid - 1500, uid, rnd(2) ? "\\Seen" : "", 2000 + rnd(60000), header.size());
+      fetch += header + ")\r\n";
+    }
+    responses.push_back(fetch + fmt("A%03d OK Fetch completed.\r\n", tag));
+  }
+
+  // The text body
+  std::string body;
+  while (body.size() < 16 * 1024)
+  {
+    std::string line;
+    while (line.size() < 70)
+      line += std::string(line.size() ? " " : "") + words[rnd(16)];
+    body += line + "\r\n";
+  }
+  commands.push_back("A010 UID FETCH 3050 BODY.PEEK[1]\r\n");
+  responses.push_back(fmt("* 1550 FETCH (UID 3050 BODY[1] {%zu}\r\n", body.size()) + body + ")\r\nA010 OK Fetch completed.\r\n");
+
+  commands.push_back("A011 LOGOUT\r\n");
+  responses.push_back("* BYE Logging out\r\nA011 OK Logout completed.\r\n");
+}
+
+static double elapsedUs(std::chrono::steady_clock::time_point t0)
+{
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+}
+
+// The raw deflate with sync flush after each part as the server and zlib client do
+static std::vector<uint8_t> zlibDeflate(const std::vector<std::string> &parts, int windowBits)
+{
+  z_stream z = {};
+  deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -windowBits, 8, Z_DEFAULT_STRATEGY);
+  std::vector<uint8_t> out;
+  uint8_t buf[4096];
+  for (const std::string &s : parts)
+  {
+    z.next_in = (Bytef *)s.data();
+    z.avail_in = s.size();
+    do
+    {
+      z.next_out = buf;
+      z.avail_out = sizeof(buf);
+      deflate(&z, Z_SYNC_FLUSH);
+      out.insert(out.end(), buf, buf + sizeof(buf) - z.avail_out);
+    } while (z.avail_out == 0);
+  }
+  deflateEnd(&z);
+  return out;
+}
+
+static bool zlibInflate(const std::vector<uint8_t> &in, std::string &out)
+{
+  z_stream z = {};
+  inflateInit2(&z, -15);
+  uint8_t buf[4096];
+  z.next_in = (Bytef *)in.data();
+  z.avail_in = in.size();
+  int ret = Z_OK;
+  out.clear();
+  while (ret == Z_OK && z.avail_in > 0)
+  {
+    z.next_out = buf;
+    z.avail_out = sizeof(buf);
+    ret = inflate(&z, Z_SYNC_FLUSH);
+    out.append((char *)buf, sizeof(buf) - z.avail_out);
+  }
+  inflateEnd(&z);
+  return ret == Z_OK || ret == Z_BUF_ERROR;
+}
+
+int main()
+{
+  makeSession();
+
+  std::string session;
+  for (const std::string &s : responses)
+    session += s;
+
+  MB_FS mbfs;
+  Client client;
+  const int rounds = 20;
+
+  // Server to client
+  std::vector<uint8_t> stream = zlibDeflate(responses, 15);
+
+  printf("server responses %zu bytes, compressed %zu bytes, %.1f%% saved\n", session.size(), stream.size(),
+         100.0 - 100.0 * stream.size() / session.size());
+
+  std::string out;
+  double us = 0;
+  for (int r = 0; r < rounds; r++)
+  {
+    RFC1951_Inflater inflater;
+    if (!inflater.begin(&mbfs, 15))
+      return 1;
+
+    client.setRx(stream.data(), stream.size());
+    out.clear();
+    uint8_t buf[512];
+
+    auto t0 = std::chrono::steady_clock::now();
+    while (!client.done() || inflater.available(&client) > 0)
+    {
+      // The TCP segment of 1 to 1460 bytes
+      client.arrive(1 + rnd(1460));
+      int n = inflater.available(&client);
+      if (n < 0)
+        return 1;
+      while ((n = inflater.read(buf, sizeof(buf))) > 0)
+        out.append((char *)buf, n);
+    }
+    us += elapsedUs(t0);
+
+    if (out != session)
+    {
+      printf("inflated stream differs\n");
+      return 1;
+    }
+  }
+
+  printf("%-22s %8.1f MB/s (inflated)\n", "RFC1951_Inflater", session.size() * rounds / us);
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++)
+    zlibInflate(stream, out);
+  printf("%-22s %8.1f MB/s (inflated)\n", "zlib inflate", session.size() * rounds / elapsedUs(t0));
+
+  // Client to server
+  size_t cmdLen = 0;
+  for (const std::string &s : commands)
+    cmdLen += s.size();
+
+  printf("\nclient commands %zu bytes (%zu commands)\n", cmdLen, commands.size());
+
+  for (uint8_t windowBits = 8; windowBits <= RFC1951_MAX_DEFLATE_WINDOW_BITS; windowBits += 2)
+  {
+    us = 0;
+    for (int r = 0; r < rounds; r++)
+    {
+      RFC1951_Deflater deflater;
+      if (!deflater.begin(&mbfs, windowBits))
+        return 1;
+
+      client.tx.clear();
+
+      auto t0 = std::chrono::steady_clock::now();
+      for (const std::string &s : commands)
+      {
+        if (deflater.write(&client, (const uint8_t *)s.data(), s.size()) != (int)s.size())
+          return 1;
+      }
+      us += elapsedUs(t0);
+    }
+
+    std::string cmds;
+    if (!zlibInflate(client.tx, cmds) || cmds.size() != cmdLen)
+    {
+      printf("deflated commands differ\n");
+      return 1;
+    }
+
+    printf("RFC1951_Deflater %2d bits %5zu bytes, %5.1f%% saved %8.2f us/command\n", windowBits, client.tx.size(),
+           100.0 - 100.0 * client.tx.size() / cmdLen, us / rounds / commands.size());
+  }
+
+  std::vector<uint8_t> z = zlibDeflate(commands, 15);
+  printf("%-22s %5zu bytes, %5.1f%% saved\n", "zlib deflate 15 bits", z.size(), 100.0 - 100.0 * z.size() / cmdLen);
+
+  return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * Host benchmark of the IMAP header cache (Header_Cache) at 10k and 100k entries.
+ *
+ * The cache files are written and read by Header_Cache through MB_FS with the flash file system on host
+ * (host/Host_FS.h, the files are stored under bench_fs). The records have the same layout as the records of
+ * writeHeaderCache (the header data length, flags, the RFC822 header fields and the MIME header fields).
+ * The cache opening, the lookup of the recent UIDs, the random UIDs and the missing UIDs, the record reading,
+ * the insert of the new UIDs and the removal of the random UIDs are timed at each cache size.
+ *
+ * The index file is sorted by UID and binary searched in file, the lookup reads about log2(n) entries. The
+ * new UIDs are appended to the index file, the removed UIDs are merged by copying the index file once per
+ * HEADER_CACHE_MAX_PENDING removals.
+ *
+ * Build and run (from test/bench)
+ * g++ -std=c++11 -O2 -Ihost -I../../src bench_header_cache.cpp -o bench_header_cache && ./bench_header_cache
+ */
+
+#define BENCH_HOST_FS
+
+#include <Arduino.h>
+#include <chrono>
+#include <string>
+#include "extras/Header_Cache.h"
+
+#define RFC822_FIELDS 15
+#define RECORD_STRINGS (RFC822_FIELDS + 7)
+
+static MB_FS mbfs;
+static Header_Cache hc;
+static const char *path = "/hcache/bench";
+static uint32_t uidValidity = 1697000000;
+
+// The header of the typical message, the From, To, Subject, Date and Message-ID fields are set
+static void makeFields(uint32_t uid, MB_String *fields)
+{
+  for (int i = 0; i < RECORD_STRINGS; i++)
+    fields[i].clear();
+
+  fields[0] = "\"Alice Smith\" <alice@example.com>";
+  fields[2] = "team@example.com";
+  fields[4] = "Weekly report for the project ";
+  fields[4] += (int)uid;
+  fields[5] = "Mon, 12 Oct 2026 09:30:00 +0000";
+  fields[6] = "<";
+  fields[6] += (int)uid;
+  fields[6] += ".1697000000@mail.example.com>";
+  fields[RFC822_FIELDS] = "text/plain";
+  fields[RFC822_FIELDS + 1] = "7bit";
+  fields[RFC822_FIELDS + 5] = "utf-8";
+}
+
+static bool writeRecord(uint32_t uid)
+{
+  MB_String fields[RECORD_STRINGS];
+  const MB_String *strings[RECORD_STRINGS];
+  uint32_t values[2] = {512, 0};
+
+  makeFields(uid, fields);
+  for (int i = 0; i < RECORD_STRINGS; i++)
+    strings[i] = &fields[i];
+
+  return hc.write(uid, values, 2, strings, RECORD_STRINGS);
+}
+
+static bool readRecord(uint32_t uid)
+{
+  header_cache_index_t item;
+  if (!hc.find(uid, item))
+    return false;
+
+  MB_String fields[RECORD_STRINGS], expected[RECORD_STRINGS];
+  MB_String *strings[RECORD_STRINGS];
+  uint32_t values[2];
+
+  for (int i = 0; i < RECORD_STRINGS; i++)
+    strings[i] = &fields[i];
+
+  if (!hc.read(item, values, 2, strings, RECORD_STRINGS) || values[0] != 512)
+    return false;
+
+  makeFields(uid, expected);
+  for (int i = 0; i < RECORD_STRINGS; i++)
+  {
+    if (strcmp(fields[i].c_str(), expected[i].c_str()) != 0)
+      return false;
+  }
+
+  return true;
+}
+
+// The cache with the UIDs 1 to n which were fetched in order
+static bool createCache(uint32_t n)
+{
+  // The different UIDVALIDITY clears the cache files
+  if (!hc.begin(&mbfs, mbfs_flash, path, uidValidity + n))
+    return false;
+
+  for (uint32_t uid = 1; uid <= n; uid++)
+  {
+    if (!writeRecord(uid))
+      return false;
+  }
+
+  hc.flush();
+  return hc.begin(&mbfs, mbfs_flash, path, uidValidity + n) && hc.count() == (int)n;
+}
+
+template <typename F>
+static void bench(const char *name, int ops, F f)
+{
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < ops; i++)
+    f(i);
+  auto t1 = std::chrono::steady_clock::now();
+  printf("  %-16s %12.2f us/op\n", name, std::chrono::duration<double, std::micro>(t1 - t0).count() / ops);
+}
+
+int main()
+{
+  static const uint32_t sizes[] = {10000, 100000};
+  uint32_t seed = 12345;
+  long found = 0;
+
+  for (uint32_t n : sizes)
+  {
+    if (!createCache(n))
+    {
+      printf("cache could not be created\n");
+      return 1;
+    }
+
+    printf("%u entries\n", n);
+
+    bench("begin", 1000, [&](int)
+          { found += hc.begin(&mbfs, mbfs_flash, path, uidValidity + n); });
+
+    header_cache_index_t item;
+
+    // The newest 1000 messages that are fetched again
+    bench("find recent", 100000, [&](int i)
+          { found += hc.find(n - (i % 1000), item); });
+
+    bench("find random", 100000, [&](int)
+          {
+            seed = seed * 1103515245 + 12345;
+            found += hc.find(1 + (seed >> 8) % n, item); });
+
+    // The new messages that are not cached yet
+    bench("find missing", 100000, [&](int i)
+          { found += hc.find(n + 1 + i, item); });
+
+    bench("read record", 10000, [&](int i)
+          { found += readRecord(n - (i % 1000)); });
+
+    bench("insert", 1000, [&](int i)
+          { writeRecord(n + 1 + i); });
+
+    // The expunged messages, UIDs 1 to 160 which are at the start of index file
+    bench("remove", 160, [&](int i)
+          { hc.remove(1 + i); });
+
+    hc.flush();
+
+    if (!hc.begin(&mbfs, mbfs_flash, path, uidValidity + n) || hc.count() != (int)n + 1000 - 160 ||
+        hc.find(160, item) || !readRecord(161) || !readRecord(n) || !readRecord(n + 1000))
+    {
+      printf("cache differs\n");
+      return 1;
+    }
+  }
+
+  mbfs.remove(MB_String(path) + ".idx", mbfs_flash);
+  mbfs.remove(MB_String(path) + ".dat", mbfs_flash);
+  HostFS.rmdir("/hcache");
+  HostFS.rmdir("");
+
+  return found == 0;
+}
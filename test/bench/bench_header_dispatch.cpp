@@ -0,0 +1,155 @@
+/**
+ * Host benchmark of the header field name dispatch of the IMAP header parser (esp_mail_get_header_field_hash).
+ *
+ * The header lines of the fetched messages are dispatched to their fields once with the perfect hash
+ * lookup of the library (header_field_hash) and once with the former field by field compare (the "Name:"
+ * token of every known field was built and compared to the line in turn until one matched). The time and
+ * the heap allocations (counted by the malloc wrapper, glibc) per header line are reported.
+ *
+ * ESP_Mail_Const.h keeps the 32-bit addresses of the device build (MB_String toAddr), -fpermissive builds
+ * it on 64-bit host.
+ *
+ * Build and run (from test/bench)
+ * g++ -std=c++11 -O2 -fpermissive -Ihost -I../../src bench_header_dispatch.cpp -o bench_header_dispatch && ./bench_header_dispatch
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include <string>
+#include "ESP_Mail_Const.h"
+
+extern "C" void *__libc_malloc(size_t size);
+
+static size_t allocs = 0;
+
+extern "C" void *malloc(size_t size)
+{
+  allocs++;
+  return __libc_malloc(size);
+}
+
+// The field names in header_field_hash, rfc822_headers followed by the content fields of message_headers
+static const esp_mail_message_header_field_types content_fields[] = {
+    esp_mail_message_header_field_content_transfer_encoding, esp_mail_message_header_field_accept_language,
+    esp_mail_message_header_field_content_language, esp_mail_message_header_field_content_type,
+    esp_mail_message_header_field_content_description, esp_mail_message_header_field_content_id,
+    esp_mail_message_header_field_content_disposition};
+
+static const int content_count = sizeof(content_fields) / sizeof(content_fields[0]);
+static const int fields = esp_mail_rfc822_header_field_maxType + content_count;
+
+// The hash table value of field
+static int fieldValue(int i)
+{
+  return i < esp_mail_rfc822_header_field_maxType ? ESP_MAIL_HEADER_HASH_RFC822(i)
+                                                  : ESP_MAIL_HEADER_HASH_MESSAGE(content_fields[i - esp_mail_rfc822_header_field_maxType]);
+}
+
+static const char *fieldName(int i)
+{
+  return i < esp_mail_rfc822_header_field_maxType ? rfc822_headers[i].text
+                                                  : message_headers[content_fields[i - esp_mail_rfc822_header_field_maxType]].text;
+}
+
+static int hashDispatch(const char *buf, int &valuePos)
+{
+  return esp_mail_get_header_field_hash(buf, valuePos, false);
+}
+
+// The former dispatch, the field name token was built in the string for every compare
+static int compareDispatch(const char *buf, int &valuePos)
+{
+  valuePos = 0;
+  for (int i = 0; i < fields; i++)
+  {
+    std::string token = fieldName(i);
+    token += ":";
+    if (strncasecmp(buf, token.c_str(), token.size()) == 0)
+    {
+      valuePos = token.size();
+      while (buf[valuePos] == ' ' || buf[valuePos] == '\t')
+        valuePos++;
+      return fieldValue(i);
+    }
+  }
+  return 0;
+}
+
+static const char *lines[] = {
+    "Return-Path: <alice@example.com>",
+    "Received: from mail.example.com (mail.example.com [192.0.2.1]) by mx.example.net",
+    "\tfor <bob@example.net>; Mon, 12 Oct 2026 09:30:01 +0000",
+    "DKIM-Signature: v=1; a=rsa-sha256; c=relaxed/relaxed; d=example.com; s=mail",
+    "Message-ID: <1697000000.1234@mail.example.com>",
+    "Date: Mon, 12 Oct 2026 09:30:00 +0000",
+    "From: \"Alice Smith\" <alice@example.com>",
+    "To: bob@example.net",
+    "Cc: team@example.com",
+    "Subject: Weekly report",
+    "In-Reply-To: <1696990000.99@mail.example.net>",
+    "References: <1696990000.99@mail.example.net>",
+    "MIME-Version: 1.0",
+    "Content-Type: multipart/mixed; boundary=\"b1\"",
+    "Content-Transfer-Encoding: 7bit",
+    "X-Mailer: Example Mailer 1.0",
+    "Content-Language: en-US",
+    "Accept-Language: en-US"};
+
+static const int count = sizeof(lines) / sizeof(lines[0]);
+
+static int sink = 0;
+
+static void bench(const char *name, int (*dispatch)(const char *, int &))
+{
+  const int n = 200000;
+  int valuePos = 0;
+  allocs = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < n; r++)
+  {
+    for (int i = 0; i < count; i++)
+      sink += dispatch(lines[i], valuePos) + valuePos;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / n / count;
+  printf("%-16s %8.1f ns/line %6.2f allocs/line\n", name, ns, (double)allocs / n / count);
+}
+
+int main()
+{
+  // Every field name is found in the table
+  for (int i = 0; i < fields; i++)
+  {
+    std::string line = fieldName(i);
+    line += ": value";
+    int p = 0;
+    if (hashDispatch(line.c_str(), p) != fieldValue(i) || strcmp(line.c_str() + p, "value") != 0)
+    {
+      printf("%s is not found\n", fieldName(i));
+      return 1;
+    }
+  }
+
+  // Both dispatches should find the same field and value position, also in other letter case
+  for (int i = 0; i < count; i++)
+  {
+    std::string lower = lines[i];
+    for (char &c : lower)
+      c = tolower(c);
+
+    int p1 = 0, p2 = 0, p3 = 0;
+    int f1 = hashDispatch(lines[i], p1), f2 = compareDispatch(lines[i], p2), f3 = hashDispatch(lower.c_str(), p3);
+    if (f1 != f2 || p1 != p2 || f1 != f3 || p1 != p3)
+    {
+      printf("dispatch differs: %s\n", lines[i]);
+      return 1;
+    }
+  }
+
+  bench("field compare", compareDispatch);
+  bench("perfect hash", hashDispatch);
+
+  return sink == 0;
+}
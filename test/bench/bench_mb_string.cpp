@@ -0,0 +1,107 @@
+/**
+ * Host benchmark of MB_String allocations and throughput (inline short string buffer and geometric growth).
+ *
+ * The string buffers are allocated by the counting allocator (MB_STRING_ALLOCATOR), the number of
+ * allocations and reallocations per operation and the time per operation are reported for the short
+ * header values, the appended response text and the built commands.
+ *
+ * Build and run (from test/bench)
+ * g++ -std=c++11 -O2 -Ihost -I../../src bench_mb_string.cpp -o bench_mb_string && ./bench_mb_string
+ *
+ * Build with the smallest inline buffer to compare
+ * g++ -std=c++11 -O2 -Ihost -I../../src -DMB_STRING_SSO_SIZE=4 bench_mb_string.cpp -o bench_mb_string_sso4
+ */
+
+#include <Arduino.h>
+#include <chrono>
+
+class Counting_Allocator
+{
+public:
+  static void *alloc(size_t len)
+  {
+    allocs++;
+    return malloc(len);
+  }
+
+  static void *resize(void *p, size_t len)
+  {
+    reallocs++;
+    return realloc(p, len);
+  }
+
+  static void dealloc(void *p) { free(p); }
+
+  static size_t allocs, reallocs;
+};
+
+size_t Counting_Allocator::allocs = 0;
+size_t Counting_Allocator::reallocs = 0;
+
+#define MB_STRING_ALLOCATOR Counting_Allocator
+#include "extras/MB_String.h"
+
+static size_t sink = 0;
+
+template <typename F>
+static void bench(const char *name, int ops, F f)
+{
+  Counting_Allocator::allocs = 0;
+  Counting_Allocator::reallocs = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < ops; i++)
+    f(i);
+  auto t1 = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / ops;
+  printf("%-22s %8.2f allocs/op %8.2f reallocs/op %10.1f ns/op\n", name,
+         (double)Counting_Allocator::allocs / ops, (double)Counting_Allocator::reallocs / ops, ns);
+}
+
+int main()
+{
+  static const char *values[] = {"utf-8", "base64", "text/plain", "INBOX", "7bit", "attachment", "\\Seen", "A001"};
+  static const char *line = "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tem\r\n";
+
+  printf("MB_STRING_SSO_SIZE %d, sizeof(MB_String) %zu\n", MB_STRING_SSO_SIZE, sizeof(MB_String));
+
+  // The header values and tags that are created and destroyed
+  bench("short values", 1000000, [](int i)
+        {
+          MB_String s = values[i & 7];
+          MB_String t = s;
+          sink += t.length(); });
+
+  // The response text that is appended line by line (4 KB)
+  bench("append 4 KB", 20000, [](int)
+        {
+          MB_String s;
+          for (int j = 0; j < 52; j++)
+            s += line;
+          sink += s.length(); });
+
+  // The command that is built from the mixed parts
+  bench("build command", 500000, [](int i)
+        {
+          MB_String cmd = "A";
+          cmd += i;
+          cmd += " UID FETCH ";
+          cmd += i * 7 + 1;
+          cmd += " BODY.PEEK[HEADER.FIELDS (FROM SUBJECT DATE)]";
+          sink += cmd.length(); });
+
+  // The space-joined list of short tokens
+  bench("join tokens", 200000, [](int)
+        {
+          MB_String s;
+          for (int j = 0; j < 8; j++)
+          {
+            if (s.length() > 0)
+              s += ' ';
+            s += values[j];
+          }
+          sink += s.length(); });
+
+  return sink == 0;
+}
@@ -0,0 +1,180 @@
+/**
+ * Host-simulated benchmark of the tiered buffer placement policy (Mem_Placement_Policy).
+ *
+ * The buffer accesses of a fetch workload are replayed through the simulated memory: the internal RAM
+ * access takes int_ns, the PSRAM access is served from the direct-mapped cache (cache_kb, 32-byte lines)
+ * and takes psram_ns when the line misses. The buffer of each purpose is placed by the placeInPSRAM of
+ * the library policy, the header record strings are placed by its header_record tier (stringPSRAMMinSize).
+ *
+ * Build and run (from test/bench)
+ * g++ -std=c++11 -O2 -Ihost -I../../src bench_mem_placement.cpp -o bench_mem_placement
+ * ./bench_mem_placement [int_ns] [psram_ns] [cache_kb] [psram_threshold]
+ */
+
+#include <Arduino.h>
+#include <vector>
+#include "extras/Mem_Placement.h"
+
+struct policy_t
+{
+  const char *name;
+  esp_mail_mem_placement_policy_t policy;
+};
+
+class Sim_Memory
+{
+public:
+  Sim_Memory(double int_ns, double psram_ns, size_t cache_kb)
+    : int_ns(int_ns), psram_ns(psram_ns), tags(cache_kb * 1024 / line, UINT32_MAX) {}
+
+  // Access n bytes at the offset of buffer, one access per 4-byte word
+  void access(bool psram, uint32_t base, size_t offset, size_t n)
+  {
+    for (size_t i = offset; i < offset + n; i += 4)
+    {
+      if (!psram)
+      {
+        ns += int_ns;
+        continue;
+      }
+
+      uint32_t addr = base + (uint32_t)i;
+      uint32_t ln = addr / line;
+      uint32_t &tag = tags[ln % tags.size()];
+      if (tag == ln)
+        ns += int_ns;
+      else
+      {
+        tag = ln;
+        misses++;
+        ns += psram_ns;
+      }
+    }
+  }
+
+  double ns = 0;
+  size_t misses = 0;
+
+private:
+  static const uint32_t line = 32;
+  double int_ns, psram_ns;
+  std::vector<uint32_t> tags;
+};
+
+struct buffer_t
+{
+  esp_mail_mem_purpose purpose;
+  size_t size;
+  uint32_t base;
+  bool psram;
+};
+
+// The header record strings of message e.g. From, To, Subject, Date, Message-ID and the content fields
+static const size_t header_sizes[] = {40, 24, 64, 32, 48, 16, 16, 24, 80};
+static const int header_count = sizeof(header_sizes) / sizeof(header_sizes[0]);
+
+// Replay the fetch of messages, each one reads the response lines, decodes the body and stages the attachment
+static void run(const policy_t &p, double int_ns, double psram_ns, size_t cache_kb)
+{
+  buffer_t bufs[] = {
+    {esp_mail_mem_purpose_response_buffer, 1024, 0, false},
+    {esp_mail_mem_purpose_general, 512, 0, false},
+    {esp_mail_mem_purpose_decoded_body, 4096, 0, false},
+    {esp_mail_mem_purpose_attachment_staging, 16384, 0, false}};
+
+  // The PSRAM buffers are laid out one after another as they are allocated
+  uint32_t next = 0;
+  size_t internal = 0;
+  for (size_t i = 0; i < sizeof(bufs) / sizeof(bufs[0]); i++)
+  {
+    bufs[i].psram = p.policy.placeInPSRAM(bufs[i].size, bufs[i].purpose);
+    if (bufs[i].psram)
+    {
+      bufs[i].base = next;
+      next += (uint32_t)bufs[i].size;
+    }
+    else
+      internal += bufs[i].size;
+  }
+
+  // The header record strings of all messages are kept until the fetch is done
+  std::vector<buffer_t> headers;
+  for (int msg = 0; msg < 200; msg++)
+  {
+    for (int i = 0; i < header_count; i++)
+    {
+      buffer_t b = {esp_mail_mem_purpose_general, header_sizes[i], 0, header_sizes[i] >= p.policy.stringPSRAMMinSize()};
+      if (b.psram)
+      {
+        b.base = next;
+        next += (uint32_t)b.size;
+      }
+      else
+        internal += b.size;
+      headers.push_back(b);
+    }
+  }
+
+  Sim_Memory mem(int_ns, psram_ns, cache_kb);
+  buffer_t &resp = bufs[0], &hdr = bufs[1], &body = bufs[2], &stage = bufs[3];
+
+  for (int msg = 0; msg < 200; msg++)
+  {
+    // 64 response lines, each line is written, scanned twice by the parser and its token copied
+    for (int line = 0; line < 64; line++)
+    {
+      size_t len = 76;
+      mem.access(resp.psram, resp.base, 0, len);
+      mem.access(resp.psram, resp.base, 0, len);
+      mem.access(resp.psram, resp.base, 0, len);
+      mem.access(hdr.psram, hdr.base, (line * 32) % hdr.size, 32);
+
+      // The decoded body and the staging chunk are streamed
+      mem.access(body.psram, body.base, (line * 57) % (body.size - 57), 57);
+      mem.access(stage.psram, stage.base, (line * 256) % stage.size, 256);
+    }
+
+    // The header fields are copied to their strings and read back by the application
+    for (int i = 0; i < header_count; i++)
+    {
+      buffer_t &h = headers[msg * header_count + i];
+      mem.access(h.psram, h.base, 0, h.size);
+      mem.access(h.psram, h.base, 0, h.size);
+    }
+  }
+
+  printf("%-14s internal %7zu B  psram misses %9zu  time %10.3f ms\n", p.name, internal, mem.misses, mem.ns / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+  double int_ns = argc > 1 ? atof(argv[1]) : 2;
+  double psram_ns = argc > 2 ? atof(argv[2]) : 100;
+  size_t cache_kb = argc > 3 ? (size_t)atoi(argv[3]) : 16;
+  size_t psram_threshold = argc > 4 ? (size_t)atoi(argv[4]) : ESP_MAIL_PSRAM_THRESHOLD;
+
+  if (cache_kb == 0)
+    cache_kb = 1;
+
+  printf("internal %.1f ns, psram %.1f ns (miss), cache %zu KB, threshold %zu B\n", int_ns, psram_ns, cache_kb, psram_threshold);
+
+  // The global switch (ESP_MAIL_USE_PSRAM) before the policy
+  policy_t all_psram = {"all psram", esp_mail_mem_placement_policy_t()};
+  all_psram.policy.general = all_psram.policy.response_buffer = all_psram.policy.attachment_staging = esp_mail_mem_tier_psram;
+  all_psram.policy.decoded_body = all_psram.policy.header_record = esp_mail_mem_tier_psram;
+
+  // The default policy
+  policy_t tiered = {"tiered", esp_mail_mem_placement_policy_t()};
+
+  // The reference, all buffers in internal RAM
+  policy_t all_internal = {"all internal", esp_mail_mem_placement_policy_t()};
+  all_internal.policy.general = all_internal.policy.response_buffer = all_internal.policy.attachment_staging = esp_mail_mem_tier_internal;
+  all_internal.policy.decoded_body = all_internal.policy.header_record = esp_mail_mem_tier_internal;
+
+  all_psram.policy.psram_threshold = tiered.policy.psram_threshold = all_internal.policy.psram_threshold = psram_threshold;
+
+  run(all_psram, int_ns, psram_ns, cache_kb);
+  run(tiered, int_ns, psram_ns, cache_kb);
+  run(all_internal, int_ns, psram_ns, cache_kb);
+  return 0;
+}
@@ -0,0 +1,167 @@
+/**
+ * Host benchmark of the PROGMEM token compare and search primitives (PGM_Compare).
+ *
+ * The recorded IMAP response lines are parsed with the token checks of the response handlers, once with
+ * PGM_Compare and once with the former strcmpP/strposP (copied here as the baseline, they copied the buffer
+ * slice and the token to heap for every call). The heap allocations per parsed response are counted by the
+ * malloc wrapper (glibc) and the time per response is reported.
+ *
+ * Build and run (from test/bench)
+ * g++ -std=c++11 -O2 -Ihost -I../../src bench_pgm_compare.cpp -o bench_pgm_compare && ./bench_pgm_compare
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include "extras/PGM_Compare.h"
+
+extern "C" void *__libc_malloc(size_t size);
+
+static size_t allocs = 0;
+
+extern "C" void *malloc(size_t size)
+{
+  allocs++;
+  return __libc_malloc(size);
+}
+
+// The former strpos
+static int strpos(const char *haystack, const char *needle, int offset, bool caseSensitive)
+{
+  if (!haystack || !needle)
+    return -1;
+
+  int hlen = strlen(haystack);
+  int nlen = strlen(needle);
+
+  if (hlen == 0 || nlen == 0)
+    return -1;
+
+  int hidx = offset, nidx = 0;
+  while ((*(haystack + hidx) != '\0') && (*(needle + nidx) != '\0') && hidx < hlen)
+  {
+    bool nm = caseSensitive ? *(needle + nidx) != *(haystack + hidx) : tolower(*(needle + nidx)) != tolower(*(haystack + hidx));
+
+    if (nm)
+    {
+      hidx++;
+      nidx = 0;
+    }
+    else
+    {
+      nidx++;
+      hidx++;
+      if (nidx == nlen)
+        return hidx - nidx;
+    }
+  }
+
+  return -1;
+}
+
+// The former strposP, the token was copied to MB_String (heap)
+static int strposP(const char *buf, PGM_P token, int ofs, bool caseSensitive = true)
+{
+  char *s = strdup(token);
+  int ret = strpos(buf, s, ofs, caseSensitive);
+  free(s);
+  return ret;
+}
+
+// The former strcmpP, the buffer slice and the token were copied to heap
+static bool strcmpP(const char *buf, int ofs, PGM_P token, bool caseSensitive = true)
+{
+  if (ofs < 0)
+  {
+    int p = strposP(buf, token, 0, caseSensitive);
+    if (p == -1)
+      return false;
+    ofs = p;
+  }
+
+  size_t len = strlen_P(token);
+  char *tmp = (char *)calloc(1, len + 1);
+  memcpy(tmp, &buf[ofs], len);
+  char *s = strdup(token);
+  bool ret = strcasecmp(s, tmp) == 0;
+  free(s);
+  free(tmp);
+  return ret;
+}
+
+static const char *response[] = {
+    "* 12 FETCH (UID 1234 FLAGS (\\Seen) RFC822.SIZE 20480 BODY[HEADER.FIELDS (FROM SUBJECT DATE)] {112}\r\n",
+    "From: \"Alice\" <alice@example.com>\r\n",
+    "Subject: Weekly report\r\n",
+    "Date: Mon, 12 Oct 2026 09:30:00 +0000\r\n",
+    "\r\n",
+    ")\r\n",
+    "* 13 FETCH (UID 1235 FLAGS () RFC822.SIZE 4096 BODY[HEADER.FIELDS (FROM SUBJECT DATE)] {98}\r\n",
+    "from: bob@example.com\r\n",
+    "SUBJECT: Re: Weekly report\r\n",
+    "Date: Mon, 12 Oct 2026 10:02:11 +0000\r\n",
+    "\r\n",
+    ")\r\n",
+    "A012 OK UID FETCH completed\r\n"};
+
+static const int lines = sizeof(response) / sizeof(response[0]);
+
+static const char t_untagged[] PROGMEM = "* ";
+static const char t_fetch[] PROGMEM = " FETCH ";
+static const char t_uid[] PROGMEM = "UID ";
+static const char t_flags[] PROGMEM = "FLAGS (";
+static const char t_size[] PROGMEM = "RFC822.SIZE ";
+static const char t_from[] PROGMEM = "From:";
+static const char t_subject[] PROGMEM = "Subject:";
+static const char t_date[] PROGMEM = "Date:";
+static const char t_ok[] PROGMEM = " OK ";
+
+static int sink = 0;
+
+static void parseLegacy()
+{
+  for (int i = 0; i < lines; i++)
+  {
+    const char *s = response[i];
+    if (strcmpP(s, 0, t_untagged))
+      sink += strposP(s, t_fetch, 0) + strposP(s, t_uid, 0) + strposP(s, t_flags, 0) + strposP(s, t_size, 0);
+    else if (strcmpP(s, 0, t_from, false) || strcmpP(s, 0, t_subject, false) || strcmpP(s, 0, t_date, false))
+      sink++;
+    else
+      sink += strposP(s, t_ok, 0);
+  }
+}
+
+static void parsePGM()
+{
+  for (int i = 0; i < lines; i++)
+  {
+    const char *s = response[i];
+    if (PGM_Compare::startsWith(s, t_untagged))
+      sink += PGM_Compare::find(s, t_fetch, 0) + PGM_Compare::find(s, t_uid, 0) + PGM_Compare::find(s, t_flags, 0) + PGM_Compare::find(s, t_size, 0);
+    else if (PGM_Compare::startsWith(s, t_from, false) || PGM_Compare::startsWith(s, t_subject, false) || PGM_Compare::startsWith(s, t_date, false))
+      sink++;
+    else
+      sink += PGM_Compare::find(s, t_ok, 0);
+  }
+}
+
+static void bench(const char *name, void (*parse)())
+{
+  const int n = 100000;
+  allocs = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < n; i++)
+    parse();
+  auto t1 = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+  printf("%-16s %8.2f allocs/response %10.1f ns/response (%d lines)\n", name, (double)allocs / n, ns, lines);
+}
+
+int main()
+{
+  bench("strcmpP/strposP", parseLegacy);
+  bench("PGM_Compare", parsePGM);
+  return sink == 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * Host microbenchmark of the RFC 2047 encoded-word decoder (RFC2047_Decoder) over the corpus of
+ * internationalized Subject and From headers.
+ *
+ * The corpus has the plain ASCII header, the Q and B encoded words in UTF-8, the single-byte character sets
+ * that are transcoded to UTF-8, the multibyte character sets that are kept as is, the adjacent encoded words
+ * and the encoded words that are mixed with the plain text. The corpus is decoded in place (without the
+ * charset callback) and with charset transcoding, the time per header and the heap allocations counted by
+ * the malloc wrapper (glibc) are reported.
+ *
+ * Build and run (from test/bench)
+ * g++ -std=c++11 -O2 -Ihost -I../../src bench_rfc2047.cpp ../../src/extras/RFC2047.cpp -o bench_rfc2047 && ./bench_rfc2047
+ */
+
+#include <Arduino.h>
+#include <chrono>
+#include "extras/RFC2047.h"
+
+extern "C" void *__libc_malloc(size_t size);
+
+static size_t allocs = 0;
+
+extern "C" void *malloc(size_t size)
+{
+  allocs++;
+  return __libc_malloc(size);
+}
+
+static const char *corpus[] = {
+    "Weekly report for October",
+    "=?UTF-8?B?8J+OiSBZb3VyIG9yZGVyIGhhcyBzaGlwcGVk?=",
+    "=?UTF-8?Q?R=C3=A9union_de_l'=C3=A9quipe_=C3=A0_10h?=",
+    "=?ISO-8859-1?Q?Gr=FC=DFe_aus_M=FCnchen?=",
+    "=?ISO-8859-1?B?U2Xxb3IgSm9z6SBO+vFleg==?=",
+    "\"=?ISO-8859-2?Q?Dvo=F8=E1k,_Zden=ECk?=\" <zdenek@example.cz>",
+    "=?KOI8-R?B?79Teo9Qg2sEgzsXExczA?=",
+    "=?windows-1251?B?0fe48iDt4CDu7+vg8vMguTEwMjQ=?=",
+    "=?ISO-8859-7?B?yuHr5+zd8eEg8+Hy?=",
+    "=?TIS-620?B?ysfRyrTVpMPRug==?=",
+    "=?UTF-8?B?5Lya6K6u6YCa55+l77ya5pys5ZGo5LqU5LiL5Y2I5LiJ54K5?=",
+    "=?ISO-2022-JP?B?GyRCJCpMZCQkOWckbyQ7JCIkaiQsJEgkJiQ0JDYkJCReJDkbKEI=?=",
+    "=?GB2312?B?xPq1xNXLtaXS0cn6s8k=?=",
+    "=?UTF-8?B?zpXOu867zrfOvc65zrrOrCDOus6xzrkg0YDRg9GB0YHQutC40Lk=?= =?UTF-8?B?INCyINC+0LTQvdC+0Lwg0LfQsNCz0L7Qu9C+0LLQutC1?=",
+    "=?UTF-8?Q?Re:_Fwd:_Pr=C3=A9avis?= =?UTF-8?Q?_de_r=C3=A9siliation?= (urgent)",
+    "Invoice =?windows-1252?B?liCAMSAyOTksMDAgZHVl?= today"};
+
+static const int headers = sizeof(corpus) / sizeof(corpus[0]);
+
+// The single-byte character sets that are transcoded to UTF-8
+static bool charsetTable(void *, const char *charset, const uint16_t *&table)
+{
+  static const struct
+  {
+    const char *name;
+    const uint16_t *table;
+  } tables[] = {
+      {"iso-8859-1", nullptr},
+      {"iso-8859-2", charset_table_iso8859_2},
+      {"iso-8859-7", charset_table_iso8859_7},
+      {"tis-620", charset_table_iso8859_11},
+      {"koi8-r", charset_table_koi8_r},
+      {"windows-1251", charset_table_windows_1251},
+      {"windows-1252", charset_table_windows_1252}};
+
+  for (size_t i = 0; i < sizeof(tables) / sizeof(tables[0]); i++)
+  {
+    if (strcasecmp(charset, tables[i].name) == 0)
+    {
+      table = tables[i].table;
+      return true;
+    }
+  }
+  return false;
+}
+
+int main()
+{
+  static char in[headers][256];
+  static char out[headers][256 * 3 + 1];
+  size_t inBytes = 0;
+
+  for (int i = 0; i < headers; i++)
+    inBytes += strlen(corpus[i]);
+
+  RFC2047_Decoder decoder;
+  const int rounds = 100000;
+
+  for (int mode = 0; mode < 2; mode++)
+  {
+    bool transcode = mode == 1;
+    size_t outBytes = 0;
+    double ns = 0;
+
+    allocs = 0;
+
+    for (int r = 0; r < rounds; r++)
+    {
+      // The in-place decoding overwrites the input, it is restored outside the timing
+      if (!transcode)
+      {
+        for (int i = 0; i < headers; i++)
+          strcpy(in[i], corpus[i]);
+      }
+
+      auto t0 = std::chrono::steady_clock::now();
+      for (int i = 0; i < headers; i++)
+      {
+        if (transcode)
+          outBytes += decoder.decode(out[i], corpus[i], sizeof(out[i]), charsetTable, nullptr);
+        else
+          outBytes += decoder.decode(in[i], in[i], sizeof(in[i]));
+      }
+      auto t1 = std::chrono::steady_clock::now();
+      ns += std::chrono::duration<double, std::nano>(t1 - t0).count();
+    }
+
+    printf("%-12s %8.1f ns/header %8.1f MB/s %6.2f allocs/header\n", transcode ? "transcoded" : "in place",
+           ns / rounds / headers, (double)inBytes * rounds / ns * 1000, (double)allocs / rounds / headers);
+
+    if (outBytes == 0)
+      return 1;
+  }
+
+  // The decoded headers for review, ISO-2022-JP and GB2312 are kept as is (decoded by the user callback)
+  for (int i = 0; i < headers; i++)
+    printf("%s\n", out[i]);
+
+  return 0;
+}
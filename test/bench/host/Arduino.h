@@ -0,0 +1,89 @@
+#pragma once
+
+#ifndef BENCH_HOST_ARDUINO_H
+#define BENCH_HOST_ARDUINO_H
+
+/**
+ * The minimal Arduino API for building the library headers on host for the benchmarks.
+ * Only the functions that are used by the benchmarked headers are provided.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <string>
+#include <cstddef>
+#include <time.h>
+
+#define PROGMEM
+#define PGM_P const char *
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define strlen_P strlen
+#define strcat_P strcat
+#define strcpy_P strcpy
+#define memcpy_P memcpy
+#define strncasecmp_P strncasecmp
+#define HEX 16
+
+class __FlashStringHelper;
+
+class String
+{
+public:
+  String() {}
+  String(const char *s) : s(s) {}
+  const char *c_str() const { return s.c_str(); }
+  size_t length() const { return s.size(); }
+
+private:
+  std::string s;
+};
+
+class StringSumHelper : public String
+{
+};
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(const uint8_t *buf, size_t len) { return fwrite(buf, 1, len, stdout); }
+  size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t println(const char *s) { return print(s) + print("\n"); }
+};
+
+static Print Serial;
+
+class IPAddress
+{
+public:
+  IPAddress() {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : addr{a, b, c, d} {}
+
+private:
+  uint8_t addr[4] = {0};
+};
+
+inline unsigned long millis()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000UL + ts.tv_nsec / 1000000;
+}
+
+inline void delay(unsigned long ms)
+{
+  struct timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000};
+  nanosleep(&ts, nullptr);
+}
+
+inline char *utoa(unsigned value, char *buf, int) { return sprintf(buf, "%u", value), buf; }
+inline char *itoa(int value, char *buf, int) { return sprintf(buf, "%d", value), buf; }
+inline char *ltoa(long value, char *buf, int) { return sprintf(buf, "%ld", value), buf; }
+inline char *ultoa(unsigned long value, char *buf, int) { return sprintf(buf, "%lu", value), buf; }
+
+#endif
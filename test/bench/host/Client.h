@@ -0,0 +1,55 @@
+#pragma once
+
+#ifndef BENCH_HOST_CLIENT_H
+#define BENCH_HOST_CLIENT_H
+
+#include <vector>
+
+/**
+ * The client that replays the recorded stream and keeps the written data.
+ * The stream is received in parts, arrive() makes the next part available to read.
+ */
+class Client
+{
+public:
+  void setRx(const uint8_t *data, size_t len)
+  {
+    _rx = data;
+    _rxLen = len;
+    _rxPos = 0;
+    _arrived = 0;
+  }
+
+  void arrive(size_t len) { _arrived = _arrived + len < _rxLen ? _arrived + len : _rxLen; }
+
+  bool done() const { return _rxPos == _rxLen; }
+
+  int available() { return (int)(_arrived - _rxPos); }
+
+  int read() { return _rxPos < _arrived ? _rx[_rxPos++] : -1; }
+
+  int read(uint8_t *buf, size_t len)
+  {
+    if (len > _arrived - _rxPos)
+      len = _arrived - _rxPos;
+    memcpy(buf, _rx + _rxPos, len);
+    _rxPos += len;
+    return (int)len;
+  }
+
+  size_t write(const uint8_t *buf, size_t len)
+  {
+    tx.insert(tx.end(), buf, buf + len);
+    return len;
+  }
+
+  bool connected() { return true; }
+
+  std::vector<uint8_t> tx;
+
+private:
+  const uint8_t *_rx = nullptr;
+  size_t _rxLen = 0, _rxPos = 0, _arrived = 0;
+};
+
+#endif
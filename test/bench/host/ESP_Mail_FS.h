@@ -0,0 +1,8 @@
+#pragma once
+
+// The host build of the benchmarks has no library build options, the benchmark that uses MB_FS
+// defines BENCH_HOST_FS for the flash file system on host
+#if defined(BENCH_HOST_FS)
+#include "Host_FS.h"
+#define ESP_MAIL_DEFAULT_FLASH_FS HostFS
+#endif
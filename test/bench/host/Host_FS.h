@@ -0,0 +1,84 @@
+#pragma once
+
+#ifndef BENCH_HOST_FS_H
+#define BENCH_HOST_FS_H
+
+/**
+ * The flash file system on host for the benchmarks that use MB_FS, the files are stored with stdio
+ * under the bench_fs directory of the current directory.
+ * Only the File and FS functions that are used by MB_FS are provided.
+ */
+
+#include <stdio.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs
+{
+  class File
+  {
+  public:
+    File() {}
+    File(FILE *f) : f(f) {}
+
+    operator bool() const { return f != nullptr; }
+
+    int size()
+    {
+      struct stat st;
+      return fstat(fileno(f), &st) == 0 ? (int)st.st_size : 0;
+    }
+
+    int available() { return size() - (int)ftell(f); }
+    int read(uint8_t *buf, size_t len) { return fread(buf, 1, len, f); }
+    int read() { return fgetc(f); }
+    int write(const uint8_t *buf, size_t len) { return fwrite(buf, 1, len, f); }
+    int write(uint8_t v) { return fputc(v, f) == EOF ? 0 : 1; }
+    int print(const char *str) { return fputs(str, f) < 0 ? 0 : strlen(str); }
+    int print(int v) { return fprintf(f, "%d", v); }
+    int print(unsigned int v) { return fprintf(f, "%u", v); }
+    bool seek(int pos) { return fseek(f, pos, SEEK_SET) == 0; }
+
+    void close()
+    {
+      if (f)
+        fclose(f);
+      f = nullptr;
+    }
+
+  private:
+    FILE *f = nullptr;
+  };
+
+  class FS
+  {
+  public:
+    bool begin() { return ::mkdir(root, 0755) == 0 || access(root, F_OK) == 0; }
+
+    File open(const char *path, const char *mode)
+    {
+      return File(fopen(hostPath(path).c_str(), mode[0] == 'r' ? "rb" : (mode[0] == 'w' ? "wb" : "ab")));
+    }
+
+    bool exists(const char *path) { return access(hostPath(path).c_str(), F_OK) == 0; }
+    bool remove(const char *path) { return ::remove(hostPath(path).c_str()) == 0; }
+    bool mkdir(const char *path) { return ::mkdir(hostPath(path).c_str(), 0755) == 0; }
+    bool rmdir(const char *path) { return ::rmdir(hostPath(path).c_str()) == 0; }
+
+  private:
+    const char *root = "bench_fs";
+
+    std::string hostPath(const char *path)
+    {
+      std::string s = root;
+      if (path[0] != '/')
+        s += '/';
+      return s + path;
+    }
+  };
+}
+
+static fs::FS HostFS;
+
+#endif
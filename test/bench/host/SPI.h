@@ -0,0 +1,3 @@
+#pragma once
+
+// MB_FS includes SPI.h when the file system is used, the host build has no SPI
@@ -0,0 +1,3 @@
+#pragma once
+
+// The host build of the benchmarks has no network interfaces